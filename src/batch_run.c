@@ -0,0 +1,648 @@
+/*
+ * Copyright 2017 Jonathan Eyolfson
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "i8hex_parser.h"
+#include "run_options.h"
+#include "teensy_3_2.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* A job is a line of i8hex-reader's run options, with either a hex file or
+   a snapshot.  The options point into the job's own copy of the line */
+struct job {
+	char *line;
+	char *words;
+	struct run_options options;
+	struct teensy_3_2_flash *flash; // of the hex file
+	bool failed;
+	int signal;              // that took down the job's worker process
+	struct teensy_3_2_run_result result;
+	double seconds;          // host time the emulation took
+};
+
+/* Each hex file is parsed once, into a flash image every worker shares */
+struct image {
+	const char *file;
+	struct teensy_3_2_flash *flash; // NULL if the file can't be used
+};
+
+/* Each worker runs the jobs in its range from the front, a worker without
+   any left steals the back half of another worker's range */
+struct worker {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	size_t next;
+	size_t end;
+};
+
+static struct job *jobs;
+static size_t jobs_size;
+static struct image *images;
+static size_t images_size;
+static struct worker *workers;
+static size_t workers_size;
+
+static bool job_parse(struct job *job, const char *path, size_t number)
+{
+	char *saved;
+	for (char *word = strtok_r(job->words, " \t", &saved); word != NULL;
+	     word = strtok_r(NULL, " \t", &saved)) {
+		if (!run_options_parse(&job->options, word)) {
+			fprintf(stderr, "%s:%zu: can't use %s\n", path, number,
+			        word);
+			return false;
+		}
+	}
+	if (!run_options_finish(&job->options)) {
+		fprintf(stderr, "%s:%zu: can't be run\n", path, number);
+		return false;
+	}
+	return true;
+}
+
+/* Blank lines and lines starting with # aren't jobs */
+static bool jobs_read(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		perror(path);
+		return false;
+	}
+	size_t capacity = 0;
+	char *line = NULL;
+	size_t line_capacity = 0;
+	ssize_t length;
+	size_t number = 0;
+	bool valid = true;
+	while (valid && (length = getline(&line, &line_capacity, file)) != -1) {
+		++number;
+		while (length > 0 && (line[length - 1] == '\n'
+		                      || line[length - 1] == ' '
+		                      || line[length - 1] == '\t')) {
+			line[--length] = '\0';
+		}
+		size_t skip = strspn(line, " \t");
+		if (line[skip] == '\0' || line[skip] == '#') {
+			continue;
+		}
+
+		if (jobs_size == capacity) {
+			capacity = capacity == 0 ? 64 : 2 * capacity;
+			jobs = realloc(jobs, capacity * sizeof(struct job));
+			assert(jobs != NULL);
+		}
+		struct job *job = &jobs[jobs_size];
+		memset(job, 0, sizeof(struct job));
+		job->line = strdup(line + skip);
+		job->words = strdup(line + skip);
+		assert(job->line != NULL && job->words != NULL);
+		++jobs_size;
+		valid = job_parse(job, path, number);
+	}
+	free(line);
+	fclose(file);
+	return valid;
+}
+
+static struct teensy_3_2_flash *image_load(const char *file)
+{
+	for (size_t i = 0; i < images_size; ++i) {
+		if (strcmp(images[i].file, file) == 0) {
+			return images[i].flash;
+		}
+	}
+	static uint8_t data[0x10000];
+	size_t data_size = 0;
+	struct teensy_3_2_flash *flash = NULL;
+	if (i8hex_parse(file, data, sizeof(data), &data_size) == FAILURE) {
+		fprintf(stderr, "%s: can't be parsed\n", file);
+	}
+	else {
+		flash = teensy_3_2_flash_create(data, data_size);
+	}
+	images = realloc(images, (images_size + 1) * sizeof(struct image));
+	assert(images != NULL);
+	images[images_size].file = file;
+	images[images_size].flash = flash;
+	++images_size;
+	return flash;
+}
+
+static void images_load(void)
+{
+	for (size_t i = 0; i < jobs_size; ++i) {
+		struct job *job = &jobs[i];
+		if (job->options.file != NULL) {
+			job->flash = image_load(job->options.file);
+			job->failed = job->flash == NULL;
+		}
+	}
+}
+
+static void job_run(struct job *job, struct teensy_3_2 *board)
+{
+	if (job->failed) {
+		return;
+	}
+	if (job->options.snapshot != NULL) {
+		if (!teensy_3_2_snapshot_load(board, job->options.snapshot)) {
+			job->failed = true;
+			return;
+		}
+	}
+	else {
+		teensy_3_2_flash_use(board, job->flash);
+	}
+	struct timespec start;
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	job->result = teensy_3_2_emulate_until(board, NULL, 0,
+	                                       &job->options.control);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	job->seconds = (end.tv_sec - start.tv_sec)
+	               + (end.tv_nsec - start.tv_nsec) / 1e9;
+	if (job->result.stop == TEENSY_3_2_STOP_INVALID) {
+		fprintf(stderr, "%s: a watched or written location can't "
+		                "be used\n", job->line);
+		job->failed = true;
+	}
+}
+
+/* Returns false if the worker's range is empty */
+static bool job_pop(struct worker *worker, size_t *i)
+{
+	pthread_mutex_lock(&worker->mutex);
+	bool popped = worker->next < worker->end;
+	if (popped) {
+		*i = worker->next++;
+	}
+	pthread_mutex_unlock(&worker->mutex);
+	return popped;
+}
+
+/* Moves the back half of another worker's range to this one, returns false
+   once every other range is empty */
+static bool jobs_steal(struct worker *worker)
+{
+	size_t self = worker - workers;
+	for (size_t i = 1; i < workers_size; ++i) {
+		struct worker *victim = &workers[(self + i) % workers_size];
+		pthread_mutex_lock(&victim->mutex);
+		size_t left = victim->end - victim->next;
+		size_t taken = (left + 1) / 2;
+		victim->end -= taken;
+		size_t start = victim->end;
+		pthread_mutex_unlock(&victim->mutex);
+		if (taken != 0) {
+			pthread_mutex_lock(&worker->mutex);
+			worker->next = start;
+			worker->end = start + taken;
+			pthread_mutex_unlock(&worker->mutex);
+			return true;
+		}
+	}
+	return false;
+}
+
+/* A board is reused for every job the worker runs, so the blocks built
+   for a firmware stay cached across its scenarios */
+static void *worker_run(void *arg)
+{
+	struct worker *worker = arg;
+	struct teensy_3_2 *board = teensy_3_2_create();
+	do {
+		size_t i;
+		while (job_pop(worker, &i)) {
+			job_run(&jobs[i], board);
+		}
+	} while (jobs_steal(worker));
+	teensy_3_2_destroy(board);
+	return NULL;
+}
+
+/* With --processes the jobs run in worker processes instead of threads,
+   so a job that crashes the emulator only takes its worker down.  The
+   coordinator sends each worker the numbers of the jobs to run, a batch at
+   a time over a Unix domain socket, and the worker answers once it ran the
+   batch.  The reports go in memory shared with the workers, so a whole
+   batch is one message each way.  Workers are forked once the jobs are
+   read, so they already have the jobs and share the flash images.
+
+   A worker marks the job it's running, so when it goes down the job that
+   took it down is known.  Its jobs without a report go back in the queue
+   and a new worker takes its place */
+#define BATCH_MAX 64
+#define JOB_NONE UINT32_MAX
+
+struct report {
+	atomic_bool done;
+	bool failed;
+	struct teensy_3_2_run_result result;
+	double seconds;
+};
+
+struct process {
+	pid_t pid;
+	int socket;              // -1 once the worker exited
+	bool closed;             // told there's nothing left
+	_Atomic uint32_t *running; // shared, the job the worker is running
+	uint32_t sent[2 * BATCH_MAX];
+	size_t sent_size;
+	size_t answered;         // from the front of sent
+};
+
+// Taken from the back, so the jobs start out in order
+static uint32_t *queue;
+static size_t queue_size;
+static struct report *reports;
+static struct process *processes;
+static size_t processes_size;
+
+static void worker_process(int socket, _Atomic uint32_t *running)
+{
+	struct teensy_3_2 *board = teensy_3_2_create();
+	uint32_t batch[BATCH_MAX];
+	ssize_t size;
+	while ((size = recv(socket, batch, sizeof(batch), 0)) > 0) {
+		uint32_t count = size / sizeof(uint32_t);
+		for (uint32_t i = 0; i < count; ++i) {
+			struct job *job = &jobs[batch[i]];
+			atomic_store(running, batch[i]);
+			job_run(job, board);
+			struct report *report = &reports[batch[i]];
+			report->failed = job->failed;
+			report->result = job->result;
+			report->seconds = job->seconds;
+			atomic_store_explicit(&report->done, true,
+			                      memory_order_release);
+		}
+		atomic_store(running, JOB_NONE);
+		if (send(socket, &count, sizeof(count), MSG_NOSIGNAL) == -1) {
+			_exit(1);
+		}
+	}
+	teensy_3_2_destroy(board);
+	_exit(size == 0 ? 0 : 1);
+}
+
+static void process_start(struct process *process)
+{
+	int sockets[2];
+	int error = socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets);
+	assert(error == 0);
+	atomic_store(process->running, JOB_NONE);
+	fflush(stdout);
+	pid_t pid = fork();
+	assert(pid != -1);
+	if (pid == 0) {
+		close(sockets[0]);
+		for (size_t i = 0; i < processes_size; ++i) {
+			if (processes[i].socket != -1) {
+				close(processes[i].socket);
+			}
+		}
+		worker_process(sockets[1], process->running);
+	}
+	close(sockets[1]);
+	process->pid = pid;
+	process->socket = sockets[0];
+	process->closed = false;
+	process->sent_size = 0;
+	process->answered = 0;
+}
+
+/* A batch is a share of the queue small enough that the workers finish at
+   about the same time, a worker gets the next one while it still has half
+   a batch left so it never waits on the coordinator */
+static void process_feed(struct process *process)
+{
+	size_t left = process->sent_size - process->answered;
+	if (queue_size == 0) {
+		if (left == 0 && !process->closed) {
+			shutdown(process->socket, SHUT_WR);
+			process->closed = true;
+		}
+		return;
+	}
+	size_t batch = queue_size / (2 * processes_size);
+	if (batch < 1) {
+		batch = 1;
+	}
+	else if (batch > BATCH_MAX) {
+		batch = BATCH_MAX;
+	}
+	if (left >= batch) {
+		return;
+	}
+	if (batch > queue_size) {
+		batch = queue_size;
+	}
+	memmove(process->sent, process->sent + process->answered,
+	        left * sizeof(uint32_t));
+	process->sent_size = left;
+	process->answered = 0;
+	uint32_t *batch_jobs = process->sent + process->sent_size;
+	for (size_t i = 0; i < batch; ++i) {
+		batch_jobs[i] = queue[--queue_size];
+	}
+	process->sent_size += batch;
+	// A worker that's gone is noticed by the poll, which requeues these
+	send(process->socket, batch_jobs, batch * sizeof(uint32_t),
+	     MSG_NOSIGNAL);
+}
+
+/* Returns false if the job doesn't have a report yet */
+static bool report_take(uint32_t i)
+{
+	struct report *report = &reports[i];
+	if (!atomic_load_explicit(&report->done, memory_order_acquire)) {
+		return false;
+	}
+	struct job *job = &jobs[i];
+	job->failed = report->failed;
+	job->result = report->result;
+	job->seconds = report->seconds;
+	return true;
+}
+
+static void process_answered(struct process *process, uint32_t count)
+{
+	assert(count <= process->sent_size - process->answered);
+	for (uint32_t i = 0; i < count; ++i) {
+		bool taken = report_take(process->sent[process->answered++]);
+		assert(taken);
+	}
+}
+
+static void process_exited(struct process *process)
+{
+	close(process->socket);
+	process->socket = -1;
+	int wait_status;
+	while (waitpid(process->pid, &wait_status, 0) == -1) {
+		assert(errno == EINTR);
+	}
+	uint32_t crashed = atomic_load(process->running);
+	for (size_t i = process->answered; i < process->sent_size; ++i) {
+		uint32_t job = process->sent[i];
+		if (report_take(job)) {
+			continue;
+		}
+		if (job == crashed) {
+			jobs[job].failed = true;
+			if (WIFSIGNALED(wait_status)) {
+				jobs[job].signal = WTERMSIG(wait_status);
+			}
+		}
+		else {
+			queue[queue_size++] = job;
+		}
+	}
+	process->answered = process->sent_size;
+	if (queue_size > 0) {
+		process_start(process);
+		process_feed(process);
+	}
+}
+
+static void processes_run(size_t count)
+{
+	if (jobs_size == 0) {
+		return;
+	}
+	queue = malloc(jobs_size * sizeof(uint32_t));
+	assert(jobs_size == 0 || queue != NULL);
+	for (size_t i = 0; i < jobs_size; ++i) {
+		queue[i] = jobs_size - 1 - i;
+	}
+	queue_size = jobs_size;
+
+	processes_size = count < jobs_size ? count : jobs_size;
+	processes = calloc(processes_size, sizeof(struct process));
+	struct pollfd *polls = calloc(processes_size, sizeof(struct pollfd));
+	assert(processes_size == 0 || (processes != NULL && polls != NULL));
+	size_t shared_size = jobs_size * sizeof(struct report)
+	                     + processes_size * sizeof(_Atomic uint32_t);
+	void *shared = mmap(NULL, shared_size, PROT_READ | PROT_WRITE,
+	                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	assert(shared != MAP_FAILED);
+	reports = shared;
+	_Atomic uint32_t *running = (_Atomic uint32_t *) (reports + jobs_size);
+	for (size_t i = 0; i < processes_size; ++i) {
+		processes[i].socket = -1;
+		processes[i].running = &running[i];
+	}
+	for (size_t i = 0; i < processes_size; ++i) {
+		process_start(&processes[i]);
+		process_feed(&processes[i]);
+	}
+
+	bool working = processes_size > 0;
+	while (working) {
+		for (size_t i = 0; i < processes_size; ++i) {
+			polls[i].fd = processes[i].socket;
+			polls[i].events = POLLIN;
+		}
+		if (poll(polls, processes_size, -1) == -1) {
+			assert(errno == EINTR);
+			continue;
+		}
+		working = false;
+		for (size_t i = 0; i < processes_size; ++i) {
+			struct process *process = &processes[i];
+			if (polls[i].fd != -1 && polls[i].revents != 0) {
+				uint32_t answer;
+				ssize_t size = recv(process->socket, &answer,
+				                    sizeof(answer), 0);
+				if (size == sizeof(answer)) {
+					process_answered(process, answer);
+					process_feed(process);
+				}
+				else {
+					process_exited(process);
+				}
+			}
+			working = working || process->socket != -1;
+		}
+	}
+	munmap(shared, shared_size);
+	free(polls);
+	free(processes);
+	free(queue);
+}
+
+static void threads_run(size_t count)
+{
+	workers_size = count < jobs_size ? count : jobs_size;
+	workers = calloc(workers_size, sizeof(struct worker));
+	assert(workers_size == 0 || workers != NULL);
+	for (size_t i = 0; i < workers_size; ++i) {
+		pthread_mutex_init(&workers[i].mutex, NULL);
+		workers[i].next = jobs_size * i / workers_size;
+		workers[i].end = jobs_size * (i + 1) / workers_size;
+	}
+	for (size_t i = 0; i < workers_size; ++i) {
+		int error = pthread_create(&workers[i].thread, NULL,
+		                           worker_run, &workers[i]);
+		assert(error == 0);
+	}
+	for (size_t i = 0; i < workers_size; ++i) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	for (size_t i = 0; i < workers_size; ++i) {
+		pthread_mutex_destroy(&workers[i].mutex);
+	}
+	free(workers);
+}
+
+/* One tab-separated line for each job, with the job last since it can have
+   tabs of its own */
+static bool metrics_write(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		perror(path);
+		return false;
+	}
+	fprintf(file, "stop\tinstructions\tcycles\tseconds\tjob\n");
+	for (size_t i = 0; i < jobs_size; ++i) {
+		const struct job *job = &jobs[i];
+		const char *stop = job->signal != 0 ? "crashed"
+		                   : job->failed ? "failed"
+		                   : teensy_3_2_stop_name(job->result.stop);
+		fprintf(file, "%s\t%" PRIu64 "\t%" PRIu64 "\t%.6f\t%s\n", stop,
+		        job->result.instructions, job->result.cycles,
+		        job->seconds, job->line);
+	}
+	if (fclose(file) != 0) {
+		perror(path);
+		return false;
+	}
+	return true;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: batch-run [--threads=N|--processes=N] "
+	                "[--metrics=PATH] JOBS\n");
+}
+
+static bool parse_count(const char *value, long *count)
+{
+	char *end;
+	*count = strtol(value, &end, 10);
+	return end != value && *end == '\0' && *count > 0;
+}
+
+int main(int argc, char **argv)
+{
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	bool threads_given = false;
+	long processes = 0;
+	const char *metrics = NULL;
+	const char *path = NULL;
+	for (int i = 1; i < argc; ++i) {
+		const char *value;
+		if ((value = option_value(argv[i], "--threads=")) != NULL) {
+			if (!parse_count(value, &threads)) {
+				usage();
+				return 1;
+			}
+			threads_given = true;
+		}
+		else if ((value = option_value(argv[i], "--processes="))
+		         != NULL) {
+			if (!parse_count(value, &processes)) {
+				usage();
+				return 1;
+			}
+		}
+		else if ((value = option_value(argv[i], "--metrics="))
+		         != NULL) {
+			metrics = value;
+		}
+		else if (path == NULL && argv[i][0] != '-') {
+			path = argv[i];
+		}
+		else {
+			usage();
+			return 1;
+		}
+	}
+	if (path == NULL || (threads_given && processes != 0)) {
+		usage();
+		return 1;
+	}
+	if (threads <= 0) {
+		threads = 1;
+	}
+
+	if (!jobs_read(path)) {
+		return 2;
+	}
+	images_load();
+	teensy_3_2_set_trace_level(TEENSY_3_2_TRACE_NONE);
+
+	if (processes != 0) {
+		processes_run(processes);
+	}
+	else {
+		threads_run(threads);
+	}
+
+	int status = 0;
+	if (metrics != NULL && !metrics_write(metrics)) {
+		status = 3;
+	}
+	for (size_t i = 0; i < jobs_size; ++i) {
+		struct job *job = &jobs[i];
+		if (job->signal != 0) {
+			printf("%s: crashed (%s)\n", job->line,
+			       strsignal(job->signal));
+			status = 3;
+		}
+		else if (job->failed) {
+			printf("%s: failed\n", job->line);
+			status = 3;
+		}
+		else {
+			run_result_print(job->line, &job->result);
+		}
+		free(job->line);
+		free(job->words);
+	}
+	free(jobs);
+	for (size_t i = 0; i < images_size; ++i) {
+		teensy_3_2_flash_free(images[i].flash);
+	}
+	free(images);
+	return status;
+}
@@ -0,0 +1,472 @@
+/*
+ * Copyright 2017 Jonathan Eyolfson
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "i8hex_parser.h"
+#include "run_options.h"
+#include "teensy_3_2.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Inputs are fed to the firmware through UART0, an execution starts from a
+   checkpoint of the booted board and runs until the firmware waits for
+   more input (the core is idle) or an instruction limit */
+#define INPUT_MAX 256
+#define CORPUS_MAX 4096
+#define EXECUTION_INSTRUCTIONS 100000
+#define EXECUTIONS 1000000
+
+struct input {
+	uint32_t size;
+	uint8_t data[INPUT_MAX];
+};
+
+/* The executions run in a child sharing this with the parent, so a crash
+   only loses the child.  Seen has a bit for each bucket of hit counts an
+   edge had in any execution so far */
+struct shared {
+	uint8_t trace[TEENSY_3_2_COVERAGE_SIZE];
+	uint8_t seen[TEENSY_3_2_COVERAGE_SIZE];
+	uint64_t executions;
+	uint64_t hangs;
+	uint32_t seeds;
+	uint32_t seeds_run;
+	uint32_t corpus_size;
+	struct input corpus[CORPUS_MAX];
+	struct input current;
+};
+
+static struct shared *shared;
+static uint8_t buckets[256];
+static uint64_t random_state;
+static uint8_t data[0x10000];
+
+static const uint8_t interesting[] = {
+	0x00, 0x01, 0x7F, 0x80, 0xFF, '\n', '\r', ' ', '0', 'A',
+};
+
+/* xorshift64* */
+static uint64_t random_next(void)
+{
+	random_state ^= random_state >> 12;
+	random_state ^= random_state << 25;
+	random_state ^= random_state >> 27;
+	return random_state * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+static uint32_t random_below(uint32_t limit)
+{
+	return (random_next() >> 32) % limit;
+}
+
+/* The same buckets as AFL: 1, 2, 3, 4-7, 8-15, 16-31, 32-127 and 128+ */
+static void buckets_init(void)
+{
+	for (uint32_t count = 1; count < 256; ++count) {
+		uint8_t bucket;
+		if (count <= 3) {
+			bucket = count == 3 ? 4 : count;
+		}
+		else if (count <= 7) {
+			bucket = 8;
+		}
+		else if (count <= 15) {
+			bucket = 16;
+		}
+		else if (count <= 31) {
+			bucket = 32;
+		}
+		else if (count <= 127) {
+			bucket = 64;
+		}
+		else {
+			bucket = 128;
+		}
+		buckets[count] = bucket;
+	}
+}
+
+/* Returns true if the trace has an edge in a bucket no execution reached
+   before, and marks it seen */
+static bool trace_new(void)
+{
+	bool found = false;
+	for (size_t i = 0; i < TEENSY_3_2_COVERAGE_SIZE; i += 8) {
+		uint64_t word;
+		memcpy(&word, &shared->trace[i], sizeof(word));
+		if (word == 0) {
+			continue;
+		}
+		for (size_t j = i; j < i + 8; ++j) {
+			uint8_t bucket = buckets[shared->trace[j]];
+			if ((bucket & ~shared->seen[j]) != 0) {
+				shared->seen[j] |= bucket;
+				found = true;
+			}
+		}
+	}
+	return found;
+}
+
+static uint32_t edges_seen(void)
+{
+	uint32_t edges = 0;
+	for (size_t i = 0; i < TEENSY_3_2_COVERAGE_SIZE; ++i) {
+		edges += shared->seen[i] != 0;
+	}
+	return edges;
+}
+
+/* A stack of random byte edits, like AFL's havoc stage */
+static void mutate(struct input *input)
+{
+	uint32_t edits = UINT32_C(1) << (1 + random_below(4));
+	for (uint32_t i = 0; i < edits; ++i) {
+		uint32_t at = input->size != 0 ? random_below(input->size) : 0;
+		switch (random_below(6)) {
+		case 0:
+			if (input->size != 0) {
+				input->data[at] ^= 1 << random_below(8);
+			}
+			break;
+		case 1:
+			if (input->size != 0) {
+				input->data[at] = random_next();
+			}
+			break;
+		case 2:
+			if (input->size != 0) {
+				input->data[at] = interesting[random_below(
+					sizeof(interesting))];
+			}
+			break;
+		case 3:
+			if (input->size < INPUT_MAX) {
+				at = random_below(input->size + 1);
+				memmove(&input->data[at + 1], &input->data[at],
+				        input->size - at);
+				input->data[at] = random_next();
+				++input->size;
+			}
+			break;
+		case 4:
+			if (input->size != 0) {
+				memmove(&input->data[at], &input->data[at + 1],
+				        input->size - at - 1);
+				--input->size;
+			}
+			break;
+		case 5: {
+			// Splice in part of another input
+			uint32_t pick = random_below(shared->corpus_size);
+			const struct input *other = &shared->corpus[pick];
+			if (other->size == 0) {
+				break;
+			}
+			uint32_t from = random_below(other->size);
+			uint32_t length = 1 + random_below(other->size - from);
+			at = random_below(input->size + 1);
+			if (at + length > INPUT_MAX) {
+				length = INPUT_MAX - at;
+			}
+			memcpy(&input->data[at], &other->data[from], length);
+			if (at + length > input->size) {
+				input->size = at + length;
+			}
+			break;
+		}
+		}
+	}
+}
+
+static double seconds_since(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec)
+	       + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* An input that reaches a new edge joins the corpus, unless it's already
+   in there */
+static void execute(struct teensy_3_2 *board,
+                    const struct teensy_3_2_checkpoint *boot,
+                    const struct teensy_3_2_run_control *control,
+                    bool in_corpus)
+{
+	const struct input *input = &shared->current;
+	memset(shared->trace, 0, sizeof(shared->trace));
+	teensy_3_2_checkpoint_restore(board, boot);
+	teensy_3_2_input(board, input->data, input->size);
+	struct teensy_3_2_run_result result =
+		teensy_3_2_emulate_until(board, NULL, 0, control);
+	++shared->executions;
+	if (result.stop == TEENSY_3_2_STOP_INSTRUCTIONS) {
+		++shared->hangs;
+	}
+	if (trace_new() && !in_corpus && shared->corpus_size < CORPUS_MAX) {
+		shared->corpus[shared->corpus_size++] = *input;
+	}
+}
+
+/* Runs in the child until the execution or time limit.  The seeds run
+   first so their edges aren't new to the mutations */
+static void fuzz(struct teensy_3_2 *board,
+                 const struct teensy_3_2_checkpoint *boot,
+                 const struct teensy_3_2_run_control *control,
+                 uint64_t executions, const struct timespec *start,
+                 double seconds)
+{
+	// A restarted child mustn't repeat the inputs of the one that crashed
+	random_state ^= (shared->executions + 1) * UINT64_C(0x9E3779B97F4A7C15);
+	teensy_3_2_coverage(board, shared->trace);
+	while (shared->seeds_run < shared->seeds) {
+		shared->current = shared->corpus[shared->seeds_run++];
+		execute(board, boot, control, true);
+	}
+	while (shared->executions < executions
+	       && (seconds == 0 || seconds_since(start) < seconds)) {
+		shared->current =
+			shared->corpus[random_below(shared->corpus_size)];
+		mutate(&shared->current);
+		execute(board, boot, control, false);
+	}
+}
+
+static bool input_write(const char *directory, const char *prefix,
+                        uint32_t number, const struct input *input)
+{
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s%06" PRIu32, directory, prefix,
+	         number);
+	FILE *file = fopen(path, "wb");
+	bool written = file != NULL
+	               && fwrite(input->data, 1, input->size, file)
+	                  == input->size;
+	if (file != NULL && fclose(file) != 0) {
+		written = false;
+	}
+	if (!written) {
+		perror(path);
+	}
+	return written;
+}
+
+/* Every file in the corpus directory is a seed, except crashes, longer
+   ones are cut to INPUT_MAX */
+static bool corpus_read(const char *directory)
+{
+	DIR *dir = opendir(directory);
+	if (dir == NULL) {
+		perror(directory);
+		return false;
+	}
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL
+	       && shared->corpus_size < CORPUS_MAX) {
+		if (entry->d_name[0] == '.'
+		    || strncmp(entry->d_name, "crash-", 6) == 0) {
+			continue;
+		}
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", directory,
+		         entry->d_name);
+		FILE *file = fopen(path, "rb");
+		if (file == NULL) {
+			continue;
+		}
+		struct input *input = &shared->corpus[shared->corpus_size++];
+		input->size = fread(input->data, 1, INPUT_MAX, file);
+		fclose(file);
+	}
+	closedir(dir);
+	return true;
+}
+
+static void input_print(const struct input *input)
+{
+	for (uint32_t i = 0; i < input->size; ++i) {
+		printf("%02X", input->data[i]);
+	}
+	printf("\n");
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: fuzz [--corpus=DIR] [--executions=N] "
+	                "[--duration=SECONDS] [--seed=N] "
+	                "[--execution-instructions=N] [run options for the "
+	                "boot] FILE|--snapshot=PATH\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct run_options boot = {0};
+	const char *corpus = NULL;
+	uint64_t executions = EXECUTIONS;
+	double seconds = 0;
+	uint64_t seed = 1;
+	struct teensy_3_2_run_control control = {
+		.instructions = EXECUTION_INSTRUCTIONS,
+		.until_idle = true,
+	};
+	int i = 1;
+	for (; i < argc; ++i) {
+		const char *value;
+		char *end = NULL;
+		if ((value = option_value(argv[i], "--corpus=")) != NULL) {
+			corpus = value;
+		}
+		else if ((value = option_value(argv[i], "--executions="))
+		         != NULL) {
+			executions = strtoull(value, &end, 0);
+		}
+		else if ((value = option_value(argv[i], "--duration="))
+		         != NULL) {
+			seconds = strtod(value, &end);
+		}
+		else if ((value = option_value(argv[i], "--seed=")) != NULL) {
+			seed = strtoull(value, &end, 0);
+		}
+		else if ((value = option_value(argv[i],
+		                               "--execution-instructions="))
+		         != NULL) {
+			control.instructions = strtoull(value, &end, 0);
+		}
+		else if (!run_options_parse(&boot, argv[i])) {
+			break;
+		}
+		if (end != NULL && (end == value || *end != '\0')) {
+			break;
+		}
+	}
+	if (i < argc || seed == 0 || control.instructions == 0) {
+		usage();
+		return 1;
+	}
+	if (!run_options_finish(&boot)) {
+		return 1;
+	}
+	teensy_3_2_set_trace_level(TEENSY_3_2_TRACE_NONE);
+
+	struct teensy_3_2 *board = teensy_3_2_create();
+	size_t data_size = 0;
+	if (boot.snapshot != NULL) {
+		if (!teensy_3_2_snapshot_load(board, boot.snapshot)) {
+			return 2;
+		}
+	}
+	else if (i8hex_parse(boot.file, data, sizeof(data), &data_size)
+	         == FAILURE) {
+		return 2;
+	}
+	struct teensy_3_2_run_result booted =
+		teensy_3_2_emulate_until(board, data, data_size, &boot.control);
+	if (booted.stop == TEENSY_3_2_STOP_INVALID) {
+		fprintf(stderr, "a watched or written location can't be "
+		                "used\n");
+		return 1;
+	}
+	run_result_print("boot", &booted);
+	struct teensy_3_2_checkpoint *checkpoint =
+		teensy_3_2_checkpoint_take(board);
+
+	shared = mmap(NULL, sizeof(struct shared), PROT_READ | PROT_WRITE,
+	              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED) {
+		perror("mmap");
+		return 3;
+	}
+	if (corpus != NULL && !corpus_read(corpus)) {
+		return 2;
+	}
+	if (shared->corpus_size == 0) {
+		shared->corpus_size = 1; // an empty input
+	}
+	shared->seeds = shared->corpus_size;
+	buckets_init();
+	random_state = seed;
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	uint32_t crashes = 0;
+	int status = 0;
+	while (true) {
+		fflush(stdout);
+		pid_t child = fork();
+		if (child == -1) {
+			perror("fork");
+			status = 3;
+			break;
+		}
+		if (child == 0) {
+			fuzz(board, checkpoint, &control, executions, &start,
+			     seconds);
+			_exit(0);
+		}
+		int wait_status;
+		while (waitpid(child, &wait_status, 0) == -1) {
+			assert(errno == EINTR);
+		}
+		if (!WIFSIGNALED(wait_status)) {
+			break;
+		}
+		printf("crash (%s) on input ",
+		       strsignal(WTERMSIG(wait_status)));
+		input_print(&shared->current);
+		if (corpus != NULL) {
+			input_write(corpus, "crash-", crashes,
+			            &shared->current);
+		}
+		++crashes;
+		// The crashing execution counts, the next child goes on after
+		++shared->executions;
+	}
+
+	if (corpus != NULL) {
+		for (uint32_t j = shared->seeds; j < shared->corpus_size; ++j) {
+			if (!input_write(corpus, "id-", j,
+			                 &shared->corpus[j])) {
+				status = 3;
+				break;
+			}
+		}
+	}
+	double elapsed = seconds_since(&start);
+	printf("%" PRIu64 " executions in %.2f seconds (%.0f/s), %" PRIu64
+	       " hit the instruction limit, %" PRIu32 " crashes\n",
+	       shared->executions, elapsed, shared->executions / elapsed,
+	       shared->hangs, crashes);
+	printf("corpus of %" PRIu32 " inputs (%" PRIu32 " new), %" PRIu32
+	       " edges seen\n", shared->corpus_size,
+	       shared->corpus_size - shared->seeds, edges_seen());
+
+	munmap(shared, sizeof(struct shared));
+	teensy_3_2_checkpoint_free(checkpoint);
+	teensy_3_2_destroy(board);
+	return status;
+}
@@ -1,975 +1,436 @@
 #include "get_address_name.h"
 
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+/* Sorted by address */
+static const struct address_name address_names[] = {
+	{ 0x40020000, "FTFL_FSTAT" },
+	{ 0x40020001, "FTFL_FCNFG" },
+	{ 0x40020002, "FTFL_FSEC" },
+	{ 0x40020003, "FTFL_FOPT" },
+	{ 0x40020004, "FTFL_FCCOB3" },
+	{ 0x40020005, "FTFL_FCCOB2" },
+	{ 0x40020006, "FTFL_FCCOB1" },
+	{ 0x40020007, "FTFL_FCCOB0" },
+	{ 0x40020008, "FTFL_FCCOB7" },
+	{ 0x40020009, "FTFL_FCCOB6" },
+	{ 0x4002000A, "FTFL_FCCOB5" },
+	{ 0x4002000B, "FTFL_FCCOB4" },
+	{ 0x4002000C, "FTFL_FCCOBB" },
+	{ 0x4002000D, "FTFL_FCCOBA" },
+	{ 0x4002000E, "FTFL_FCCOB9" },
+	{ 0x4002000F, "FTFL_FCCOB8" },
+	{ 0x40020010, "FTFL_FPROT3" },
+	{ 0x40020011, "FTFL_FPROT2" },
+	{ 0x40020012, "FTFL_FPROT1" },
+	{ 0x40020013, "FTFL_FPROT0" },
+	{ 0x40020016, "FTFL_FEPROT" },
+	{ 0x40020017, "FTFL_FDPROT" },
+	{ 0x40037000, "PIT_MCR" },
+	{ 0x40037100, "PIT_LDVAL0" },
+	{ 0x40037104, "PIT_CVAL0" },
+	{ 0x40037108, "PIT_TCTRL0" },
+	{ 0x4003710C, "PIT_TFLG0" },
+	{ 0x40037110, "PIT_LDVAL1" },
+	{ 0x40037114, "PIT_CVAL1" },
+	{ 0x40037118, "PIT_TCTRL1" },
+	{ 0x4003711C, "PIT_TFLG1" },
+	{ 0x40037120, "PIT_LDVAL2" },
+	{ 0x40037124, "PIT_CVAL2" },
+	{ 0x40037128, "PIT_TCTRL2" },
+	{ 0x4003712C, "PIT_TFLG2" },
+	{ 0x40037130, "PIT_LDVAL3" },
+	{ 0x40037134, "PIT_CVAL3" },
+	{ 0x40037138, "PIT_TCTRL3" },
+	{ 0x4003713C, "PIT_TFLG3" },
+	{ 0x40038000, "FTM0_SC" },
+	{ 0x40038004, "FTM0_CNT" },
+	{ 0x40038008, "FTM0_MOD" },
+	{ 0x4003800C, "FTM0_C0SC" },
+	{ 0x40038010, "FTM0_C0V" },
+	{ 0x40038014, "FTM0_C1SC" },
+	{ 0x40038018, "FTM0_C1V" },
+	{ 0x4003801C, "FTM0_C2SC" },
+	{ 0x40038020, "FTM0_C2V" },
+	{ 0x40038024, "FTM0_C3SC" },
+	{ 0x40038028, "FTM0_C3V" },
+	{ 0x4003802C, "FTM0_C4SC" },
+	{ 0x40038030, "FTM0_C4V" },
+	{ 0x40038034, "FTM0_C5SC" },
+	{ 0x40038038, "FTM0_C5V" },
+	{ 0x4003803C, "FTM0_C6SC" },
+	{ 0x40038040, "FTM0_C6V" },
+	{ 0x40038044, "FTM0_C7SC" },
+	{ 0x40038048, "FTM0_C7V" },
+	{ 0x4003804C, "FTM0_CTNIN" },
+	{ 0x40038050, "FTM0_STATUS" },
+	{ 0x40038054, "FTM0_MODE" },
+	{ 0x40039000, "FTM1_SC" },
+	{ 0x40039004, "FTM1_CNT" },
+	{ 0x40039008, "FTM1_MOD" },
+	{ 0x4003900C, "FTM1_C0SC" },
+	{ 0x40039010, "FTM1_C0V" },
+	{ 0x40039014, "FTM1_C1SC" },
+	{ 0x40039018, "FTM1_C1V" },
+	{ 0x4003901C, "FTM1_C2SC" },
+	{ 0x40039020, "FTM1_C2V" },
+	{ 0x40039024, "FTM1_C3SC" },
+	{ 0x40039028, "FTM1_C3V" },
+	{ 0x4003902C, "FTM1_C4SC" },
+	{ 0x40039030, "FTM1_C4V" },
+	{ 0x40039034, "FTM1_C5SC" },
+	{ 0x40039038, "FTM1_C5V" },
+	{ 0x4003903C, "FTM1_C6SC" },
+	{ 0x40039040, "FTM1_C6V" },
+	{ 0x40039044, "FTM1_C7SC" },
+	{ 0x40039048, "FTM1_C7V" },
+	{ 0x4003904C, "FTM1_CTNIN" },
+	{ 0x40039050, "FTM1_STATUS" },
+	{ 0x40039054, "FTM1_MODE" },
+	{ 0x4003B000, "ADC0_SC1A" },
+	{ 0x4003B004, "ADC0_SC1B" },
+	{ 0x4003B008, "ADC0_CFG1" },
+	{ 0x4003B00C, "ADC0_CFG2" },
+	{ 0x4003B010, "ADC0_RA" },
+	{ 0x4003B014, "ADC0_RB" },
+	{ 0x4003B018, "ADC0_CV1" },
+	{ 0x4003B01C, "ADC0_CV2" },
+	{ 0x4003B020, "ADC0_SC2" },
+	{ 0x4003B024, "ADC0_SC3" },
+	{ 0x4003B028, "ADC0_OFS" },
+	{ 0x4003D010, "RTC_CR" },
+	{ 0x4003D014, "RTC_SR" },
+	{ 0x4003D018, "RTC_LR" },
+	{ 0x40047000, "SIM_SOPT1" },
+	{ 0x40047004, "SIM_SOPT1CFG" },
+	{ 0x40048004, "SIM_SOPT2" },
+	{ 0x4004800C, "SIM_SOPT4" },
+	{ 0x40048010, "SIM_SOPT5" },
+	{ 0x40048018, "SIM_SOPT7" },
+	{ 0x40048024, "SIM_SDID" },
+	{ 0x40048028, "SIM_SCGC1" },
+	{ 0x4004802C, "SIM_SCGC2" },
+	{ 0x40048030, "SIM_SCGC3" },
+	{ 0x40048034, "SIM_SCGC4" },
+	{ 0x40048038, "SIM_SCGC5" },
+	{ 0x4004803C, "SIM_SCGC6" },
+	{ 0x40048040, "SIM_SCGC7" },
+	{ 0x40048044, "SIM_CLKDIV1" },
+	{ 0x40048048, "SIM_CLKDIV2" },
+	{ 0x4004804C, "SIM_FCFG1" },
+	{ 0x40048050, "SIM_FCFG2" },
+	{ 0x4004B000, "PORTC_PCR0" },
+	{ 0x4004B004, "PORTC_PCR1" },
+	{ 0x4004B008, "PORTC_PCR2" },
+	{ 0x4004B00C, "PORTC_PCR3" },
+	{ 0x4004B010, "PORTC_PCR4" },
+	{ 0x4004B014, "PORTC_PCR5" },
+	{ 0x4004B018, "PORTC_PCR6" },
+	{ 0x4004B01C, "PORTC_PCR7" },
+	{ 0x4004B020, "PORTC_PCR8" },
+	{ 0x4004B024, "PORTC_PCR9" },
+	{ 0x40052000, "WDOG_STCTRLH" },
+	{ 0x4005200E, "WDOG_UNLOCK" },
+	{ 0x40064000, "MCG_C1" },
+	{ 0x40064001, "MCG_C2" },
+	{ 0x40064002, "MCG_C3" },
+	{ 0x40064003, "MCG_C4" },
+	{ 0x40064004, "MCG_C5" },
+	{ 0x40064005, "MCG_C6" },
+	{ 0x40064006, "MCG_S" },
+	{ 0x40065000, "OSC_CR" },
+	{ 0x40072000, "USB0_PERID" },
+	{ 0x40072004, "USB0_IDCOMP" },
+	{ 0x40072008, "USB0_REV" },
+	{ 0x4007200C, "USB0_ADDINFO" },
+	{ 0x40072010, "USB0_OTGISTAT" },
+	{ 0x40072014, "USB0_OTGICR" },
+	{ 0x40072018, "USB0_OTGSTAT" },
+	{ 0x40072080, "USB0_ISTAT" },
+	{ 0x40072084, "USB0_INTEN" },
+	{ 0x40072088, "USB0_ERRSTAT" },
+	{ 0x40072090, "USB0_STAT" },
+	{ 0x40072094, "USB0_CTL" },
+	{ 0x4007209C, "USB0_BDTPAGE1" },
+	{ 0x400720B0, "USB0_BDTPAGE2" },
+	{ 0x400720B4, "USB0_BDTPAGE3" },
+	{ 0x40072100, "USB0_USBCTRL" },
+	{ 0x40072104, "USB0_OBSERVE" },
+	{ 0x40072108, "USB0_CONTROL" },
+	{ 0x4007210C, "USB0_USBTRC0" },
+	{ 0x40072114, "USB0_USBFRMADJUST" },
+	{ 0x40074000, "VREF_TRM" },
+	{ 0x40074001, "VREF_SC" },
+	{ 0x4007D000, "PMC_LVDSC1" },
+	{ 0x4007D001, "PMC_LVDSC2" },
+	{ 0x4007D002, "PMC_REGSC" },
+	{ 0x400B8000, "FTM2_SC" },
+	{ 0x400B8004, "FTM2_CNT" },
+	{ 0x400B8008, "FTM2_MOD" },
+	{ 0x400B800C, "FTM2_C0SC" },
+	{ 0x400B8010, "FTM2_C0V" },
+	{ 0x400B8014, "FTM2_C1SC" },
+	{ 0x400B8018, "FTM2_C1V" },
+	{ 0x400B801C, "FTM2_C2SC" },
+	{ 0x400B8020, "FTM2_C2V" },
+	{ 0x400B8024, "FTM2_C3SC" },
+	{ 0x400B8028, "FTM2_C3V" },
+	{ 0x400B802C, "FTM2_C4SC" },
+	{ 0x400B8030, "FTM2_C4V" },
+	{ 0x400B8034, "FTM2_C5SC" },
+	{ 0x400B8038, "FTM2_C5V" },
+	{ 0x400B803C, "FTM2_C6SC" },
+	{ 0x400B8040, "FTM2_C6V" },
+	{ 0x400B8044, "FTM2_C7SC" },
+	{ 0x400B8048, "FTM2_C7V" },
+	{ 0x400B804C, "FTM2_CTNIN" },
+	{ 0x400B8050, "FTM2_STATUS" },
+	{ 0x400B8054, "FTM2_MODE" },
+	{ 0x400BB000, "ADC1_SC1A" },
+	{ 0x400BB004, "ADC1_SC1B" },
+	{ 0x400BB008, "ADC1_CFG1" },
+	{ 0x400BB00C, "ADC1_CFG2" },
+	{ 0x400BB010, "ADC1_RA" },
+	{ 0x400BB014, "ADC1_RB" },
+	{ 0x400BB018, "ADC1_CV1" },
+	{ 0x400BB01C, "ADC1_CV2" },
+	{ 0x400BB020, "ADC1_SC2" },
+	{ 0x400BB024, "ADC1_SC3" },
+	{ 0x400BB028, "ADC1_OFS" },
+	{ 0x400BB02C, "ADC1_PG" },
+	{ 0x400BB030, "ADC1_MG" },
+	{ 0xE0001000, "DWT_CTRL" },
+	{ 0xE000E010, "SYST_CSR" },
+	{ 0xE000E014, "SYST_RVR" },
+	{ 0xE000E018, "SYST_CVR" },
+	{ 0xE000E100, "NVIC_ISER0" },
+	{ 0xE000E104, "NVIC_ISER1" },
+	{ 0xE000E108, "NVIC_ISER2" },
+	{ 0xE000E400, "NVIC_IPR0" },
+	{ 0xE000E404, "NVIC_IPR1" },
+	{ 0xE000E408, "NVIC_IPR2" },
+	{ 0xE000E40C, "NVIC_IPR3" },
+	{ 0xE000E410, "NVIC_IPR4" },
+	{ 0xE000E414, "NVIC_IPR5" },
+	{ 0xE000E418, "NVIC_IPR6" },
+	{ 0xE000E41C, "NVIC_IPR7" },
+	{ 0xE000E420, "NVIC_IPR8" },
+	{ 0xE000E424, "NVIC_IPR9" },
+	{ 0xE000E428, "NVIC_IPR10" },
+	{ 0xE000E42C, "NVIC_IPR11" },
+	{ 0xE000E430, "NVIC_IPR12" },
+	{ 0xE000E434, "NVIC_IPR13" },
+	{ 0xE000E438, "NVIC_IPR14" },
+	{ 0xE000E43C, "NVIC_IPR15" },
+	{ 0xE000E440, "NVIC_IPR16" },
+	{ 0xE000E444, "NVIC_IPR17" },
+	{ 0xE000E448, "NVIC_IPR18 (Interrupt Number 72)" },
+	{ 0xE000E449, "NVIC_IPR18 (Interrupt Number 73)" },
+	{ 0xE000E44A, "NVIC_IPR18 (Interrupt Number 74)" },
+	{ 0xE000E44B, "NVIC_IPR18 (Interrupt Number 75)" },
+	{ 0xE000E44C, "NVIC_IPR19" },
+	{ 0xE000E450, "NVIC_IPR20" },
+	{ 0xE000E454, "NVIC_IPR21" },
+	{ 0xE000E458, "NVIC_IPR22" },
+	{ 0xE000E45C, "NVIC_IPR23" },
+	{ 0xE000E460, "NVIC_IPR24" },
+	{ 0xE000E464, "NVIC_IPR25" },
+	{ 0xE000E468, "NVIC_IPR26" },
+	{ 0xE000E46C, "NVIC_IPR27" },
+	{ 0xE000E470, "NVIC_IPR28" },
+	{ 0xE000E474, "NVIC_IPR29" },
+	{ 0xE000E478, "NVIC_IPR30" },
+	{ 0xE000E47C, "NVIC_IPR31" },
+	{ 0xE000E480, "NVIC_IPR32" },
+	{ 0xE000E484, "NVIC_IPR33" },
+	{ 0xE000E488, "NVIC_IPR34" },
+	{ 0xE000E48C, "NVIC_IPR35" },
+	{ 0xE000E490, "NVIC_IPR36" },
+	{ 0xE000E494, "NVIC_IPR37" },
+	{ 0xE000E498, "NVIC_IPR38" },
+	{ 0xE000E49C, "NVIC_IPR39" },
+	{ 0xE000E4A0, "NVIC_IPR40" },
+	{ 0xE000E4A4, "NVIC_IPR41" },
+	{ 0xE000E4A8, "NVIC_IPR42" },
+	{ 0xE000E4AC, "NVIC_IPR43" },
+	{ 0xE000E4B0, "NVIC_IPR44" },
+	{ 0xE000E4B4, "NVIC_IPR45" },
+	{ 0xE000E4B8, "NVIC_IPR46" },
+	{ 0xE000E4BC, "NVIC_IPR47" },
+	{ 0xE000E4C0, "NVIC_IPR48" },
+	{ 0xE000E4C4, "NVIC_IPR49" },
+	{ 0xE000E4C8, "NVIC_IPR50" },
+	{ 0xE000E4CC, "NVIC_IPR51" },
+	{ 0xE000E4D0, "NVIC_IPR52" },
+	{ 0xE000E4D4, "NVIC_IPR53" },
+	{ 0xE000E4D8, "NVIC_IPR54" },
+	{ 0xE000E4DC, "NVIC_IPR55" },
+	{ 0xE000E4E0, "NVIC_IPR56" },
+	{ 0xE000E4E4, "NVIC_IPR57" },
+	{ 0xE000E4E8, "NVIC_IPR58" },
+	{ 0xE000E4EC, "NVIC_IPR59" },
+	{ 0xE000E4F0, "NVIC_IPR60" },
+	{ 0xE000E4F4, "NVIC_IPR61" },
+	{ 0xE000E4F8, "NVIC_IPR62" },
+	{ 0xE000E4FC, "NVIC_IPR63" },
+	{ 0xE000E500, "NVIC_IPR64" },
+	{ 0xE000E504, "NVIC_IPR65" },
+	{ 0xE000E508, "NVIC_IPR66" },
+	{ 0xE000E50C, "NVIC_IPR67" },
+	{ 0xE000E510, "NVIC_IPR68" },
+	{ 0xE000E514, "NVIC_IPR69" },
+	{ 0xE000E518, "NVIC_IPR70" },
+	{ 0xE000E51C, "NVIC_IPR71" },
+	{ 0xE000E520, "NVIC_IPR72" },
+	{ 0xE000E524, "NVIC_IPR73" },
+	{ 0xE000E528, "NVIC_IPR74" },
+	{ 0xE000E52C, "NVIC_IPR75" },
+	{ 0xE000E530, "NVIC_IPR76" },
+	{ 0xE000E534, "NVIC_IPR77" },
+	{ 0xE000E538, "NVIC_IPR78" },
+	{ 0xE000E53C, "NVIC_IPR79" },
+	{ 0xE000E540, "NVIC_IPR80" },
+	{ 0xE000E544, "NVIC_IPR81" },
+	{ 0xE000E548, "NVIC_IPR82" },
+	{ 0xE000E54C, "NVIC_IPR83" },
+	{ 0xE000E550, "NVIC_IPR84" },
+	{ 0xE000E554, "NVIC_IPR85" },
+	{ 0xE000E558, "NVIC_IPR86" },
+	{ 0xE000E55C, "NVIC_IPR87" },
+	{ 0xE000E560, "NVIC_IPR88" },
+	{ 0xE000E564, "NVIC_IPR89" },
+	{ 0xE000E568, "NVIC_IPR90" },
+	{ 0xE000E56C, "NVIC_IPR91" },
+	{ 0xE000E570, "NVIC_IPR92" },
+	{ 0xE000E574, "NVIC_IPR93" },
+	{ 0xE000E578, "NVIC_IPR94" },
+	{ 0xE000E57C, "NVIC_IPR95" },
+	{ 0xE000E580, "NVIC_IPR96" },
+	{ 0xE000E584, "NVIC_IPR97" },
+	{ 0xE000E588, "NVIC_IPR98" },
+	{ 0xE000E58C, "NVIC_IPR99" },
+	{ 0xE000E590, "NVIC_IPR100" },
+	{ 0xE000E594, "NVIC_IPR101" },
+	{ 0xE000E598, "NVIC_IPR102" },
+	{ 0xE000E59C, "NVIC_IPR103" },
+	{ 0xE000E5A0, "NVIC_IPR104" },
+	{ 0xE000E5A4, "NVIC_IPR105" },
+	{ 0xE000E5A8, "NVIC_IPR106" },
+	{ 0xE000E5AC, "NVIC_IPR107" },
+	{ 0xE000E5B0, "NVIC_IPR108" },
+	{ 0xE000E5B4, "NVIC_IPR109" },
+	{ 0xE000E5B8, "NVIC_IPR110" },
+	{ 0xE000E5BC, "NVIC_IPR111" },
+	{ 0xE000E5C0, "NVIC_IPR112" },
+	{ 0xE000E5C4, "NVIC_IPR113" },
+	{ 0xE000E5C8, "NVIC_IPR114" },
+	{ 0xE000E5CC, "NVIC_IPR115" },
+	{ 0xE000E5D0, "NVIC_IPR116" },
+	{ 0xE000E5D4, "NVIC_IPR117" },
+	{ 0xE000E5D8, "NVIC_IPR118" },
+	{ 0xE000E5DC, "NVIC_IPR119" },
+	{ 0xE000E5E0, "NVIC_IPR120" },
+	{ 0xE000E5E4, "NVIC_IPR121" },
+	{ 0xE000E5E8, "NVIC_IPR122" },
+	{ 0xE000E5EC, "NVIC_IPR123" },
+	{ 0xE000ED00, "CPUID" },
+	{ 0xE000ED04, "ICSR" },
+	{ 0xE000ED08, "VTOR" },
+	{ 0xE000EDF0, "SCS_DHCSR" },
+	{ 0xE000EDF4, "SCS_DCRSR" },
+	{ 0xE000EDF8, "SCS_DCRDR" },
+	{ 0xE000EDFC, "SCS_DEMCR" },
+	{ 0xE004E004, "ICTR" },
+};
+
+#define ADDRESS_NAMES_SIZE (sizeof(address_names) / sizeof(address_names[0]))
+
+/* Indices into address_names sorted by name, built the first time a name
+   is looked up */
+static uint16_t address_names_by_name[ADDRESS_NAMES_SIZE];
+
+static int compare_names(const void *a, const void *b)
+{
+	const uint16_t *i = a;
+	const uint16_t *j = b;
+	return strcmp(address_names[*i].name, address_names[*j].name);
+}
+
+static void address_names_by_name_build(void)
+{
+	for (size_t i = 0; i < ADDRESS_NAMES_SIZE; ++i) {
+		// lower_bound needs address_names sorted too
+		assert(i == 0
+		       || address_names[i - 1].address
+		          < address_names[i].address);
+		address_names_by_name[i] = i;
+	}
+	qsort(address_names_by_name, ADDRESS_NAMES_SIZE, sizeof(uint16_t),
+	      compare_names);
+}
+
+/* Index of the first entry with an address not less than the given one,
+   the loop has no data dependent branches so it stays predictable */
+static size_t lower_bound(uint32_t address)
+{
+	const struct address_name *base = address_names;
+	size_t size = ADDRESS_NAMES_SIZE;
+	while (size > 1) {
+		size_t half = size / 2;
+		base = (base[half - 1].address < address) ? base + half : base;
+		size -= half;
+	}
+	return (base - address_names) + (base->address < address);
+}
+
 const char *get_address_name(uint32_t address)
 {
-	const char *name = "";
+	size_t i = lower_bound(address);
+	if (i < ADDRESS_NAMES_SIZE && address_names[i].address == address) {
+		return address_names[i].name;
+	}
 
 	if (address >= 0xE0000000 && address <= 0xE00FFFFF) {
-		name = "PPB (Private Peripheral Bus)";
+		return "PPB (Private Peripheral Bus)";
 	}
+	return "";
+}
+
+bool get_name_address(const char *name, uint32_t *address)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, address_names_by_name_build);
 
-	switch (address) {
-	case 0x40020000:
-		name = "FTFL_FSTAT";
-		break;
-	case 0x40020001:
-		name = "FTFL_FCNFG";
-		break;
-	case 0x40020002:
-		name = "FTFL_FSEC";
-		break;
-	case 0x40020003:
-		name = "FTFL_FOPT";
-		break;
-	case 0x40020004:
-		name = "FTFL_FCCOB3";
-		break;
-	case 0x40020005:
-		name = "FTFL_FCCOB2";
-		break;
-	case 0x40020006:
-		name = "FTFL_FCCOB1";
-		break;
-	case 0x40020007:
-		name = "FTFL_FCCOB0";
-		break;
-	case 0x40020008:
-		name = "FTFL_FCCOB7";
-		break;
-	case 0x40020009:
-		name = "FTFL_FCCOB6";
-		break;
-	case 0x4002000A:
-		name = "FTFL_FCCOB5";
-		break;
-	case 0x4002000B:
-		name = "FTFL_FCCOB4";
-		break;
-	case 0x4002000C:
-		name = "FTFL_FCCOBB";
-		break;
-	case 0x4002000D:
-		name = "FTFL_FCCOBA";
-		break;
-	case 0x4002000E:
-		name = "FTFL_FCCOB9";
-		break;
-	case 0x4002000F:
-		name = "FTFL_FCCOB8";
-		break;
-	case 0x40020010:
-		name = "FTFL_FPROT3";
-		break;
-	case 0x40020011:
-		name = "FTFL_FPROT2";
-		break;
-	case 0x40020012:
-		name = "FTFL_FPROT1";
-		break;
-	case 0x40020013:
-		name = "FTFL_FPROT0";
-		break;
-	case 0x40020016:
-		name = "FTFL_FEPROT";
-		break;
-	case 0x40020017:
-		name = "FTFL_FDPROT";
-		break;
-	case 0x40038000:
-		name = "FTM0_SC";
-		break;
-	case 0x40038004:
-		name = "FTM0_CNT";
-		break;
-	case 0x40038008:
-		name = "FTM0_MOD";
-		break;
-	case 0x4003800C:
-		name = "FTM0_C0SC";
-		break;
-	case 0x40038010:
-		name = "FTM0_C0V";
-		break;
-	case 0x40038014:
-		name = "FTM0_C1SC";
-		break;
-	case 0x40038018:
-		name = "FTM0_C1V";
-		break;
-	case 0x4003801C:
-		name = "FTM0_C2SC";
-		break;
-	case 0x40038020:
-		name = "FTM0_C2V";
-		break;
-	case 0x40038024:
-		name = "FTM0_C3SC";
-		break;
-	case 0x40038028:
-		name = "FTM0_C3V";
-		break;
-	case 0x4003802C:
-		name = "FTM0_C4SC";
-		break;
-	case 0x40038030:
-		name = "FTM0_C4V";
-		break;
-	case 0x40038034:
-		name = "FTM0_C5SC";
-		break;
-	case 0x40038038:
-		name = "FTM0_C5V";
-		break;
-	case 0x4003803C:
-		name = "FTM0_C6SC";
-		break;
-	case 0x40038040:
-		name = "FTM0_C6V";
-		break;
-	case 0x40038044:
-		name = "FTM0_C7SC";
-		break;
-	case 0x40038048:
-		name = "FTM0_C7V";
-		break;
-	case 0x4003804C:
-		name = "FTM0_CTNIN";
-		break;
-	case 0x40038050:
-		name = "FTM0_STATUS";
-		break;
-	case 0x40038054:
-		name = "FTM0_MODE";
-		break;
-	case 0x40039000:
-		name = "FTM1_SC";
-		break;
-	case 0x40039004:
-		name = "FTM1_CNT";
-		break;
-	case 0x40039008:
-		name = "FTM1_MOD";
-		break;
-	case 0x4003900C:
-		name = "FTM1_C0SC";
-		break;
-	case 0x40039010:
-		name = "FTM1_C0V";
-		break;
-	case 0x40039014:
-		name = "FTM1_C1SC";
-		break;
-	case 0x40039018:
-		name = "FTM1_C1V";
-		break;
-	case 0x4003901C:
-		name = "FTM1_C2SC";
-		break;
-	case 0x40039020:
-		name = "FTM1_C2V";
-		break;
-	case 0x40039024:
-		name = "FTM1_C3SC";
-		break;
-	case 0x40039028:
-		name = "FTM1_C3V";
-		break;
-	case 0x4003902C:
-		name = "FTM1_C4SC";
-		break;
-	case 0x40039030:
-		name = "FTM1_C4V";
-		break;
-	case 0x40039034:
-		name = "FTM1_C5SC";
-		break;
-	case 0x40039038:
-		name = "FTM1_C5V";
-		break;
-	case 0x4003903C:
-		name = "FTM1_C6SC";
-		break;
-	case 0x40039040:
-		name = "FTM1_C6V";
-		break;
-	case 0x40039044:
-		name = "FTM1_C7SC";
-		break;
-	case 0x40039048:
-		name = "FTM1_C7V";
-		break;
-	case 0x4003904C:
-		name = "FTM1_CTNIN";
-		break;
-	case 0x40039050:
-		name = "FTM1_STATUS";
-		break;
-	case 0x40039054:
-		name = "FTM1_MODE";
-		break;
-	case 0x4003B000:
-		name = "ADC0_SC1A";
-		break;
-	case 0x4003B004:
-		name = "ADC0_SC1B";
-		break;
-	case 0x4003B008:
-		name = "ADC0_CFG1";
-		break;
-	case 0x4003B00C:
-		name = "ADC0_CFG2";
-		break;
-	case 0x4003B010:
-		name = "ADC0_RA";
-		break;
-	case 0x4003B014:
-		name = "ADC0_RB";
-		break;
-	case 0x4003B018:
-		name = "ADC0_CV1";
-		break;
-	case 0x4003B01C:
-		name = "ADC0_CV2";
-		break;
-	case 0x4003B020:
-		name = "ADC0_SC2";
-		break;
-	case 0x4003B024:
-		name = "ADC0_SC3";
-		break;
-	case 0x4003B028:
-		name = "ADC0_OFS";
-		break;
-	case 0x4003D010:
-		name = "RTC_CR";
-		break;
-	case 0x4003D014:
-		name = "RTC_SR";
-		break;
-	case 0x4003D018:
-		name = "RTC_LR";
-		break;
-	case 0x40047000:
-		name = "SIM_SOPT1";
-		break;
-	case 0x40047004:
-		name = "SIM_SOPT1CFG";
-		break;
-	case 0x40048004:
-		name = "SIM_SOPT2";
-		break;
-	case 0x4004800C:
-		name = "SIM_SOPT4";
-		break;
-	case 0x40048010:
-		name = "SIM_SOPT5";
-		break;
-	case 0x40048018:
-		name = "SIM_SOPT7";
-		break;
-	case 0x40048024:
-		name = "SIM_SDID";
-		break;
-	case 0x40048028:
-		name = "SIM_SCGC1";
-		break;
-	case 0x4004802C:
-		name = "SIM_SCGC2";
-		break;
-	case 0x40048030:
-		name = "SIM_SCGC3";
-		break;
-	case 0x40048034:
-		name = "SIM_SCGC4";
-		break;
-	case 0x40048038:
-		name = "SIM_SCGC5";
-		break;
-	case 0x4004803C:
-		name = "SIM_SCGC6";
-		break;
-	case 0x40048040:
-		name = "SIM_SCGC7";
-		break;
-	case 0x40048044:
-		name = "SIM_CLKDIV1";
-		break;
-	case 0x40048048:
-		name = "SIM_CLKDIV2";
-		break;
-	case 0x4004804C:
-		name = "SIM_FCFG1";
-		break;
-	case 0x40048050:
-		name = "SIM_FCFG2";
-		break;
-	case 0x4004B000:
-		name = "PORTC_PCR0";
-		break;
-	case 0x4004B004:
-		name = "PORTC_PCR1";
-		break;
-	case 0x4004B008:
-		name = "PORTC_PCR2";
-		break;
-	case 0x4004B00C:
-		name = "PORTC_PCR3";
-		break;
-	case 0x4004B010:
-		name = "PORTC_PCR4";
-		break;
-	case 0x4004B014:
-		name = "PORTC_PCR5";
-		break;
-	case 0x4004B018:
-		name = "PORTC_PCR6";
-		break;
-	case 0x4004B01C:
-		name = "PORTC_PCR7";
-		break;
-	case 0x4004B020:
-		name = "PORTC_PCR8";
-		break;
-	case 0x4004B024:
-		name = "PORTC_PCR9";
-		break;
-	case 0x40052000:
-		name = "WDOG_STCTRLH";
-		break;
-	case 0x4005200E:
-		name = "WDOG_UNLOCK";
-		break;
-	case 0x40064000:
-		name = "MCG_C1";
-		break;
-	case 0x40064001:
-		name = "MCG_C2";
-		break;
-	case 0x40064002:
-		name = "MCG_C3";
-		break;
-	case 0x40064003:
-		name = "MCG_C4";
-		break;
-	case 0x40064004:
-		name = "MCG_C5";
-		break;
-	case 0x40064005:
-		name = "MCG_C6";
-		break;
-	case 0x40064006:
-		name = "MCG_S";
-		break;
-	case 0x40065000:
-		name = "OSC_CR";
-		break;
-	case 0x40072000:
-		name = "USB0_PERID";
-		break;
-	case 0x40072004:
-		name = "USB0_IDCOMP";
-		break;
-	case 0x40072008:
-		name = "USB0_REV";
-		break;
-	case 0x4007200C:
-		name = "USB0_ADDINFO";
-		break;
-	case 0x40072010:
-		name = "USB0_OTGISTAT";
-		break;
-	case 0x40072014:
-		name = "USB0_OTGICR";
-		break;
-	case 0x40072018:
-		name = "USB0_OTGSTAT";
-		break;
-	case 0x40072080:
-		name = "USB0_ISTAT";
-		break;
-	case 0x40072084:
-		name = "USB0_INTEN";
-		break;
-	case 0x40072088:
-		name = "USB0_ERRSTAT";
-		break;
-	case 0x40072090:
-		name = "USB0_STAT";
-		break;
-	case 0x40072094:
-		name = "USB0_CTL";
-		break;
-	case 0x4007209C:
-		name = "USB0_BDTPAGE1";
-		break;
-	case 0x400720B0:
-		name = "USB0_BDTPAGE2";
-		break;
-	case 0x400720B4:
-		name = "USB0_BDTPAGE3";
-		break;
-	case 0x40072100:
-		name = "USB0_USBCTRL";
-		break;
-	case 0x40072104:
-		name = "USB0_OBSERVE";
-		break;
-	case 0x40072108:
-		name = "USB0_CONTROL";
-		break;
-	case 0x4007210C:
-		name = "USB0_USBTRC0";
-		break;
-	case 0x40072114:
-		name = "USB0_USBFRMADJUST";
-		break;
-	case 0x40074000:
-		name = "VREF_TRM";
-		break;
-	case 0x40074001:
-		name = "VREF_SC";
-		break;
-	case 0x4007D000:
-		name = "PMC_LVDSC1";
-		break;
-	case 0x4007D001:
-		name = "PMC_LVDSC2";
-		break;
-	case 0x4007D002:
-		name = "PMC_REGSC";
-		break;
-	case 0x400B8000:
-		name = "FTM2_SC";
-		break;
-	case 0x400B8004:
-		name = "FTM2_CNT";
-		break;
-	case 0x400B8008:
-		name = "FTM2_MOD";
-		break;
-	case 0x400B800C:
-		name = "FTM2_C0SC";
-		break;
-	case 0x400B8010:
-		name = "FTM2_C0V";
-		break;
-	case 0x400B8014:
-		name = "FTM2_C1SC";
-		break;
-	case 0x400B8018:
-		name = "FTM2_C1V";
-		break;
-	case 0x400B801C:
-		name = "FTM2_C2SC";
-		break;
-	case 0x400B8020:
-		name = "FTM2_C2V";
-		break;
-	case 0x400B8024:
-		name = "FTM2_C3SC";
-		break;
-	case 0x400B8028:
-		name = "FTM2_C3V";
-		break;
-	case 0x400B802C:
-		name = "FTM2_C4SC";
-		break;
-	case 0x400B8030:
-		name = "FTM2_C4V";
-		break;
-	case 0x400B8034:
-		name = "FTM2_C5SC";
-		break;
-	case 0x400B8038:
-		name = "FTM2_C5V";
-		break;
-	case 0x400B803C:
-		name = "FTM2_C6SC";
-		break;
-	case 0x400B8040:
-		name = "FTM2_C6V";
-		break;
-	case 0x400B8044:
-		name = "FTM2_C7SC";
-		break;
-	case 0x400B8048:
-		name = "FTM2_C7V";
-		break;
-	case 0x400B804C:
-		name = "FTM2_CTNIN";
-		break;
-	case 0x400B8050:
-		name = "FTM2_STATUS";
-		break;
-	case 0x400B8054:
-		name = "FTM2_MODE";
-		break;
-	case 0x400BB000:
-		name = "ADC1_SC1A";
-		break;
-	case 0x400BB004:
-		name = "ADC1_SC1B";
-		break;
-	case 0x400BB008:
-		name = "ADC1_CFG1";
-		break;
-	case 0x400BB00C:
-		name = "ADC1_CFG2";
-		break;
-	case 0x400BB010:
-		name = "ADC1_RA";
-		break;
-	case 0x400BB014:
-		name = "ADC1_RB";
-		break;
-	case 0x400BB018:
-		name = "ADC1_CV1";
-		break;
-	case 0x400BB01C:
-		name = "ADC1_CV2";
-		break;
-	case 0x400BB020:
-		name = "ADC1_SC2";
-		break;
-	case 0x400BB024:
-		name = "ADC1_SC3";
-		break;
-	case 0x400BB028:
-		name = "ADC1_OFS";
-		break;
-	case 0x400BB02C:
-		name = "ADC1_PG";
-		break;
-	case 0x400BB030:
-		name = "ADC1_MG";
-		break;
-	case 0xE0001000:
-		name = "DWT_CTRL";
-		break;
-	case 0xE000E010:
-		name = "SYST_CSR";
-		break;
-	case 0xE000E014:
-		name = "SYST_RVR";
-		break;
-	case 0xE000E018:
-		name = "SYST_CVR";
-		break;
-	case 0xE000E100:
-		name = "NVIC_ISER0";
-		break;
-	case 0xE000E104:
-		name = "NVIC_ISER1";
-		break;
-	case 0xE000E108:
-		name = "NVIC_ISER2";
-		break;
-	case 0xE000E400:
-		name = "NVIC_IPR0";
-		break;
-	case 0xE000E404:
-		name = "NVIC_IPR1";
-		break;
-	case 0xE000E408:
-		name = "NVIC_IPR2";
-		break;
-	case 0xE000E40C:
-		name = "NVIC_IPR3";
-		break;
-	case 0xE000E410:
-		name = "NVIC_IPR4";
-		break;
-	case 0xE000E414:
-		name = "NVIC_IPR5";
-		break;
-	case 0xE000E418:
-		name = "NVIC_IPR6";
-		break;
-	case 0xE000E41C:
-		name = "NVIC_IPR7";
-		break;
-	case 0xE000E420:
-		name = "NVIC_IPR8";
-		break;
-	case 0xE000E424:
-		name = "NVIC_IPR9";
-		break;
-	case 0xE000E428:
-		name = "NVIC_IPR10";
-		break;
-	case 0xE000E42C:
-		name = "NVIC_IPR11";
-		break;
-	case 0xE000E430:
-		name = "NVIC_IPR12";
-		break;
-	case 0xE000E434:
-		name = "NVIC_IPR13";
-		break;
-	case 0xE000E438:
-		name = "NVIC_IPR14";
-		break;
-	case 0xE000E43C:
-		name = "NVIC_IPR15";
-		break;
-	case 0xE000E440:
-		name = "NVIC_IPR16";
-		break;
-	case 0xE000E444:
-		name = "NVIC_IPR17";
-		break;
-	case 0xE000E448:
-		name = "NVIC_IPR18 (Interrupt Number 72)";
-		break;
-	case 0xE000E449:
-		name = "NVIC_IPR18 (Interrupt Number 73)";
-		break;
-	case 0xE000E44A:
-		name = "NVIC_IPR18 (Interrupt Number 74)";
-		break;
-	case 0xE000E44B:
-		name = "NVIC_IPR18 (Interrupt Number 75)";
-		break;
-	case 0xE000E44C:
-		name = "NVIC_IPR19";
-		break;
-	case 0xE000E450:
-		name = "NVIC_IPR20";
-		break;
-	case 0xE000E454:
-		name = "NVIC_IPR21";
-		break;
-	case 0xE000E458:
-		name = "NVIC_IPR22";
-		break;
-	case 0xE000E45C:
-		name = "NVIC_IPR23";
-		break;
-	case 0xE000E460:
-		name = "NVIC_IPR24";
-		break;
-	case 0xE000E464:
-		name = "NVIC_IPR25";
-		break;
-	case 0xE000E468:
-		name = "NVIC_IPR26";
-		break;
-	case 0xE000E46C:
-		name = "NVIC_IPR27";
-		break;
-	case 0xE000E470:
-		name = "NVIC_IPR28";
-		break;
-	case 0xE000E474:
-		name = "NVIC_IPR29";
-		break;
-	case 0xE000E478:
-		name = "NVIC_IPR30";
-		break;
-	case 0xE000E47C:
-		name = "NVIC_IPR31";
-		break;
-	case 0xE000E480:
-		name = "NVIC_IPR32";
-		break;
-	case 0xE000E484:
-		name = "NVIC_IPR33";
-		break;
-	case 0xE000E488:
-		name = "NVIC_IPR34";
-		break;
-	case 0xE000E48C:
-		name = "NVIC_IPR35";
-		break;
-	case 0xE000E490:
-		name = "NVIC_IPR36";
-		break;
-	case 0xE000E494:
-		name = "NVIC_IPR37";
-		break;
-	case 0xE000E498:
-		name = "NVIC_IPR38";
-		break;
-	case 0xE000E49C:
-		name = "NVIC_IPR39";
-		break;
-	case 0xE000E4A0:
-		name = "NVIC_IPR40";
-		break;
-	case 0xE000E4A4:
-		name = "NVIC_IPR41";
-		break;
-	case 0xE000E4A8:
-		name = "NVIC_IPR42";
-		break;
-	case 0xE000E4AC:
-		name = "NVIC_IPR43";
-		break;
-	case 0xE000E4B0:
-		name = "NVIC_IPR44";
-		break;
-	case 0xE000E4B4:
-		name = "NVIC_IPR45";
-		break;
-	case 0xE000E4B8:
-		name = "NVIC_IPR46";
-		break;
-	case 0xE000E4BC:
-		name = "NVIC_IPR47";
-		break;
-	case 0xE000E4C0:
-		name = "NVIC_IPR48";
-		break;
-	case 0xE000E4C4:
-		name = "NVIC_IPR49";
-		break;
-	case 0xE000E4C8:
-		name = "NVIC_IPR50";
-		break;
-	case 0xE000E4CC:
-		name = "NVIC_IPR51";
-		break;
-	case 0xE000E4D0:
-		name = "NVIC_IPR52";
-		break;
-	case 0xE000E4D4:
-		name = "NVIC_IPR53";
-		break;
-	case 0xE000E4D8:
-		name = "NVIC_IPR54";
-		break;
-	case 0xE000E4DC:
-		name = "NVIC_IPR55";
-		break;
-	case 0xE000E4E0:
-		name = "NVIC_IPR56";
-		break;
-	case 0xE000E4E4:
-		name = "NVIC_IPR57";
-		break;
-	case 0xE000E4E8:
-		name = "NVIC_IPR58";
-		break;
-	case 0xE000E4EC:
-		name = "NVIC_IPR59";
-		break;
-	case 0xE000E4F0:
-		name = "NVIC_IPR60";
-		break;
-	case 0xE000E4F4:
-		name = "NVIC_IPR61";
-		break;
-	case 0xE000E4F8:
-		name = "NVIC_IPR62";
-		break;
-	case 0xE000E4FC:
-		name = "NVIC_IPR63";
-		break;
-	case 0xE000E500:
-		name = "NVIC_IPR64";
-		break;
-	case 0xE000E504:
-		name = "NVIC_IPR65";
-		break;
-	case 0xE000E508:
-		name = "NVIC_IPR66";
-		break;
-	case 0xE000E50C:
-		name = "NVIC_IPR67";
-		break;
-	case 0xE000E510:
-		name = "NVIC_IPR68";
-		break;
-	case 0xE000E514:
-		name = "NVIC_IPR69";
-		break;
-	case 0xE000E518:
-		name = "NVIC_IPR70";
-		break;
-	case 0xE000E51C:
-		name = "NVIC_IPR71";
-		break;
-	case 0xE000E520:
-		name = "NVIC_IPR72";
-		break;
-	case 0xE000E524:
-		name = "NVIC_IPR73";
-		break;
-	case 0xE000E528:
-		name = "NVIC_IPR74";
-		break;
-	case 0xE000E52C:
-		name = "NVIC_IPR75";
-		break;
-	case 0xE000E530:
-		name = "NVIC_IPR76";
-		break;
-	case 0xE000E534:
-		name = "NVIC_IPR77";
-		break;
-	case 0xE000E538:
-		name = "NVIC_IPR78";
-		break;
-	case 0xE000E53C:
-		name = "NVIC_IPR79";
-		break;
-	case 0xE000E540:
-		name = "NVIC_IPR80";
-		break;
-	case 0xE000E544:
-		name = "NVIC_IPR81";
-		break;
-	case 0xE000E548:
-		name = "NVIC_IPR82";
-		break;
-	case 0xE000E54C:
-		name = "NVIC_IPR83";
-		break;
-	case 0xE000E550:
-		name = "NVIC_IPR84";
-		break;
-	case 0xE000E554:
-		name = "NVIC_IPR85";
-		break;
-	case 0xE000E558:
-		name = "NVIC_IPR86";
-		break;
-	case 0xE000E55C:
-		name = "NVIC_IPR87";
-		break;
-	case 0xE000E560:
-		name = "NVIC_IPR88";
-		break;
-	case 0xE000E564:
-		name = "NVIC_IPR89";
-		break;
-	case 0xE000E568:
-		name = "NVIC_IPR90";
-		break;
-	case 0xE000E56C:
-		name = "NVIC_IPR91";
-		break;
-	case 0xE000E570:
-		name = "NVIC_IPR92";
-		break;
-	case 0xE000E574:
-		name = "NVIC_IPR93";
-		break;
-	case 0xE000E578:
-		name = "NVIC_IPR94";
-		break;
-	case 0xE000E57C:
-		name = "NVIC_IPR95";
-		break;
-	case 0xE000E580:
-		name = "NVIC_IPR96";
-		break;
-	case 0xE000E584:
-		name = "NVIC_IPR97";
-		break;
-	case 0xE000E588:
-		name = "NVIC_IPR98";
-		break;
-	case 0xE000E58C:
-		name = "NVIC_IPR99";
-		break;
-	case 0xE000E590:
-		name = "NVIC_IPR100";
-		break;
-	case 0xE000E594:
-		name = "NVIC_IPR101";
-		break;
-	case 0xE000E598:
-		name = "NVIC_IPR102";
-		break;
-	case 0xE000E59C:
-		name = "NVIC_IPR103";
-		break;
-	case 0xE000E5A0:
-		name = "NVIC_IPR104";
-		break;
-	case 0xE000E5A4:
-		name = "NVIC_IPR105";
-		break;
-	case 0xE000E5A8:
-		name = "NVIC_IPR106";
-		break;
-	case 0xE000E5AC:
-		name = "NVIC_IPR107";
-		break;
-	case 0xE000E5B0:
-		name = "NVIC_IPR108";
-		break;
-	case 0xE000E5B4:
-		name = "NVIC_IPR109";
-		break;
-	case 0xE000E5B8:
-		name = "NVIC_IPR110";
-		break;
-	case 0xE000E5BC:
-		name = "NVIC_IPR111";
-		break;
-	case 0xE000E5C0:
-		name = "NVIC_IPR112";
-		break;
-	case 0xE000E5C4:
-		name = "NVIC_IPR113";
-		break;
-	case 0xE000E5C8:
-		name = "NVIC_IPR114";
-		break;
-	case 0xE000E5CC:
-		name = "NVIC_IPR115";
-		break;
-	case 0xE000E5D0:
-		name = "NVIC_IPR116";
-		break;
-	case 0xE000E5D4:
-		name = "NVIC_IPR117";
-		break;
-	case 0xE000E5D8:
-		name = "NVIC_IPR118";
-		break;
-	case 0xE000E5DC:
-		name = "NVIC_IPR119";
-		break;
-	case 0xE000E5E0:
-		name = "NVIC_IPR120";
-		break;
-	case 0xE000E5E4:
-		name = "NVIC_IPR121";
-		break;
-	case 0xE000E5E8:
-		name = "NVIC_IPR122";
-		break;
-	case 0xE000E5EC:
-		name = "NVIC_IPR123";
-		break;
-	case 0xE000EDF0:
-		name = "SCS_DHCSR";
-		break;
-	case 0xE000EDF4:
-		name = "SCS_DCRSR";
-		break;
-	case 0xE000EDF8:
-		name = "SCS_DCRDR";
-		break;
-	case 0xE000EDFC:
-		name = "SCS_DEMCR";
-		break;
-	case 0xE004E004:
-		name = "ICTR";
-		break;
-	case 0xE000ED00:
-		name = "CPUID";
-		break;
-	case 0xE000ED04:
-		name = "ICSR";
-		break;
-	case 0xE000ED08:
-		name = "VTOR";
-		break;
+	size_t low = 0;
+	size_t high = ADDRESS_NAMES_SIZE;
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		const struct address_name *entry =
+			&address_names[address_names_by_name[middle]];
+		int compare = strcmp(name, entry->name);
+		if (compare == 0) {
+			*address = entry->address;
+			return true;
+		}
+		else if (compare < 0) {
+			high = middle;
+		}
+		else {
+			low = middle + 1;
+		}
 	}
+	return false;
+}
 
-	return name;
+size_t get_address_names(uint32_t start, uint32_t end,
+                         const struct address_name **names)
+{
+	size_t first = lower_bound(start);
+	size_t last = end == 0 ? ADDRESS_NAMES_SIZE : lower_bound(end);
+	*names = &address_names[first];
+	return last > first ? last - first : 0;
 }
@@ -1,8 +1,23 @@
 #ifndef GET_ADDRESS_NAME
 #define GET_ADDRESS_NAME
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+struct address_name {
+	uint32_t address;
+	const char *name;
+};
+
 const char *get_address_name(uint32_t address);
 
+/* Reverse lookup, returns false if no register has the name */
+bool get_name_address(const char *name, uint32_t *address);
+
+/* All the named registers in [start, end), sorted by address, an end of 0
+   is the end of the address space */
+size_t get_address_names(uint32_t start, uint32_t end,
+                         const struct address_name **names);
+
 #endif
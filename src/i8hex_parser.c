@@ -13,8 +13,6 @@ static const uint8_t RECORD_BYTE_COUNT_MAX = 16;
 static const uint8_t RECORD_TYPE_DATA = 0;
 static const uint8_t RECORD_TYPE_END_OF_FILE = 1;
 
-static uint16_t address_valid = 0x00;
-
 struct record {
 	uint8_t byte_count;
 	uint16_t address;
@@ -174,18 +172,18 @@ static int parse(uint8_t *state, struct record *record, bool *valid, uint8_t c)
 }
 
 static void record_valid(struct record *record, uint8_t *data,
-                         size_t data_capacity) {
+                         size_t data_capacity, uint16_t *address_valid) {
 	if (record->type != RECORD_TYPE_DATA) {
 		return;
 	}
 
-	assert(record->address == address_valid);
+	assert(record->address == *address_valid);
 	for (uint16_t i = 0; i < record->byte_count; ++i) {
 		uint16_t data_i = record->address + i;
 		assert(data_i < data_capacity);
 		data[data_i] = record->data[i];
 	}
-	address_valid += record->byte_count;
+	*address_valid += record->byte_count;
 }
 
 enum i8hex_parse_result i8hex_parse(const char *path, uint8_t *data_ptr,
@@ -203,6 +201,7 @@ enum i8hex_parse_result i8hex_parse(const char *path, uint8_t *data_ptr,
 	uint8_t state = 0;
 	struct record record;
 	bool valid;
+	uint16_t address_valid = 0x00;
 
 	ssize_t bytes_read;
 	bytes_read = read(fd, buf, BUF_LENGTH);
@@ -214,7 +213,8 @@ enum i8hex_parse_result i8hex_parse(const char *path, uint8_t *data_ptr,
 				break;
 			}
 			if (valid) {
-				record_valid(&record, data_ptr, data_capacity);
+				record_valid(&record, data_ptr, data_capacity,
+				             &address_valid);
 			}
 			++i;
 		}
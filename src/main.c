@@ -16,21 +16,289 @@
  */
 
 #include "i8hex_parser.h"
+#include "run_options.h"
 #include "teensy_3_2.h"
 
-static uint8_t data[0x20008000];
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+static uint8_t data[0x10000];
+
+static bool parse_trace_level(const char *arg,
+                              enum teensy_3_2_trace_level *level)
+{
+	static const struct {
+		const char *arg;
+		enum teensy_3_2_trace_level level;
+	} levels[] = {
+		{ "--trace=none", TEENSY_3_2_TRACE_NONE },
+		{ "--trace=branches", TEENSY_3_2_TRACE_BRANCHES },
+		{ "--trace=instructions", TEENSY_3_2_TRACE_INSTRUCTIONS },
+		{ "--trace=full", TEENSY_3_2_TRACE_FULL },
+	};
+
+	for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i) {
+		if (strcmp(arg, levels[i].arg) == 0) {
+			*level = levels[i].level;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* A scenario is a line of run options, it carries on from the booted board
+   in a child so it can't change what the next one starts from */
+static bool scenario_parse(struct run_options *options,
+                           const struct run_options *boot, char *line)
+{
+	memset(options, 0, sizeof(struct run_options));
+	options->file = boot->file;
+	options->snapshot = boot->snapshot;
+	options->symbols = boot->symbols;
+	char *saved;
+	for (char *word = strtok_r(line, " \t", &saved); word != NULL;
+	     word = strtok_r(NULL, " \t", &saved)) {
+		if (!run_options_parse(options, word)) {
+			fprintf(stderr, "can't use %s\n", word);
+			return false;
+		}
+	}
+	return run_options_finish(options);
+}
+
+static void scenario_run(struct teensy_3_2 *board, const char *name,
+                         const struct run_options *options)
+{
+	teensy_3_2_continue(board);
+	struct teensy_3_2_run_result result =
+		teensy_3_2_emulate_until(board, NULL, 0, &options->control);
+	if (result.stop == TEENSY_3_2_STOP_INVALID) {
+		fprintf(stderr, "%s: a watched or written location can't be "
+		                "used\n", name);
+		fflush(stdout);
+		_exit(1);
+	}
+	run_result_print(name, &result);
+	fflush(stdout);
+	_exit(0);
+}
+
+/* Runs each scenario read from standard input in its own child, which
+   shares the booted board copy-on-write.  A scenario that fails an
+   assertion only takes its child down */
+static int fork_server(struct teensy_3_2 *board,
+                       const struct run_options *boot)
+{
+	int status = 0;
+	char *line = NULL;
+	size_t line_capacity = 0;
+	ssize_t length;
+	while ((length = getline(&line, &line_capacity, stdin)) != -1) {
+		while (length > 0 && (line[length - 1] == '\n'
+		                      || line[length - 1] == ' '
+		                      || line[length - 1] == '\t')) {
+			line[--length] = '\0';
+		}
+		size_t skip = strspn(line, " \t");
+		if (line[skip] == '\0' || line[skip] == '#') {
+			continue;
+		}
+		char *name = strdup(line + skip);
+		assert(name != NULL);
+
+		struct run_options options;
+		if (!scenario_parse(&options, boot, line + skip)) {
+			printf("%s: failed\n", name);
+			status = 3;
+			free(name);
+			continue;
+		}
+		fflush(stdout);
+		pid_t child = fork();
+		if (child == -1) {
+			perror("fork");
+			free(name);
+			status = 3;
+			break;
+		}
+		if (child == 0) {
+			scenario_run(board, name, &options);
+		}
+		int wait_status;
+		while (waitpid(child, &wait_status, 0) == -1) {
+			assert(errno == EINTR);
+		}
+		if (WIFSIGNALED(wait_status)) {
+			printf("%s: crashed (%s)\n", name,
+			       strsignal(WTERMSIG(wait_status)));
+			status = 3;
+		}
+		else if (WEXITSTATUS(wait_status) != 0) {
+			printf("%s: failed\n", name);
+			status = 3;
+		}
+		free(name);
+	}
+	free(line);
+	return status;
+}
+
+/* Runs the same instructions again on a new board with every block single
+   stepped, each instruction charged on its own has to add up to what the
+   blocks were charged */
+static bool cycles_check(const struct run_options *options, size_t data_size,
+                         const struct teensy_3_2_run_result *expected)
+{
+	struct teensy_3_2 *board = teensy_3_2_create();
+	if (options->snapshot != NULL
+	    && !teensy_3_2_snapshot_load(board, options->snapshot)) {
+		teensy_3_2_destroy(board);
+		return false;
+	}
+	struct teensy_3_2_run_control control = options->control;
+	control.instructions = expected->instructions;
+	control.single_step = true;
+	teensy_3_2_set_trace_level(TEENSY_3_2_TRACE_NONE);
+	struct teensy_3_2_run_result result =
+		teensy_3_2_emulate_until(board, data, data_size, &control);
+	teensy_3_2_destroy(board);
+	if (result.instructions != expected->instructions
+	    || result.pc != expected->pc
+	    || result.cycles != expected->cycles) {
+		fprintf(stderr, "single stepping stopped after %" PRIu64
+		                " instructions at %08X with %" PRIu64
+		                " cycles\n", result.instructions, result.pc,
+		        result.cycles);
+		return false;
+	}
+	return true;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: i8hex-reader [--trace=none|branches|"
+	                "instructions|full] [--trace-file=PATH] "
+	                "[--indexed-trace=PATH] [--branch-trace=PATH] "
+	                "[--instructions=N] [--until-pc=ADDRESS|SYMBOL] "
+	                "[--symbols=PATH] [--until-change=ADDRESS[:SIZE]] "
+	                "[--timeout=SECONDS] [--until-idle] "
+	                "[--write=ADDRESS[:SIZE]=VALUE] [--cycles] "
+	                "[--check-cycles] [--save-snapshot=PATH] "
+	                "[--fork-server] "
+	                "FILE|--snapshot=PATH\n");
+}
 
 int main(int argc, char **argv)
 {
-	if (argc != 2) {
+	enum teensy_3_2_trace_level level = TEENSY_3_2_TRACE_FULL;
+	const char *trace_file = NULL;
+	bool indexed = false;
+	const char *branch_trace = NULL;
+	struct run_options options = {0};
+	bool cycles = false;
+	bool check_cycles = false;
+	const char *save_snapshot = NULL;
+	bool serve = false;
+	int i = 1;
+	for (; i < argc; ++i) {
+		const char *value;
+		if ((value = option_value(argv[i], "--trace-file=")) != NULL) {
+			trace_file = value;
+		}
+		else if ((value = option_value(argv[i], "--indexed-trace="))
+		         != NULL) {
+			trace_file = value;
+			indexed = true;
+		}
+		else if ((value = option_value(argv[i], "--branch-trace="))
+		         != NULL) {
+			branch_trace = value;
+		}
+		else if (strcmp(argv[i], "--cycles") == 0) {
+			cycles = true;
+		}
+		else if (strcmp(argv[i], "--check-cycles") == 0) {
+			check_cycles = true;
+		}
+		else if (strcmp(argv[i], "--fork-server") == 0) {
+			serve = true;
+		}
+		else if ((value = option_value(argv[i], "--save-snapshot="))
+		         != NULL) {
+			save_snapshot = value;
+		}
+		else if (!parse_trace_level(argv[i], &level)
+		         && !run_options_parse(&options, argv[i])) {
+			break;
+		}
+	}
+	if (i < argc) {
+		usage();
+		return 1;
+	}
+	if (!run_options_finish(&options)) {
 		return 1;
 	}
+	teensy_3_2_set_trace_level(level);
 
-	size_t data_size;
-	if (i8hex_parse(argv[1], data, 0x10000, &data_size) == FAILURE) {
+	struct teensy_3_2 *board = teensy_3_2_create();
+	size_t data_size = 0;
+	if (options.snapshot != NULL) {
+		if (!teensy_3_2_snapshot_load(board, options.snapshot)) {
+			return 2;
+		}
+	}
+	else if (i8hex_parse(options.file, data, sizeof(data), &data_size)
+	         == FAILURE) {
 		return 2;
 	}
 
-	teensy_3_2_emulate(data, data_size);
-	return 0;
+	if (trace_file != NULL && !teensy_3_2_trace_open(trace_file, indexed)) {
+		perror(trace_file);
+		return 3;
+	}
+	if (branch_trace != NULL
+	    && !teensy_3_2_branch_trace_open(board, branch_trace)) {
+		perror(branch_trace);
+		return 3;
+	}
+	struct teensy_3_2_run_result result =
+		teensy_3_2_emulate_until(board, data, data_size,
+		                         &options.control);
+	teensy_3_2_trace_close();
+	teensy_3_2_branch_trace_close(board);
+	if (result.stop == TEENSY_3_2_STOP_INVALID) {
+		fprintf(stderr, "a watched or written location can't be "
+		                "used\n");
+		return 1;
+	}
+	teensy_3_2_watchdog_print(&result);
+	if (save_snapshot != NULL
+	    && !teensy_3_2_snapshot_save(board, save_snapshot)) {
+		perror(save_snapshot);
+		return 3;
+	}
+	if (options.limited || cycles) {
+		printf("Stopped (%s) after %" PRIu64 " instructions at "
+		       "%08X\n", teensy_3_2_stop_name(result.stop),
+		       result.instructions, result.pc);
+	}
+	if (cycles) {
+		printf("Cycles: %" PRIu64 "\n", result.cycles);
+	}
+	if (check_cycles && !cycles_check(&options, data_size, &result)) {
+		return 4;
+	}
+	// The run so far was the boot every scenario starts from
+	int status = serve ? fork_server(board, &options) : 0;
+	teensy_3_2_destroy(board);
+	return status;
 }
@@ -0,0 +1,224 @@
+/*
+ * Copyright 2017 Jonathan Eyolfson
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "run_options.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char *option_value(const char *arg, const char *option)
+{
+	size_t length = strlen(option);
+	if (strncmp(arg, option, length) != 0) {
+		return NULL;
+	}
+	return arg + length;
+}
+
+static bool parse_number(const char *text, int base, uint64_t *value)
+{
+	char *end;
+	errno = 0;
+	*value = strtoull(text, &end, base);
+	return errno == 0 && end != text && *end == '\0';
+}
+
+/* Symbols come from the output of nm run on the firmware's ELF file, the
+   Thumb bit of a function is cleared */
+static bool symbol_address(const char *path, const char *name,
+                           uint32_t *address)
+{
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		perror(path);
+		return false;
+	}
+	char line[512];
+	bool found = false;
+	while (!found && fgets(line, sizeof(line), file) != NULL) {
+		unsigned int value;
+		char type;
+		char symbol[256];
+		if (sscanf(line, "%x %c %255s", &value, &type, symbol) == 3
+		    && strcmp(symbol, name) == 0) {
+			*address = value & 0xFFFFFFFE;
+			found = true;
+		}
+	}
+	fclose(file);
+	return found;
+}
+
+/* A PC is a symbol if there's a symbol file with it, otherwise an address
+   in hex */
+static bool parse_pc(const char *text, const char *symbols, uint32_t *pc)
+{
+	if (symbols != NULL && symbol_address(symbols, text, pc)) {
+		return true;
+	}
+	uint64_t value;
+	if (!parse_number(text, 16, &value) || value > UINT32_MAX) {
+		return false;
+	}
+	*pc = value & 0xFFFFFFFE;
+	return true;
+}
+
+/* ADDRESS[:SIZE] in the first length characters of text, the size
+   defaults to a word */
+static bool parse_location(const char *text, size_t length,
+                           uint32_t *address, uint8_t *size)
+{
+	char copy[32];
+	if (length >= sizeof(copy)) {
+		return false;
+	}
+	memcpy(copy, text, length);
+	copy[length] = '\0';
+
+	const char *colon = strchr(copy, ':');
+	size_t address_length = colon != NULL ? (size_t) (colon - copy)
+	                                      : length;
+	copy[address_length] = '\0';
+	uint64_t value;
+	if (!parse_number(copy, 16, &value) || value > UINT32_MAX) {
+		return false;
+	}
+	*address = value;
+	*size = 4;
+	if (colon != NULL) {
+		if (!parse_number(colon + 1, 10, &value)
+		    || (value != 1 && value != 2 && value != 4)) {
+			return false;
+		}
+		*size = value;
+	}
+	return true;
+}
+
+static bool parse_watch(const char *text,
+                        struct teensy_3_2_run_control *control)
+{
+	return parse_location(text, strlen(text), &control->watch_address,
+	                      &control->watch_size);
+}
+
+/* ADDRESS[:SIZE]=VALUE, the value is in hex like the address */
+static bool parse_write(const char *text,
+                        struct teensy_3_2_run_control *control)
+{
+	const char *equals = strchr(text, '=');
+	if (equals == NULL || control->writes_size == TEENSY_3_2_WRITES) {
+		return false;
+	}
+	struct teensy_3_2_write *write =
+		&control->writes[control->writes_size];
+	uint64_t value;
+	if (!parse_location(text, equals - text, &write->address,
+	                    &write->size)
+	    || !parse_number(equals + 1, 16, &value)
+	    || value >> (8 * write->size) != 0) {
+		return false;
+	}
+	write->value = value;
+	++control->writes_size;
+	return true;
+}
+
+bool run_options_parse(struct run_options *options, const char *arg)
+{
+	struct teensy_3_2_run_control *control = &options->control;
+	const char *value;
+	if ((value = option_value(arg, "--instructions=")) != NULL) {
+		if (!parse_number(value, 0, &control->instructions)) {
+			return false;
+		}
+	}
+	else if ((value = option_value(arg, "--until-pc=")) != NULL) {
+		options->until_pc = value;
+	}
+	else if ((value = option_value(arg, "--until-change=")) != NULL) {
+		if (!parse_watch(value, control)) {
+			return false;
+		}
+	}
+	else if ((value = option_value(arg, "--timeout=")) != NULL) {
+		char *end;
+		control->seconds = strtod(value, &end);
+		if (end == value || *end != '\0' || control->seconds <= 0) {
+			return false;
+		}
+	}
+	else if (strcmp(arg, "--until-idle") == 0) {
+		control->until_idle = true;
+	}
+	else if ((value = option_value(arg, "--write=")) != NULL) {
+		return parse_write(value, control);
+	}
+	else if ((value = option_value(arg, "--symbols=")) != NULL) {
+		options->symbols = value;
+		return true;
+	}
+	else if ((value = option_value(arg, "--snapshot=")) != NULL) {
+		options->snapshot = value;
+		return true;
+	}
+	else if (arg[0] != '-' && options->file == NULL) {
+		options->file = arg;
+		return true;
+	}
+	else {
+		return false;
+	}
+	options->limited = true;
+	return true;
+}
+
+bool run_options_finish(struct run_options *options)
+{
+	if ((options->file == NULL) == (options->snapshot == NULL)) {
+		fprintf(stderr, "a run needs either a hex file or a "
+		                "snapshot\n");
+		return false;
+	}
+	if (options->until_pc != NULL) {
+		if (!parse_pc(options->until_pc, options->symbols,
+		              &options->control.pc)) {
+			fprintf(stderr, "unknown PC: %s\n", options->until_pc);
+			return false;
+		}
+		options->control.until_pc = true;
+	}
+	if (!options->limited) {
+		options->control.instructions =
+			TEENSY_3_2_DEFAULT_INSTRUCTIONS;
+	}
+	return true;
+}
+
+void run_result_print(const char *name,
+                      const struct teensy_3_2_run_result *result)
+{
+	printf("%s: stopped (%s) after %" PRIu64 " instructions at %08X, "
+	       "%" PRIu64 " cycles, watchdog %s\n", name,
+	       teensy_3_2_stop_name(result->stop), result->instructions,
+	       result->pc, result->cycles,
+	       result->watchdog_disabled ? "disabled" : "missed");
+}
@@ -0,0 +1,34 @@
+#ifndef RUN_OPTIONS_H
+#define RUN_OPTIONS_H
+
+#include "teensy_3_2.h"
+
+#include <stdbool.h>
+
+/* The options saying what to run and when to stop, shared by i8hex-reader
+   and batch-run.  The firmware comes from either a hex file or a
+   snapshot */
+struct run_options {
+	struct teensy_3_2_run_control control;
+	bool limited;            // any stop option given
+	const char *until_pc;    // address or symbol, resolved by finish
+	const char *symbols;
+	const char *file;
+	const char *snapshot;
+};
+
+/* Returns the text after an option's "--name=" prefix, or NULL */
+const char *option_value(const char *arg, const char *option);
+
+/* Returns false if arg isn't a run option or its value can't be used */
+bool run_options_parse(struct run_options *options, const char *arg);
+
+/* Resolves the PC and defaults the instruction limit once every option is
+   parsed, returns false after printing why the options can't be used */
+bool run_options_finish(struct run_options *options);
+
+/* One line with how a run stopped */
+void run_result_print(const char *name,
+                      const struct teensy_3_2_run_result *result);
+
+#endif
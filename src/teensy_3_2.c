@@ -1,190 +1,192 @@
 #include "teensy_3_2.h"
 
 #include "get_address_name.h"
+#include "trace_ring.h"
 
 #include <assert.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
-/* SRAM_L = [0x1FFF8000, 0x20000000)
- * SRAM_U = [0x20000000, 0x20007FFF)
- */
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-#define SRAM_LOWER 0x1FFF8000
-#define SRAM_UPPER 0x20007FFF
+#if defined(__x86_64__)
+#include "x86-64-compiler/x86_64.h"
+#endif
 
-static uint8_t program_flash[0x40000]; // 256 KiB
-static uint8_t eeprom[0x800];          //   2 KiB
-static uint8_t sram[0x10000];          //  64 KiB
+/* The branches level prints only the taken branches, instructions prints
+   the disassembly of every instruction (branches included) and full adds
+   every register, flag and memory access.  Building with TRACE_DISABLED
+   removes it all */
+static enum teensy_3_2_trace_level trace_level = TEENSY_3_2_TRACE_FULL;
 
-static uint8_t *flash;
+#if defined(TRACE_DISABLED)
+#define tracing(level) false
+#else
+#define tracing(level) (trace_level >= (level))
+#endif
 
-static uint32_t MCG_S_reads = 0;
-static uint32_t systick_millis_count_reads = 0;
+void teensy_3_2_set_trace_level(enum teensy_3_2_trace_level level)
+{
+	trace_level = level;
+}
 
-static uint8_t WDOG_state = 0;
+/* Every trace output is an event, either printed right away or queued for
+   the writer thread when tracing to a file */
+static bool trace_to_file;
 
-static uint8_t memory_read(uint32_t address)
+bool teensy_3_2_trace_open(const char *path, bool indexed)
 {
-	if (address < 0x08000000) {
-		return flash[address];
-	}
-	else if ((address >= SRAM_LOWER) && (address <= SRAM_UPPER)) {
-		// systick_millis_count
-		if (address == 0x1FFF8AE8) {
-			++systick_millis_count_reads;
-			if (systick_millis_count_reads == 1) {
-				return 0;
-			}
-			else if (systick_millis_count_reads == 2) {
-				return 4;
-			}
-			else if (systick_millis_count_reads == 3) {
-				return 4;
-			}
-			else if (systick_millis_count_reads == 4) {
-				return 4;
-			}
-			else if (systick_millis_count_reads == 5) {
-				return 4;
-			}
-			return 5;
-		}
-		return sram[address - SRAM_LOWER];
-	}
-	else if ((address >= 0x40000000) && (address <= 0x4007FFFF)) {
-		if (address == 0x40020000) {
-			return 0x80;
-		}
-		else if (address == 0x40064006) {
-			++MCG_S_reads;
-			if (MCG_S_reads == 1) {
-				return 0x02;
-			}
-			if (MCG_S_reads == 3) {
-				return 0x08;
-			}
-			if (MCG_S_reads == 4) {
-				return 0x20;
-			}
-			if (MCG_S_reads == 5) {
-				return 0x40;
-			}
-			if (MCG_S_reads == 6) {
-				return 0x0C;
-			}
-		}
-		return 0;
-	}
-	else if ((address >= 0x42000000) && (address <= 0x43FFFFFF)) {
-		// Intentionally left blank
-		return 0;
+	trace_to_file = trace_ring_open(path, indexed);
+	return trace_to_file;
+}
+
+void teensy_3_2_trace_close(void)
+{
+	if (trace_to_file) {
+		trace_ring_close();
+		trace_to_file = false;
 	}
-	else if ((address >= 0xE0000000) && (address <= 0xFFFFFFFF)) {
-		return 0;
+}
+
+static void trace_event(uint8_t type, uint8_t n, uint32_t address,
+                        uint32_t value)
+{
+	struct teensy_3_2_trace_event event = {
+		.type = type,
+		.n = n,
+		.address = address,
+		.value = value,
+	};
+	if (trace_to_file) {
+		trace_ring_push(&event);
 	}
 	else {
-		printf("memory_read(%08X)\n", address);
-		assert(false);
+		teensy_3_2_trace_event_print(&event);
 	}
 }
 
-static uint8_t memory_byte_read(uint32_t address)
+static void trace_register(uint8_t n, uint32_t value)
 {
-	uint8_t data = memory_read(address);
-	printf("  > READ (%s) MemU[%08X,1] = %02X\n",
-	       get_address_name(address), address, data);
-	return data;
+	if (tracing(TEENSY_3_2_TRACE_FULL)) {
+		trace_event(TEENSY_3_2_TRACE_EVENT_REGISTER, n, 0, value);
+	}
 }
 
-static uint16_t memory_halfword_read(uint32_t address)
+static void trace_register_load(uint8_t n, uint32_t value, uint32_t address)
 {
-	uint16_t data = memory_read(address)
-	              | (memory_read(address + 1) << 8);
-	// printf("  > READ MemU[%08X,2] = %04X\n", address, data);
-	return data;
+	if (tracing(TEENSY_3_2_TRACE_FULL)) {
+		trace_event(TEENSY_3_2_TRACE_EVENT_REGISTER_LOAD, n, address,
+		            value);
+	}
 }
 
-static uint32_t memory_word_read(uint32_t address)
+static void trace_pc(uint32_t value)
 {
-	uint32_t data =  memory_read(address)
-	                 | (memory_read(address + 1) << 8)
-	                 | (memory_read(address + 2) << 16)
-	                 | (memory_read(address + 3) << 24);
-	printf("  > READ (%s) MemU[%08X,4] = %08X\n",
-	       get_address_name(address), address, data);
-	return data;
+	if (tracing(TEENSY_3_2_TRACE_FULL)) {
+		trace_event(TEENSY_3_2_TRACE_EVENT_PC, 0, 0, value);
+	}
 }
 
-static void memory_write(uint32_t address, uint8_t data)
+static void trace_apsr(uint32_t value)
 {
-	if (address < 0x08000000) {
-		assert(false);
-		flash[address] = data;
-	}
-	else if ((address >= SRAM_LOWER) && (address <= SRAM_UPPER)) {
-		sram[address - SRAM_LOWER] = data;
-	}
-	else if ((address >= 0x40000000) && (address <= 0x400FFFFF)) {
-		// Intentionally left blank
-	}
-	else if ((address >= 0x42000000) && (address <= 0x43FFFFFF)) {
-		// Intentionally left blank
-	}
-	else if ((address >= 0xE0000000) && (address <= 0xE00FFFFF)) {
-		// Intentionally left blank
-	}
-	else {
-		assert(false);
+	if (tracing(TEENSY_3_2_TRACE_FULL)) {
+		trace_event(TEENSY_3_2_TRACE_EVENT_APSR, 0, 0, value);
 	}
 }
 
-static void memory_byte_write(uint32_t address, uint8_t data)
+static void trace_itstate(uint8_t value)
 {
-	const char *name = get_address_name(address);
-	printf("  > (%s) MemU[%08X,1] = %02X\n", name, address, data);
-	memory_write(address, data);
+	if (tracing(TEENSY_3_2_TRACE_FULL)) {
+		trace_event(TEENSY_3_2_TRACE_EVENT_ITSTATE, 0, 0, value);
+	}
 }
 
-static void memory_halfword_write(uint32_t address, uint16_t data)
+static void trace_read(uint32_t address, uint8_t size, uint32_t value)
 {
-	const char *name = get_address_name(address);
-	printf("  > (%s) MemU[%08X,2] = %04X\n", name, address, data);
-	memory_write(address    , data      );
-	memory_write(address + 1, data >>  8);
-
-	if (address == 0x4005200E && WDOG_state == 0 && data == 0xC520) {
-		WDOG_state = 1;
+	if (tracing(TEENSY_3_2_TRACE_FULL)) {
+		trace_event(TEENSY_3_2_TRACE_EVENT_READ, size, address, value);
 	}
-	else if (address == 0x4005200E && WDOG_state == 1 && data == 0xD928) {
-		WDOG_state = 2;
-	}
-	else if (address == 0x40052000 && WDOG_state == 2 && data == 0x0010) {
-		WDOG_state = 3;
+}
+
+static void trace_write(uint32_t address, uint8_t size, uint32_t value)
+{
+	if (tracing(TEENSY_3_2_TRACE_FULL)) {
+		trace_event(TEENSY_3_2_TRACE_EVENT_WRITE, size, address, value);
 	}
 }
 
-static void memory_word_write(uint32_t address, uint32_t data)
+static void trace_exception(uint8_t number, uint32_t from, uint32_t to)
 {
-	const char *name = get_address_name(address);
-	printf("  > (%s) MemU[%08X,4] = %08X\n", name, address, data);
-	memory_write(address    , data      );
-	memory_write(address + 1, data >>  8);
-	memory_write(address + 2, data >> 16);
-	memory_write(address + 3, data >> 24);
+	if (tracing(TEENSY_3_2_TRACE_BRANCHES)) {
+		trace_event(TEENSY_3_2_TRACE_EVENT_EXCEPTION, number, from, to);
+	}
 }
 
-static uint32_t word_at_address(uint32_t base)
+static void trace_note_higher_registers(void)
 {
-	return flash[base] +
-	       + (flash[base + 1] * 0x100)
-	       + (flash[base + 2] * 0x10000)
-	       + (flash[base + 3] * 0x1000000);
+	if (tracing(TEENSY_3_2_TRACE_FULL)) {
+		trace_event(TEENSY_3_2_TRACE_EVENT_NOTE_HIGHER_REGISTERS, 0, 0,
+		            0);
+	}
 }
 
+/* SRAM_L = [0x1FFF8000, 0x20000000)
+ * SRAM_U = [0x20000000, 0x20007FFF)
+ */
+
+#define SRAM_LOWER 0x1FFF8000
+#define SRAM_UPPER 0x20007FFF
+
+#define PROGRAM_FLASH_SIZE 0x40000 // 256 KiB
+#define EEPROM_SIZE 0x800          //   2 KiB
+#define SRAM_SIZE 0x10000          //  64 KiB
+
+/* Guest memory is looked up through 4 KiB pages.  A page backed by host
+   memory is accessed directly, everything else goes through the slow path,
+   which checks the peripheral registry and falls back to memory_read and
+   memory_write a byte at a time.  Direct accesses assume a little-endian
+   host, like the guest */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "direct guest memory accesses need a little-endian host"
+#endif
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (UINT32_C(1) << PAGE_SHIFT)
+#define PAGE_OFFSET_MASK (PAGE_SIZE - 1)
+
+/* A modelled peripheral, the callbacks get the whole access (1, 2 or 4
+   bytes) starting inside [start, start + size) */
+struct peripheral {
+	const char *name;
+	uint32_t start;
+	uint32_t size;
+	uint32_t (*read)(uint32_t address, uint8_t size);
+	void (*write)(uint32_t address, uint32_t data, uint8_t size);
+};
+
+struct page {
+	uint8_t *read;
+	uint8_t *write;
+	// Indexed by page offset, NULL if no peripheral is in the page
+	const struct peripheral **peripherals;
+};
+
 struct registers {
 	uint32_t r[16];
 	uint32_t apsr;
+	uint8_t flags_kind;
+	bool flags_carry;
+	uint32_t flags_x;
+	uint32_t flags_y;
 	uint32_t ipsr;
 	uint32_t epsr;
 	uint32_t primask;
@@ -192,1828 +194,2146 @@ struct registers {
 	uint8_t itstate;
 };
 
-struct AddWithCarry_Result {
-	uint32_t result;
-	bool carry_out;
-	bool overflow;
+/* A predecoded instruction, the decoders fill in the fields their encoding
+   uses and the execute function reads them back */
+struct inst {
+	void (*execute)(struct registers *registers, const struct inst *inst);
+	void (*disassemble)(const struct inst *inst);
+	uint32_t address;
+	uint32_t imm32;
+	uint16_t first_halfword;
+	uint16_t second_halfword;
+	uint16_t register_list;
+	uint8_t length;
+	uint8_t itstate;
+	uint8_t cond;
+	uint8_t d;
+	uint8_t n;
+	uint8_t m;
+	uint8_t t;
+	uint8_t a;
+	uint8_t shift_t;
+	uint8_t shift_n;
+	bool setflags;
+	bool index;
+	bool add;
+	bool wback;
+	bool carry;
+	bool carry_in;
+	bool nonzero;
 };
 
-enum SRType {
-	SRType_None,
-	SRType_LSL,
-	SRType_LSR,
-	SRType_ASR,
-	SRType_ROR,
-	SRType_RRX,
+/* Sources of scheduler events, see event_schedule */
+enum event_source {
+	EVENT_SYSTICK,
+	EVENT_PIT0,
+	EVENT_PIT1,
+	EVENT_PIT2,
+	EVENT_PIT3,
+	EVENT_SOURCES,
 };
 
-static bool is_branch;
-static bool is_it_inst;
+#define EVENT_NONE 0xFF
+
+#define EXCEPTIONS 111 // the vector table
+#define EXCEPTION_WORDS ((EXCEPTIONS + 31) / 32)
+
+/* A flash image is a program copied into a page-aligned mapping that's
+   made read-only afterwards, along with a cache of the instructions
+   decoded from it.  Both mappings are shared, so every board running the
+   image uses the same memory, in this process and in any forked from it
+   after the image was made.  Flash is immutable, so each instruction in it
+   is only decoded once, by the first board that runs it */
+enum inst_state {
+	INST_EMPTY,
+	INST_DECODING,
+	INST_DECODED,
+};
 
-struct ShiftTNTuple {
-	enum SRType shift_t;
-	uint8_t shift_n;
+struct teensy_3_2_flash {
+	uint8_t *data;             // PROGRAM_FLASH_SIZE bytes
+	struct inst *insts;        // one for each halfword
+	_Atomic uint8_t *states;   // an inst_state for each of insts
+	atomic_uint references;
 };
 
-struct ResultCarryTuple {
-	uint32_t result;
-	bool carry;
+#define FLASH_CACHE_SIZE \
+	(PROGRAM_FLASH_SIZE / 2 * (sizeof(struct inst) + 1))
+
+#define PIT_CHANNELS 4
+
+struct pit_channel {
+	uint32_t LDVAL;
+	uint32_t TCTRL;
+	uint32_t TFLG;
 };
 
-struct ResultCarryOverflowTuple {
-	uint32_t result;
-	bool carry;
-	bool overflow;
+/* An emulated board holds everything an emulation changes, so each thread
+   can run its own.  The code works on the board of the calling thread,
+   which the entry points set */
+struct teensy_3_2 {
+	struct teensy_3_2_flash *flash; // NULL until a program is loaded
+	uint8_t eeprom[EEPROM_SIZE];
+	uint8_t sram[SRAM_SIZE];
+	struct page pages[UINT32_C(1) << (32 - PAGE_SHIFT)];
+	bool peripherals_registered;
+
+	/* Every read off the direct path is counted, a loop that doesn't make
+	   any can only see memory that nothing else changes.  The reads of
+	   timer counters (SYST_CVR and PIT_CVALn) are a subset that only
+	   depends on the cycle count.  Stable reads are another subset that
+	   keep returning the same value while only the loop runs, like UART0
+	   once its input ran out */
+	uint32_t slow_reads;
+	uint32_t time_reads;
+	uint32_t stable_reads;
+
+	uint8_t WDOG_state;
+	uint32_t MCG_S_reads;
+	uint32_t SIM_CLKDIV1;
+	uint32_t flash_wait_states;
+	uint32_t core_divider;
+	uint32_t bus_divider;
+	uint32_t PIT_MCR;
+	struct pit_channel pit_channels[PIT_CHANNELS];
+	uint8_t UART0_C2;
+	// Received through UART0, see teensy_3_2_input
+	const uint8_t *input;
+	uint32_t input_size;
+	uint32_t input_next;
+
+	// Edge coverage, see teensy_3_2_coverage
+	uint8_t *coverage;
+	uint32_t coverage_previous;
+
+	uint64_t cycles; // guest cycles so far, see inst_cycles
+	bool after_load_store; // the last instruction pipelines with the next
+	uint64_t event_cycle[EVENT_SOURCES];
+	uint8_t event_heap[EVENT_SOURCES];
+	uint8_t event_index[EVENT_SOURCES]; // in event_heap, or EVENT_NONE
+	uint8_t events_scheduled;
+	uint64_t next_event;
+
+	uint32_t exception_pending[EXCEPTION_WORDS];
+	uint32_t exception_enabled[EXCEPTION_WORDS];
+	uint32_t exception_active[EXCEPTION_WORDS];
+	uint8_t exception_priority[EXCEPTIONS];
+	uint32_t pending_priorities;
+	uint32_t execution_priority;
+	uint32_t exception_current; // IPSR
+	uint32_t VTOR;
+	uint32_t exc_return;
+	uint32_t SYST_CSR;
+	uint32_t SYST_RVR;
+	uint32_t systick_value; // SYST_CVR while disabled
+
+	bool is_branch;
+	bool is_it_inst;
+	struct inst inst_uncached;
+	struct block *block_map[PROGRAM_FLASH_SIZE / 2];
+	uint8_t *jit_code;
+	size_t jit_code_size;
+	bool jit_disabled;
+	bool single_step; // see block_run
+	// The block running and its registers, see now
+	const struct block *running;
+	const struct registers *running_registers;
+
+	FILE *branch_trace;
+	uint8_t branch_trace_atoms;
+	uint8_t branch_trace_atom_count;
+	uint32_t branch_trace_address;
+	uint64_t branch_trace_count;
+	uint64_t branch_trace_next_sync;
+
+	// The registers an emulation stopped with, for a snapshot or to
+	// continue from
+	struct registers final_registers;
+	// Loaded by teensy_3_2_snapshot_load for the next emulation
+	const struct snapshot *snapshot;
+	// Set by teensy_3_2_continue for the next emulation
+	bool continuing;
 };
 
-static struct ResultCarryTuple LSL_C(uint32_t x, uint8_t shift)
+static _Thread_local struct teensy_3_2 *board;
+
+static uint64_t now(void);
+
+static uint8_t memory_read(uint32_t address)
 {
-	assert(shift > 0);
-	uint64_t extended_x = x;
-	extended_x <<= shift;
-	struct ResultCarryTuple T;
-	T.result = (extended_x & 0xFFFFFFFF);
-	T.carry = (extended_x & 0x100000000);
-	return T;
+	if (address < PROGRAM_FLASH_SIZE) {
+		return board->flash->data[address];
+	}
+	else if (address < 0x08000000) {
+		return 0;
+	}
+	else if ((address >= SRAM_LOWER) && (address <= SRAM_UPPER)) {
+		return board->sram[address - SRAM_LOWER];
+	}
+	else if ((address >= 0x40000000) && (address <= 0x4007FFFF)) {
+		// Intentionally left blank
+		return 0;
+	}
+	else if ((address >= 0x42000000) && (address <= 0x43FFFFFF)) {
+		// Intentionally left blank
+		return 0;
+	}
+	else if ((address >= 0xE0000000) && (address <= 0xFFFFFFFF)) {
+		return 0;
+	}
+	else {
+		printf("memory_read(%08X)\n", address);
+		assert(false);
+	}
 }
 
-static uint32_t LSL(uint32_t x, uint8_t shift)
+static void memory_write(uint32_t address, uint8_t data)
 {
-	if (shift == 0) {
-		return x;
+	if (address < 0x08000000) {
+		assert(false);
+	}
+	else if ((address >= SRAM_LOWER) && (address <= SRAM_UPPER)) {
+		board->sram[address - SRAM_LOWER] = data;
+	}
+	else if ((address >= 0x40000000) && (address <= 0x400FFFFF)) {
+		// Intentionally left blank
+	}
+	else if ((address >= 0x42000000) && (address <= 0x43FFFFFF)) {
+		// Intentionally left blank
+	}
+	else if ((address >= 0xE0000000) && (address <= 0xE00FFFFF)) {
+		// Intentionally left blank
 	}
 	else {
-		struct ResultCarryTuple T = LSL_C(x, shift);
-		return T.result;
+		assert(false);
 	}
 }
 
-static struct ResultCarryTuple LSR_C(uint32_t x, uint8_t shift)
+static void pages_map(uint32_t start, uint32_t size, uint8_t *host,
+                      bool read, bool write)
 {
-	assert(shift > 0);
-	uint64_t extended_x = x;
-	struct ResultCarryTuple T;
-	T.result = (extended_x >> shift) & 0xFFFFFFFF;
-	T.carry = ((extended_x >> (shift - 1)) & 0x1) == 0x1;
-	return T;
+	assert((start & PAGE_OFFSET_MASK) == 0);
+	assert((size & PAGE_OFFSET_MASK) == 0);
+	for (uint32_t offset = 0; offset < size; offset += PAGE_SIZE) {
+		struct page *page =
+			&board->pages[(start + offset) >> PAGE_SHIFT];
+		page->read = read ? host + offset : NULL;
+		page->write = write ? host + offset : NULL;
+	}
 }
 
-static uint32_t LSR(uint32_t x, uint8_t shift)
+/* Registering a peripheral takes its pages off the direct path */
+static void peripheral_register(const struct peripheral *peripheral)
 {
-	if (shift == 0) {
-		return x;
+	for (uint32_t i = 0; i < peripheral->size; ++i) {
+		uint32_t address = peripheral->start + i;
+		struct page *page = &board->pages[address >> PAGE_SHIFT];
+		page->read = NULL;
+		page->write = NULL;
+		if (page->peripherals == NULL) {
+			page->peripherals = calloc(PAGE_SIZE,
+			                           sizeof(struct peripheral *));
+			assert(page->peripherals != NULL);
+		}
+		page->peripherals[address & PAGE_OFFSET_MASK] = peripheral;
 	}
-	else {
-		struct ResultCarryTuple T = LSR_C(x, shift);
-		return T.result;
+}
+
+static const struct peripheral *peripheral_lookup(uint32_t address)
+{
+	const struct page *page = &board->pages[address >> PAGE_SHIFT];
+	if (page->peripherals == NULL) {
+		return NULL;
 	}
+	return page->peripherals[address & PAGE_OFFSET_MASK];
 }
 
-static struct ResultCarryTuple ASR_C(uint32_t x, uint8_t shift)
+/* Returns NULL if the access has to take the slow path */
+static uint8_t *page_read(uint32_t address, uint32_t size)
 {
-	assert(shift > 0);
-	uint64_t extended_x = x;
-	if ((x & 0x80000000) == 0x80000000) {
-		extended_x |= ((uint64_t) 0xFFFFFFFF00000000);
+	const struct page *page = &board->pages[address >> PAGE_SHIFT];
+	uint32_t offset = address & PAGE_OFFSET_MASK;
+	if (page->read == NULL || offset + size > PAGE_SIZE) {
+		return NULL;
 	}
-	struct ResultCarryTuple T;
-	T.result = (extended_x >> shift) & 0xFFFFFFFF;
-	T.carry = (extended_x & (1 << (shift - 1)))
-	          == (((uint64_t) 1) << (shift - 1));
-	return T;
+	return page->read + offset;
 }
 
-static struct ResultCarryTuple ROR_C(uint32_t x, uint8_t shift)
+static uint8_t *page_write(uint32_t address, uint32_t size)
 {
-	assert(shift != 0);
-	uint8_t m = shift % 32;
-	struct ResultCarryTuple T;
-	T.result = LSR(x, m) | LSL(x, 32 - m);
-	T.carry = (T.result & 0x80000000) == 0x80000000;
-	return T;
+	const struct page *page = &board->pages[address >> PAGE_SHIFT];
+	uint32_t offset = address & PAGE_OFFSET_MASK;
+	if (page->write == NULL || offset + size > PAGE_SIZE) {
+		return NULL;
+	}
+	return page->write + offset;
 }
 
-static struct ResultCarryTuple Shift_C(uint32_t value, enum SRType type,
-                                       uint8_t amount, bool carry_in)
+/* An access starting in a peripheral goes to it whole, otherwise each byte
+   is looked up on its own */
+static uint32_t memory_slow_read(uint32_t address, uint8_t size)
 {
-	struct ResultCarryTuple T;
-	if (amount == 0) {
-		T.result = value;
-		T.carry = carry_in;
+	++board->slow_reads;
+	const struct peripheral *peripheral = peripheral_lookup(address);
+	if (peripheral != NULL && peripheral->read != NULL) {
+		return peripheral->read(address, size);
 	}
-	else {
-		switch (type) {
-		case SRType_LSL:
-			T = LSL_C(value, amount);
-			break;
-		case SRType_LSR:
-			T = LSR_C(value, amount);
-			break;
-		case SRType_ASR:
-			T = ASR_C(value, amount);
-			break;
-		case SRType_ROR:
-			T = ROR_C(value, amount);
-			break;
-		default:
-			assert(false);
+
+	uint32_t data = 0;
+	for (uint8_t i = 0; i < size; ++i) {
+		uint8_t byte;
+		peripheral = peripheral_lookup(address + i);
+		if (peripheral != NULL && peripheral->read != NULL) {
+			byte = peripheral->read(address + i, 1);
+		}
+		else {
+			byte = memory_read(address + i);
 		}
+		data |= byte << (8 * i);
 	}
-
-	return T;
+	return data;
 }
 
-static uint32_t Shift(uint32_t value, enum SRType type,
-                      uint8_t amount, bool carry_in)
+static void memory_slow_write(uint32_t address, uint32_t data, uint8_t size)
 {
-	struct ResultCarryTuple T = Shift_C(value, type, amount, carry_in);
-	return T.result;
-}
+	const struct peripheral *peripheral = peripheral_lookup(address);
+	if (peripheral != NULL && peripheral->write != NULL) {
+		peripheral->write(address, data, size);
+		return;
+	}
 
-uint8_t APSR_N(struct registers *registers)
-{
-	return (registers->apsr & 0x80000000) >> 31;
+	for (uint8_t i = 0; i < size; ++i) {
+		uint8_t byte = data >> (8 * i);
+		peripheral = peripheral_lookup(address + i);
+		if (peripheral != NULL && peripheral->write != NULL) {
+			peripheral->write(address + i, byte, 1);
+		}
+		else {
+			memory_write(address + i, byte);
+		}
+	}
 }
 
-uint8_t APSR_Z(struct registers *registers)
+static uint8_t memory_byte_read(uint32_t address)
 {
-	return (registers->apsr & 0x40000000) >> 30;
+	uint8_t *host = page_read(address, 1);
+	uint8_t data = host != NULL ? *host : memory_slow_read(address, 1);
+	trace_read(address, 1, data);
+	return data;
 }
 
-uint8_t APSR_C(struct registers *registers)
+static uint16_t memory_halfword_read(uint32_t address)
 {
-	return (registers->apsr & 0x20000000) >> 29;
+	uint16_t data;
+	uint8_t *host = page_read(address, 2);
+	if (host != NULL) {
+		memcpy(&data, host, 2);
+	}
+	else {
+		data = memory_slow_read(address, 2);
+	}
+	// printf("  > READ MemU[%08X,2] = %04X\n", address, data);
+	return data;
 }
 
-uint8_t APSR_V(struct registers *registers)
+static uint32_t memory_word_read(uint32_t address)
 {
-	return (registers->apsr & 0x10000000) >> 28;
+	uint32_t data;
+	uint8_t *host = page_read(address, 4);
+	if (host != NULL) {
+		memcpy(&data, host, 4);
+	}
+	else {
+		data = memory_slow_read(address, 4);
+	}
+	trace_read(address, 4, data);
+	return data;
 }
 
-uint8_t APSR_Q(struct registers *registers)
+static void memory_byte_write(uint32_t address, uint8_t data)
 {
-	return (registers->apsr & 0x08000000) >> 27;
+	trace_write(address, 1, data);
+	uint8_t *host = page_write(address, 1);
+	if (host != NULL) {
+		*host = data;
+	}
+	else {
+		memory_slow_write(address, data, 1);
+	}
 }
 
-void APSR_N_set(struct registers *registers)
+static void memory_halfword_write(uint32_t address, uint16_t data)
 {
-	registers->apsr |= 0x80000000;
+	trace_write(address, 2, data);
+	uint8_t *host = page_write(address, 2);
+	if (host != NULL) {
+		memcpy(host, &data, 2);
+	}
+	else {
+		memory_slow_write(address, data, 2);
+	}
 }
 
-void APSR_Z_set(struct registers *registers)
+static void memory_word_write(uint32_t address, uint32_t data)
 {
-	registers->apsr |= 0x40000000;
+	trace_write(address, 4, data);
+	uint8_t *host = page_write(address, 4);
+	if (host != NULL) {
+		memcpy(host, &data, 4);
+	}
+	else {
+		memory_slow_write(address, data, 4);
+	}
 }
 
-void APSR_C_set(struct registers *registers)
+/* Peripheral models, only as much as the firmware needs to boot */
+
+// FTFL_FSTAT always reports the flash command as complete (CCIF)
+static uint32_t FTFL_read(uint32_t address, uint8_t size)
 {
-	registers->apsr |= 0x20000000;
+	return 0x80;
 }
 
-void APSR_V_set(struct registers *registers)
+// MCG_S steps through the clock mode changes the startup code waits for
+
+static uint32_t MCG_S_read(uint32_t address, uint8_t size)
 {
-	registers->apsr |= 0x10000000;
+	++board->MCG_S_reads;
+	if (board->MCG_S_reads == 1) {
+		return 0x02;
+	}
+	if (board->MCG_S_reads == 3) {
+		return 0x08;
+	}
+	if (board->MCG_S_reads == 4) {
+		return 0x20;
+	}
+	if (board->MCG_S_reads == 5) {
+		return 0x40;
+	}
+	if (board->MCG_S_reads == 6) {
+		return 0x0C;
+	}
+	return 0;
 }
 
-void APSR_N_clear(struct registers *registers)
+/* Discrete-event scheduler, a timer schedules the cycle of its next event
+   (reaching zero, a compare match, ...) instead of being ticked.  Each
+   source has at most one event, they're kept in a min-heap on the cycle
+   and the emulator only compares cycles with next_event between blocks */
+static void event_place(uint8_t i, uint8_t source)
 {
-	registers->apsr &= ~0x80000000;
+	board->event_heap[i] = source;
+	board->event_index[source] = i;
 }
 
-void APSR_Z_clear(struct registers *registers)
+/* Moves the event at i up or down to where its cycle belongs */
+static void event_sift(uint8_t i)
 {
-	registers->apsr &= ~0x40000000;
+	uint8_t source = board->event_heap[i];
+	uint64_t cycle = board->event_cycle[source];
+	while (i > 0
+	       && board->event_cycle[board->event_heap[(i - 1) / 2]] > cycle) {
+		event_place(i, board->event_heap[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	while (2 * i + 1 < board->events_scheduled) {
+		uint8_t child = 2 * i + 1;
+		if (child + 1 < board->events_scheduled
+		    && board->event_cycle[board->event_heap[child + 1]]
+		       < board->event_cycle[board->event_heap[child]]) {
+			++child;
+		}
+		if (board->event_cycle[board->event_heap[child]] >= cycle) {
+			break;
+		}
+		event_place(i, board->event_heap[child]);
+		i = child;
+	}
+	event_place(i, source);
 }
 
-void APSR_C_clear(struct registers *registers)
+static bool event_scheduled(enum event_source source)
 {
-	registers->apsr &= ~0x20000000;
+	return board->event_index[source] != EVENT_NONE;
 }
 
-void APSR_V_clear(struct registers *registers)
+/* Replaces the event of a source if it already has one */
+static void event_schedule(enum event_source source, uint64_t cycle)
 {
-	registers->apsr &= ~0x10000000;
+	board->event_cycle[source] = cycle;
+	if (!event_scheduled(source)) {
+		event_place(board->events_scheduled, source);
+		++board->events_scheduled;
+	}
+	event_sift(board->event_index[source]);
+	board->next_event = board->event_cycle[board->event_heap[0]];
 }
 
-void setflags_ResultCarryTuple(struct registers *registers,
-                               struct ResultCarryTuple T)
+static void event_cancel(enum event_source source)
 {
-	if ((T.result & 0x80000000) == 0x80000000) { APSR_N_set(registers); }
-	else                                       { APSR_N_clear(registers); }
-
-	if (T.result == 0) { APSR_Z_set(registers); }
-	else               { APSR_Z_clear(registers); }
-
-	if (T.carry) { APSR_C_set(registers); }
-	else         { APSR_C_clear(registers); }
+	if (!event_scheduled(source)) {
+		return;
+	}
+	uint8_t i = board->event_index[source];
+	board->event_index[source] = EVENT_NONE;
+	--board->events_scheduled;
+	if (i < board->events_scheduled) {
+		event_place(i, board->event_heap[board->events_scheduled]);
+		event_sift(i);
+	}
+	board->next_event = board->events_scheduled != 0
+	                    ? board->event_cycle[board->event_heap[0]]
+	                    : UINT64_MAX;
 }
 
-void setflags_ResultCarryOverflowTuple(struct registers *registers,
-                                       struct ResultCarryOverflowTuple T)
+static void events_reset(void)
 {
-	if ((T.result & 0x80000000) == 0x80000000) { APSR_N_set(registers); }
-	else                                       { APSR_N_clear(registers); }
-
-	if (T.result == 0) { APSR_Z_set(registers); }
-	else               { APSR_Z_clear(registers); }
+	memset(board->event_index, EVENT_NONE, sizeof(board->event_index));
+	board->events_scheduled = 0;
+	board->next_event = UINT64_MAX;
+}
 
-	if (T.carry) { APSR_C_set(registers); }
-	else         { APSR_C_clear(registers); }
+/* Exceptions are tracked by number in bitmasks, numbers below 16 are the
+   system exceptions and the rest are IRQs.  Only SVCall, PendSV, SysTick
+   and the IRQs have a priority, the upper 4 bits of it are implemented.
+   pending_priorities has bit p set while an enabled exception of priority
+   p is pending, the emulator only checks it between blocks */
+#define EXCEPTION_PENDSV 14
+#define EXCEPTION_SYSTICK 15
+#define EXCEPTION_IRQ0 16
+#define PRIORITY_THREAD 0x100
 
-	if (T.overflow) { APSR_V_set(registers); }
-	else            { APSR_V_clear(registers); }
+static bool exception_bit(const uint32_t *bits, uint32_t number)
+{
+	return (bits[number / 32] & (UINT32_C(1) << (number % 32))) != 0;
 }
 
-struct ResultCarryOverflowTuple AddWithCarry(uint32_t x, uint32_t y, bool carry_in)
+static void exception_bit_set(uint32_t *bits, uint32_t number, bool value)
 {
-	struct ResultCarryOverflowTuple T;
-
-
-	uint64_t unsigned_sum = ((uint64_t) x) + ((uint64_t) y);
-	if (carry_in) unsigned_sum += 1;
+	if (number >= EXCEPTIONS) {
+		return;
+	}
+	if (value) {
+		bits[number / 32] |= UINT32_C(1) << (number % 32);
+	}
+	else {
+		bits[number / 32] &= ~(UINT32_C(1) << (number % 32));
+	}
+}
 
-	int64_t signed_sum = ((int32_t) x) + ((int32_t) y);
-	if (carry_in) signed_sum += 1;
+/* Rebuilt whenever a pending, enabled, active or priority bit changes */
+static void exceptions_update(void)
+{
+	board->pending_priorities = 0;
+	board->execution_priority = PRIORITY_THREAD;
+	for (uint32_t number = 0; number < EXCEPTIONS; ++number) {
+		uint32_t priority = board->exception_priority[number];
+		if (exception_bit(board->exception_pending, number)
+		    && exception_bit(board->exception_enabled, number)) {
+			board->pending_priorities |=
+				UINT32_C(1) << (priority >> 4);
+		}
+		if (exception_bit(board->exception_active, number)
+		    && priority < board->execution_priority) {
+			board->execution_priority = priority;
+		}
+	}
+}
 
-	T.result = (unsigned_sum & 0xFFFFFFFF);
+static void exception_pend(uint32_t number, bool pending)
+{
+	exception_bit_set(board->exception_pending, number, pending);
+	exceptions_update();
+}
 
-	if (((uint64_t) T.result) == unsigned_sum)
-		T.carry = false;
-	else
-		T.carry = true;
+/* The lowest numbered pending exception of the highest priority */
+static uint32_t exception_highest_pending(void)
+{
+	for (uint32_t number = 0; number < EXCEPTIONS; ++number) {
+		if (exception_bit(board->exception_pending, number)
+		    && exception_bit(board->exception_enabled, number)
+		    && board->exception_priority[number] >> 4
+		       == (uint32_t) __builtin_ctz(board->pending_priorities)) {
+			return number;
+		}
+	}
+	return 0;
+}
 
-	if (((int64_t) ((int32_t) T.result)) == signed_sum)
-		T.overflow = false;
-	else
-		T.overflow = true;
+/* SysTick counts down core cycles (the reference clock is taken to be the
+   core clock too) from SYST_RVR to 0, the cycle it next reaches 0 is
+   scheduled as an event */
+#define SYST_CSR_ENABLE 0x00000001
+#define SYST_CSR_TICKINT 0x00000002
+#define SYST_CSR_CLKSOURCE 0x00000004
+#define SYST_CSR_COUNTFLAG 0x00010000
 
-	return T;
+static uint32_t systick_current(void)
+{
+	if ((board->SYST_CSR & SYST_CSR_ENABLE) == 0) {
+		return board->systick_value;
+	}
+	uint64_t cycles = now();
+	if (!event_scheduled(EVENT_SYSTICK)
+	    || cycles >= board->event_cycle[EVENT_SYSTICK]) {
+		return 0;
+	}
+	return board->event_cycle[EVENT_SYSTICK] - cycles;
 }
 
-void ITAdvance(struct registers *registers)
+static void systick_start(uint32_t value)
 {
-	if ((registers->itstate & 0b00000111) == 0b00000000) {
-		registers->itstate = 0;
+	if (value != 0) {
+		event_schedule(EVENT_SYSTICK, now() + value);
+	}
+	else if (board->SYST_RVR != 0) {
+		event_schedule(EVENT_SYSTICK, now() + 1 + board->SYST_RVR);
 	}
 	else {
-		uint8_t old_state = registers->itstate & 0b00011111;
-		uint8_t new_state = (old_state << 1) & 0b00011111;
-		registers->itstate = (registers->itstate & 0b11100000)
-		                     | new_state;
+		event_cancel(EVENT_SYSTICK);
 	}
-	printf("  > ITSTATE = %02X\n", registers->itstate);
 }
 
-bool InITBlock(struct registers *registers)
+/* Events only run between blocks, a late one counts every wrap it missed
+   but only pends SysTick once */
+static void systick_wrap(enum event_source source)
 {
-	return (registers->itstate & 0b00001111) != 0b0000;
+	board->SYST_CSR |= SYST_CSR_COUNTFLAG;
+	if ((board->SYST_CSR & SYST_CSR_TICKINT) != 0) {
+		exception_pend(EXCEPTION_SYSTICK, true);
+	}
+	if (board->SYST_RVR == 0) {
+		return;
+	}
+	uint64_t period = board->SYST_RVR + 1;
+	uint64_t next = board->event_cycle[source];
+	event_schedule(source,
+	               next + ((board->cycles - next) / period + 1) * period);
 }
 
-bool LastInITBlock(struct registers *registers)
+/* The system control space is modelled a word at a time, byte and
+   halfword accesses only change the bytes in mask */
+static uint32_t scs_word_read(uint32_t address)
 {
-	return (registers->itstate & 0b00001111) == 0b1000;
+	if (address == 0xE000E010) {
+		uint32_t value = board->SYST_CSR;
+		board->SYST_CSR &= ~SYST_CSR_COUNTFLAG;
+		return value;
+	}
+	else if (address == 0xE000E014) {
+		return board->SYST_RVR;
+	}
+	else if (address == 0xE000E018) {
+		++board->time_reads;
+		return systick_current();
+	}
+	else if (address >= 0xE000E100 && address < 0xE000E300) {
+		uint32_t *bits = address < 0xE000E200
+		                 ? board->exception_enabled
+		                 : board->exception_pending;
+		uint32_t first = EXCEPTION_IRQ0 + 32 * ((address % 0x80) / 4);
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < 32 && first + i < EXCEPTIONS; ++i) {
+			value |= (uint32_t) exception_bit(bits, first + i) << i;
+		}
+		return value;
+	}
+	else if (address >= 0xE000E400 && address < 0xE000E500) {
+		uint32_t first = EXCEPTION_IRQ0 + (address - 0xE000E400);
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < 4 && first + i < EXCEPTIONS; ++i) {
+			value |= board->exception_priority[first + i]
+			         << (8 * i);
+		}
+		return value;
+	}
+	else if (address == 0xE000ED04) {
+		uint32_t value = board->exception_current;
+		if (board->pending_priorities != 0) {
+			value |= 0x00400000 // ISRPENDING
+			         | (exception_highest_pending() << 12);
+		}
+		if (exception_bit(board->exception_pending, EXCEPTION_PENDSV)) {
+			value |= 0x10000000;
+		}
+		if (exception_bit(board->exception_pending,
+		                  EXCEPTION_SYSTICK)) {
+			value |= 0x04000000;
+		}
+		return value;
+	}
+	else if (address == 0xE000ED08) {
+		return board->VTOR;
+	}
+	else if (address == 0xE000ED0C) {
+		return 0xFA050000;
+	}
+	else if (address >= 0xE000ED18 && address < 0xE000ED24) {
+		uint32_t first = 4 + (address - 0xE000ED18);
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < 4; ++i) {
+			value |= board->exception_priority[first + i]
+			         << (8 * i);
+		}
+		return value;
+	}
+	return 0;
 }
 
-uint8_t CurrentCond(struct registers *registers)
+static void scs_word_write(uint32_t address, uint32_t data, uint32_t mask)
 {
-	// Directly from branch instructions
-	uint16_t first_halfword = memory_halfword_read(registers->r[15]);
-	if ((first_halfword & 0xF000) == 0xD000) {
-		uint8_t cond = (first_halfword & 0x0F00) >> 8;
-		return cond;
+	data &= mask;
+	if (address == 0xE000E010) {
+		bool was_enabled = (board->SYST_CSR & SYST_CSR_ENABLE) != 0;
+		if (was_enabled) {
+			board->systick_value = systick_current();
+		}
+		uint32_t writable = SYST_CSR_ENABLE | SYST_CSR_TICKINT
+		                    | SYST_CSR_CLKSOURCE;
+		board->SYST_CSR = (board->SYST_CSR & ~(writable & mask))
+		                  | (data & writable);
+		if ((board->SYST_CSR & SYST_CSR_ENABLE) != 0) {
+			systick_start(board->systick_value);
+		}
+		else {
+			event_cancel(EVENT_SYSTICK);
+		}
+	}
+	else if (address == 0xE000E014) {
+		board->SYST_RVR = ((board->SYST_RVR & ~mask) | data)
+		                  & 0x00FFFFFF;
 	}
-	else if ((first_halfword & 0xF800) == 0xF000) {
-		uint16_t second_halfword = memory_halfword_read(registers->r[15] + 2);
-		if ((second_halfword & 0xD000) == 0x8000) {
-			uint8_t cond = (first_halfword & 0x03C0) >> 6;
-			return cond;
+	else if (address == 0xE000E018) {
+		board->SYST_CSR &= ~SYST_CSR_COUNTFLAG;
+		board->systick_value = 0;
+		if ((board->SYST_CSR & SYST_CSR_ENABLE) != 0) {
+			systick_start(0);
 		}
 	}
-
-	if (InITBlock(registers)) {
-		return (registers->itstate & 0xF0) >> 4;
+	else if (address >= 0xE000E100 && address < 0xE000E300) {
+		uint32_t *bits = address < 0xE000E200
+		                 ? board->exception_enabled
+		                 : board->exception_pending;
+		bool set = (address % 0x100) < 0x80;
+		uint32_t first = EXCEPTION_IRQ0 + 32 * ((address % 0x80) / 4);
+		for (uint32_t i = 0; i < 32; ++i) {
+			if ((data & (UINT32_C(1) << i)) != 0) {
+				exception_bit_set(bits, first + i, set);
+			}
+		}
+		exceptions_update();
+	}
+	else if (address >= 0xE000E400 && address < 0xE000E500) {
+		uint32_t first = EXCEPTION_IRQ0 + (address - 0xE000E400);
+		for (uint32_t i = 0; i < 4 && first + i < EXCEPTIONS; ++i) {
+			if ((mask & (0xFF << (8 * i))) != 0) {
+				board->exception_priority[first + i] =
+					data >> (8 * i) & 0xF0;
+			}
+		}
+		exceptions_update();
+	}
+	else if (address == 0xE000ED04) {
+		if ((data & 0x10000000) != 0) {
+			exception_pend(EXCEPTION_PENDSV, true);
+		}
+		if ((data & 0x08000000) != 0) {
+			exception_pend(EXCEPTION_PENDSV, false);
+		}
+		if ((data & 0x04000000) != 0) {
+			exception_pend(EXCEPTION_SYSTICK, true);
+		}
+		if ((data & 0x02000000) != 0) {
+			exception_pend(EXCEPTION_SYSTICK, false);
+		}
+	}
+	else if (address == 0xE000ED08) {
+		board->VTOR = ((board->VTOR & ~mask) | data) & 0x3FFFFF80;
+	}
+	else if (address >= 0xE000ED18 && address < 0xE000ED24) {
+		uint32_t first = 4 + (address - 0xE000ED18);
+		for (uint32_t i = 0; i < 4; ++i) {
+			if ((mask & (0xFF << (8 * i))) != 0) {
+				board->exception_priority[first + i] =
+					data >> (8 * i) & 0xF0;
+			}
+		}
+		exceptions_update();
 	}
+}
 
-	return 0b1111; // TODO
+static uint32_t scs_read(uint32_t address, uint8_t size)
+{
+	return scs_word_read(address & ~UINT32_C(3)) >> (8 * (address & 3));
 }
 
-bool ConditionPassed(struct registers *registers)
+static void scs_write(uint32_t address, uint32_t data, uint8_t size)
 {
-	uint8_t cond = CurrentCond(registers);
+	uint8_t shift = 8 * (address & 3);
+	uint32_t mask = size == 4 ? 0xFFFFFFFF
+	                          : ((UINT32_C(1) << (8 * size)) - 1) << shift;
+	scs_word_write(address & ~UINT32_C(3), data << shift, mask);
+}
 
-	bool result;
-	switch (cond & 0b1110) {
-	case 0b0000:
-		result = APSR_Z(registers) == 1;
-		break;
-	case 0b0010:
-		result = APSR_C(registers) == 1;
-		break;
-	case 0b0100:
-		result = APSR_N(registers) == 1;
-		break;
-	case 0b0110:
-		result = APSR_V(registers) == 1;
-		break;
-	case 0b1000:
-		result = (APSR_C(registers) == 1) && (APSR_Z(registers) == 0);
-		break;
-	case 0b1010:
-		result = APSR_N(registers) == APSR_V(registers);
-		break;
-	case 0b1100:
-		result = (APSR_N(registers) == APSR_V(registers))
-		         && (APSR_Z(registers) == 0);
-		break;
-	case 0b1110:
-		result = true;
-		break;
+static void exceptions_reset(void)
+{
+	memset(board->exception_pending, 0, sizeof(board->exception_pending));
+	memset(board->exception_active, 0, sizeof(board->exception_active));
+	memset(board->exception_priority, 0, sizeof(board->exception_priority));
+	memset(board->exception_enabled, 0, sizeof(board->exception_enabled));
+	for (uint32_t number = 4; number < EXCEPTION_IRQ0; ++number) {
+		exception_bit_set(board->exception_enabled, number, true);
 	}
+	board->exception_current = 0;
+	board->VTOR = 0;
+	board->SYST_CSR = 0;
+	board->SYST_RVR = 0;
+	board->systick_value = 0;
+	events_reset();
+	board->cycles = 0;
+	board->after_load_store = false;
+	exceptions_update();
+}
 
-	if (((cond & 0b0001) == 0b0001) && (cond != 0b1111)) {
-		result = !result;
-	}
+/* SIM_CLKDIV1 divides MCGOUTCLK for the core (OUTDIV1), the bus (OUTDIV2)
+   and the flash (OUTDIV4), so the flash wait states and the bus clock
+   follow from the dividers without working out MCGOUTCLK from the MCG.
+   Out of reset the flash runs at half the core clock */
+#define SIM_CLKDIV1_ADDRESS 0x40048044
+#define SIM_CLKDIV1_RESET 0x00010000
 
-	return result;
+static uint32_t SIM_CLKDIV1_read(uint32_t address, uint8_t size)
+{
+	return board->SIM_CLKDIV1 >> (8 * (address - SIM_CLKDIV1_ADDRESS));
 }
 
-uint32_t SP(struct registers *registers)
+static void SIM_CLKDIV1_write(uint32_t address, uint32_t data, uint8_t size)
 {
-	return registers->r[13];
+	uint8_t shift = 8 * (address - SIM_CLKDIV1_ADDRESS);
+	uint32_t mask = size == 4 ? 0xFFFFFFFF
+	                          : ((UINT32_C(1) << (8 * size)) - 1) << shift;
+	board->SIM_CLKDIV1 = (board->SIM_CLKDIV1 & ~mask)
+	                     | ((data << shift) & mask);
+
+	uint32_t core = (board->SIM_CLKDIV1 >> 28) + 1;
+	uint32_t flash_divider = ((board->SIM_CLKDIV1 >> 16) & 0xF) + 1;
+	board->flash_wait_states = (flash_divider + core - 1) / core - 1;
+	board->core_divider = core;
+	board->bus_divider = ((board->SIM_CLKDIV1 >> 24) & 0xF) + 1;
 }
 
-/* A4.2.2 */
-uint32_t PC(struct registers *registers)
+/* The PIT channels count down the bus clock from PIT_LDVALn, the cycle a
+   running channel next reaches 0 is scheduled as an event.  Chained
+   channels aren't modelled */
+#define PIT_ADDRESS 0x40037000
+#define PIT_IRQ0 68
+#define PIT_MCR_MDIS 0x00000002
+#define PIT_TCTRL_TEN 0x00000001
+#define PIT_TCTRL_TIE 0x00000002
+#define PIT_TFLG_TIF 0x00000001
+
+static bool pit_running(uint32_t channel)
 {
-	return registers->r[15] + 4;
+	return (board->PIT_MCR & PIT_MCR_MDIS) == 0
+	       && (board->pit_channels[channel].TCTRL & PIT_TCTRL_TEN) != 0;
 }
 
-uint32_t Align_PC_4(struct registers *registers)
+/* Core cycles for a number of bus clock ticks, rounded up */
+static uint64_t pit_cycles(uint64_t ticks)
 {
-	return PC(registers) & 0xFFFFFFFC;
+	return (ticks * board->bus_divider + board->core_divider - 1)
+	       / board->core_divider;
 }
 
-struct ShiftTNTuple DecodeImmShift(uint8_t type, uint8_t imm5)
+static void pit_start(uint32_t channel)
 {
-	struct ShiftTNTuple T;
+	if (pit_running(channel)) {
+		uint64_t period =
+			pit_cycles(board->pit_channels[channel].LDVAL + 1ULL);
+		event_schedule(EVENT_PIT0 + channel, now() + period);
+	}
+	else {
+		event_cancel(EVENT_PIT0 + channel);
+	}
+}
 
-	switch (type) {
-	case 0b00:
-		T.shift_t = SRType_LSL;
-		T.shift_n = imm5;
-		break;
-	case 0b01:
-		T.shift_t = SRType_LSR;
-		if (imm5 == 0b00000) {
-			T.shift_n = 32;
-		}
-		else {
-			T.shift_n = imm5;;
+static uint32_t pit_current(uint32_t channel)
+{
+	enum event_source source = EVENT_PIT0 + channel;
+	uint64_t cycles = now();
+	if (!event_scheduled(source) || cycles >= board->event_cycle[source]) {
+		return 0;
+	}
+	uint64_t ticks = (board->event_cycle[source] - cycles)
+	                 * board->core_divider / board->bus_divider;
+	return ticks == 0 ? 0 : ticks - 1;
+}
+
+/* Like systick_wrap, a late event counts every timeout it missed but only
+   pends the IRQ once.  The new PIT_LDVALn is loaded here */
+static void pit_timeout(enum event_source source)
+{
+	uint32_t channel = source - EVENT_PIT0;
+	struct pit_channel *pit = &board->pit_channels[channel];
+	pit->TFLG |= PIT_TFLG_TIF;
+	if ((pit->TCTRL & PIT_TCTRL_TIE) != 0) {
+		exception_pend(EXCEPTION_IRQ0 + PIT_IRQ0 + channel, true);
+	}
+	uint64_t period = pit_cycles(pit->LDVAL + 1ULL);
+	uint64_t next = board->event_cycle[source];
+	event_schedule(source,
+	               next + ((board->cycles - next) / period + 1) * period);
+}
+
+static uint32_t pit_word_read(uint32_t address)
+{
+	uint32_t offset = address - PIT_ADDRESS;
+	if (offset == 0) {
+		return board->PIT_MCR;
+	}
+	if (offset < 0x100) {
+		return 0;
+	}
+	uint32_t channel = (offset - 0x100) / 0x10;
+	struct pit_channel *pit = &board->pit_channels[channel];
+	switch (offset % 0x10) {
+	case 0x0:
+		return pit->LDVAL;
+	case 0x4:
+		++board->time_reads;
+		return pit_current(channel);
+	case 0x8:
+		return pit->TCTRL;
+	default:
+		return pit->TFLG;
+	}
+}
+
+static void pit_word_write(uint32_t address, uint32_t data, uint32_t mask)
+{
+	uint32_t offset = address - PIT_ADDRESS;
+	data &= mask;
+	if (offset == 0) {
+		board->PIT_MCR = ((board->PIT_MCR & ~mask) | data) & 0x3;
+		for (uint32_t channel = 0; channel < PIT_CHANNELS; ++channel) {
+			if (pit_running(channel)
+			    != event_scheduled(EVENT_PIT0 + channel)) {
+				pit_start(channel);
+			}
 		}
+		return;
+	}
+	if (offset < 0x100) {
+		return;
+	}
+	uint32_t channel = (offset - 0x100) / 0x10;
+	struct pit_channel *pit = &board->pit_channels[channel];
+	switch (offset % 0x10) {
+	case 0x0:
+		pit->LDVAL = (pit->LDVAL & ~mask) | data;
 		break;
-	case 0b10:
-		T.shift_t = SRType_ASR;
-		if (imm5 == 0b00000) {
-			T.shift_n = 32;
+	case 0x8: {
+		bool was_running = pit_running(channel);
+		pit->TCTRL = ((pit->TCTRL & ~mask) | data) & 0x7;
+		if (pit_running(channel) != was_running) {
+			pit_start(channel);
 		}
-		else {
-			T.shift_n = imm5;;
+		if ((pit->TCTRL & PIT_TCTRL_TIE) != 0
+		    && (pit->TFLG & PIT_TFLG_TIF) != 0) {
+			exception_pend(EXCEPTION_IRQ0 + PIT_IRQ0 + channel,
+			               true);
 		}
 		break;
-	case 0b11:
-		if (imm5 == 0b00000) {
-			T.shift_t = SRType_RRX;
-			T.shift_n = 1;
-		}
-		else {
-			T.shift_t = SRType_ROR;
-			T.shift_n = imm5;
-		}
+	}
+	case 0xC:
+		pit->TFLG &= ~(data & PIT_TFLG_TIF);
 		break;
 	}
+}
 
-	return T;
+static uint32_t pit_read(uint32_t address, uint8_t size)
+{
+	return pit_word_read(address & ~UINT32_C(3)) >> (8 * (address & 3));
 }
 
-struct ResultCarryTuple ThumbExpandImm_C(uint16_t imm12, bool carry) {
-	struct ResultCarryTuple T;
+static void pit_write(uint32_t address, uint32_t data, uint8_t size)
+{
+	uint8_t shift = 8 * (address & 3);
+	uint32_t mask = size == 4 ? 0xFFFFFFFF
+	                          : ((UINT32_C(1) << (8 * size)) - 1) << shift;
+	pit_word_write(address & ~UINT32_C(3), data << shift, mask);
+}
 
-	if ((imm12 & 0xC00) == 0x000) {
-		uint8_t switch_value = (imm12 & 0x300) >> 8;
-		switch (switch_value) {
-		case 0b00:
-			T.result = (imm12 & 0x0FF);
-			break;
-		case 0b01:
-			assert(false);
-			break;
-		case 0b10:
-			assert(false);
-			break;
-		case 0b11:
-			assert(false);
-			break;
-		}
-		T.carry = carry;
-	}
-	else {
-		uint32_t unrotated_value = 0x80 + (imm12 & 0x7F);
-		uint8_t shift = (imm12 & 0xF80) >> 7;
-		T = ROR_C(unrotated_value, shift);
-	}
-
-	return T;
-}
-
-uint32_t ThumbExpandImm(struct registers *registers,
-                        uint16_t imm12)
-{
-	return ThumbExpandImm_C(imm12, APSR_C(registers)).result;
-}
-
-static const char *get_condition_name(uint8_t cond)
-{
-	const char *field;
-	switch (cond) {
-	case 0b0000:
-		field = "EQ";
-		break;
-	case 0b0001:
-		field = "NE";
-		break;
-	case 0b0010:
-		field = "CS";
-		break;
-	case 0b0011:
-		field = "CC";
-		break;
-	case 0b0100:
-		field = "MI";
-		break;
-	case 0b0101:
-		field = "PL";
-		break;
-	case 0b0110:
-		field = "VS";
-		break;
-	case 0b0111:
-		field = "VC";
-		break;
-	case 0b1000:
-		field = "HI";
-		break;
-	case 0b1001:
-		field = "LS";
-		break;
-	case 0b1010:
-		field = "GE";
-		break;
-	case 0b1011:
-		field = "LT";
-		break;
-	case 0b1100:
-		field = "GT";
-		break;
-	case 0b1101:
-		field = "LE";
-		break;
-	case 0b1110:
-		field = "";
-		break;
-	case 0b1111:
-		field = "";
-		break;
-	default:
-		assert(false);
-	}
-	return field;
-}
-
-static const char *get_condition_field(struct registers *registers)
+static void pit_reset(void)
 {
-	uint8_t cond = CurrentCond(registers);
-	return get_condition_name(cond);
+	board->PIT_MCR = PIT_MCR_MDIS;
+	memset(board->pit_channels, 0, sizeof(board->pit_channels));
 }
 
-/*
-uint8_t APSR_N(struct registers *registers)
-{
-	return (registers->apsr & 0x80000000) >> 31;
-}
-
-uint8_t APSR_Z(struct registers *registers)
-{
-	return (registers->apsr & 0x40000000) >> 30;
-}
+/* UART0 only receives, the input is there from the start and always ready
+   to read.  Sent bytes are dropped */
+#define UART0_ADDRESS 0x4006A000
+#define UART0_STATUS_IRQ 45
+#define UART_C2_RIE 0x20
+#define UART_S1_TDRE 0x80
+#define UART_S1_TC 0x40
+#define UART_S1_RDRF 0x20
+#define UART_FIFO_DEPTH 8
 
-uint8_t APSR_C(struct registers *registers)
+static uint32_t uart0_left(void)
 {
-	return (registers->apsr & 0x20000000) >> 29;
+	return board->input_size - board->input_next;
 }
 
-uint8_t APSR_V(struct registers *registers)
+/* The receive interrupt is level sensitive */
+static void uart0_update(void)
 {
-	return (registers->apsr & 0x10000000) >> 28;
+	bool pending = (board->UART0_C2 & UART_C2_RIE) != 0
+	               && uart0_left() != 0;
+	if (pending != exception_bit(board->exception_pending,
+	                             EXCEPTION_IRQ0 + UART0_STATUS_IRQ)) {
+		exception_pend(EXCEPTION_IRQ0 + UART0_STATUS_IRQ, pending);
+	}
 }
-*/
 
-static void set_bit(uint32_t *v, uint8_t i) { *v |= (1 << i); }
-
-static void b4_1_1_t1(struct registers *registers, uint16_t halfword)
+static uint8_t uart0_byte_read(uint32_t address)
 {
-	uint8_t im = (halfword & 0x0010) >> 4;
-	uint8_t I = (halfword & 0x0002) >> 1;
-	uint8_t F = (halfword & 0x0001) >> 0;
-
-	bool enable = im == 0;
-	bool disable = im == 1;
-	bool affectPRI = I == 1;
-	bool affectFAULT = F == 1;
-
-	printf("  CPS");
-	if (enable) {
-		printf("IE");
-		if (affectPRI) {
-			printf(" i");
-			registers->primask = 0;
-		}
-		if (affectFAULT) {
-			if (!affectPRI) {
-				printf(" ");
-			}
-			printf("f");
-			registers->faultmask = 0;
-		}
+	uint32_t offset = address - UART0_ADDRESS;
+	if (uart0_left() == 0 || offset == 0x03) {
+		++board->stable_reads;
 	}
-	else if (disable) {
-		printf("ID");
-		if (affectPRI) {
-			printf(" i");
-			registers->primask = 1;
-		}
-		// TODO Priority
-		if (affectFAULT) {
-			if (!affectPRI) {
-				printf(" ");
-			}
-			printf("f");
-			registers->faultmask = 1;
+	switch (offset) {
+	case 0x03: // C2
+		return board->UART0_C2;
+	case 0x04: // S1
+		return UART_S1_TDRE | UART_S1_TC
+		       | (uart0_left() != 0 ? UART_S1_RDRF : 0);
+	case 0x07: // D
+		if (uart0_left() != 0) {
+			uint8_t data = board->input[board->input_next++];
+			uart0_update();
+			return data;
 		}
+		return 0;
+	case 0x16: // RCFIFO
+		return uart0_left() < UART_FIFO_DEPTH ? uart0_left()
+		                                      : UART_FIFO_DEPTH;
 	}
-	printf("\n");
+	return 0;
 }
 
-static void ADD_immediate(struct registers *registers, uint8_t d, uint8_t n,
-                          bool setflags, uint32_t imm32)
+static uint32_t uart0_read(uint32_t address, uint8_t size)
 {
-	if (ConditionPassed(registers)) {
-		struct ResultCarryOverflowTuple T =
-			AddWithCarry(registers->r[n], imm32, false);
-		registers->r[d] = T.result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
-			setflags_ResultCarryOverflowTuple(registers, T);
-			printf("  > APSR = %08X\n", registers->apsr);
-		}
+	uint32_t value = 0;
+	for (uint8_t i = 0; i < size; ++i) {
+		value |= (uint32_t) uart0_byte_read(address + i) << (8 * i);
 	}
+	return value;
 }
 
-static void a6_7_3_t1(struct registers *registers, uint16_t halfword)
+static void uart0_write(uint32_t address, uint32_t data, uint8_t size)
 {
-	uint8_t imm3 = (halfword & 0x01C0) >> 6;
-	uint8_t n    = (halfword & 0x0038) >> 3;
-	uint8_t d    = (halfword & 0x0007) >> 0;
-
-	bool setflags = !InITBlock(registers);
-	uint32_t imm32 = imm3;
-
-	printf("  ADD");
-	if (setflags) {
-		printf("S");
-	}
-	else {
-		printf("%s", get_condition_field(registers));
+	for (uint8_t i = 0; i < size; ++i) {
+		if (address + i == UART0_ADDRESS + 0x03) {
+			board->UART0_C2 = data >> (8 * i);
+			uart0_update();
+		}
 	}
-	printf(" R%d, R%d, #%d\n", d, n, imm32);
-
-	ADD_immediate(registers, d, n, setflags, imm32);
 }
 
-static void a6_7_3_t2(struct registers *registers, uint16_t halfword)
-{
-	uint8_t d    = (halfword & 0x0700) >> 8;
-	uint8_t imm8 = (halfword & 0x00FF) >> 0;
-
-	uint8_t n = d;
-	bool setflags = !InITBlock(registers);
-
-	uint32_t imm32 = imm8;
-
-	struct ResultCarryOverflowTuple T =
-		AddWithCarry(registers->r[n], imm32, false);
+static void (*const event_handlers[EVENT_SOURCES])(enum event_source) = {
+	[EVENT_SYSTICK] = systick_wrap,
+	[EVENT_PIT0] = pit_timeout,
+	[EVENT_PIT1] = pit_timeout,
+	[EVENT_PIT2] = pit_timeout,
+	[EVENT_PIT3] = pit_timeout,
+};
 
-	printf("  ADD");
-	if (setflags) {
-		printf("S");
+/* Runs every event due by now in cycle order, a handler can schedule the
+   next event of its source */
+static void events_run(void)
+{
+	while (board->cycles >= board->next_event) {
+		enum event_source source = board->event_heap[0];
+		event_cancel(source);
+		event_handlers[source](source);
 	}
-	printf(" R%d #%d\n", d, imm32);
-
-	ADD_immediate(registers, d, n, setflags, imm32);
 }
 
-static void a6_7_3_t3(struct registers *registers,
-                      uint16_t first_halfword,
-                      uint16_t second_halfword)
+/* The exception an event would pend right now, 0 for none */
+static uint32_t event_exception(enum event_source source)
 {
-	uint8_t i    =  (first_halfword & 0x0400) >> 10;
-	uint8_t S    =  (first_halfword & 0x0010) >>  4;
-	uint8_t n    =  (first_halfword & 0x000F) >>  0;
-	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-	uint8_t d    = (second_halfword & 0x0F00) >>  8;
-	uint8_t imm8 = (second_halfword & 0x00FF) >>  0;
-
-	uint16_t imm12 = (i * 0x800)
-	                 + (imm3 * 0x100)
-	                 + imm8;
-
-	bool setflags = S == 1;
-	uint32_t imm32 = ThumbExpandImm(registers, imm12);
-
-	printf("  ADD");
-	if (setflags) {
-		printf("S");
+	if (source == EVENT_SYSTICK) {
+		return (board->SYST_CSR & SYST_CSR_TICKINT) != 0
+		       ? EXCEPTION_SYSTICK : 0;
 	}
-	printf("%s.W R%d, R%d, #%d\n",
-	       get_condition_field(registers), d, n, imm32);
-
-	ADD_immediate(registers, d, n, setflags, imm32);
+	uint32_t channel = source - EVENT_PIT0;
+	return (board->pit_channels[channel].TCTRL & PIT_TCTRL_TIE) != 0
+	       ? EXCEPTION_IRQ0 + PIT_IRQ0 + channel : 0;
 }
 
-static void ADD_register(struct registers *registers, bool is_wide,
-                         uint8_t d, uint8_t n, uint8_t m,
-                         bool setflags, enum SRType shift_t, uint8_t shift_n)
+// The watchdog unlock sequence followed by the disable
+static void WDOG_write(uint32_t address, uint32_t data, uint8_t size)
 {
-	printf("  ADD");
-	if (setflags) {
-		printf("S");
-	}
-	printf("%s", get_condition_field(registers));
-	if (is_wide) {
-		printf(".W");
-	}
-	printf(" R%d, R%d, R%d", d, n, m);
-	if (shift_n != 0) {
-		printf(", <shift>");
+	if (size != 2) {
+		return;
 	}
-	printf("\n");
 
-	if (ConditionPassed(registers)) {
-		uint32_t shifted = Shift(registers->r[m], shift_t,
-		                         shift_n, APSR_C(registers));
-		struct ResultCarryOverflowTuple T =
-			AddWithCarry(registers->r[n], shifted, false);
-		if (d == 15) {
-			assert(false); // TODO
-		}
-		else {
-			registers->r[d] = T.result;
-			printf("  > R%d = %08X\n", d, registers->r[d]);
-			if (setflags) {
-				setflags_ResultCarryOverflowTuple(registers, T);
-				printf("  > APSR = %08X\n", registers->apsr);
-			}
-		}
+	if (address == 0x4005200E && board->WDOG_state == 0 && data == 0xC520) {
+		board->WDOG_state = 1;
 	}
-}
-
-static void a6_7_4_t1(struct registers *registers, uint16_t halfword)
-{
-	uint8_t m = (halfword & 0x01C0) >> 6;
-	uint8_t n = (halfword & 0x0038) >> 3;
-	uint8_t d = (halfword & 0x0007) >> 0;
-
-	bool setflags = !InITBlock(registers);
-	if (setflags) {
-		printf("  ADDS R%d, R%d, R%d\n", d, n, m);
+	else if (address == 0x4005200E && board->WDOG_state == 1
+	         && data == 0xD928) {
+		board->WDOG_state = 2;
 	}
-	else {
-		printf("  ADD%s R%d, R%d, R%d\n",
-		       get_condition_field(registers), d, n, m);
+	else if (address == 0x40052000 && board->WDOG_state == 2
+	         && data == 0x0010) {
+		board->WDOG_state = 3;
 	}
+}
 
-	if (ConditionPassed(registers)) {
-		uint32_t shifted = registers->r[m];
-		struct ResultCarryOverflowTuple T =
-			AddWithCarry(registers->r[n], shifted, false);
-
-		assert(d != 15);
+static const struct peripheral peripherals[] = {
+	{ "FTFL_FSTAT", 0x40020000, 1, FTFL_read, NULL },
+	{ "MCG_S", 0x40064006, 1, MCG_S_read, NULL },
+	{ "WDOG", 0x40052000, 0x10, NULL, WDOG_write },
+	{ "SIM_CLKDIV1", SIM_CLKDIV1_ADDRESS, 4,
+	  SIM_CLKDIV1_read, SIM_CLKDIV1_write },
+	{ "PIT_MCR", PIT_ADDRESS, 0x140, pit_read, pit_write },
+	{ "UART0", UART0_ADDRESS, 0x20, uart0_read, uart0_write },
+	{ "SYST_CSR", 0xE000E010, 0x10, scs_read, scs_write },
+	{ "NVIC_ISER0", 0xE000E100, 0x400, scs_read, scs_write },
+	{ "SCB_ICSR", 0xE000ED04, 0x20, scs_read, scs_write },
+};
 
-		registers->r[d] = T.result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
-			setflags_ResultCarryOverflowTuple(registers, T);
-			printf("  > APSR = %08X\n", registers->apsr);
+/* Only the pages of flash, SRAM and the peripherals are ever set, so the
+   rest of the table is never touched and doesn't take up memory.  The
+   peripherals never change, so a board registers them once and they're
+   cleared when it's destroyed */
+static void pages_reset(void)
+{
+	for (size_t i = 0; i < sizeof(peripherals) / sizeof(peripherals[0]);
+	     ++i) {
+		uint32_t start = peripherals[i].start & ~PAGE_OFFSET_MASK;
+		uint32_t end = peripherals[i].start + peripherals[i].size;
+		for (uint32_t address = start; address < end;
+		     address += PAGE_SIZE) {
+			struct page *page =
+				&board->pages[address >> PAGE_SHIFT];
+			free(page->peripherals);
+			page->peripherals = NULL;
+		}
+	}
+}
+
+static void memory_init(void)
+{
+	memset(board->sram, 0, sizeof(board->sram));
+	board->WDOG_state = 0;
+	board->MCG_S_reads = 0;
+	SIM_CLKDIV1_write(SIM_CLKDIV1_ADDRESS, SIM_CLKDIV1_RESET, 4);
+	exceptions_reset();
+	pit_reset();
+	board->UART0_C2 = 0;
+	pages_map(0x00000000, PROGRAM_FLASH_SIZE, board->flash->data, true,
+	          false);
+	pages_map(SRAM_LOWER, sizeof(board->sram), board->sram, true, true);
+
+	if (board->peripherals_registered) {
+		return;
+	}
+	board->peripherals_registered = true;
+	for (size_t i = 0; i < sizeof(peripherals) / sizeof(peripherals[0]);
+	     ++i) {
+		// A peripheral named after a register has to start at it
+		uint32_t address;
+		if (get_name_address(peripherals[i].name, &address)) {
+			assert(address == peripherals[i].start);
 		}
+		peripheral_register(&peripherals[i]);
 	}
 }
 
-static void a6_7_4_t2(struct registers *registers, uint16_t halfword)
+static uint32_t word_at_address(uint32_t base)
 {
-	uint8_t DN = (halfword & 0x0080) >> 7;
-	uint8_t m = (halfword & 0x0078) >> 3;
-	uint8_t Rdn = (halfword & 0x0007) >> 0;
-
-	uint8_t dn = (DN << 3) | Rdn;
+	const uint8_t *flash = board->flash->data;
+	return flash[base] +
+	       + (flash[base + 1] * 0x100)
+	       + (flash[base + 2] * 0x10000)
+	       + (flash[base + 3] * 0x1000000);
+}
 
-	bool setflags = false;
+struct AddWithCarry_Result {
+	uint32_t result;
+	bool carry_out;
+	bool overflow;
+};
 
-	printf("  ADD%s R%d, R%d\n", get_condition_field(registers), dn, m);
+enum SRType {
+	SRType_None,
+	SRType_LSL,
+	SRType_LSR,
+	SRType_ASR,
+	SRType_ROR,
+	SRType_RRX,
+};
 
-	uint32_t shifted = registers->r[m];
-	struct ResultCarryOverflowTuple T = AddWithCarry(registers->r[dn],
-	                                                 shifted, false);
+struct ShiftTNTuple {
+	enum SRType shift_t;
+	uint8_t shift_n;
+};
 
-	assert(dn != 15);
+struct ResultCarryTuple {
+	uint32_t result;
+	bool carry;
+};
 
-	registers->r[dn] = T.result;
-	printf("  > R%d = %08X\n", dn, registers->r[dn]);
-}
+struct ResultCarryOverflowTuple {
+	uint32_t result;
+	bool carry;
+	bool overflow;
+};
 
-static void a6_7_4_t3(struct registers *registers,
-                      uint16_t first_halfword,
-                      uint16_t second_halfword)
+static struct ResultCarryTuple LSL_C(uint32_t x, uint8_t shift)
 {
-	uint8_t S = (first_halfword & 0x0010) >> 4;
-	uint8_t n = (first_halfword & 0x000F) >> 0;
-	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-	uint8_t d = (second_halfword & 0x0F00) >> 8;
-	uint8_t imm2 = (second_halfword & 0x00C0) >> 6;
-	uint8_t type = (second_halfword & 0x0030) >> 4;
-	uint8_t m = (second_halfword & 0x000F) >> 0;
-
-	bool setflags = S == 1;
-	uint8_t imm5 = (imm3 << 2) | imm2;
-	struct ShiftTNTuple T = DecodeImmShift(type, imm5);
-
-	ADD_register(registers, true, d, n, m, setflags, T.shift_t, T.shift_n);
+	assert(shift > 0);
+	uint64_t extended_x = x;
+	extended_x <<= shift;
+	struct ResultCarryTuple T;
+	T.result = (extended_x & 0xFFFFFFFF);
+	T.carry = (extended_x & 0x100000000);
+	return T;
 }
 
-static void ADD_SP_plus_immediate(struct registers *registers,
-                                  uint8_t d, uint32_t imm32, bool setflags)
+static uint32_t LSL(uint32_t x, uint8_t shift)
 {
-	if (ConditionPassed(registers)) {
-		struct ResultCarryOverflowTuple T;
-		T = AddWithCarry(SP(registers), imm32, false);
-		registers->r[d] = T.result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
-			setflags_ResultCarryOverflowTuple(registers, T);
-			printf("  > APSR = %08X\n", registers->apsr);
-		}
+	if (shift == 0) {
+		return x;
+	}
+	else {
+		struct ResultCarryTuple T = LSL_C(x, shift);
+		return T.result;
 	}
 }
 
-static void a6_7_5_t1(struct registers *registers, uint16_t halfword)
+static struct ResultCarryTuple LSR_C(uint32_t x, uint8_t shift)
 {
-	uint8_t d = (halfword & 0x0700) >> 8;
-	uint8_t imm8 = (halfword & 0x00FF) >> 0;
-	bool setflags = false;
-
-	uint32_t imm32 = imm8 << 2;
-
-	printf("  ADD%s R%d, SP, #%d\n", get_condition_field(registers), d, imm8);
-
-	ADD_SP_plus_immediate(registers, d, imm32, setflags);
+	assert(shift > 0);
+	uint64_t extended_x = x;
+	struct ResultCarryTuple T;
+	T.result = (extended_x >> shift) & 0xFFFFFFFF;
+	T.carry = ((extended_x >> (shift - 1)) & 0x1) == 0x1;
+	return T;
 }
 
-static void a6_7_5_t2(struct registers *registers, uint16_t halfword)
+static uint32_t LSR(uint32_t x, uint8_t shift)
 {
-	uint8_t d = 13;
-	bool setflags = false;
-
-	uint8_t imm7 = (halfword & 0x007F) >> 0;
-	uint32_t imm32 = imm7 << 2;
-
-	printf("  ADD%s SP, SP, #%d\n", get_condition_field(registers), imm7);
-
-	ADD_SP_plus_immediate(registers, d, imm32, setflags);
+	if (shift == 0) {
+		return x;
+	}
+	else {
+		struct ResultCarryTuple T = LSR_C(x, shift);
+		return T.result;
+	}
 }
 
-static void a6_7_8_t1(struct registers *registers,
-                      uint16_t first_halfword,
-                      uint16_t second_halfword)
+static struct ResultCarryTuple ASR_C(uint32_t x, uint8_t shift)
 {
-	uint8_t i = (first_halfword & 0x0400) >> 10;
-	uint8_t S = (first_halfword & 0x0010) >> 4;
-	uint8_t n = (first_halfword & 0x000F) >> 0;
-	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-	uint8_t d = (second_halfword & 0x0F00) >> 8;
-	uint8_t imm8 = (second_halfword & 0x00FF) >> 0;
-
-	if (d == 0xF && S == 1) {
-		assert(false);
+	assert(shift > 0);
+	uint64_t extended_x = x;
+	if ((x & 0x80000000) == 0x80000000) {
+		extended_x |= ((uint64_t) 0xFFFFFFFF00000000);
 	}
+	struct ResultCarryTuple T;
+	T.result = (extended_x >> shift) & 0xFFFFFFFF;
+	T.carry = (extended_x & (1 << (shift - 1)))
+	          == (((uint64_t) 1) << (shift - 1));
+	return T;
+}
 
-	bool setflags = S == 1;
-	uint16_t imm12 = (i * 0x800)
-	                 + (imm3 * 0x100)
-	                 + imm8;
-	struct ResultCarryTuple T = ThumbExpandImm_C(imm12, APSR_C(registers));
+static struct ResultCarryTuple ROR_C(uint32_t x, uint8_t shift)
+{
+	assert(shift != 0);
+	uint8_t m = shift % 32;
+	struct ResultCarryTuple T;
+	T.result = LSR(x, m) | LSL(x, 32 - m);
+	T.carry = (T.result & 0x80000000) == 0x80000000;
+	return T;
+}
 
-	if (setflags) {
-		printf("  ANDS%s R%d, R%d, #0x%08X\n",
-		       get_condition_field(registers), d, n, T.result);
+static struct ResultCarryTuple Shift_C(uint32_t value, enum SRType type,
+                                       uint8_t amount, bool carry_in)
+{
+	struct ResultCarryTuple T;
+	if (amount == 0) {
+		T.result = value;
+		T.carry = carry_in;
 	}
 	else {
-		printf("  AND%s R%d, R%d, #0x%08X\n",
-		        get_condition_field(registers), d, n, T.result);
-	}
-
-	if (ConditionPassed(registers)) {
-		int32_t result = registers->r[n] & T.result;
-		registers->r[d] = result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
-			if ((result & 0x80000000) == 0x80000000) {
-				APSR_N_set(registers);
-			}
-			else {
-				APSR_N_clear(registers);
-			}
-			if (result == 0) {
-				APSR_Z_set(registers);
-			}
-			else {
-				APSR_Z_clear(registers);
-			}
-			if (T.carry) {
-				APSR_C_set(registers);
-			}
-			else {
-				APSR_C_clear(registers);
-			}
-			printf("  > APSR = %08X\n", registers->apsr);
+		switch (type) {
+		case SRType_LSL:
+			T = LSL_C(value, amount);
+			break;
+		case SRType_LSR:
+			T = LSR_C(value, amount);
+			break;
+		case SRType_ASR:
+			T = ASR_C(value, amount);
+			break;
+		case SRType_ROR:
+			T = ROR_C(value, amount);
+			break;
+		default:
+			assert(false);
 		}
 	}
+
+	return T;
 }
 
-static void ASR_immediate(struct registers *registers,
-                          uint8_t d, uint8_t shift_n, uint8_t m, bool setflags)
+static uint32_t Shift(uint32_t value, enum SRType type,
+                      uint8_t amount, bool carry_in)
 {
-	if (ConditionPassed(registers)) {
-		struct ResultCarryTuple T =
-			Shift_C(registers->r[m], SRType_ASR, shift_n,
-			        APSR_C(registers));
-		registers->r[d] = T.result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
-			setflags_ResultCarryTuple(registers, T);
-			printf("  > APSR = %08X\n", registers->apsr);
-		}
-	}
+	struct ResultCarryTuple T = Shift_C(value, type, amount, carry_in);
+	return T.result;
 }
 
-static void a6_7_10_t1(struct registers *registers, uint16_t halfword)
+struct ResultCarryOverflowTuple AddWithCarry(uint32_t x, uint32_t y, bool carry_in)
 {
-	uint8_t imm5 = (halfword & 0x07C0) >> 6;
-	uint8_t m = (halfword & 0x0038) >> 3;
-	uint8_t d = (halfword & 0x0007) >> 0;
+	struct ResultCarryOverflowTuple T;
 
-	bool setflags = !InITBlock(registers);
 
-	struct ShiftTNTuple T = DecodeImmShift(0b10, imm5);
-	uint8_t shift_n = T.shift_n;
+	uint64_t unsigned_sum = ((uint64_t) x) + ((uint64_t) y);
+	if (carry_in) unsigned_sum += 1;
 
-	printf("  ASR");
-	if (setflags) {
-		printf("S");
-	}
-	else {
-		printf("%s", get_condition_field(registers));
-	}
-	printf(" R%d, R%d, #%d\n", d, m, imm5);
+	int64_t signed_sum = ((int32_t) x) + ((int32_t) y);
+	if (carry_in) signed_sum += 1;
 
-	ASR_immediate(registers, d, shift_n, m, setflags);
-}
+	T.result = (unsigned_sum & 0xFFFFFFFF);
 
-static void a6_7_10_t2(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
-{
-	uint8_t S    =  (first_halfword & 0x0010) >>  4;
-	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-	uint8_t d    = (second_halfword & 0x0F00) >>  8;
-	uint8_t imm2 = (second_halfword & 0x00C0) >>  6;
-	uint8_t m    = (second_halfword & 0x000F) >>  0;
+	if (((uint64_t) T.result) == unsigned_sum)
+		T.carry = false;
+	else
+		T.carry = true;
 
-	bool setflags = S == 1;
-	uint8_t imm5 = (imm3 << 2) | imm2;
+	if (((int64_t) ((int32_t) T.result)) == signed_sum)
+		T.overflow = false;
+	else
+		T.overflow = true;
 
-	struct ShiftTNTuple T = DecodeImmShift(0b10, imm5);
-	uint8_t shift_n = T.shift_n;
+	return T;
+}
 
-	assert(!(d == 13 || d == 15 || m == 13 || m == 15));
+/* The flags are evaluated lazily, a flag setting instruction only records
+   the values NZCV is computed from and APSR_NZCV folds them into APSR the
+   first time anything reads it */
+enum flags_kind {
+	FLAGS_APSR,
+	FLAGS_RESULT_CARRY,
+	FLAGS_ADD_WITH_CARRY,
+};
 
-	printf("  ASR");
-	if (setflags) {
-		printf("S");
+static uint8_t APSR_NZCV(struct registers *registers)
+{
+	if (registers->flags_kind == FLAGS_APSR) {
+		return registers->apsr >> 28;
+	}
+
+	// FLAGS_RESULT_CARRY keeps V from before
+	uint32_t result = registers->flags_x;
+	bool carry = registers->flags_carry;
+	bool overflow = (registers->apsr & 0x10000000) == 0x10000000;
+	if (registers->flags_kind == FLAGS_ADD_WITH_CARRY) {
+		struct ResultCarryOverflowTuple T =
+			AddWithCarry(registers->flags_x, registers->flags_y,
+			             registers->flags_carry);
+		result = T.result;
+		carry = T.carry;
+		overflow = T.overflow;
+	}
+	else {
+		assert(registers->flags_kind == FLAGS_RESULT_CARRY);
 	}
-	printf("%s.W R%d, R%d, #%d\n",
-	       get_condition_field(registers), d, m, imm5);
 
-	ASR_immediate(registers, d, shift_n, m, setflags);
+	uint8_t nzcv = ((result >> 31) << 3)
+	               | ((result == 0) << 2)
+	               | (carry << 1)
+	               | overflow;
+	registers->apsr = (registers->apsr & 0x0FFFFFFF) | (nzcv << 28);
+	registers->flags_kind = FLAGS_APSR;
+	return nzcv;
 }
 
-static void BranchTo(struct registers *registers, uint32_t address)
+static uint32_t APSR(struct registers *registers)
 {
-	registers->r[15] = address;
-	printf("  > PC = %08X\n", registers->r[15]);
-	is_branch = true;
+	APSR_NZCV(registers);
+	return registers->apsr;
 }
 
-static void BranchWritePC(struct registers *registers, uint32_t address)
+uint8_t APSR_N(struct registers *registers)
 {
-	BranchTo(registers, address & ~(0x1));
+	return (APSR_NZCV(registers) >> 3) & 1;
 }
 
-static void BXWritePC(struct registers *registers, uint32_t address)
+uint8_t APSR_Z(struct registers *registers)
 {
-	assert((address & 0x00000001) == 0x00000001);
-	BranchTo(registers, address & 0xFFFFFFFE);
+	return (APSR_NZCV(registers) >> 2) & 1;
 }
 
-static void LoadWritePC(struct registers *registers, uint32_t address)
+uint8_t APSR_C(struct registers *registers)
 {
-	BXWritePC(registers, address);
+	return (APSR_NZCV(registers) >> 1) & 1;
 }
 
-static void B(struct registers *registers, uint32_t imm32)
+uint8_t APSR_V(struct registers *registers)
 {
-	if (ConditionPassed(registers)) {
-		BranchWritePC(registers, PC(registers) + imm32);
-	}
+	return APSR_NZCV(registers) & 1;
 }
 
-static void a6_7_12_t1(struct registers *registers, uint16_t halfword)
+uint8_t APSR_Q(struct registers *registers)
 {
-	uint8_t cond = (halfword & 0x0F00) >> 8;
-	uint8_t imm8 = (halfword & 0x00FF) >> 0;
-	uint32_t imm32 = imm8 << 1;
+	return (registers->apsr & 0x08000000) >> 27;
+}
 
-	// SignExtend
-	if ((imm32 & (1 << 8)) == (1 << 8)) {
-		imm32 |= 0xFFFFFE00;
+/* V is left as it was */
+void setflags_ResultCarryTuple(struct registers *registers,
+                               struct ResultCarryTuple T)
+{
+	if (registers->flags_kind != FLAGS_APSR
+	    && registers->flags_kind != FLAGS_RESULT_CARRY) {
+		APSR_NZCV(registers);
 	}
-
-	uint32_t address = PC(registers) + imm32;
-	printf("  B%s label_%08X\n", get_condition_field(registers), address);
-
-	B(registers, imm32);
+	registers->flags_kind = FLAGS_RESULT_CARRY;
+	registers->flags_x = T.result;
+	registers->flags_carry = T.carry;
 }
 
-static void a6_7_12_t2(struct registers *registers, uint16_t halfword)
+void setflags_AddWithCarry(struct registers *registers,
+                           uint32_t x, uint32_t y, bool carry_in)
 {
-	uint16_t imm11 = (halfword & 0x07FF) >> 0;
-	uint32_t imm32 = imm11 << 1;
-
+	registers->flags_kind = FLAGS_ADD_WITH_CARRY;
+	registers->flags_x = x;
+	registers->flags_y = y;
+	registers->flags_carry = carry_in;
+}
 
-	if ((imm32 & (1 << 11)) == (1 << 11)) {
-		imm32 |= 0xFFFFF000;
+void ITAdvance(struct registers *registers)
+{
+	if ((registers->itstate & 0b00000111) == 0b00000000) {
+		registers->itstate = 0;
 	}
+	else {
+		uint8_t old_state = registers->itstate & 0b00011111;
+		uint8_t new_state = (old_state << 1) & 0b00011111;
+		registers->itstate = (registers->itstate & 0b11100000)
+		                     | new_state;
+	}
+	trace_itstate(registers->itstate);
+}
 
-	uint32_t address = PC(registers) + imm32;
-	printf("  B%s label_%08X\n", get_condition_field(registers), address);
-
-	B(registers, imm32);
+bool InITBlock(struct registers *registers)
+{
+	return (registers->itstate & 0b00001111) != 0b0000;
 }
 
-static void a6_7_12_t3(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
+bool LastInITBlock(struct registers *registers)
 {
-	uint8_t  S     =  (first_halfword & 0x0400) >> 10;
-	uint8_t  cond  =  (first_halfword & 0x03C0) >>  6;
-	uint8_t  imm6  =  (first_halfword & 0x003F) >>  0;
-	uint8_t  J1    = (second_halfword & 0x2000) >> 13;
-	uint8_t  J2    = (second_halfword & 0x0800) >> 11;
-	uint16_t imm11 = (second_halfword & 0x07FF) >>  0;
+	return (registers->itstate & 0b00001111) == 0b1000;
+}
 
-	uint32_t imm32 = (S << 20)
-	                 | (J2 << 19)
-	                 | (J1 << 18)
-	                 | (imm6 << 12)
-	                 | (imm11 << 1);
-	if (S == 1) {
-		imm32 |= 0xFFE00000;
+uint8_t CurrentCond(struct registers *registers)
+{
+	if (InITBlock(registers)) {
+		return (registers->itstate & 0xF0) >> 4;
 	}
 
-	assert(!InITBlock(registers));
-
-	uint32_t address = PC(registers) + imm32;
-	printf("  B%s label_%08X\n", get_condition_field(registers), address);
-
-	B(registers, imm32);
+	return 0b1111; // TODO
 }
 
-static void a6_7_12_t4(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
-{
-	uint8_t  S     =  (first_halfword & 0x0400) >> 10;
-	uint16_t imm10 =  (first_halfword & 0x03FF) >>  0;
-	uint8_t  J1    = (second_halfword & 0x2000) >> 13;
-	uint8_t  J2    = (second_halfword & 0x0800) >> 11;
-	uint16_t imm11 = (second_halfword & 0x07FF) >>  0;
+/* Bit NZCV of the entry for a condition is set if the condition holds for
+   those flags, following the ConditionPassed pseudocode */
+static const uint16_t condition_table[16] = {
+	0xF0F0, // EQ
+	0x0F0F, // NE
+	0xCCCC, // CS
+	0x3333, // CC
+	0xFF00, // MI
+	0x00FF, // PL
+	0xAAAA, // VS
+	0x5555, // VC
+	0x0C0C, // HI
+	0xF3F3, // LS
+	0xAA55, // GE
+	0x55AA, // LT
+	0x0A05, // GT
+	0xF5FA, // LE
+	0xFFFF, // AL
+	0xFFFF, // Always (unconditional)
+};
 
-	uint8_t I1 = (~(J1 ^ S)) & 1;
-	uint8_t I2 = (~(J2 ^ S)) & 1;
-	uint32_t imm32 = (I1 * 0x800000)
-	                 + (I2 * 0x400000)
-	                 + (imm10 * 0x1000)
-	                 + (imm11 * 0x2);
-	if (S == 1) {
-		imm32 |= 0xFF000000;
+bool ConditionHolds(struct registers *registers, uint8_t cond)
+{
+	if (cond >= 0b1110) {
+		return true;
 	}
+	return (condition_table[cond] >> APSR_NZCV(registers)) & 1;
+}
 
-	uint32_t address = PC(registers) + imm32;
-	printf("  B%s label_%08X\n", get_condition_field(registers), address);
+/* The condition is captured when the instruction is decoded, either from
+   ITSTATE or from the encoding itself for conditional branches */
+bool ConditionPassed(struct registers *registers, const struct inst *inst)
+{
+	return ConditionHolds(registers, inst->cond);
+}
 
-	B(registers, imm32);
+uint32_t SP(struct registers *registers)
+{
+	return registers->r[13];
 }
 
-static void BIC_immediate(struct registers *registers, uint8_t d, uint8_t n,
-                          bool setflags, int32_t imm32, bool carry)
+/* A4.2.2 */
+uint32_t PC(struct registers *registers)
 {
-	if (ConditionPassed(registers)) {
-		uint32_t result = registers->r[n] & (~imm32);
-		registers->r[d] = result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
-			if ((result & 0x80000000) == 0x80000000) {
-				APSR_N_set(registers);
-			}
-			else {
-				APSR_N_clear(registers);
-			}
-			if (result == 0) {
-				APSR_Z_set(registers);
-			}
-			else {
-				APSR_Z_clear(registers);
-			}
-			if (carry) {
-				APSR_C_set(registers);
-			}
-			else {
-				APSR_C_clear(registers);
-			}
-			printf("  > APSR = %08X\n", registers->apsr);
-		}
-	}
+	return registers->r[15] + 4;
 }
 
-static void a6_7_15_t1(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
+uint32_t Align_PC_4(struct registers *registers)
 {
-	uint8_t i    =  (first_halfword & 0x0400) >> 10;
-	uint8_t S    =  (first_halfword & 0x0010) >>  4;
-	uint8_t n    =  (first_halfword & 0x000F) >>  0;
-	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-	uint8_t d    = (second_halfword & 0x0F00) >>  8;
-	uint8_t imm8 = (second_halfword & 0x00FF) >>  0;
+	return PC(registers) & 0xFFFFFFFC;
+}
 
-	uint16_t imm12 = (i << 11) | (imm3 << 8) | imm8;
-	bool setflags = S == 1;
-	struct ResultCarryTuple T = ThumbExpandImm_C(imm12, APSR_C(registers));
-	uint32_t imm32 = T.result;
-	bool carry = T.carry;
-	assert(!(d == 13 || d == 15 || n == 13 || n == 15));
+struct ShiftTNTuple DecodeImmShift(uint8_t type, uint8_t imm5)
+{
+	struct ShiftTNTuple T;
 
-	printf("  BIC");
-	if (setflags) {
-		printf("S");
+	switch (type) {
+	case 0b00:
+		T.shift_t = SRType_LSL;
+		T.shift_n = imm5;
+		break;
+	case 0b01:
+		T.shift_t = SRType_LSR;
+		if (imm5 == 0b00000) {
+			T.shift_n = 32;
+		}
+		else {
+			T.shift_n = imm5;;
+		}
+		break;
+	case 0b10:
+		T.shift_t = SRType_ASR;
+		if (imm5 == 0b00000) {
+			T.shift_n = 32;
+		}
+		else {
+			T.shift_n = imm5;;
+		}
+		break;
+	case 0b11:
+		if (imm5 == 0b00000) {
+			T.shift_t = SRType_RRX;
+			T.shift_n = 1;
+		}
+		else {
+			T.shift_t = SRType_ROR;
+			T.shift_n = imm5;
+		}
+		break;
 	}
-	printf("%s R%d, R%d, #0x%08X\n",
-	       get_condition_field(registers), d, n, imm32);
 
-	BIC_immediate(registers, d, n, setflags, imm32, carry);
+	return T;
 }
 
-static void a6_7_18_t1(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
-{
-	uint8_t  S     =  (first_halfword & 0x0400) >> 10;
-	uint16_t imm10 =  (first_halfword & 0x03FF) >>  0;
-	uint8_t  J1    = (second_halfword & 0x2000) >> 13;
-	uint8_t  J2    = (second_halfword & 0x0800) >> 11;
-	uint16_t imm11 = (second_halfword & 0x07FF) >>  0;
+struct ResultCarryTuple ThumbExpandImm_C(uint16_t imm12, bool carry) {
+	struct ResultCarryTuple T;
 
-	uint8_t I1 = (~(J1 ^ S)) & 1;
-	uint8_t I2 = (~(J2 ^ S)) & 1;
-	uint32_t imm32 = (I1 * 0x800000)
-	                 + (I2 * 0x400000)
-	                 + (imm10 * 0x1000)
-	                 + (imm11 * 0x2);
-	if (S == 1) {
-		imm32 |= 0xFF000000;
+	if ((imm12 & 0xC00) == 0x000) {
+		uint8_t switch_value = (imm12 & 0x300) >> 8;
+		switch (switch_value) {
+		case 0b00:
+			T.result = (imm12 & 0x0FF);
+			break;
+		case 0b01:
+			assert(false);
+			break;
+		case 0b10:
+			assert(false);
+			break;
+		case 0b11:
+			assert(false);
+			break;
+		}
+		T.carry = carry;
+	}
+	else {
+		uint32_t unrotated_value = 0x80 + (imm12 & 0x7F);
+		uint8_t shift = (imm12 & 0xF80) >> 7;
+		T = ROR_C(unrotated_value, shift);
 	}
 
-	uint32_t next_instr_addr = registers->r[15] + 4;
-	uint32_t lr_value = next_instr_addr | 0x1;
-	uint32_t address = registers->r[15] + 4 + imm32;
-	/* Set the last bit to zero */
-	address &= 0xFFFFFFFE;
-
-	printf("  BL label_%08X\n", address);
-	registers->r[14] = lr_value;
-	printf("  > R14 = %08X\n", lr_value);
-	registers->r[15] = address;
-	printf("  > R15 = %08X\n", address);
-
-	is_branch = true;
+	return T;
 }
 
-static void a6_7_19_t1(struct registers *registers,
-                       uint16_t halfword)
+uint32_t ThumbExpandImm(struct registers *registers,
+                        uint16_t imm12)
 {
-	uint8_t m = (halfword & 0x0078) >> 3;
-
-	printf("  BLX%s R%d\n", get_condition_field(registers), m);
-
-	if (ConditionPassed(registers)) {
-		uint32_t target = registers->r[m];
-		uint32_t next_instr_address = PC(registers) - 2;
-		registers->r[14] = next_instr_address | 0b1;
-		printf("  > R14 = %08X\n", registers->r[14]);
-		BXWritePC(registers, target);
+	return ThumbExpandImm_C(imm12, APSR_C(registers)).result;
+}
 
-		is_branch = true;
+static const char *get_condition_name(uint8_t cond)
+{
+	const char *field;
+	switch (cond) {
+	case 0b0000:
+		field = "EQ";
+		break;
+	case 0b0001:
+		field = "NE";
+		break;
+	case 0b0010:
+		field = "CS";
+		break;
+	case 0b0011:
+		field = "CC";
+		break;
+	case 0b0100:
+		field = "MI";
+		break;
+	case 0b0101:
+		field = "PL";
+		break;
+	case 0b0110:
+		field = "VS";
+		break;
+	case 0b0111:
+		field = "VC";
+		break;
+	case 0b1000:
+		field = "HI";
+		break;
+	case 0b1001:
+		field = "LS";
+		break;
+	case 0b1010:
+		field = "GE";
+		break;
+	case 0b1011:
+		field = "LT";
+		break;
+	case 0b1100:
+		field = "GT";
+		break;
+	case 0b1101:
+		field = "LE";
+		break;
+	case 0b1110:
+		field = "";
+		break;
+	case 0b1111:
+		field = "";
+		break;
+	default:
+		assert(false);
+		field = "";
 	}
+	return field;
 }
 
-static void a6_7_20_t1(struct registers *registers,
-                       uint16_t halfword)
+/*
+uint8_t APSR_N(struct registers *registers)
 {
-	uint8_t m = (halfword & 0x0078) >> 3;
-	printf("  BX R%d\n", m);
-	uint32_t address = registers->r[m] & ~(0x00000001);
-	registers->r[15] = address;
-	printf("  > R15 = %08X\n", address);
+	return (registers->apsr & 0x80000000) >> 31;
+}
 
-	is_branch = true;
+uint8_t APSR_Z(struct registers *registers)
+{
+	return (registers->apsr & 0x40000000) >> 30;
 }
 
-static void a6_7_21_t1(struct registers *registers,
-                        uint16_t halfword)
+uint8_t APSR_C(struct registers *registers)
 {
-	uint8_t op = (halfword & 0x0800) >> 11;
-	uint8_t i = (halfword & 0x0200) >> 9;
-	uint8_t imm5 = (halfword & 0x00F8) >> 3;
-	uint8_t rn = (halfword & 0x0007);
+	return (registers->apsr & 0x20000000) >> 29;
+}
 
-	uint32_t imm32 = (i * 0x40)
-	                 + (imm5 * 0x2);
-	uint32_t address = PC(registers) + imm32;
+uint8_t APSR_V(struct registers *registers)
+{
+	return (registers->apsr & 0x10000000) >> 28;
+}
+*/
 
-	printf("  CB");
-	if (op == 1){
-		printf("N");
-	}
-	printf("Z R%d, %08X\n", rn, address);
+static void set_bit(uint32_t *v, uint8_t i) { *v |= (1 << i); }
 
-	if ((op == 0 && registers->r[rn] == 0)
-	    || (op == 1 && registers->r[rn] != 0)) {
-		registers->r[15] = address;
-		printf("  > R15 = %08X\n", address);
-		is_branch = true;
+static void print_register_list(uint16_t register_list)
+{
+	bool first = false;
+	for (uint8_t i = 0; i < 16; ++i) {
+		if ((register_list & (0x0001 << i)) == (0x0001 << i)) {
+			if (!first) {
+				first = true;
+			}
+			else {
+				printf(", ");
+			}
+			printf("R%d", i);
+		}
 	}
 }
 
-static void CMP(struct registers *registers, uint8_t n, uint32_t imm32)
+/* ThumbExpandImm_C only produces a carry for rotated immediates, otherwise
+   the carry is whatever APSR.C is when the instruction executes */
+static bool ThumbExpandImm_carry(struct registers *registers,
+                                 const struct inst *inst)
 {
-	if (ConditionPassed(registers)) {
-		struct ResultCarryOverflowTuple T =
-			AddWithCarry(registers->r[n], ~imm32, true);
-		setflags_ResultCarryOverflowTuple(registers, T);
-		printf("  > APSR = %08X\n", registers->apsr);
+	if (inst->carry_in) {
+		return APSR_C(registers);
 	}
+	return inst->carry;
 }
 
-static void a6_7_27_t1(struct registers *registers, uint16_t halfword)
+static void decode_ThumbExpandImm_C(struct inst *inst, uint16_t imm12)
 {
-	uint8_t n = (halfword & 0x0700) >> 8;
-	uint8_t imm8 = (halfword & 0x00FF) >> 0;
-
-	uint32_t imm32 = imm8;
-
-	printf("  CMP%s R%d, #%d\n",
-	       get_condition_field(registers),  n, imm32);
-	CMP(registers, n, imm32);
+	struct ResultCarryTuple T = ThumbExpandImm_C(imm12, false);
+	inst->imm32 = T.result;
+	inst->carry = T.carry;
+	inst->carry_in = (imm12 & 0xC00) == 0x000;
 }
 
-static void a6_7_27_t2(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
+static void CPS(struct registers *registers, const struct inst *inst)
 {
-	uint8_t i    =  (first_halfword & 0x0400) >> 10;
-	uint8_t n    =  (first_halfword & 0x000F) >>  0;
-	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-	uint8_t imm8 = (second_halfword & 0x00FF) >>  0;
+	uint8_t im = (inst->first_halfword & 0x0010) >> 4;
+	uint8_t I  = (inst->first_halfword & 0x0002) >> 1;
+	uint8_t F  = (inst->first_halfword & 0x0001) >> 0;
 
-	uint16_t imm12 = (i << 11) | (imm3 << 8) | imm8;
-
-	uint32_t imm32 = ThumbExpandImm(registers, imm12);
-
-	assert(n != 15);
+	bool affectPRI = I == 1;
+	bool affectFAULT = F == 1;
 
-	printf("  CMP%s R%d, #%d\n", get_condition_field(registers), n, imm32);
-	CMP(registers, n, imm32);
+	if (affectPRI) {
+		registers->primask = im;
+	}
+	// TODO Priority
+	if (affectFAULT) {
+		registers->faultmask = im;
+	}
 }
 
-static void a6_7_28_t1(struct registers *registers, uint16_t halfword)
+static void b4_1_1_t1_disassemble(const struct inst *inst)
 {
-	uint8_t m = (halfword & 0x0038) >> 3;
-	uint8_t n = (halfword & 0x0007) >> 0;
+	uint8_t im = (inst->first_halfword & 0x0010) >> 4;
+	uint8_t I  = (inst->first_halfword & 0x0002) >> 1;
+	uint8_t F  = (inst->first_halfword & 0x0001) >> 0;
 
-	enum SRType shift_t = SRType_LSL;
-	uint8_t shift_n = 0;
-
-	// TODO use proper CMP register function
-	assert(shift_n == 0);
-	uint32_t shifted = registers->r[m];
+	bool enable = im == 0;
+	bool affectPRI = I == 1;
+	bool affectFAULT = F == 1;
 
-	printf("  CMP%s R%d, R%d\n",
-	       get_condition_field(registers), n, m);
-	CMP(registers, n, shifted);
+	printf("  CPS");
+	if (enable) {
+		printf("IE");
+	}
+	else {
+		printf("ID");
+	}
+	if (affectPRI) {
+		printf(" i");
+	}
+	if (affectFAULT) {
+		if (!affectPRI) {
+			printf(" ");
+		}
+		printf("f");
+	}
+	printf("\n");
 }
 
-static void a6_7_28_t2(struct registers *registers, uint16_t halfword)
+/* CPS is only used during boot, its fields stay in the halfword */
+static void b4_1_1_t1(struct registers *registers, struct inst *inst,
+                      uint16_t halfword)
 {
-	uint8_t N  = (halfword & 0x0080) >> 7;
-	uint8_t m  = (halfword & 0x0078) >> 3;
-	uint8_t Rn = (halfword & 0x0007) >> 0;
-
-	uint8_t n = (N << 3) | Rn;
-
-	enum SRType shift_t = SRType_LSL;
-	uint8_t shift_n = 0;
-
-	assert(!((n < 8) && (m < 8)));
-	assert(!((n == 15) || (m == 15)));
-
-	// TODO use proper CMP register function
-	assert(shift_n == 0);
-	uint32_t shifted = registers->r[m];
-
-	printf("  CMP%s R%d, R%d\n",
-	       get_condition_field(registers), n, m);
-	CMP(registers, n, shifted);
+	inst->execute = CPS;
+	inst->disassemble = b4_1_1_t1_disassemble;
 }
 
-static void a6_7_37_t1(struct registers *registers, uint16_t halfword)
+static void ADD_immediate(struct registers *registers, const struct inst *inst)
 {
-	uint8_t firstcond = (halfword & 0x00F0) >> 4;
-	uint8_t mask      = (halfword & 0x000F) >> 0;
-
-	uint8_t firstcond0 = (firstcond & 0b0001) >> 0;
+	if (ConditionPassed(registers, inst)) {
+		uint32_t x = registers->r[inst->n];
+		uint32_t y = inst->imm32;
+		struct ResultCarryOverflowTuple T = AddWithCarry(x, y, false);
+		registers->r[inst->d] = T.result;
+		trace_register(inst->d, registers->r[inst->d]);
+		if (inst->setflags) {
+			setflags_AddWithCarry(registers, x, y, false);
+			trace_apsr(APSR(registers));
+		}
+	}
+}
 
-	uint8_t mask3 = (mask & 0b1000) >> 3;
-	uint8_t mask2 = (mask & 0b0100) >> 2;
-	uint8_t mask1 = (mask & 0b0010) >> 1;
-	uint8_t mask0 = (mask & 0b0001) >> 0;
-
-	printf("  IT", get_condition_name(firstcond));
-	if (mask0 == 1) {
-		if (mask3 == firstcond0) { printf("T"); }
-		else                     { printf("E"); }
-		if (mask2 == firstcond0) { printf("T"); }
-		else                     { printf("E"); }
-		if (mask1 == firstcond0) { printf("T"); }
-		else                     { printf("E"); }
-	}
-	else if (mask1 == 1) {
-		if (mask3 == firstcond0) { printf("T"); }
-		else                     { printf("E"); }
-		if (mask2 == firstcond0) { printf("T"); }
-		else                     { printf("E"); }
-	}
-	else if (mask2 == 1) {
-		if (mask3 == firstcond0) { printf("T"); }
-		else                     { printf("E"); }
-	}
-	else {
-		assert(mask == 0b1000);
-	}
-
-	printf(" %s\n", get_condition_name(firstcond));
-
-	registers->itstate = (halfword & 0x00FF) >> 0;
-	printf("  > ITSTATE = %02X\n", registers->itstate);
-
-	is_it_inst = true;
-}
-
-static void LDR_immediate(struct registers *registers,
-                          uint8_t t, uint8_t n, uint32_t imm32,
-                          bool index, bool add, bool wback)
+static void a6_7_3_t1_disassemble(const struct inst *inst)
 {
-	if (index) {
-		if (!wback) {
-			printf("  LDR%s R%d, [R%d, #",
-			       get_condition_field(registers), t, n);
-			if (add) {
-				printf("+");
-			}
-			else {
-				printf("-");
-			}
-			printf("%d]\n", imm32);
-		}
-		else {
-			printf("  LDR%s R%d, [R%d, #",
-			       get_condition_field(registers), t, n);
-			if (add) {
-				printf("+");
-			}
-			else {
-				printf("-");
-			}
-			printf("%d]!\n", imm32);
-		}
+	printf("  ADD");
+	if (inst->setflags) {
+		printf("S");
 	}
 	else {
-		// wback == TRUE
-		printf("  LDR%s R%d, [R%d], #",
-		       get_condition_field(registers), t, n);
-		if (add) {
-			printf("+");
-		}
-		else {
-			printf("-");
-		}
-		printf("%d\n", imm32);
-	}
-
-	if (ConditionPassed(registers)) {
-		uint32_t offset_addr;
-		if (add) {
-			offset_addr = registers->r[n] + imm32;
-		}
-		else {
-			offset_addr = registers->r[n] - imm32;
-		}
-
-		uint32_t address;
-		if (index) {
-			address = offset_addr;
-		}
-		else {
-			address = registers->r[n];
-		}
-
-		uint32_t data = memory_word_read(address);
-		if (wback) {
-			registers->r[n] = offset_addr;
-			printf("  > R%d = %08X\n", n, registers->r[n]);
-		}
-
-		if (t == 15) {
-			assert(false);
-		}
-		else {
-			registers->r[t] = data;
-			printf("  > R%d = %08X\n", t, registers->r[t]);
-		}
+		printf("%s", get_condition_name(inst->cond));
 	}
+	printf(" R%d, R%d, #%d\n", inst->d, inst->n, inst->imm32);
 }
 
-static void a6_7_42_t1(struct registers *registers,
-                       uint16_t halfword)
+static void a6_7_3_t1(struct registers *registers, struct inst *inst,
+                      uint16_t halfword)
 {
-	uint8_t imm5 = (halfword & 0x07C0) >> 6;
+	uint8_t imm3 = (halfword & 0x01C0) >> 6;
 	uint8_t n    = (halfword & 0x0038) >> 3;
-	uint8_t t    = (halfword & 0x0007) >> 0;
+	uint8_t d    = (halfword & 0x0007) >> 0;
 
-	uint32_t imm32 = imm5 << 2;
-	bool index = true;
-	bool add = true;
-	bool wback = false;
+	inst->d = d;
+	inst->n = n;
+	inst->setflags = !InITBlock(registers);
+	inst->imm32 = imm3;
+	inst->execute = ADD_immediate;
+	inst->disassemble = a6_7_3_t1_disassemble;
+}
 
-	LDR_immediate(registers, t, n, imm32, index, add, wback);
+static void a6_7_3_t2_disassemble(const struct inst *inst)
+{
+	printf("  ADD");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf(" R%d #%d\n", inst->d, inst->imm32);
 }
 
-static void a6_7_42_t2(struct registers *registers,
-                       uint16_t halfword)
+static void a6_7_3_t2(struct registers *registers, struct inst *inst,
+                      uint16_t halfword)
 {
-	uint8_t t    = (halfword & 0x0700) >> 8;
+	uint8_t d    = (halfword & 0x0700) >> 8;
 	uint8_t imm8 = (halfword & 0x00FF) >> 0;
 
-	uint8_t n    = 13;
-	uint32_t imm32 = imm8 << 2;
-	bool index = true;
-	bool add = true;
-	bool wback = false;
-
-	LDR_immediate(registers, t, n, imm32, index, add, wback);
+	inst->d = d;
+	inst->n = d;
+	inst->setflags = !InITBlock(registers);
+	inst->imm32 = imm8;
+	inst->execute = ADD_immediate;
+	inst->disassemble = a6_7_3_t2_disassemble;
 }
 
-static void a6_7_42_t3(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
+static void a6_7_3_t3_disassemble(const struct inst *inst)
 {
-	uint8_t  n     =  (first_halfword & 0x000F) >>  0;
-	uint8_t  t     = (second_halfword & 0xF000) >> 12;
-	uint16_t imm12 = (second_halfword & 0x0FFF) >>  0;
-
-	uint32_t imm32 = imm12;
-	bool index = true;
-	bool add = true;
-	bool wback = false;
-
-	LDR_immediate(registers, t, n, imm32, index, add, wback);
+	printf("  ADD");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf("%s.W R%d, R%d, #%d\n",
+	       get_condition_name(inst->cond), inst->d, inst->n, inst->imm32);
 }
 
-static void a6_7_42_t4(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
+static void a6_7_3_t3(struct registers *registers, struct inst *inst,
+                      uint16_t first_halfword,
+                      uint16_t second_halfword)
 {
+	uint8_t i    =  (first_halfword & 0x0400) >> 10;
+	uint8_t S    =  (first_halfword & 0x0010) >>  4;
 	uint8_t n    =  (first_halfword & 0x000F) >>  0;
-	uint8_t t    = (second_halfword & 0xF000) >> 12;
-	uint8_t P    = (second_halfword & 0x0400) >> 10;
-	uint8_t U    = (second_halfword & 0x0200) >>  9;
-	uint8_t W    = (second_halfword & 0x0100) >>  8;
+	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
+	uint8_t d    = (second_halfword & 0x0F00) >>  8;
 	uint8_t imm8 = (second_halfword & 0x00FF) >>  0;
 
-	uint32_t imm32 = imm8;
-	bool index = P == 1;
-	bool add = U == 1;
-	bool wback = W == 1;
-
-	assert(!(wback && (n == t)));
-	assert(!((t == 15)
-	         && InITBlock(registers) && !LastInITBlock(registers)));
-
-	assert(!(!index && !wback));
+	uint16_t imm12 = (i * 0x800)
+	                 + (imm3 * 0x100)
+	                 + imm8;
 
-	LDR_immediate(registers, t, n, imm32, index, add, wback);
+	inst->d = d;
+	inst->n = n;
+	inst->setflags = S == 1;
+	inst->imm32 = ThumbExpandImm(registers, imm12);
+	inst->execute = ADD_immediate;
+	inst->disassemble = a6_7_3_t3_disassemble;
 }
 
-static void LDR_literal(struct registers *registers,
-                        uint8_t t, uint32_t imm32, bool add)
+static void ADD_register(struct registers *registers, const struct inst *inst)
 {
-	if (ConditionPassed(registers)) {
-		uint32_t base = Align_PC_4(registers);
-		uint32_t address;
-		if (add) {
-			address = base + imm32;
-		}
-		else {
-			address = base - imm32;
-		}
-		uint32_t data = memory_word_read(address);
-		if (t == 15) {
-			assert(false);
+	if (ConditionPassed(registers, inst)) {
+		uint32_t shifted = Shift(registers->r[inst->m], inst->shift_t,
+		                         inst->shift_n, APSR_C(registers));
+		uint32_t x = registers->r[inst->n];
+		uint32_t y = shifted;
+		struct ResultCarryOverflowTuple T = AddWithCarry(x, y, false);
+		if (inst->d == 15) {
+			assert(false); // TODO
 		}
 		else {
-			registers->r[t] = data;
-			printf("  > R%d = %08X\n", t, registers->r[t]);
+			registers->r[inst->d] = T.result;
+			trace_register(inst->d, registers->r[inst->d]);
+			if (inst->setflags) {
+				setflags_AddWithCarry(registers, x, y, false);
+				trace_apsr(APSR(registers));
+			}
 		}
 	}
 }
 
-static void a6_7_43_t1(struct registers *registers, uint16_t halfword)
-{
-	uint8_t t = (halfword & 0x0700) >> 8;
-	uint8_t imm8 = halfword;
-
-	uint32_t imm32 = imm8 * 0x4;
-
-	printf("  LDR R%d [PC, #%d]\n", t, imm32);
-	LDR_literal(registers, t, imm32, true);
-}
-
-static void LDR_register(struct registers *registers,
-                         uint8_t t, uint8_t n, uint8_t m,
-                         bool index, bool add, bool wback,
-                         enum SRType shift_t, uint8_t shift_n)
+static void a6_7_4_t1_disassemble(const struct inst *inst)
 {
-	if (ConditionPassed(registers)) {
-		uint32_t offset = Shift(registers->r[m], shift_t,
-		                        shift_n, APSR_C(registers));
-		uint32_t offset_addr;
-		if (add) {
-			offset_addr = registers->r[n] + offset;
-		}
-		else {
-			offset_addr = registers->r[n] - offset;
-		}
-		uint32_t address;
-		if (index) {
-			address = offset_addr;
-		}
-		else {
-			address = registers->r[n];
-		}
-		uint32_t data = memory_word_read(address);
-		if (wback) {
-			registers->r[n] = offset_addr;
-			printf("  > R%d = %08X\n", n, registers->r[n]);
-		}
-
-		if (t == 15) {
-			assert(false);
-		}
-		else {
-			registers->r[t] = data;
-			printf("  > R%d = %08X\n", t, registers->r[t]);
-		}
+	if (inst->setflags) {
+		printf("  ADDS R%d, R%d, R%d\n", inst->d, inst->n, inst->m);
+	}
+	else {
+		printf("  ADD%s R%d, R%d, R%d\n",
+		       get_condition_name(inst->cond),
+		       inst->d, inst->n, inst->m);
 	}
 }
 
-static void a6_7_44_t1(struct registers *registers, uint16_t halfword)
+static void a6_7_4_t1(struct registers *registers, struct inst *inst,
+                      uint16_t halfword)
 {
 	uint8_t m = (halfword & 0x01C0) >> 6;
 	uint8_t n = (halfword & 0x0038) >> 3;
-	uint8_t t = (halfword & 0x0007) >> 0;
-
-	bool index = true;
-	bool add = true;
-	bool wback = false;
-	enum SRType shift_t = SRType_LSL;
-	uint8_t shift_n = 0;
-
-	printf("  LDR%s R%d, [R%d, R%d]\n",
-	       get_condition_field(registers), t, n, m);
+	uint8_t d = (halfword & 0x0007) >> 0;
 
-	LDR_register(registers, t, n, m, index, add, wback, shift_t, shift_n);
+	inst->d = d;
+	inst->n = n;
+	inst->m = m;
+	inst->setflags = !InITBlock(registers);
+	inst->shift_t = SRType_LSL;
+	inst->shift_n = 0;
+	inst->execute = ADD_register;
+	inst->disassemble = a6_7_4_t1_disassemble;
 }
 
-static void a6_7_44_t2(struct registers *registers,
-                       uint16_t first_halfword, uint16_t second_halfword)
+static void a6_7_4_t2_disassemble(const struct inst *inst)
 {
-	uint8_t n    =  (first_halfword & 0x000F) >>  0;
-	uint8_t t    = (second_halfword & 0xF000) >> 12;
-	uint8_t imm2 = (second_halfword & 0x0030) >>  4;
-	uint8_t m    = (second_halfword & 0x000F) >>  0;
+	printf("  ADD%s R%d, R%d\n",
+	       get_condition_name(inst->cond), inst->d, inst->m);
+}
 
-	bool index = true;
-	bool add = true;
-	bool wback = false;
-	enum SRType shift_t = SRType_LSL;
-	uint8_t shift_n = imm2;
+static void a6_7_4_t2(struct registers *registers, struct inst *inst,
+                      uint16_t halfword)
+{
+	uint8_t DN = (halfword & 0x0080) >> 7;
+	uint8_t m = (halfword & 0x0078) >> 3;
+	uint8_t Rdn = (halfword & 0x0007) >> 0;
 
-	assert(!(m == 13 || m == 15));
-	assert(!(t == 15 && InITBlock(registers)
-	         && !LastInITBlock(registers)));
+	uint8_t dn = (DN << 3) | Rdn;
 
-	printf("  LDR%s.W R%d, [R%d, R%d",
-	       get_condition_field(registers), t, n, m);
-	if (shift_n != 0) {
-		printf(", LSL #%d", shift_n);
-	}
-	printf("]\n");
+	assert(dn != 15);
 
-	LDR_register(registers, t, n, m, index, add, wback, shift_t, shift_n);
+	inst->d = dn;
+	inst->n = dn;
+	inst->m = m;
+	inst->setflags = false;
+	inst->shift_t = SRType_LSL;
+	inst->shift_n = 0;
+	inst->execute = ADD_register;
+	inst->disassemble = a6_7_4_t2_disassemble;
 }
 
-static void LDRB_immediate(struct registers *registers,
-                           uint8_t t, uint8_t n, int32_t imm32,
-                           bool index, bool add, bool wback)
+static void a6_7_4_t3_disassemble(const struct inst *inst)
 {
-	if (ConditionPassed(registers)) {
-		uint32_t offset_addr;
-		if (add) {
-			offset_addr = registers->r[n] + imm32;
-		}
-		else {
-			offset_addr = registers->r[n] - imm32;
-		}
-		uint32_t address;
-		if (index) {
-			address = offset_addr;
-		}
-		else {
-			address = registers->r[n];
-		}
-
-		uint8_t data = memory_byte_read(address);
-		registers->r[t] = data;
-		printf("  > R%d = %08X\n", t, registers->r[t]);
-
-		if (wback) {
-			registers->r[n] = offset_addr;
-			printf("  > R%d = %08X\n", n, registers->r[n]);
-		}
+	printf("  ADD");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf("%s", get_condition_name(inst->cond));
+	printf(".W");
+	printf(" R%d, R%d, R%d", inst->d, inst->n, inst->m);
+	if (inst->shift_n != 0) {
+		printf(", <shift>");
 	}
+	printf("\n");
 }
 
-static void a6_7_45_t1(struct registers *registers,
-                       uint16_t halfword)
+static void a6_7_4_t3(struct registers *registers, struct inst *inst,
+                      uint16_t first_halfword,
+                      uint16_t second_halfword)
 {
-	uint8_t imm5 = (halfword & 0x07C0) >> 6;
-	uint8_t n    = (halfword & 0x0038) >> 3;
-	uint8_t t    = (halfword & 0x0007) >> 0;
-
-	uint32_t imm32 = imm5;
-	bool index = true;
-	bool add = true;
-	bool wback = false;
+	uint8_t S = (first_halfword & 0x0010) >> 4;
+	uint8_t n = (first_halfword & 0x000F) >> 0;
+	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
+	uint8_t d = (second_halfword & 0x0F00) >> 8;
+	uint8_t imm2 = (second_halfword & 0x00C0) >> 6;
+	uint8_t type = (second_halfword & 0x0030) >> 4;
+	uint8_t m = (second_halfword & 0x000F) >> 0;
 
-	printf("  LDRB%s R%d [R%d, #%d]\n",
-	       get_condition_field(registers), t, n, imm32);
+	uint8_t imm5 = (imm3 << 2) | imm2;
+	struct ShiftTNTuple T = DecodeImmShift(type, imm5);
 
-	LDRB_immediate(registers, t, n, imm32, index, add, wback);
+	inst->d = d;
+	inst->n = n;
+	inst->m = m;
+	inst->setflags = S == 1;
+	inst->shift_t = T.shift_t;
+	inst->shift_n = T.shift_n;
+	inst->execute = ADD_register;
+	inst->disassemble = a6_7_4_t3_disassemble;
 }
 
-static void a6_7_45_t2(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
+static void ADD_SP_plus_immediate(struct registers *registers,
+                                  const struct inst *inst)
 {
-	uint8_t  n     =  (first_halfword & 0x000F) >>  0;
-	uint8_t  t     = (second_halfword & 0xF000) >> 12;
-	uint16_t imm12 = (second_halfword & 0x0FFF) >>  0;
-
-	uint32_t imm32 = imm12;
-	bool index = true;
-	bool add = true;
-	bool wback = false;
-
-	assert(!(t == 13));
-
-	printf("  LDRB%s.W R%d, [R%d, #%d]\n",
-	       get_condition_field(registers), t, n, imm32);
-
-	LDRB_immediate(registers, t, n, imm32, index, add, wback);
+	if (ConditionPassed(registers, inst)) {
+		uint32_t x = SP(registers);
+		uint32_t y = inst->imm32;
+		struct ResultCarryOverflowTuple T = AddWithCarry(x, y, false);
+		registers->r[inst->d] = T.result;
+		trace_register(inst->d, registers->r[inst->d]);
+		if (inst->setflags) {
+			setflags_AddWithCarry(registers, x, y, false);
+			trace_apsr(APSR(registers));
+		}
+	}
 }
 
-static void LDRB_register(struct registers *registers,
-                          uint8_t t, uint8_t n, uint8_t m,
-                          bool index, bool add, bool wback,
-                          enum SRType shift_t, uint8_t shift_n)
+static void a6_7_5_t1_disassemble(const struct inst *inst)
 {
-	assert(shift_t == SRType_LSL);
-	assert(shift_n == 0);
+	printf("  ADD%s R%d, SP, #%d\n",
+	       get_condition_name(inst->cond), inst->d, inst->imm32 >> 2);
+}
 
-	if (ConditionPassed(registers)) {
-		uint32_t offset = registers->r[m];
-		uint32_t offset_addr;
-		if (add) {
-			offset_addr = registers->r[n] + offset;
-		}
-		else {
-			offset_addr = registers->r[n] - offset;
-		}
-		uint32_t address;
-		if (index) {
-			address = offset_addr;
-		}
-		else {
-			address = registers->r[n];
-		}
-		uint32_t data = memory_byte_read(address); // ZeroExtend
+static void a6_7_5_t1(struct registers *registers, struct inst *inst,
+                      uint16_t halfword)
+{
+	uint8_t d = (halfword & 0x0700) >> 8;
+	uint8_t imm8 = (halfword & 0x00FF) >> 0;
 
-		registers->r[t] = data;
-		printf("  > R%d = %08X\n", t, registers->r[t]);
-	}
+	inst->d = d;
+	inst->setflags = false;
+	inst->imm32 = imm8 << 2;
+	inst->execute = ADD_SP_plus_immediate;
+	inst->disassemble = a6_7_5_t1_disassemble;
 }
 
-static void a6_7_47_t1(struct registers *registers,
-                       uint16_t halfword)
+static void a6_7_5_t2_disassemble(const struct inst *inst)
 {
-	uint8_t m = (halfword & 0x01C0) >> 6;
-	uint8_t n = (halfword & 0x0038) >> 3;
-	uint8_t t = (halfword & 0x0007) >> 0;
-
-	bool index = true;
-	bool add = true;
-	bool wback = false;
+	printf("  ADD%s SP, SP, #%d\n",
+	       get_condition_name(inst->cond), inst->imm32 >> 2);
+}
 
-	enum SRType shift_t = SRType_LSL;
-	uint8_t shift_n = 0;
+static void a6_7_5_t2(struct registers *registers, struct inst *inst,
+                      uint16_t halfword)
+{
+	uint8_t imm7 = (halfword & 0x007F) >> 0;
 
-	printf("  LDRB%s R%d [R%d, R%d]\n",
-	       get_condition_field(registers), t, n, m);
-	LDRB_register(registers, t, n, m, index, add, wback, shift_t, shift_n);
+	inst->d = 13;
+	inst->setflags = false;
+	inst->imm32 = imm7 << 2;
+	inst->execute = ADD_SP_plus_immediate;
+	inst->disassemble = a6_7_5_t2_disassemble;
 }
 
-static void LSL_immediate(struct registers *registers,
-                          uint8_t d, uint8_t m, bool setflags, uint8_t shift_n)
+static void AND_immediate(struct registers *registers, const struct inst *inst)
 {
-	if (ConditionPassed(registers)) {
-		struct ResultCarryTuple T =
-			Shift_C(registers->r[m], SRType_LSL,
-			        shift_n, APSR_C(registers));
-		registers->r[d] = T.result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
+	if (ConditionPassed(registers, inst)) {
+		struct ResultCarryTuple T;
+		T.result = registers->r[inst->n] & inst->imm32;
+		T.carry = ThumbExpandImm_carry(registers, inst);
+		registers->r[inst->d] = T.result;
+		trace_register(inst->d, registers->r[inst->d]);
+		if (inst->setflags) {
 			setflags_ResultCarryTuple(registers, T);
-			printf("  > APSR = %08X\n", registers->apsr);
+			trace_apsr(APSR(registers));
 		}
 	}
 }
 
-static void a6_7_67_t1(struct registers *registers,
-                       uint16_t halfword)
+static void a6_7_8_t1_disassemble(const struct inst *inst)
 {
-	uint8_t imm5 = (halfword & 0x07C0) >> 6;
-	uint8_t m = (halfword & 0x0038) >> 3;
-	uint8_t d = (halfword & 0x0007) >> 0;
-
-	bool setflags = !InITBlock(registers);
-	struct ShiftTNTuple T = DecodeImmShift(0b00, imm5);
-	uint8_t shift_n = T.shift_n;
-
-	printf("  LSL");
-	if (setflags) {
-		printf("S");
+	if (inst->setflags) {
+		printf("  ANDS%s R%d, R%d, #0x%08X\n",
+		       get_condition_name(inst->cond),
+		       inst->d, inst->n, inst->imm32);
 	}
-	printf(" R%d, R%d, #%d\n", d, m, shift_n);
-
-	LSL_immediate(registers, d, m, setflags, shift_n);
-}
-
-static void LSL_register(struct registers *registers,
-                          uint8_t d, uint8_t n, uint8_t m, bool setflags)
-{
-	if (ConditionPassed(registers)) {
-		uint8_t shift_n = (registers->r[m] & 0x000000FF);
-		struct ResultCarryTuple T =
-			Shift_C(registers->r[n], SRType_LSL,
-			        shift_n, APSR_C(registers));
-		registers->r[d] = T.result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
-			setflags_ResultCarryTuple(registers, T);
-			printf("  > APSR = %08X\n", registers->apsr);
-		}
+	else {
+		printf("  AND%s R%d, R%d, #0x%08X\n",
+		       get_condition_name(inst->cond),
+		       inst->d, inst->n, inst->imm32);
 	}
 }
 
-static void a6_7_68_t2(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
+static void a6_7_8_t1(struct registers *registers, struct inst *inst,
+                      uint16_t first_halfword,
+                      uint16_t second_halfword)
 {
-	uint8_t S =  (first_halfword & 0x0010) >> 4;
-	uint8_t n =  (first_halfword & 0x000F) >> 0;
+	uint8_t i = (first_halfword & 0x0400) >> 10;
+	uint8_t S = (first_halfword & 0x0010) >> 4;
+	uint8_t n = (first_halfword & 0x000F) >> 0;
+	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
 	uint8_t d = (second_halfword & 0x0F00) >> 8;
-	uint8_t m = (second_halfword & 0x000F) >> 0;
-
-	bool setflags = S == 1;
-
-	assert(!(d == 13 || d == 15 || n == 13 || n == 15));
+	uint8_t imm8 = (second_halfword & 0x00FF) >> 0;
 
-	printf("  LSL");
-	if (setflags) {
-		printf("S");
+	if (d == 0xF && S == 1) {
+		assert(false);
 	}
-	printf("%s.W R%d, R%d, R%d\n",
-	       get_condition_field(registers), d, n, m);
 
-	LSL_register(registers, d, n, m, setflags);
+	uint16_t imm12 = (i * 0x800)
+	                 + (imm3 * 0x100)
+	                 + imm8;
+
+	inst->d = d;
+	inst->n = n;
+	inst->setflags = S == 1;
+	decode_ThumbExpandImm_C(inst, imm12);
+	inst->execute = AND_immediate;
+	inst->disassemble = a6_7_8_t1_disassemble;
 }
 
-static void LSR_immediate(struct registers *registers,
-                          uint8_t d, uint8_t m, bool setflags, uint8_t shift_n)
+static void ASR_immediate(struct registers *registers, const struct inst *inst)
 {
-	printf("  LSR");
-	if (setflags) {
-		printf("S");
-	}
-	printf("%s R%d, R%d, #%d\n",
-	       get_condition_field(registers), d, m, shift_n);
-
-	if (ConditionPassed(registers)) {
+	if (ConditionPassed(registers, inst)) {
 		struct ResultCarryTuple T =
-			Shift_C(registers->r[m], SRType_LSR, shift_n,
-			        APSR_C(registers));
-		registers->r[d] = T.result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-
-		if (setflags) {
+			Shift_C(registers->r[inst->m], SRType_ASR,
+			        inst->shift_n, APSR_C(registers));
+		registers->r[inst->d] = T.result;
+		trace_register(inst->d, registers->r[inst->d]);
+		if (inst->setflags) {
 			setflags_ResultCarryTuple(registers, T);
-			printf("  > APSR = %08X\n", registers->apsr);
+			trace_apsr(APSR(registers));
 		}
 	}
 }
 
-static void a6_7_69_t1(struct registers *registers,
+static void a6_7_10_t1_disassemble(const struct inst *inst)
+{
+	printf("  ASR");
+	if (inst->setflags) {
+		printf("S");
+	}
+	else {
+		printf("%s", get_condition_name(inst->cond));
+	}
+	printf(" R%d, R%d, #%d\n", inst->d, inst->m, inst->shift_n & 0x1F);
+}
+
+static void a6_7_10_t1(struct registers *registers, struct inst *inst,
                        uint16_t halfword)
 {
 	uint8_t imm5 = (halfword & 0x07C0) >> 6;
-	uint8_t m    = (halfword & 0x0038) >> 3;
-	uint8_t d    = (halfword & 0x0007) >> 0;
+	uint8_t m = (halfword & 0x0038) >> 3;
+	uint8_t d = (halfword & 0x0007) >> 0;
 
-	bool setflags = !InITBlock(registers);
+	struct ShiftTNTuple T = DecodeImmShift(0b10, imm5);
 
-	struct ShiftTNTuple T = DecodeImmShift(0b01, imm5);
-	uint8_t shift_n = T.shift_n;
+	inst->d = d;
+	inst->m = m;
+	inst->setflags = !InITBlock(registers);
+	inst->shift_n = T.shift_n;
+	inst->execute = ASR_immediate;
+	inst->disassemble = a6_7_10_t1_disassemble;
+}
 
-	LSR_immediate(registers, d, m, setflags, shift_n);
+static void a6_7_10_t2_disassemble(const struct inst *inst)
+{
+	printf("  ASR");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf("%s.W R%d, R%d, #%d\n",
+	       get_condition_name(inst->cond), inst->d, inst->m,
+	       inst->shift_n & 0x1F);
 }
 
-static void a6_7_69_t2(struct registers *registers,
+static void a6_7_10_t2(struct registers *registers, struct inst *inst,
                        uint16_t first_halfword,
                        uint16_t second_halfword)
 {
@@ -2023,823 +2343,721 @@ static void a6_7_69_t2(struct registers *registers,
 	uint8_t imm2 = (second_halfword & 0x00C0) >>  6;
 	uint8_t m    = (second_halfword & 0x000F) >>  0;
 
-	bool setflags = S == 1;
-
 	uint8_t imm5 = (imm3 << 2) | imm2;
-	struct ShiftTNTuple T = DecodeImmShift(0b01, imm5);
-	uint8_t shift_n = T.shift_n;
+	struct ShiftTNTuple T = DecodeImmShift(0b10, imm5);
 
 	assert(!(d == 13 || d == 15 || m == 13 || m == 15));
 
-	LSR_immediate(registers, d, m, setflags, shift_n);
+	inst->d = d;
+	inst->m = m;
+	inst->setflags = S == 1;
+	inst->shift_n = T.shift_n;
+	inst->execute = ASR_immediate;
+	inst->disassemble = a6_7_10_t2_disassemble;
+}
+
+/* Exception entry and return (B1.5.6 to B1.5.8), everything runs on the
+   main stack.  An exception return is only noted when the PC is written
+   and happens once the instruction is done, the way POP also updates SP
+   after loading the PC */
+#define EXC_RETURN_HANDLER 0xFFFFFFF1
+#define EXC_RETURN_THREAD_MSP 0xFFFFFFF9
+#define EXCEPTION_ENTRY_CYCLES 12
+#define EXCEPTION_RETURN_CYCLES 10
+#define XPSR_STACK_ALIGNED 0x00000200
+
+static uint32_t XPSR(struct registers *registers)
+{
+	return (APSR(registers) & 0xF8000000)
+	       | 0x01000000 // Thumb
+	       | ((registers->itstate & 0x03) << 25)
+	       | ((registers->itstate & 0xFC) << 8)
+	       | registers->ipsr;
+}
+
+static void exception_entry(struct registers *registers, uint32_t number)
+{
+	uint32_t return_address = registers->r[15];
+	uint32_t xpsr = XPSR(registers);
+	if ((registers->r[13] & 0x4) != 0) {
+		xpsr |= XPSR_STACK_ALIGNED;
+	}
+	uint32_t frame = (registers->r[13] - 0x20) & ~UINT32_C(7);
+	const uint32_t values[8] = {
+		registers->r[0], registers->r[1], registers->r[2],
+		registers->r[3], registers->r[12], registers->r[14],
+		return_address, xpsr,
+	};
+	for (uint8_t i = 0; i < 8; ++i) {
+		memory_word_write(frame + 4 * i, values[i]);
+	}
+
+	registers->r[13] = frame;
+	trace_register(13, registers->r[13]);
+	registers->r[14] = registers->ipsr != 0 ? EXC_RETURN_HANDLER
+	                                        : EXC_RETURN_THREAD_MSP;
+	trace_register(14, registers->r[14]);
+	registers->ipsr = number;
+	registers->itstate = 0;
+	board->exception_current = number;
+	exception_bit_set(board->exception_pending, number, false);
+	exception_bit_set(board->exception_active, number, true);
+	exceptions_update();
+
+	registers->r[15] = memory_word_read(board->VTOR + 4 * number)
+	                   & 0xFFFFFFFE;
+	board->cycles += EXCEPTION_ENTRY_CYCLES;
+	board->after_load_store = false;
+	trace_exception(number, return_address, registers->r[15]);
+}
+
+/* Takes the highest priority pending exception if it preempts what's
+   running, not inside an IT block */
+static bool exception_take(struct registers *registers)
+{
+	if (registers->primask != 0 || registers->itstate != 0) {
+		return false;
+	}
+	uint32_t priority = __builtin_ctz(board->pending_priorities) << 4;
+	if (priority >= board->execution_priority) {
+		return false;
+	}
+	exception_entry(registers, exception_highest_pending());
+	return true;
+}
+
+static void exception_return(struct registers *registers)
+{
+	assert(board->exc_return == EXC_RETURN_HANDLER
+	       || board->exc_return == EXC_RETURN_THREAD_MSP);
+	board->exc_return = 0;
+	exception_bit_set(board->exception_active, registers->ipsr, false);
+
+	uint32_t frame = registers->r[13];
+	uint32_t values[8];
+	for (uint8_t i = 0; i < 8; ++i) {
+		values[i] = memory_word_read(frame + 4 * i);
+	}
+	for (uint8_t i = 0; i < 4; ++i) {
+		registers->r[i] = values[i];
+	}
+	registers->r[12] = values[4];
+	registers->r[14] = values[5];
+	uint32_t xpsr = values[7];
+	registers->r[13] = frame + 0x20
+	                   + ((xpsr & XPSR_STACK_ALIGNED) != 0 ? 4 : 0);
+	trace_register(13, registers->r[13]);
+	registers->apsr = xpsr & 0xF8000000;
+	registers->flags_kind = FLAGS_APSR;
+	registers->ipsr = xpsr & 0x1FF;
+	registers->itstate = ((xpsr >> 8) & 0xFC) | ((xpsr >> 25) & 0x03);
+	board->exception_current = registers->ipsr;
+	exceptions_update();
+
+	registers->r[15] = values[6] & 0xFFFFFFFE;
+	trace_pc(registers->r[15]);
+	board->cycles += EXCEPTION_RETURN_CYCLES;
+	board->after_load_store = false;
 }
 
-static void a6_7_73_t1(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
+static void BranchTo(struct registers *registers, uint32_t address)
 {
-	uint8_t n = (first_halfword & 0x000F) >> 0;
-	uint8_t a = (second_halfword & 0xF000) >> 12;
-	uint8_t d = (second_halfword & 0x0F00) >> 8;
-	uint8_t m = (second_halfword & 0x000F) >> 0;
-
-	uint64_t result = registers->r[n] * registers->r[m] + registers->r[a];
-
-	printf("  MLA R%d, R%d, R%d, R%d\n", d, n, m, a);
-	registers->r[d] = (result & 0xFFFFFFFF);
-	printf("  > R%d = %08X\n", d, registers->r[d]);
+	registers->r[15] = address;
+	trace_pc(registers->r[15]);
+	board->is_branch = true;
 }
 
-static void a6_7_74_t1(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
+static void BranchWritePC(struct registers *registers, uint32_t address)
 {
-	uint8_t n = (first_halfword & 0x000F) >> 0;
-	uint8_t a = (second_halfword & 0xF000) >> 12;
-	uint8_t d = (second_halfword & 0x0F00) >> 8;
-	uint8_t m = (second_halfword & 0x000F) >> 0;
-
-	uint64_t result = registers->r[a] - registers->r[n] * registers->r[m];
-
-	printf("  MLS R%d, R%d, R%d, R%d\n", d, n, m, a);
-	registers->r[d] = (result & 0xFFFFFFFF);
-	printf("  > R%d = %08X\n", d, registers->r[d]);
+	BranchTo(registers, address & ~(0x1));
 }
 
-static void MOV_immediate(struct registers *registers,
-                          uint8_t d,
-                          bool setflags,
-                          uint32_t imm32,
-                          bool carry)
+static void BXWritePC(struct registers *registers, uint32_t address)
 {
-	if (ConditionPassed(registers)) {
-		uint32_t result = imm32;
-		registers->r[d] = imm32;
-		printf("  > R%d = %08X\n", d, imm32);
-		if (setflags) {
-			if ((result & 0x80000000) == 0x80000000) {
-				APSR_N_set(registers);
-			}
-			else {
-				APSR_N_clear(registers);
-			}
-			if (result == 0) {
-				APSR_Z_set(registers);
-			}
-			else {
-				APSR_Z_clear(registers);
-			}
-			if (carry) {
-				APSR_C_set(registers);
-			}
-			else {
-				APSR_C_clear(registers);
-			}
-			printf("  > APSR = %08X\n", registers->apsr);
-		}
+	if (registers->ipsr != 0 && (address & 0xF0000000) == 0xF0000000) {
+		board->exc_return = address;
+		BranchTo(registers, address);
+		return;
 	}
+	assert((address & 0x00000001) == 0x00000001);
+	BranchTo(registers, address & 0xFFFFFFFE);
 }
 
-static void a6_7_75_t1(struct registers *registers,
-                       uint16_t halfword)
+static void LoadWritePC(struct registers *registers, uint32_t address)
 {
-	uint8_t d = (halfword & 0x0700) >> 8;
-	uint8_t imm8 = (halfword & 0x00FF) >> 0;
-
-	bool setflags;
-	if (InITBlock(registers)) {
-		setflags = false;
-		printf("  MOV%s R%d, #%d\n",
-		       get_condition_field(registers), d, imm8);
-	}
-	else {
-		setflags = true;
-		printf("  MOVS R%d, #%d\n", d, imm8);
-	}
-	uint32_t imm32 = imm8;
-	bool carry = APSR_C(registers);
-
-	MOV_immediate(registers, d, setflags, imm32, carry);
+	BXWritePC(registers, address);
 }
 
-static void a6_7_75_t2(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
+static void B(struct registers *registers, const struct inst *inst)
 {
-	uint8_t i    =  (first_halfword & 0x0400) >> 10;
-	uint8_t S    =  (first_halfword & 0x0010) >>  4;
-	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-	uint8_t d    = (second_halfword & 0x0F00) >>  8;
-	uint8_t imm8 = (second_halfword & 0x00FF) >>  0;
-
-	bool setflags = S == 1;
-	uint16_t imm12 = (i << 11) | (imm3 << 8) | imm8;
-
-	struct ResultCarryTuple T = ThumbExpandImm_C(imm12, false);
-	uint32_t imm32 = T.result;
-	bool carry = T.result;
-
-	printf("  MOV");
-	if (setflags) {
-		printf("S");
+	if (ConditionPassed(registers, inst)) {
+		BranchWritePC(registers, PC(registers) + inst->imm32);
 	}
-	printf("%s.W R%d #0x%08X\n",
-	       get_condition_field(registers), d, T.result);
-
-	MOV_immediate(registers, d, setflags, imm32, carry);
 }
 
-static void a6_7_75_t3(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
+static void a6_7_12_disassemble(const struct inst *inst)
 {
-	uint8_t i = (first_halfword & 0x0400) >> 10;
-	uint8_t imm4 = (first_halfword & 0x000F);
-	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-	uint8_t rd = (0x0F00 & second_halfword) >> 8;
-	uint8_t imm8 = (second_halfword & 0x00FF);
-	uint32_t imm32 = (imm4 * 0x1000)
-	                 + (i * 0x0800)
-	                 + (imm3 * 0x0100)
-	                 + imm8;
-
-	registers->r[rd] = imm32;
-	printf("  MOVW R%d #0x%04X\n", rd, imm32);
-	printf("  > R%d = %08X\n", rd, imm32);
+	uint32_t address = inst->address + 4 + inst->imm32;
+	printf("  B%s label_%08X\n", get_condition_name(inst->cond), address);
 }
 
-static void a6_7_76_t1(struct registers *registers,
+/* Conditional branches carry their own condition instead of using ITSTATE */
+static void a6_7_12_t1(struct registers *registers, struct inst *inst,
                        uint16_t halfword)
 {
-	uint8_t D  = (halfword & 0x0080) >> 7;
-	uint8_t m  = (halfword & 0x0078) >> 3;
-	uint8_t Rd = (halfword & 0x0007) >> 0;
+	uint8_t cond = (halfword & 0x0F00) >> 8;
+	uint8_t imm8 = (halfword & 0x00FF) >> 0;
+	uint32_t imm32 = imm8 << 1;
 
-	uint8_t d = (D << 3) | Rd;
-	bool setflags = false;
+	// SignExtend
+	if ((imm32 & (1 << 8)) == (1 << 8)) {
+		imm32 |= 0xFFFFFE00;
+	}
 
-	uint32_t result = registers->r[m];
-	assert(d != 15);
+	inst->cond = cond;
+	inst->imm32 = imm32;
+	inst->execute = B;
+	inst->disassemble = a6_7_12_disassemble;
+}
 
-	printf("  MOV%s R%d, R%d\n", get_condition_field(registers), d, m);
+static void a6_7_12_t2(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
+{
+	uint16_t imm11 = (halfword & 0x07FF) >> 0;
+	uint32_t imm32 = imm11 << 1;
 
-	if (ConditionPassed(registers)) {
-		registers->r[d] = result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
+	if ((imm32 & (1 << 11)) == (1 << 11)) {
+		imm32 |= 0xFFFFF000;
 	}
+
+	inst->imm32 = imm32;
+	inst->execute = B;
+	inst->disassemble = a6_7_12_disassemble;
 }
 
-static void a6_7_78_t1(struct registers *registers,
+static void a6_7_12_t3(struct registers *registers, struct inst *inst,
                        uint16_t first_halfword,
                        uint16_t second_halfword)
 {
-	uint8_t i = (first_halfword & 0x0400) >> 10;
-	uint8_t imm4 = (first_halfword & 0x000F) >> 0;
-	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-	uint8_t d = (second_halfword & 0x0F00) >> 8;
-	uint8_t imm8 = (second_halfword & 0x00FF) >> 0;
+	uint8_t  S     =  (first_halfword & 0x0400) >> 10;
+	uint8_t  cond  =  (first_halfword & 0x03C0) >>  6;
+	uint8_t  imm6  =  (first_halfword & 0x003F) >>  0;
+	uint8_t  J1    = (second_halfword & 0x2000) >> 13;
+	uint8_t  J2    = (second_halfword & 0x0800) >> 11;
+	uint16_t imm11 = (second_halfword & 0x07FF) >>  0;
 
-	uint16_t imm16 = (imm4 << 12)
-	                 + (i << 11)
-	                 + (imm3 << 8)
-	                 + imm8;
+	uint32_t imm32 = (S << 20)
+	                 | (J2 << 19)
+	                 | (J1 << 18)
+	                 | (imm6 << 12)
+	                 | (imm11 << 1);
+	if (S == 1) {
+		imm32 |= 0xFFE00000;
+	}
 
-	printf("  MOVT%s R%d, #0x%04X\n",
-	       get_condition_field(registers), d, imm16);
+	assert(!InITBlock(registers));
 
-	registers->r[d] &= 0xFFFF;
-	registers->r[d] |= imm16 << 16;
-	printf("  > R%d = %08X\n", d, registers->r[d]);
+	inst->cond = cond;
+	inst->imm32 = imm32;
+	inst->execute = B;
+	inst->disassemble = a6_7_12_disassemble;
 }
 
-static void a6_7_84_t1(struct registers *registers,
+static void a6_7_12_t4(struct registers *registers, struct inst *inst,
                        uint16_t first_halfword,
                        uint16_t second_halfword)
 {
-	uint8_t i = (first_halfword & 0x0400) >> 10;
-	uint8_t S = (first_halfword & 0x0010) >> 4;
-	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-	uint8_t d = (second_halfword & 0x0F00) >> 8;
-	uint8_t imm8 = (second_halfword & 0x00FF) >> 0;
-
-	bool setflags = S == 1;
-
-	uint16_t imm12 = (i << 11) | (imm3 << 8) | imm8;
-
-	struct ResultCarryTuple T = ThumbExpandImm_C(imm12, APSR_C(registers));
-	uint32_t imm32 = T.result;
+	uint8_t  S     =  (first_halfword & 0x0400) >> 10;
+	uint16_t imm10 =  (first_halfword & 0x03FF) >>  0;
+	uint8_t  J1    = (second_halfword & 0x2000) >> 13;
+	uint8_t  J2    = (second_halfword & 0x0800) >> 11;
+	uint16_t imm11 = (second_halfword & 0x07FF) >>  0;
 
-	printf("  MVN");
-	if (setflags) {
-		printf("S");
+	uint8_t I1 = (~(J1 ^ S)) & 1;
+	uint8_t I2 = (~(J2 ^ S)) & 1;
+	uint32_t imm32 = (I1 * 0x800000)
+	                 + (I2 * 0x400000)
+	                 + (imm10 * 0x1000)
+	                 + (imm11 * 0x2);
+	if (S == 1) {
+		imm32 |= 0xFF000000;
 	}
-	printf("%s R%d, #0x%08X\n",
-	       get_condition_field(registers), d, imm32);
 
-	if (ConditionPassed(registers)) {
-		uint32_t result = ~imm32;
-		registers->r[d] = result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
-			T.result = result;
-			setflags_ResultCarryTuple(registers, T);
-			printf("  > APSR = %08X\n", registers->apsr);
-		}
-	}
+	inst->imm32 = imm32;
+	inst->execute = B;
+	inst->disassemble = a6_7_12_disassemble;
 }
 
-static void a6_7_87_t1(struct registers *registers, uint16_t halfword)
+static void BIC_immediate(struct registers *registers, const struct inst *inst)
 {
-	printf("  NOP\n");
+	if (ConditionPassed(registers, inst)) {
+		struct ResultCarryTuple T;
+		T.result = registers->r[inst->n] & (~inst->imm32);
+		T.carry = ThumbExpandImm_carry(registers, inst);
+		registers->r[inst->d] = T.result;
+		trace_register(inst->d, registers->r[inst->d]);
+		if (inst->setflags) {
+			setflags_ResultCarryTuple(registers, T);
+			trace_apsr(APSR(registers));
+		}
+	}
 }
 
-static void a6_7_89_t1(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
+static void a6_7_15_t1_disassemble(const struct inst *inst)
 {
-	assert(false);
+	printf("  BIC");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf("%s R%d, R%d, #0x%08X\n",
+	       get_condition_name(inst->cond), inst->d, inst->n, inst->imm32);
 }
 
-static void a6_7_90_t1(struct registers *registers,
+static void a6_7_15_t1(struct registers *registers, struct inst *inst,
                        uint16_t first_halfword,
                        uint16_t second_halfword)
 {
-	uint8_t i = (first_halfword & 0x0400) >> 10;
-	uint8_t S = (first_halfword & 0x0010) >> 4;
-	uint8_t n = (first_halfword & 0x000F) >> 0;
+	uint8_t i    =  (first_halfword & 0x0400) >> 10;
+	uint8_t S    =  (first_halfword & 0x0010) >>  4;
+	uint8_t n    =  (first_halfword & 0x000F) >>  0;
 	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-	uint8_t d = (second_halfword & 0x0F00) >> 8;
-	uint8_t imm8 = (second_halfword & 0x00FF) >> 0;
+	uint8_t d    = (second_halfword & 0x0F00) >>  8;
+	uint8_t imm8 = (second_halfword & 0x00FF) >>  0;
 
 	uint16_t imm12 = (i << 11) | (imm3 << 8) | imm8;
+	assert(!(d == 13 || d == 15 || n == 13 || n == 15));
 
-	struct ResultCarryTuple T = ThumbExpandImm_C(imm12, APSR_C(registers));
-	uint32_t imm32 = T.result;
+	inst->d = d;
+	inst->n = n;
+	inst->setflags = S == 1;
+	decode_ThumbExpandImm_C(inst, imm12);
+	inst->execute = BIC_immediate;
+	inst->disassemble = a6_7_15_t1_disassemble;
+}
 
-	bool setflags = S == 1;
+static void BL(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint32_t next_instr_addr = registers->r[15] + 4;
+		uint32_t lr_value = next_instr_addr | 0x1;
+		uint32_t address = registers->r[15] + 4 + inst->imm32;
+		/* Set the last bit to zero */
+		address &= 0xFFFFFFFE;
 
-	printf("  ORR");
-	if (setflags) {
-		printf("S");
-	}
-	printf("%s R%d, R%d, #0x%08X\n",
-	       get_condition_field(registers), d, n, imm32);
+		registers->r[14] = lr_value;
+		trace_register(14, lr_value);
+		registers->r[15] = address;
+		trace_register(15, address);
 
-	if (ConditionPassed(registers)) {
-		uint32_t result = registers->r[n] | imm32;
-		registers->r[d] = result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
-			T.result = result;
-			setflags_ResultCarryTuple(registers, T);
-			printf("  > APSR = %08X\n", registers->apsr);
-		}
+		board->is_branch = true;
 	}
 }
 
-static void ORR_register(struct registers *registers,
-                         uint8_t d, uint8_t n, uint8_t m, bool setflags,
-                         enum SRType shift_t, uint8_t shift_n)
+static void a6_7_18_t1_disassemble(const struct inst *inst)
 {
-	if (ConditionPassed(registers)) {
-		struct ResultCarryTuple T =
-			Shift_C(registers->r[m], shift_t, shift_n,
-			        APSR_C(registers));
-		uint32_t shifted = T.result;
-		uint32_t result = registers->r[m] | shifted;
-		registers->r[d] = result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
-			T.result = result;
-			setflags_ResultCarryTuple(registers, T);
-			printf("  > APSR = %08X\n", registers->apsr);
-		}
-	}
+	uint32_t address = (inst->address + 4 + inst->imm32) & 0xFFFFFFFE;
+	printf("  BL label_%08X\n", address);
 }
 
-static void a6_7_91_t1(struct registers *registers,
-                       uint16_t halfword)
+static void a6_7_18_t1(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
 {
-	uint8_t m  = (halfword & 0x0038) >>  3;
-	uint8_t dn = (halfword & 0x0007) >>  0;
-
-	uint8_t d = dn;
-	uint8_t n = dn;
-	bool setflags = !InITBlock(registers);
-	enum SRType shift_t = SRType_LSL;
-	uint8_t shift_n = 0;
+	uint8_t  S     =  (first_halfword & 0x0400) >> 10;
+	uint16_t imm10 =  (first_halfword & 0x03FF) >>  0;
+	uint8_t  J1    = (second_halfword & 0x2000) >> 13;
+	uint8_t  J2    = (second_halfword & 0x0800) >> 11;
+	uint16_t imm11 = (second_halfword & 0x07FF) >>  0;
 
-	printf("  ORR");
-	if (setflags) {
-		printf("S");
+	uint8_t I1 = (~(J1 ^ S)) & 1;
+	uint8_t I2 = (~(J2 ^ S)) & 1;
+	uint32_t imm32 = (I1 * 0x800000)
+	                 + (I2 * 0x400000)
+	                 + (imm10 * 0x1000)
+	                 + (imm11 * 0x2);
+	if (S == 1) {
+		imm32 |= 0xFF000000;
 	}
-	printf("%s R%d, R%d\n",
-	       get_condition_field(registers), dn, m);
 
-	ORR_register(registers, d, n, m, setflags, shift_t, shift_n);
+	inst->imm32 = imm32;
+	inst->execute = BL;
+	inst->disassemble = a6_7_18_t1_disassemble;
 }
 
-static void a6_7_91_t2(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
+static void BLX_register(struct registers *registers, const struct inst *inst)
 {
-	uint8_t S    =  (first_halfword & 0x0010) >>  4;
-	uint8_t n    =  (first_halfword & 0x000F) >>  0;
-	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-	uint8_t d    = (second_halfword & 0x0F00) >>  8;
-	uint8_t imm2 = (second_halfword & 0x00C0) >>  6;
-	uint8_t type = (second_halfword & 0x0030) >>  4;
-	uint8_t m    = (second_halfword & 0x000F) >>  0;
-
-	bool setflags = S == 1;
-	uint8_t imm5 = (imm3 << 2) | imm2;
-	struct ShiftTNTuple T = DecodeImmShift(type, imm5);
-	enum SRType shift_t = T.shift_t;
-	uint8_t shift_n = T.shift_n;
-
-	assert(!(d == 13 || d == 15 || n == 13 || m == 13 || m == 15));
-
-	printf("  ORR");
-	if (setflags) {
-		printf("S");
-	}
-	printf("%s.W R%d, R%d, R%d",
-	       get_condition_field(registers), d, n, m);
-	if (shift_n != 0) {
-		printf(", <shift>");
+	if (ConditionPassed(registers, inst)) {
+		uint32_t target = registers->r[inst->m];
+		uint32_t next_instr_address = PC(registers) - 2;
+		registers->r[14] = next_instr_address | 0b1;
+		trace_register(14, registers->r[14]);
+		BXWritePC(registers, target);
 	}
-	printf("\n");
-
-	ORR_register(registers, d, n, m, setflags, shift_t, shift_n);
 }
 
-static void POP(struct registers *registers,
-                uint16_t all_registers)
+static void a6_7_19_t1_disassemble(const struct inst *inst)
 {
-	if (ConditionPassed(registers)) {
-		uint32_t address = SP(registers);
-		for (uint8_t i = 0; i < 15; ++i) {
-			if ((all_registers & (0x0001 << i)) == (0x0001 << i)) {
-				registers->r[i] = memory_word_read(address);
-				printf("  > R%d = %08X (MemA[%08X, 4])\n",
-				       i, registers->r[i], address);
-				address += 4;
-			}
-		}
-		if ((all_registers & (0x0001 << 15)) == (0x0001 << 15)) {
-			uint32_t arg = memory_word_read(address);
-			LoadWritePC(registers, arg);
-		}
-		uint8_t bit_count = __builtin_popcount(all_registers);
-		address = registers->r[13] + 4 * bit_count;
-		registers->r[13] = address;
-		printf("  > R13 = %08X\n", address);
-	}
+	printf("  BLX%s R%d\n", get_condition_name(inst->cond), inst->m);
 }
 
-static void a6_7_97_t1(struct registers *registers,
+static void a6_7_19_t1(struct registers *registers, struct inst *inst,
                        uint16_t halfword)
 {
-	uint8_t register_list = (halfword & 0x00FF) >> 0;
-	uint8_t P = (halfword & 0x0100) >> 8;
-
-	uint16_t all_registers = (P << 15) | register_list;
-	uint8_t bit_count = __builtin_popcount(all_registers);
-
-	printf("  POP {");
-	bool first = false;
-	for (uint8_t i = 0; i < 16; ++i) {
-		if ((all_registers & (0x0001 << i)) == (0x0001 << i)) {
-			if (!first) {
-				first = true;
-			}
-			else {
-				printf(", ");
-			}
-			printf("R%d", i);
-		}
-	}
-	printf("}\n");
+	uint8_t m = (halfword & 0x0078) >> 3;
 
-	POP(registers, all_registers);
+	inst->m = m;
+	inst->execute = BLX_register;
+	inst->disassemble = a6_7_19_t1_disassemble;
 }
 
-static void a6_7_97_t2(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
+static void BX(struct registers *registers, const struct inst *inst)
 {
-	uint8_t P = (second_halfword & 0x8000) >> 15;
-	uint8_t M = (second_halfword & 0x4000) >> 14;
-	uint16_t register_list = (second_halfword & 0x1FFF) >> 0;
-
-	uint16_t all_registers = (P << 15) | (M << 14) | register_list;
-
-	printf("  POP.W {");
-	bool first = false;
-	for (uint8_t i = 0; i < 16; ++i) {
-		if ((all_registers & (0x0001 << i)) == (0x0001 << i)) {
-			if (!first) {
-				first = true;
-			}
-			else {
-				printf(", ");
-			}
-			printf("R%d", i);
+	if (ConditionPassed(registers, inst)) {
+		if (registers->ipsr != 0
+		    && (registers->r[inst->m] & 0xF0000000) == 0xF0000000) {
+			BXWritePC(registers, registers->r[inst->m]);
+			return;
 		}
-	}
-	printf("}\n");
+		uint32_t address = registers->r[inst->m] & ~(0x00000001);
+		registers->r[15] = address;
+		trace_register(15, address);
 
-	uint8_t bit_count = __builtin_popcount(all_registers);
-	if ((bit_count < 2) || ((P == 1) && (M == 1))) {
-		assert(false);
+		board->is_branch = true;
 	}
-
-	POP(registers, all_registers);
 }
 
-static void PUSH(struct registers *registers,
-                 uint16_t all_registers)
+static void a6_7_20_t1_disassemble(const struct inst *inst)
 {
-	printf("  PUSH%s {", get_condition_field(registers));
-	bool first = false;
-	for (uint8_t i = 0; i < 15; ++i) {
-		if ((all_registers & (0x0001 << i)) == (0x0001 << i)) {
-			if (!first) {
-				first = true;
-			}
-			else {
-				printf(", ");
-			}
-			printf("R%d", i);
-		}
-	}
-	printf("}\n");
-
-	if (ConditionPassed(registers)) {
-		uint8_t bit_count = __builtin_popcount(all_registers);
-		uint32_t address = registers->r[13] - 4 * bit_count;
-		printf("  > Note: higher registers at higher addresses\n");
-		for (uint8_t i = 0; i < 15; ++i) {
-			if ((all_registers & (0x0001 << i)) == (0x0001 << i)) {
-				memory_word_write(address & 0xFFFFFFFC, registers->r[i]);
-				address += 4;
-			}
-		}
-		address = registers->r[13] - 4 * bit_count;
-		registers->r[13] = address;
-		printf("  > R13 = %08X\n", address);
-	}
+	printf("  BX R%d\n", inst->m);
 }
 
-static void a6_7_98_t1(struct registers *registers,
+static void a6_7_20_t1(struct registers *registers, struct inst *inst,
                        uint16_t halfword)
 {
-	uint8_t register_list = (halfword & 0x00FF) >> 0;
-	uint8_t M = (halfword & 0x0100) >> 8;
-
-	uint16_t all_registers = (M << 14) | register_list;
+	uint8_t m = (halfword & 0x0078) >> 3;
 
-	PUSH(registers, all_registers);
+	inst->m = m;
+	inst->execute = BX;
+	inst->disassemble = a6_7_20_t1_disassemble;
 }
 
-static void a6_7_98_t2(struct registers *registers,
-                       uint16_t first_halfword,
-                       uint16_t second_halfword)
+static void CBNZ_CBZ(struct registers *registers, const struct inst *inst)
 {
-	uint8_t  M             = (second_halfword & 0x4000) >> 14;
-	uint16_t register_list = (second_halfword & 0x1FFF) >>  0;
-
-	uint16_t all_registers = (M << 14) | register_list;
-
-	PUSH(registers, all_registers);
+	uint32_t address = PC(registers) + inst->imm32;
+	if ((!inst->nonzero && registers->r[inst->n] == 0)
+	    || (inst->nonzero && registers->r[inst->n] != 0)) {
+		registers->r[15] = address;
+		trace_register(15, address);
+		board->is_branch = true;
+	}
 }
 
-static void RSB_immediate(struct registers *registers,
-                          uint8_t d, uint8_t n, bool setflags, uint32_t imm32)
+static void a6_7_21_t1_disassemble(const struct inst *inst)
 {
-	if (ConditionPassed(registers)) {
-		struct ResultCarryOverflowTuple T =
-			AddWithCarry(~(registers->r[n]), imm32, true);
-		registers->r[d] = T.result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
-			setflags_ResultCarryOverflowTuple(registers, T);
-			printf("  > APSR = %08X\n", registers->apsr);
-		}
+	uint32_t address = inst->address + 4 + inst->imm32;
+
+	printf("  CB");
+	if (inst->nonzero){
+		printf("N");
 	}
+	printf("Z R%d, %08X\n", inst->n, address);
 }
 
-static void a6_7_106_t2(struct registers *registers,
-                        uint16_t first_halfword,
-                        uint16_t second_halfword)
+static void a6_7_21_t1(struct registers *registers, struct inst *inst,
+                        uint16_t halfword)
 {
-	uint8_t i    =  (first_halfword & 0x0400) >> 10;
-	uint8_t S    =  (first_halfword & 0x0010) >>  4;
-	uint8_t n    =  (first_halfword & 0x000F) >>  0;
-	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-	uint8_t d    = (second_halfword & 0x0F00) >>  8;
-	uint8_t imm8 = (second_halfword & 0x00FF) >>  0;
-
-	uint16_t imm12 = (i * 0x800)
-	                 + (imm3 * 0x100)
-	                 + imm8;
+	uint8_t op = (halfword & 0x0800) >> 11;
+	uint8_t i = (halfword & 0x0200) >> 9;
+	uint8_t imm5 = (halfword & 0x00F8) >> 3;
+	uint8_t rn = (halfword & 0x0007);
 
-	bool setflags = S == 1;
-	uint32_t imm32 = ThumbExpandImm(registers, imm12);
+	inst->n = rn;
+	inst->imm32 = (i * 0x40)
+	              + (imm5 * 0x2);
+	inst->nonzero = op == 1;
+	inst->execute = CBNZ_CBZ;
+	inst->disassemble = a6_7_21_t1_disassemble;
+}
 
-	printf("  RSB");
-	if (setflags) {
-		printf("S");
+static void CMP_immediate(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint32_t x = registers->r[inst->n];
+		uint32_t y = ~inst->imm32;
+		struct ResultCarryOverflowTuple T = AddWithCarry(x, y, true);
+		setflags_AddWithCarry(registers, x, y, true);
+		trace_apsr(APSR(registers));
 	}
-	printf("%s R%d, R%d, #0x%08X\n",
-	       get_condition_field(registers), d, n, imm32);
+}
 
-	RSB_immediate(registers, d, n, setflags, imm32);
+static void a6_7_27_disassemble(const struct inst *inst)
+{
+	printf("  CMP%s R%d, #%d\n",
+	       get_condition_name(inst->cond), inst->n, inst->imm32);
 }
 
-static void RSB_register(struct registers *registers,
-                         uint8_t d, uint8_t n, int8_t m,
-                         bool setflags, enum SRType shift_t, uint8_t shift_n)
+static void a6_7_27_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
 {
-	if (ConditionPassed(registers)) {
-		uint32_t shifted = Shift(registers->r[m],
-		                         shift_t, shift_n, APSR_C(registers));
-		struct ResultCarryOverflowTuple T =
-			AddWithCarry(~(registers->r[n]), shifted, true);
-		registers->r[d] = T.result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
-			setflags_ResultCarryOverflowTuple(registers, T);
-			printf("  > APSR = %08X\n", registers->apsr);
-		}
-	}
+	uint8_t n = (halfword & 0x0700) >> 8;
+	uint8_t imm8 = (halfword & 0x00FF) >> 0;
+
+	inst->n = n;
+	inst->imm32 = imm8;
+	inst->execute = CMP_immediate;
+	inst->disassemble = a6_7_27_disassemble;
 }
 
-static void a6_7_107_t1(struct registers *registers,
-                        uint16_t first_halfword,
-                        uint16_t second_halfword)
+static void a6_7_27_t2(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
 {
-	uint8_t S    =  (first_halfword & 0x0010) >>  4;
+	uint8_t i    =  (first_halfword & 0x0400) >> 10;
 	uint8_t n    =  (first_halfword & 0x000F) >>  0;
 	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-	uint8_t d    = (second_halfword & 0x0F00) >>  8;
-	uint8_t imm2 = (second_halfword & 0x00C0) >>  6;
-	uint8_t type = (second_halfword & 0x0030) >>  4;
-	uint8_t m    = (second_halfword & 0x000F) >>  0;
-
-	bool setflags = S == 1;
-	uint8_t imm5 = (imm3 << 2) | imm2;
-	struct ShiftTNTuple T = DecodeImmShift(type, imm5);
+	uint8_t imm8 = (second_halfword & 0x00FF) >>  0;
 
-	printf("  RSB");
-	if (setflags) {
-		printf("S");
-	}
-	printf("%s R%d, R%d, R%d",
-	       get_condition_field(registers), d, n, m);
-	if (T.shift_n != 0) {
-		printf(", <shift>");
-	}
-	printf("\n");
+	uint16_t imm12 = (i << 11) | (imm3 << 8) | imm8;
 
-	assert(!(d == 13 || d == 15 || n == 13 || n == 15));
+	assert(n != 15);
 
-	RSB_register(registers, d, n, m, setflags, T.shift_t, T.shift_n);
+	inst->n = n;
+	inst->imm32 = ThumbExpandImm(registers, imm12);
+	inst->execute = CMP_immediate;
+	inst->disassemble = a6_7_27_disassemble;
 }
 
-static void STR_immediate(struct registers *registers,
-                          uint8_t t, uint8_t n, int32_t imm32,
-                          bool index, bool add, bool wback)
+static void CMP_register(struct registers *registers, const struct inst *inst)
 {
-	if (index) {
-		if (!wback) {
-			printf("  STR%s R%d, [R%d, #%d]\n",
-			       get_condition_field(registers), t, n, imm32);
-		}
-		else {
-			printf("  STR%s R%d, [R%d, #%d]!\n",
-			       get_condition_field(registers), t, n, imm32);
-		}
-	}
-	else {
-		printf("  STR%s R%d, [R%d], #%d\n",
-		       get_condition_field(registers), t, n, imm32);
-	}
-
-	if (ConditionPassed(registers)) {
-		uint32_t offset_addr;
-		if (add) { offset_addr = registers->r[n] + imm32; }
-		else     { offset_addr = registers->r[n] - imm32; }
-		uint32_t address;
-		if (index) { address = offset_addr; }
-		else       { address = registers->r[n]; }
-
-		memory_word_write(address, registers->r[t]);
-		if (wback) {
-			printf("  > R%d = %08X\n", n, offset_addr);
-			registers->r[n] = offset_addr;
-		}
+	if (ConditionPassed(registers, inst)) {
+		uint32_t shifted = Shift(registers->r[inst->m], inst->shift_t,
+		                         inst->shift_n, APSR_C(registers));
+		uint32_t x = registers->r[inst->n];
+		uint32_t y = ~shifted;
+		struct ResultCarryOverflowTuple T = AddWithCarry(x, y, true);
+		setflags_AddWithCarry(registers, x, y, true);
+		trace_apsr(APSR(registers));
 	}
 }
 
-static void a6_7_119_t1(struct registers *registers,
-                        uint16_t halfword)
+static void a6_7_28_disassemble(const struct inst *inst)
 {
-	uint8_t imm5 = (halfword & 0x07C0) >> 6;
-	uint8_t n = (halfword & 0x0038) >> 3;
-	uint8_t t = (halfword & 0x0007) >> 0;
-
-	uint32_t imm32 = imm5 << 2;
-	bool index = true;
-	bool add = true;
-	bool wback = false;
-
-	STR_immediate(registers, t, n, imm32, index, add, wback);
+	printf("  CMP%s R%d, R%d\n",
+	       get_condition_name(inst->cond), inst->n, inst->m);
 }
 
-static void a6_7_119_t2(struct registers *registers,
-                        uint16_t halfword)
+static void a6_7_28_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
 {
-	uint8_t t = (halfword & 0x0700) >> 8;
-	uint8_t imm8 = (halfword & 0x00FF) >> 0;
-
-	uint8_t n = 13;
-	uint32_t imm32 = (imm8 << 2);
-
-	bool index = true;
-	bool add = true;
-	bool wback = false;
+	uint8_t m = (halfword & 0x0038) >> 3;
+	uint8_t n = (halfword & 0x0007) >> 0;
 
-	STR_immediate(registers, t, n, imm32, index, add, wback);
+	inst->n = n;
+	inst->m = m;
+	inst->shift_t = SRType_LSL;
+	inst->shift_n = 0;
+	inst->execute = CMP_register;
+	inst->disassemble = a6_7_28_disassemble;
 }
 
-static void a6_7_119_t3(struct registers *registers,
-                        uint16_t first_halfword,
-                        uint16_t second_halfword)
+static void a6_7_28_t2(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
 {
-	uint8_t  n     =  (first_halfword & 0x000F) >>  0;
-	uint8_t  t     = (second_halfword & 0xF000) >> 12;
-	uint16_t imm12 = (second_halfword & 0x0FFF) >>  0;
-
-	uint32_t imm32 = imm12;
+	uint8_t N  = (halfword & 0x0080) >> 7;
+	uint8_t m  = (halfword & 0x0078) >> 3;
+	uint8_t Rn = (halfword & 0x0007) >> 0;
 
-	bool index = true;
-	bool add = true;
-	bool wback = false;
+	uint8_t n = (N << 3) | Rn;
 
-	assert(!(t == 15));
+	assert(!((n < 8) && (m < 8)));
+	assert(!((n == 15) || (m == 15)));
 
-	STR_immediate(registers, t, n, imm32, index, add, wback);
+	inst->n = n;
+	inst->m = m;
+	inst->shift_t = SRType_LSL;
+	inst->shift_n = 0;
+	inst->execute = CMP_register;
+	inst->disassemble = a6_7_28_disassemble;
 }
 
-static void a6_7_119_t4(struct registers *registers,
-                        uint16_t first_halfword,
-                        uint16_t second_halfword)
+static void IT(struct registers *registers, const struct inst *inst)
 {
-	uint8_t n =  (first_halfword & 0x000F) >>  0;
-	uint8_t t = (second_halfword & 0xF000) >> 12;
-	uint8_t P = (second_halfword & 0x0400) >> 10;
-	uint8_t U = (second_halfword & 0x0200) >>  9;
-	uint8_t W = (second_halfword & 0x0100) >>  8;
-	uint8_t imm8 = (second_halfword & 0x00FF) >> 0;
+	registers->itstate = inst->imm32;
+	trace_itstate(registers->itstate);
 
-	uint32_t imm32 = imm8;
-	bool index = P == 1;
-	bool add = U == 1;
-	bool wback = W == 1;
-
-	STR_immediate(registers, t, n, imm32, index, add, wback);
+	board->is_it_inst = true;
 }
 
-static void STR_register(struct registers *registers,
-                         uint8_t t, uint8_t n, uint8_t m,
-                         bool index, bool add, bool wback,
-                         enum SRType shift_t, uint8_t shift_n)
+static void a6_7_37_t1_disassemble(const struct inst *inst)
 {
-	if (ConditionPassed(registers)) {
-		uint32_t offset = Shift(registers->r[m], shift_t,
-		                        shift_n, APSR_C(registers));
-		uint32_t address = registers->r[n] + offset;
-		uint32_t data = registers->r[t];
-		memory_word_write(address, data);
-	}
-}
+	uint8_t firstcond = (inst->imm32 & 0x00F0) >> 4;
+	uint8_t mask      = (inst->imm32 & 0x000F) >> 0;
 
-static void a6_7_120_t1(struct registers *registers,
-                        uint16_t halfword)
-{
-	uint8_t m = (halfword & 0x01C0) >> 6;
-	uint8_t n = (halfword & 0x0038) >> 3;
-	uint8_t t = (halfword & 0x0007) >> 0;
+	uint8_t firstcond0 = (firstcond & 0b0001) >> 0;
+
+	uint8_t mask3 = (mask & 0b1000) >> 3;
+	uint8_t mask2 = (mask & 0b0100) >> 2;
+	uint8_t mask1 = (mask & 0b0010) >> 1;
+	uint8_t mask0 = (mask & 0b0001) >> 0;
 
-	bool index = true;
-	bool add = true;
-	bool wback = false;
+	printf("  IT");
+	if (mask0 == 1) {
+		if (mask3 == firstcond0) { printf("T"); }
+		else                     { printf("E"); }
+		if (mask2 == firstcond0) { printf("T"); }
+		else                     { printf("E"); }
+		if (mask1 == firstcond0) { printf("T"); }
+		else                     { printf("E"); }
+	}
+	else if (mask1 == 1) {
+		if (mask3 == firstcond0) { printf("T"); }
+		else                     { printf("E"); }
+		if (mask2 == firstcond0) { printf("T"); }
+		else                     { printf("E"); }
+	}
+	else if (mask2 == 1) {
+		if (mask3 == firstcond0) { printf("T"); }
+		else                     { printf("E"); }
+	}
 
-	enum SRType shift_t = SRType_LSL;
-	uint8_t shift_n = 0;
+	printf(" %s\n", get_condition_name(firstcond));
+}
 
-	printf("  STR%s R%d, [R%d, R%d]\n",
-	       get_condition_field(registers), t, n, m);
+static void a6_7_37_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
+{
+	uint8_t mask = (halfword & 0x000F) >> 0;
 
-	STR_register(registers, t, n, m, index, add, wback, shift_t, shift_n);
+	if ((mask & 0b0111) == 0b0000) {
+		assert(mask == 0b1000);
+	}
+
+	inst->imm32 = (halfword & 0x00FF) >> 0;
+	inst->execute = IT;
+	inst->disassemble = a6_7_37_t1_disassemble;
 }
 
-static void a6_7_120_t2(struct registers *registers,
-                        uint16_t first_halfword,
-                        uint16_t second_halfword)
+static void LDR_immediate(struct registers *registers, const struct inst *inst)
 {
-	uint8_t n    =  (first_halfword & 0x000F) >>  0;
-	uint8_t t    = (second_halfword & 0xF000) >> 12;
-	uint8_t imm2 = (second_halfword & 0x0030) >>  4;
-	uint8_t m    = (second_halfword & 0x000F) >>  0;
+	if (ConditionPassed(registers, inst)) {
+		uint32_t offset_addr;
+		if (inst->add) {
+			offset_addr = registers->r[inst->n] + inst->imm32;
+		}
+		else {
+			offset_addr = registers->r[inst->n] - inst->imm32;
+		}
 
-	bool index = true;
-	bool add = true;
-	bool wback = false;
+		uint32_t address;
+		if (inst->index) {
+			address = offset_addr;
+		}
+		else {
+			address = registers->r[inst->n];
+		}
 
-	enum SRType shift_t = SRType_LSL;
-	uint8_t shift_n = imm2;
+		uint32_t data = memory_word_read(address);
+		if (inst->wback) {
+			registers->r[inst->n] = offset_addr;
+			trace_register(inst->n, registers->r[inst->n]);
+		}
 
-	printf("  STR%s R%d, [R%d, R%d",
-	       get_condition_field(registers), t, n, m);
-	if (shift_n != 0) {
-		printf(", LSL #%d", imm2);
+		if (inst->t == 15) {
+			assert(false);
+		}
+		else {
+			registers->r[inst->t] = data;
+			trace_register(inst->t, registers->r[inst->t]);
+		}
 	}
-	printf("]\n");
-
-	STR_register(registers, t, n, m, index, add, wback, shift_t, shift_n);
 }
 
-static void STRB(struct registers *registers,
-                 uint8_t t, uint8_t n, uint32_t imm32,
-                 bool index, bool add, bool wback)
+static void a6_7_42_disassemble(const struct inst *inst)
 {
-	uint32_t offset_addr;
-	if (add) { offset_addr = registers->r[n] + imm32; }
-	else     { offset_addr = registers->r[n] - imm32; }
-	uint32_t address;
-	if (index) { address = offset_addr; }
-	else       { address = registers->r[n]; }
-
-	if (index) {
-		if (!wback) {
-			printf("  STRB R%d [R%d, #%d]\n", t, n, imm32);
+	if (inst->index) {
+		printf("  LDR%s R%d, [R%d, #",
+		       get_condition_name(inst->cond), inst->t, inst->n);
+		if (inst->add) {
+			printf("+");
+		}
+		else {
+			printf("-");
+		}
+		if (!inst->wback) {
+			printf("%d]\n", inst->imm32);
 		}
 		else {
-			printf("  STRB R%d [R%d, #%d]!\n", t, n, imm32);
+			printf("%d]!\n", inst->imm32);
 		}
 	}
 	else {
-		printf("  STRB R%d [R%d] #%d\n", t, n, imm32);
-	}
-
-	uint8_t value = registers->r[t] & 0x000000FF;
-	memory_byte_write(address, value);
-
-	if (wback) {
-		registers->r[n] = offset_addr;
-		printf("  > R%d = %08X\n", n, offset_addr);
+		// wback == TRUE
+		printf("  LDR%s R%d, [R%d], #",
+		       get_condition_name(inst->cond), inst->t, inst->n);
+		if (inst->add) {
+			printf("+");
+		}
+		else {
+			printf("-");
+		}
+		printf("%d\n", inst->imm32);
 	}
 }
 
-static void a6_7_121_t1(struct registers *registers,
-                        uint16_t halfword)
+static void a6_7_42_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
 {
 	uint8_t imm5 = (halfword & 0x07C0) >> 6;
-	uint8_t n = (halfword & 0x0038) >> 3;
-	uint8_t t = (halfword & 0x0007) >> 0;
+	uint8_t n    = (halfword & 0x0038) >> 3;
+	uint8_t t    = (halfword & 0x0007) >> 0;
+
+	inst->t = t;
+	inst->n = n;
+	inst->imm32 = imm5 << 2;
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->execute = LDR_immediate;
+	inst->disassemble = a6_7_42_disassemble;
+}
 
-	uint32_t imm32 = imm5;
-	bool index = true;
-	bool add = true;
-	bool wback = false;
+static void a6_7_42_t2(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
+{
+	uint8_t t    = (halfword & 0x0700) >> 8;
+	uint8_t imm8 = (halfword & 0x00FF) >> 0;
 
-	STRB(registers, t, n, imm32, index, add, wback);
+	inst->t = t;
+	inst->n = 13;
+	inst->imm32 = imm8 << 2;
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->execute = LDR_immediate;
+	inst->disassemble = a6_7_42_disassemble;
 }
 
-static void a6_7_121_t2(struct registers *registers,
-                        uint16_t first_halfword,
-                        uint16_t second_halfword)
+static void a6_7_42_t3(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
 {
 	uint8_t  n     =  (first_halfword & 0x000F) >>  0;
 	uint8_t  t     = (second_halfword & 0xF000) >> 12;
 	uint16_t imm12 = (second_halfword & 0x0FFF) >>  0;
 
-	uint32_t imm32 = imm12;
-	bool index = true;
-	bool add = true;
-	bool wback = false;
-
-	assert(!(n == 15)); // UNDEFINED
-	assert(!(t == 13 || t == 15)); // UNPREDICTABLE
-
-	STRB(registers, t, n, imm32, index, add, wback);
+	inst->t = t;
+	inst->n = n;
+	inst->imm32 = imm12;
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->execute = LDR_immediate;
+	inst->disassemble = a6_7_42_disassemble;
 }
 
-static void a6_7_121_t3(struct registers *registers,
-                        uint16_t first_halfword,
-                        uint16_t second_halfword)
+static void a6_7_42_t4(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
 {
 	uint8_t n    =  (first_halfword & 0x000F) >>  0;
 	uint8_t t    = (second_halfword & 0xF000) >> 12;
@@ -2848,1244 +3066,4271 @@ static void a6_7_121_t3(struct registers *registers,
 	uint8_t W    = (second_halfword & 0x0100) >>  8;
 	uint8_t imm8 = (second_halfword & 0x00FF) >>  0;
 
-	uint32_t imm32 = imm8;
 	bool index = P == 1;
-	bool add = U == 1;
 	bool wback = W == 1;
 
-	STRB(registers, t, n, imm32, index, add, wback);
+	assert(!(wback && (n == t)));
+	assert(!((t == 15)
+	         && InITBlock(registers) && !LastInITBlock(registers)));
+
+	assert(!(!index && !wback));
+
+	inst->t = t;
+	inst->n = n;
+	inst->imm32 = imm8;
+	inst->index = index;
+	inst->add = U == 1;
+	inst->wback = wback;
+	inst->execute = LDR_immediate;
+	inst->disassemble = a6_7_42_disassemble;
 }
 
-static void STRB_register(struct registers *registers,
-                          uint8_t t, uint8_t n, uint8_t m,
-                          bool index, bool add, bool wback,
-                          enum SRType shift_t, uint8_t shift_n)
+static void LDR_literal(struct registers *registers, const struct inst *inst)
 {
-	assert(shift_t == SRType_LSL);
-	assert(shift_n == 0);
-
-	if (ConditionPassed(registers)) {
-		uint32_t offset = registers->r[m];
-		uint32_t address = registers->r[n] + offset;
-		memory_byte_write(address, registers->r[t]);
+	if (ConditionPassed(registers, inst)) {
+		uint32_t base = Align_PC_4(registers);
+		uint32_t address;
+		if (inst->add) {
+			address = base + inst->imm32;
+		}
+		else {
+			address = base - inst->imm32;
+		}
+		uint32_t data = memory_word_read(address);
+		if (inst->t == 15) {
+			assert(false);
+		}
+		else {
+			registers->r[inst->t] = data;
+			trace_register(inst->t, registers->r[inst->t]);
+		}
 	}
 }
 
-static void a6_7_122_t1(struct registers *registers,
-                        uint16_t halfword)
+static void a6_7_43_t1_disassemble(const struct inst *inst)
 {
-	uint8_t m = (halfword & 0x01C0) >> 6;
-	uint8_t n = (halfword & 0x0038) >> 3;
-	uint8_t t = (halfword & 0x0007) >> 0;
-
-	bool index = true;
-	bool add = true;
-	bool wback = false;
-	enum SRType shift_t = SRType_LSL;
-	uint8_t shift_n = 0;
-
-	printf("  STRB%s R%d, [R%d, R%d]\n",
-	       get_condition_field(registers), t, n, m);
-	STRB_register(registers, t, n, m, index, add, wback, shift_t, shift_n);
+	printf("  LDR R%d [PC, #%d]\n", inst->t, inst->imm32);
 }
 
-static void a6_7_128_t1(struct registers *registers,
-                        uint16_t halfword)
+static void a6_7_43_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
 {
-	uint8_t rt = (halfword & 0x0007);
-	uint8_t rn = (halfword & 0x0038) >> 3;
-	uint8_t imm5 = (halfword & 0x07C0) >> 6;
-
-	uint32_t imm32 = imm5 << 1;
-
-	uint32_t offset_addr = registers->r[rn] + imm32;
-	uint32_t address = offset_addr;
-
-	uint16_t value = registers->r[rt] & 0x0000FFFF;
-
-	printf("  STRH R%d [R%d, #%d]\n", rt, rn, imm32);
+	uint8_t t = (halfword & 0x0700) >> 8;
+	uint8_t imm8 = halfword;
 
-	memory_halfword_write(address, value);
+	inst->t = t;
+	inst->imm32 = imm8 * 0x4;
+	inst->add = true;
+	inst->execute = LDR_literal;
+	inst->disassemble = a6_7_43_t1_disassemble;
 }
 
-static void SUB_immediate(struct registers *registers,
-                          uint8_t d, uint8_t n, bool setflags, uint32_t imm32)
+static void LDR_register(struct registers *registers, const struct inst *inst)
 {
-	if (ConditionPassed(registers)) {
-		struct ResultCarryOverflowTuple T =
-			AddWithCarry(registers->r[n], ~imm32, true);
-		registers->r[d] = T.result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
-			setflags_ResultCarryOverflowTuple(registers, T);
-			printf("  > APSR = %08X\n", registers->apsr);
+	if (ConditionPassed(registers, inst)) {
+		uint32_t offset = Shift(registers->r[inst->m], inst->shift_t,
+		                        inst->shift_n, APSR_C(registers));
+		uint32_t offset_addr;
+		if (inst->add) {
+			offset_addr = registers->r[inst->n] + offset;
+		}
+		else {
+			offset_addr = registers->r[inst->n] - offset;
+		}
+		uint32_t address;
+		if (inst->index) {
+			address = offset_addr;
+		}
+		else {
+			address = registers->r[inst->n];
+		}
+		uint32_t data = memory_word_read(address);
+		if (inst->wback) {
+			registers->r[inst->n] = offset_addr;
+			trace_register(inst->n, registers->r[inst->n]);
 		}
-	}
-}
-
-static void a6_7_132_t2(struct registers *registers,
-                        uint16_t halfword)
-{
-	uint8_t d = (halfword & 0x0700) >> 8;
-	uint8_t n = d;
-	uint8_t imm8 = (halfword & 0x00FF) >> 0;
-
-	uint32_t imm32 = imm8;
-
-	bool setflags = !InITBlock(registers);
 
-	if (setflags) {
-		printf("  SUBS R%d, R%d, #%d\n", d, n, imm32);
-	}
-	else {
-		printf("  SUB R%d, R%d, #%d\n", d, n, imm32);
+		if (inst->t == 15) {
+			assert(false);
+		}
+		else {
+			registers->r[inst->t] = data;
+			trace_register(inst->t, registers->r[inst->t]);
+		}
 	}
-
-	SUB_immediate(registers, d, n, setflags, imm32);
 }
 
-static void SUB_register(struct registers *registers,
-                         uint8_t d, uint8_t n, uint8_t m, bool setflags,
-                         enum SRType shift_t, uint8_t shift_n)
+static void a6_7_44_t1_disassemble(const struct inst *inst)
 {
-	if (ConditionPassed(registers)) {
-		uint32_t shifted = Shift(registers->r[m], shift_t,
-		                         shift_n, APSR_C(registers));
-		struct ResultCarryOverflowTuple T =
-			AddWithCarry(registers->r[n], ~shifted, true);
-		registers->r[d] = T.result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
-			setflags_ResultCarryOverflowTuple(registers, T);
-			printf("  > APSR = %08X\n", registers->apsr);
-		}
-	}
+	printf("  LDR%s R%d, [R%d, R%d]\n",
+	       get_condition_name(inst->cond), inst->t, inst->n, inst->m);
 }
 
-static void a6_7_133_t1(struct registers *registers,
-                        uint16_t halfword)
+static void a6_7_44_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
 {
 	uint8_t m = (halfword & 0x01C0) >> 6;
 	uint8_t n = (halfword & 0x0038) >> 3;
-	uint8_t d = (halfword & 0x0007) >> 0;
-
-	bool setflags = !InITBlock(registers);
-	enum SRType shift_t = SRType_LSL;
-	uint8_t shift_n = 0;
-
-	printf("  SUB");
-	if (setflags) {
-		printf("S");
-	}
-	printf(" R%d, R%d, R%d\n", d, n, m);
+	uint8_t t = (halfword & 0x0007) >> 0;
 
-	SUB_register(registers, d, n, m, setflags, shift_t, shift_n);
+	inst->t = t;
+	inst->n = n;
+	inst->m = m;
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->shift_t = SRType_LSL;
+	inst->shift_n = 0;
+	inst->execute = LDR_register;
+	inst->disassemble = a6_7_44_t1_disassemble;
 }
 
-static void a6_7_134_t1(struct registers *registers,
-                        uint16_t halfword)
+static void a6_7_44_t2_disassemble(const struct inst *inst)
 {
-	uint8_t imm7 = (halfword & 0x007F) >> 0;
-
-	uint8_t d = 13;
-	bool setflags = false;
-
-	uint32_t imm32 = (imm7 << 2);
-
-	printf("  SUB%s SP, SP, #%d\n", get_condition_field(registers), imm7);
-
-	if (ConditionPassed(registers)) {
-		struct ResultCarryOverflowTuple T =
-			AddWithCarry(registers->r[d], ~imm32, true);
-		registers->r[d] = T.result;
-		printf("  > R%d = %08X\n", d, registers->r[d]);
-		if (setflags) {
-			setflags_ResultCarryOverflowTuple(registers, T);
-			printf("  > APSR = %08X\n", registers->apsr);
-		}
+	printf("  LDR%s.W R%d, [R%d, R%d",
+	       get_condition_name(inst->cond), inst->t, inst->n, inst->m);
+	if (inst->shift_n != 0) {
+		printf(", LSL #%d", inst->shift_n);
 	}
+	printf("]\n");
 }
 
-static void a6_7_144_t1(struct registers *registers,
-                        uint16_t first_halfword,
-                        uint16_t second_halfword)
+static void a6_7_44_t2(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword, uint16_t second_halfword)
 {
-	uint8_t n = (first_halfword & 0x000F) >> 0;
-	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-	uint8_t d = (second_halfword & 0x0F00) >> 8;
-	uint8_t imm2 = (second_halfword & 0x00C0) >> 6;
-	uint8_t widthminus1 = (second_halfword & 0x001F) >> 0;
-
-	uint8_t lsbit = (imm3 << 2) | imm2;
+	uint8_t n    =  (first_halfword & 0x000F) >>  0;
+	uint8_t t    = (second_halfword & 0xF000) >> 12;
+	uint8_t imm2 = (second_halfword & 0x0030) >>  4;
+	uint8_t m    = (second_halfword & 0x000F) >>  0;
 
-	printf("  UBFX%s R%d, R%d, #%d, #%d\n",
-	       get_condition_field(registers), d, n, lsbit, widthminus1 + 1);
+	assert(!(m == 13 || m == 15));
+	assert(!(t == 15 && InITBlock(registers)
+	         && !LastInITBlock(registers)));
 
-	assert(!(d == 13 || d == 15 || n == 13 || n == 15));
+	inst->t = t;
+	inst->n = n;
+	inst->m = m;
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->shift_t = SRType_LSL;
+	inst->shift_n = imm2;
+	inst->execute = LDR_register;
+	inst->disassemble = a6_7_44_t2_disassemble;
+}
 
-	if (ConditionPassed(registers)) {
-		uint8_t msbit = lsbit + widthminus1;
-		if (msbit <= 31) {
-			registers->r[d] = 0;
-			for (uint8_t i = 0; i < 32; ++i) {
-				if (i >= lsbit && i <= msbit) {
-					registers->r[d] |= (registers->r[n] & (1 << i)) >> lsbit;
-				}
-			}
-			printf("  > R%d = %08X\n", d, registers->r[d]);
+static void LDRB_immediate(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint32_t offset_addr;
+		if (inst->add) {
+			offset_addr = registers->r[inst->n] + inst->imm32;
 		}
 		else {
-			assert(false);
+			offset_addr = registers->r[inst->n] - inst->imm32;
+		}
+		uint32_t address;
+		if (inst->index) {
+			address = offset_addr;
+		}
+		else {
+			address = registers->r[inst->n];
+		}
+		uint8_t data = memory_byte_read(address);
+		registers->r[inst->t] = data;
+		trace_register(inst->t, registers->r[inst->t]);
+
+		if (inst->wback) {
+			registers->r[inst->n] = offset_addr;
+			trace_register(inst->n, registers->r[inst->n]);
 		}
 	}
 }
 
-static void a6_7_145_t1(struct registers *registers,
-                        uint16_t first_halfword,
-                        uint16_t second_halfword)
+static void a6_7_45_t1_disassemble(const struct inst *inst)
 {
-	uint8_t n = (first_halfword & 0x000F) >> 0;
-	uint8_t d = (second_halfword & 0x0F00) >> 8;
-	uint8_t m = (second_halfword & 0x000F) >> 0;
+	printf("  LDRB%s R%d [R%d, #%d]\n",
+	       get_condition_name(inst->cond), inst->t, inst->n, inst->imm32);
+}
+
+static void a6_7_45_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
+{
+	uint8_t imm5 = (halfword & 0x07C0) >> 6;
+	uint8_t n    = (halfword & 0x0038) >> 3;
+	uint8_t t    = (halfword & 0x0007) >> 0;
 
-	assert(registers->r[m] != 0);
+	inst->t = t;
+	inst->n = n;
+	inst->imm32 = imm5;
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->execute = LDRB_immediate;
+	inst->disassemble = a6_7_45_t1_disassemble;
+}
 
-	printf("  UDIV R%d, R%d, R%d\n", d, n, m);
-	registers->r[d] = registers->r[n] / registers->r[m];
-	printf("  > R%d = %08X\n", d, registers->r[d]);
+static void a6_7_45_t2_disassemble(const struct inst *inst)
+{
+	printf("  LDRB%s.W R%d, [R%d, #%d]\n",
+	       get_condition_name(inst->cond), inst->t, inst->n, inst->imm32);
 }
 
-static void a6_7_149_t1(struct registers *registers,
-                        uint16_t halfword)
+static void a6_7_45_t2(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
 {
-	uint8_t rm = (halfword & 0x0038) >> 3;
-	uint8_t rd = (halfword & 0x0007) >> 0;
+	uint8_t  n     =  (first_halfword & 0x000F) >>  0;
+	uint8_t  t     = (second_halfword & 0xF000) >> 12;
+	uint16_t imm12 = (second_halfword & 0x0FFF) >>  0;
 
-	uint32_t value = (registers->r[rm] & 0x000000FF);
+	assert(!(t == 13));
 
-	printf("  UXTB R%d, R%d\n", rd, rm);
-	registers->r[rd] = value;
-	printf("  > R%d = %08X\n", rd, registers->r[rd]);
+	inst->t = t;
+	inst->n = n;
+	inst->imm32 = imm12;
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->execute = LDRB_immediate;
+	inst->disassemble = a6_7_45_t2_disassemble;
 }
 
-static void a5_2_1(struct registers *registers,
-                   uint16_t halfword)
+static void LDRB_register(struct registers *registers, const struct inst *inst)
 {
-	uint8_t opcode = (halfword & 0x3E00) >> 9;
+	if (ConditionPassed(registers, inst)) {
+		uint32_t offset = registers->r[inst->m];
+		uint32_t offset_addr;
+		if (inst->add) {
+			offset_addr = registers->r[inst->n] + offset;
+		}
+		else {
+			offset_addr = registers->r[inst->n] - offset;
+		}
+		uint32_t address;
+		if (inst->index) {
+			address = offset_addr;
+		}
+		else {
+			address = registers->r[inst->n];
+		}
+		uint32_t data = memory_byte_read(address); // ZeroExtend
 
-	if ((opcode & 0b11100) == 0b00000) {
-		a6_7_67_t1(registers, halfword); // LSL
+		registers->r[inst->t] = data;
+		trace_register(inst->t, registers->r[inst->t]);
+	}
+}
+
+static void a6_7_47_t1_disassemble(const struct inst *inst)
+{
+	printf("  LDRB%s R%d [R%d, R%d]\n",
+	       get_condition_name(inst->cond), inst->t, inst->n, inst->m);
+}
+
+static void a6_7_47_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
+{
+	uint8_t m = (halfword & 0x01C0) >> 6;
+	uint8_t n = (halfword & 0x0038) >> 3;
+	uint8_t t = (halfword & 0x0007) >> 0;
+
+	inst->t = t;
+	inst->n = n;
+	inst->m = m;
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->shift_t = SRType_LSL;
+	inst->shift_n = 0;
+	inst->execute = LDRB_register;
+	inst->disassemble = a6_7_47_t1_disassemble;
+}
+
+static void LSL_immediate(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		struct ResultCarryTuple T =
+			Shift_C(registers->r[inst->m], SRType_LSL,
+			        inst->shift_n, APSR_C(registers));
+		registers->r[inst->d] = T.result;
+		trace_register(inst->d, registers->r[inst->d]);
+		if (inst->setflags) {
+			setflags_ResultCarryTuple(registers, T);
+			trace_apsr(APSR(registers));
+		}
+	}
+}
+
+static void a6_7_67_t1_disassemble(const struct inst *inst)
+{
+	printf("  LSL");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf(" R%d, R%d, #%d\n", inst->d, inst->m, inst->shift_n);
+}
+
+static void a6_7_67_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
+{
+	uint8_t imm5 = (halfword & 0x07C0) >> 6;
+	uint8_t m = (halfword & 0x0038) >> 3;
+	uint8_t d = (halfword & 0x0007) >> 0;
+
+	struct ShiftTNTuple T = DecodeImmShift(0b00, imm5);
+
+	inst->d = d;
+	inst->m = m;
+	inst->setflags = !InITBlock(registers);
+	inst->shift_n = T.shift_n;
+	inst->execute = LSL_immediate;
+	inst->disassemble = a6_7_67_t1_disassemble;
+}
+
+static void LSL_register(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint8_t shift_n = (registers->r[inst->m] & 0x000000FF);
+		struct ResultCarryTuple T =
+			Shift_C(registers->r[inst->n], SRType_LSL,
+			        shift_n, APSR_C(registers));
+		registers->r[inst->d] = T.result;
+		trace_register(inst->d, registers->r[inst->d]);
+		if (inst->setflags) {
+			setflags_ResultCarryTuple(registers, T);
+			trace_apsr(APSR(registers));
+		}
+	}
+}
+
+static void a6_7_68_t2_disassemble(const struct inst *inst)
+{
+	printf("  LSL");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf("%s.W R%d, R%d, R%d\n",
+	       get_condition_name(inst->cond), inst->d, inst->n, inst->m);
+}
+
+static void a6_7_68_t2(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
+{
+	uint8_t S =  (first_halfword & 0x0010) >> 4;
+	uint8_t n =  (first_halfword & 0x000F) >> 0;
+	uint8_t d = (second_halfword & 0x0F00) >> 8;
+	uint8_t m = (second_halfword & 0x000F) >> 0;
+
+	assert(!(d == 13 || d == 15 || n == 13 || n == 15));
+
+	inst->d = d;
+	inst->n = n;
+	inst->m = m;
+	inst->setflags = S == 1;
+	inst->execute = LSL_register;
+	inst->disassemble = a6_7_68_t2_disassemble;
+}
+
+static void LSR_immediate(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		struct ResultCarryTuple T =
+			Shift_C(registers->r[inst->m], SRType_LSR, inst->shift_n,
+			        APSR_C(registers));
+		registers->r[inst->d] = T.result;
+		trace_register(inst->d, registers->r[inst->d]);
+
+		if (inst->setflags) {
+			setflags_ResultCarryTuple(registers, T);
+			trace_apsr(APSR(registers));
+		}
+	}
+}
+
+static void a6_7_69_disassemble(const struct inst *inst)
+{
+	printf("  LSR");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf("%s R%d, R%d, #%d\n",
+	       get_condition_name(inst->cond), inst->d, inst->m, inst->shift_n);
+}
+
+static void a6_7_69_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
+{
+	uint8_t imm5 = (halfword & 0x07C0) >> 6;
+	uint8_t m    = (halfword & 0x0038) >> 3;
+	uint8_t d    = (halfword & 0x0007) >> 0;
+
+	struct ShiftTNTuple T = DecodeImmShift(0b01, imm5);
+
+	inst->d = d;
+	inst->m = m;
+	inst->setflags = !InITBlock(registers);
+	inst->shift_n = T.shift_n;
+	inst->execute = LSR_immediate;
+	inst->disassemble = a6_7_69_disassemble;
+}
+
+static void a6_7_69_t2(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
+{
+	uint8_t S    =  (first_halfword & 0x0010) >>  4;
+	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
+	uint8_t d    = (second_halfword & 0x0F00) >>  8;
+	uint8_t imm2 = (second_halfword & 0x00C0) >>  6;
+	uint8_t m    = (second_halfword & 0x000F) >>  0;
+
+	uint8_t imm5 = (imm3 << 2) | imm2;
+	struct ShiftTNTuple T = DecodeImmShift(0b01, imm5);
+
+	assert(!(d == 13 || d == 15 || m == 13 || m == 15));
+
+	inst->d = d;
+	inst->m = m;
+	inst->setflags = S == 1;
+	inst->shift_n = T.shift_n;
+	inst->execute = LSR_immediate;
+	inst->disassemble = a6_7_69_disassemble;
+}
+
+static void MLA(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint64_t result = registers->r[inst->n] * registers->r[inst->m]
+		                  + registers->r[inst->a];
+		registers->r[inst->d] = (result & 0xFFFFFFFF);
+		trace_register(inst->d, registers->r[inst->d]);
+	}
+}
+
+static void a6_7_73_t1_disassemble(const struct inst *inst)
+{
+	printf("  MLA R%d, R%d, R%d, R%d\n", inst->d, inst->n, inst->m, inst->a);
+}
+
+static void a6_7_73_t1(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
+{
+	inst->n = (first_halfword & 0x000F) >> 0;
+	inst->a = (second_halfword & 0xF000) >> 12;
+	inst->d = (second_halfword & 0x0F00) >> 8;
+	inst->m = (second_halfword & 0x000F) >> 0;
+	inst->execute = MLA;
+	inst->disassemble = a6_7_73_t1_disassemble;
+}
+
+static void MLS(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint64_t result = registers->r[inst->a]
+		                  - registers->r[inst->n] * registers->r[inst->m];
+		registers->r[inst->d] = (result & 0xFFFFFFFF);
+		trace_register(inst->d, registers->r[inst->d]);
+	}
+}
+
+static void a6_7_74_t1_disassemble(const struct inst *inst)
+{
+	printf("  MLS R%d, R%d, R%d, R%d\n", inst->d, inst->n, inst->m, inst->a);
+}
+
+static void a6_7_74_t1(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
+{
+	inst->n = (first_halfword & 0x000F) >> 0;
+	inst->a = (second_halfword & 0xF000) >> 12;
+	inst->d = (second_halfword & 0x0F00) >> 8;
+	inst->m = (second_halfword & 0x000F) >> 0;
+	inst->execute = MLS;
+	inst->disassemble = a6_7_74_t1_disassemble;
+}
+
+static void MOV_immediate(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		struct ResultCarryTuple T;
+		T.result = inst->imm32;
+		T.carry = ThumbExpandImm_carry(registers, inst);
+		registers->r[inst->d] = inst->imm32;
+		trace_register(inst->d, inst->imm32);
+		if (inst->setflags) {
+			setflags_ResultCarryTuple(registers, T);
+			trace_apsr(APSR(registers));
+		}
+	}
+}
+
+static void a6_7_75_t1_disassemble(const struct inst *inst)
+{
+	if (!inst->setflags) {
+		printf("  MOV%s R%d, #%d\n",
+		       get_condition_name(inst->cond), inst->d, inst->imm32);
+	}
+	else {
+		printf("  MOVS R%d, #%d\n", inst->d, inst->imm32);
+	}
+}
+
+static void a6_7_75_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
+{
+	uint8_t d = (halfword & 0x0700) >> 8;
+	uint8_t imm8 = (halfword & 0x00FF) >> 0;
+
+	inst->d = d;
+	inst->setflags = !InITBlock(registers);
+	inst->imm32 = imm8;
+	inst->carry_in = true;
+	inst->execute = MOV_immediate;
+	inst->disassemble = a6_7_75_t1_disassemble;
+}
+
+static void a6_7_75_t2_disassemble(const struct inst *inst)
+{
+	printf("  MOV");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf("%s.W R%d #0x%08X\n",
+	       get_condition_name(inst->cond), inst->d, inst->imm32);
+}
+
+static void a6_7_75_t2(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
+{
+	uint8_t i    =  (first_halfword & 0x0400) >> 10;
+	uint8_t S    =  (first_halfword & 0x0010) >>  4;
+	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
+	uint8_t d    = (second_halfword & 0x0F00) >>  8;
+	uint8_t imm8 = (second_halfword & 0x00FF) >>  0;
+
+	uint16_t imm12 = (i << 11) | (imm3 << 8) | imm8;
+
+	struct ResultCarryTuple T = ThumbExpandImm_C(imm12, false);
+
+	inst->d = d;
+	inst->setflags = S == 1;
+	inst->imm32 = T.result;
+	inst->carry = T.result;
+	inst->carry_in = false;
+	inst->execute = MOV_immediate;
+	inst->disassemble = a6_7_75_t2_disassemble;
+}
+
+static void MOVW(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		registers->r[inst->d] = inst->imm32;
+		trace_register(inst->d, inst->imm32);
+	}
+}
+
+static void a6_7_75_t3_disassemble(const struct inst *inst)
+{
+	printf("  MOVW R%d #0x%04X\n", inst->d, inst->imm32);
+}
+
+static void a6_7_75_t3(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
+{
+	uint8_t i = (first_halfword & 0x0400) >> 10;
+	uint8_t imm4 = (first_halfword & 0x000F);
+	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
+	uint8_t rd = (0x0F00 & second_halfword) >> 8;
+	uint8_t imm8 = (second_halfword & 0x00FF);
+
+	inst->d = rd;
+	inst->imm32 = (imm4 * 0x1000)
+	              + (i * 0x0800)
+	              + (imm3 * 0x0100)
+	              + imm8;
+	inst->execute = MOVW;
+	inst->disassemble = a6_7_75_t3_disassemble;
+}
+
+static void MOV_register(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		registers->r[inst->d] = registers->r[inst->m];
+		trace_register(inst->d, registers->r[inst->d]);
+	}
+}
+
+static void a6_7_76_t1_disassemble(const struct inst *inst)
+{
+	printf("  MOV%s R%d, R%d\n",
+	       get_condition_name(inst->cond), inst->d, inst->m);
+}
+
+static void a6_7_76_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
+{
+	uint8_t D  = (halfword & 0x0080) >> 7;
+	uint8_t m  = (halfword & 0x0078) >> 3;
+	uint8_t Rd = (halfword & 0x0007) >> 0;
+
+	uint8_t d = (D << 3) | Rd;
+	assert(d != 15);
+
+	inst->d = d;
+	inst->m = m;
+	inst->setflags = false;
+	inst->execute = MOV_register;
+	inst->disassemble = a6_7_76_t1_disassemble;
+}
+
+static void MOVT(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		registers->r[inst->d] &= 0xFFFF;
+		registers->r[inst->d] |= inst->imm32 << 16;
+		trace_register(inst->d, registers->r[inst->d]);
+	}
+}
+
+static void a6_7_78_t1_disassemble(const struct inst *inst)
+{
+	printf("  MOVT%s R%d, #0x%04X\n",
+	       get_condition_name(inst->cond), inst->d, inst->imm32);
+}
+
+static void a6_7_78_t1(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
+{
+	uint8_t i = (first_halfword & 0x0400) >> 10;
+	uint8_t imm4 = (first_halfword & 0x000F) >> 0;
+	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
+	uint8_t d = (second_halfword & 0x0F00) >> 8;
+	uint8_t imm8 = (second_halfword & 0x00FF) >> 0;
+
+	inst->d = d;
+	inst->imm32 = (imm4 << 12)
+	              + (i << 11)
+	              + (imm3 << 8)
+	              + imm8;
+	inst->execute = MOVT;
+	inst->disassemble = a6_7_78_t1_disassemble;
+}
+
+static void MVN_immediate(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		struct ResultCarryTuple T;
+		T.result = ~inst->imm32;
+		T.carry = ThumbExpandImm_carry(registers, inst);
+		registers->r[inst->d] = T.result;
+		trace_register(inst->d, registers->r[inst->d]);
+		if (inst->setflags) {
+			setflags_ResultCarryTuple(registers, T);
+			trace_apsr(APSR(registers));
+		}
+	}
+}
+
+static void a6_7_84_t1_disassemble(const struct inst *inst)
+{
+	printf("  MVN");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf("%s R%d, #0x%08X\n",
+	       get_condition_name(inst->cond), inst->d, inst->imm32);
+}
+
+static void a6_7_84_t1(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
+{
+	uint8_t i = (first_halfword & 0x0400) >> 10;
+	uint8_t S = (first_halfword & 0x0010) >> 4;
+	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
+	uint8_t d = (second_halfword & 0x0F00) >> 8;
+	uint8_t imm8 = (second_halfword & 0x00FF) >> 0;
+
+	uint16_t imm12 = (i << 11) | (imm3 << 8) | imm8;
+
+	inst->d = d;
+	inst->setflags = S == 1;
+	decode_ThumbExpandImm_C(inst, imm12);
+	inst->execute = MVN_immediate;
+	inst->disassemble = a6_7_84_t1_disassemble;
+}
+
+static void NOP(struct registers *registers, const struct inst *inst)
+{
+}
+
+static void a6_7_87_t1_disassemble(const struct inst *inst)
+{
+	printf("  NOP\n");
+}
+
+static void a6_7_87_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
+{
+	inst->execute = NOP;
+	inst->disassemble = a6_7_87_t1_disassemble;
+}
+
+static void a6_7_89_t1(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
+{
+	assert(false);
+}
+
+static void ORR_immediate(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		struct ResultCarryTuple T;
+		T.result = registers->r[inst->n] | inst->imm32;
+		T.carry = ThumbExpandImm_carry(registers, inst);
+		registers->r[inst->d] = T.result;
+		trace_register(inst->d, registers->r[inst->d]);
+		if (inst->setflags) {
+			setflags_ResultCarryTuple(registers, T);
+			trace_apsr(APSR(registers));
+		}
+	}
+}
+
+static void a6_7_90_t1_disassemble(const struct inst *inst)
+{
+	printf("  ORR");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf("%s R%d, R%d, #0x%08X\n",
+	       get_condition_name(inst->cond), inst->d, inst->n, inst->imm32);
+}
+
+static void a6_7_90_t1(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
+{
+	uint8_t i = (first_halfword & 0x0400) >> 10;
+	uint8_t S = (first_halfword & 0x0010) >> 4;
+	uint8_t n = (first_halfword & 0x000F) >> 0;
+	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
+	uint8_t d = (second_halfword & 0x0F00) >> 8;
+	uint8_t imm8 = (second_halfword & 0x00FF) >> 0;
+
+	uint16_t imm12 = (i << 11) | (imm3 << 8) | imm8;
+
+	inst->d = d;
+	inst->n = n;
+	inst->setflags = S == 1;
+	decode_ThumbExpandImm_C(inst, imm12);
+	inst->execute = ORR_immediate;
+	inst->disassemble = a6_7_90_t1_disassemble;
+}
+
+static void ORR_register(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		struct ResultCarryTuple T =
+			Shift_C(registers->r[inst->m], inst->shift_t,
+			        inst->shift_n, APSR_C(registers));
+		uint32_t shifted = T.result;
+		uint32_t result = registers->r[inst->m] | shifted;
+		registers->r[inst->d] = result;
+		trace_register(inst->d, registers->r[inst->d]);
+		if (inst->setflags) {
+			T.result = result;
+			setflags_ResultCarryTuple(registers, T);
+			trace_apsr(APSR(registers));
+		}
+	}
+}
+
+static void a6_7_91_t1_disassemble(const struct inst *inst)
+{
+	printf("  ORR");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf("%s R%d, R%d\n",
+	       get_condition_name(inst->cond), inst->d, inst->m);
+}
+
+static void a6_7_91_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
+{
+	uint8_t m  = (halfword & 0x0038) >>  3;
+	uint8_t dn = (halfword & 0x0007) >>  0;
+
+	inst->d = dn;
+	inst->n = dn;
+	inst->m = m;
+	inst->setflags = !InITBlock(registers);
+	inst->shift_t = SRType_LSL;
+	inst->shift_n = 0;
+	inst->execute = ORR_register;
+	inst->disassemble = a6_7_91_t1_disassemble;
+}
+
+static void a6_7_91_t2_disassemble(const struct inst *inst)
+{
+	printf("  ORR");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf("%s.W R%d, R%d, R%d",
+	       get_condition_name(inst->cond), inst->d, inst->n, inst->m);
+	if (inst->shift_n != 0) {
+		printf(", <shift>");
+	}
+	printf("\n");
+}
+
+static void a6_7_91_t2(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
+{
+	uint8_t S    =  (first_halfword & 0x0010) >>  4;
+	uint8_t n    =  (first_halfword & 0x000F) >>  0;
+	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
+	uint8_t d    = (second_halfword & 0x0F00) >>  8;
+	uint8_t imm2 = (second_halfword & 0x00C0) >>  6;
+	uint8_t type = (second_halfword & 0x0030) >>  4;
+	uint8_t m    = (second_halfword & 0x000F) >>  0;
+
+	uint8_t imm5 = (imm3 << 2) | imm2;
+	struct ShiftTNTuple T = DecodeImmShift(type, imm5);
+
+	assert(!(d == 13 || d == 15 || n == 13 || m == 13 || m == 15));
+
+	inst->d = d;
+	inst->n = n;
+	inst->m = m;
+	inst->setflags = S == 1;
+	inst->shift_t = T.shift_t;
+	inst->shift_n = T.shift_n;
+	inst->execute = ORR_register;
+	inst->disassemble = a6_7_91_t2_disassemble;
+}
+
+static void POP(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint16_t all_registers = inst->register_list;
+		uint32_t address = SP(registers);
+		for (uint8_t i = 0; i < 15; ++i) {
+			if ((all_registers & (0x0001 << i)) == (0x0001 << i)) {
+				registers->r[i] = memory_word_read(address);
+				trace_register_load(i, registers->r[i], address);
+				address += 4;
+			}
+		}
+		if ((all_registers & (0x0001 << 15)) == (0x0001 << 15)) {
+			uint32_t arg = memory_word_read(address);
+			LoadWritePC(registers, arg);
+		}
+		uint8_t bit_count = __builtin_popcount(all_registers);
+		address = registers->r[13] + 4 * bit_count;
+		registers->r[13] = address;
+		trace_register(13, address);
+	}
+}
+
+static void a6_7_97_t1_disassemble(const struct inst *inst)
+{
+	printf("  POP {");
+	print_register_list(inst->register_list);
+	printf("}\n");
+}
+
+static void a6_7_97_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
+{
+	uint8_t register_list = (halfword & 0x00FF) >> 0;
+	uint8_t P = (halfword & 0x0100) >> 8;
+
+	inst->register_list = (P << 15) | register_list;
+	inst->execute = POP;
+	inst->disassemble = a6_7_97_t1_disassemble;
+}
+
+static void a6_7_97_t2_disassemble(const struct inst *inst)
+{
+	printf("  POP.W {");
+	print_register_list(inst->register_list);
+	printf("}\n");
+}
+
+static void a6_7_97_t2(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
+{
+	uint8_t P = (second_halfword & 0x8000) >> 15;
+	uint8_t M = (second_halfword & 0x4000) >> 14;
+	uint16_t register_list = (second_halfword & 0x1FFF) >> 0;
+
+	uint16_t all_registers = (P << 15) | (M << 14) | register_list;
+
+	uint8_t bit_count = __builtin_popcount(all_registers);
+	if ((bit_count < 2) || ((P == 1) && (M == 1))) {
+		assert(false);
+	}
+
+	inst->register_list = all_registers;
+	inst->execute = POP;
+	inst->disassemble = a6_7_97_t2_disassemble;
+}
+
+static void PUSH(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint16_t all_registers = inst->register_list;
+		uint8_t bit_count = __builtin_popcount(all_registers);
+		uint32_t address = registers->r[13] - 4 * bit_count;
+		trace_note_higher_registers();
+		for (uint8_t i = 0; i < 15; ++i) {
+			if ((all_registers & (0x0001 << i)) == (0x0001 << i)) {
+				memory_word_write(address & 0xFFFFFFFC, registers->r[i]);
+				address += 4;
+			}
+		}
+		address = registers->r[13] - 4 * bit_count;
+		registers->r[13] = address;
+		trace_register(13, address);
+	}
+}
+
+static void a6_7_98_disassemble(const struct inst *inst)
+{
+	printf("  PUSH%s {", get_condition_name(inst->cond));
+	print_register_list(inst->register_list & 0x7FFF);
+	printf("}\n");
+}
+
+static void a6_7_98_t1(struct registers *registers, struct inst *inst,
+                       uint16_t halfword)
+{
+	uint8_t register_list = (halfword & 0x00FF) >> 0;
+	uint8_t M = (halfword & 0x0100) >> 8;
+
+	inst->register_list = (M << 14) | register_list;
+	inst->execute = PUSH;
+	inst->disassemble = a6_7_98_disassemble;
+}
+
+static void a6_7_98_t2(struct registers *registers, struct inst *inst,
+                       uint16_t first_halfword,
+                       uint16_t second_halfword)
+{
+	uint8_t  M             = (second_halfword & 0x4000) >> 14;
+	uint16_t register_list = (second_halfword & 0x1FFF) >>  0;
+
+	inst->register_list = (M << 14) | register_list;
+	inst->execute = PUSH;
+	inst->disassemble = a6_7_98_disassemble;
+}
+
+static void RSB_immediate(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint32_t x = ~(registers->r[inst->n]);
+		uint32_t y = inst->imm32;
+		struct ResultCarryOverflowTuple T = AddWithCarry(x, y, true);
+		registers->r[inst->d] = T.result;
+		trace_register(inst->d, registers->r[inst->d]);
+		if (inst->setflags) {
+			setflags_AddWithCarry(registers, x, y, true);
+			trace_apsr(APSR(registers));
+		}
+	}
+}
+
+static void a6_7_106_t2_disassemble(const struct inst *inst)
+{
+	printf("  RSB");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf("%s R%d, R%d, #0x%08X\n",
+	       get_condition_name(inst->cond), inst->d, inst->n, inst->imm32);
+}
+
+static void a6_7_106_t2(struct registers *registers, struct inst *inst,
+                        uint16_t first_halfword,
+                        uint16_t second_halfword)
+{
+	uint8_t i    =  (first_halfword & 0x0400) >> 10;
+	uint8_t S    =  (first_halfword & 0x0010) >>  4;
+	uint8_t n    =  (first_halfword & 0x000F) >>  0;
+	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
+	uint8_t d    = (second_halfword & 0x0F00) >>  8;
+	uint8_t imm8 = (second_halfword & 0x00FF) >>  0;
+
+	uint16_t imm12 = (i * 0x800)
+	                 + (imm3 * 0x100)
+	                 + imm8;
+
+	inst->d = d;
+	inst->n = n;
+	inst->setflags = S == 1;
+	inst->imm32 = ThumbExpandImm(registers, imm12);
+	inst->execute = RSB_immediate;
+	inst->disassemble = a6_7_106_t2_disassemble;
+}
+
+static void RSB_register(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint32_t shifted = Shift(registers->r[inst->m], inst->shift_t,
+		                         inst->shift_n, APSR_C(registers));
+		uint32_t x = ~(registers->r[inst->n]);
+		uint32_t y = shifted;
+		struct ResultCarryOverflowTuple T = AddWithCarry(x, y, true);
+		registers->r[inst->d] = T.result;
+		trace_register(inst->d, registers->r[inst->d]);
+		if (inst->setflags) {
+			setflags_AddWithCarry(registers, x, y, true);
+			trace_apsr(APSR(registers));
+		}
+	}
+}
+
+static void a6_7_107_t1_disassemble(const struct inst *inst)
+{
+	printf("  RSB");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf("%s R%d, R%d, R%d",
+	       get_condition_name(inst->cond), inst->d, inst->n, inst->m);
+	if (inst->shift_n != 0) {
+		printf(", <shift>");
+	}
+	printf("\n");
+}
+
+static void a6_7_107_t1(struct registers *registers, struct inst *inst,
+                        uint16_t first_halfword,
+                        uint16_t second_halfword)
+{
+	uint8_t S    =  (first_halfword & 0x0010) >>  4;
+	uint8_t n    =  (first_halfword & 0x000F) >>  0;
+	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
+	uint8_t d    = (second_halfword & 0x0F00) >>  8;
+	uint8_t imm2 = (second_halfword & 0x00C0) >>  6;
+	uint8_t type = (second_halfword & 0x0030) >>  4;
+	uint8_t m    = (second_halfword & 0x000F) >>  0;
+
+	uint8_t imm5 = (imm3 << 2) | imm2;
+	struct ShiftTNTuple T = DecodeImmShift(type, imm5);
+
+	assert(!(d == 13 || d == 15 || n == 13 || n == 15));
+
+	inst->d = d;
+	inst->n = n;
+	inst->m = m;
+	inst->setflags = S == 1;
+	inst->shift_t = T.shift_t;
+	inst->shift_n = T.shift_n;
+	inst->execute = RSB_register;
+	inst->disassemble = a6_7_107_t1_disassemble;
+}
+
+static void STR_immediate(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint32_t offset_addr;
+		if (inst->add) { offset_addr = registers->r[inst->n] + inst->imm32; }
+		else           { offset_addr = registers->r[inst->n] - inst->imm32; }
+		uint32_t address;
+		if (inst->index) { address = offset_addr; }
+		else             { address = registers->r[inst->n]; }
+
+		memory_word_write(address, registers->r[inst->t]);
+		if (inst->wback) {
+			trace_register(inst->n, offset_addr);
+			registers->r[inst->n] = offset_addr;
+		}
+	}
+}
+
+static void a6_7_119_disassemble(const struct inst *inst)
+{
+	const char *cond = get_condition_name(inst->cond);
+	if (inst->index) {
+		if (!inst->wback) {
+			printf("  STR%s R%d, [R%d, #%d]\n",
+			       cond, inst->t, inst->n, inst->imm32);
+		}
+		else {
+			printf("  STR%s R%d, [R%d, #%d]!\n",
+			       cond, inst->t, inst->n, inst->imm32);
+		}
+	}
+	else {
+		printf("  STR%s R%d, [R%d], #%d\n",
+		       cond, inst->t, inst->n, inst->imm32);
+	}
+}
+
+static void a6_7_119_t1(struct registers *registers, struct inst *inst,
+                        uint16_t halfword)
+{
+	uint8_t imm5 = (halfword & 0x07C0) >> 6;
+	uint8_t n = (halfword & 0x0038) >> 3;
+	uint8_t t = (halfword & 0x0007) >> 0;
+
+	inst->t = t;
+	inst->n = n;
+	inst->imm32 = imm5 << 2;
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->execute = STR_immediate;
+	inst->disassemble = a6_7_119_disassemble;
+}
+
+static void a6_7_119_t2(struct registers *registers, struct inst *inst,
+                        uint16_t halfword)
+{
+	uint8_t t = (halfword & 0x0700) >> 8;
+	uint8_t imm8 = (halfword & 0x00FF) >> 0;
+
+	inst->t = t;
+	inst->n = 13;
+	inst->imm32 = (imm8 << 2);
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->execute = STR_immediate;
+	inst->disassemble = a6_7_119_disassemble;
+}
+
+static void a6_7_119_t3(struct registers *registers, struct inst *inst,
+                        uint16_t first_halfword,
+                        uint16_t second_halfword)
+{
+	uint8_t  n     =  (first_halfword & 0x000F) >>  0;
+	uint8_t  t     = (second_halfword & 0xF000) >> 12;
+	uint16_t imm12 = (second_halfword & 0x0FFF) >>  0;
+
+	assert(!(t == 15));
+
+	inst->t = t;
+	inst->n = n;
+	inst->imm32 = imm12;
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->execute = STR_immediate;
+	inst->disassemble = a6_7_119_disassemble;
+}
+
+static void a6_7_119_t4(struct registers *registers, struct inst *inst,
+                        uint16_t first_halfword,
+                        uint16_t second_halfword)
+{
+	uint8_t n =  (first_halfword & 0x000F) >>  0;
+	uint8_t t = (second_halfword & 0xF000) >> 12;
+	uint8_t P = (second_halfword & 0x0400) >> 10;
+	uint8_t U = (second_halfword & 0x0200) >>  9;
+	uint8_t W = (second_halfword & 0x0100) >>  8;
+	uint8_t imm8 = (second_halfword & 0x00FF) >> 0;
+
+	inst->t = t;
+	inst->n = n;
+	inst->imm32 = imm8;
+	inst->index = P == 1;
+	inst->add = U == 1;
+	inst->wback = W == 1;
+	inst->execute = STR_immediate;
+	inst->disassemble = a6_7_119_disassemble;
+}
+
+static void STR_register(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint32_t offset = Shift(registers->r[inst->m], inst->shift_t,
+		                        inst->shift_n, APSR_C(registers));
+		uint32_t address = registers->r[inst->n] + offset;
+		uint32_t data = registers->r[inst->t];
+		memory_word_write(address, data);
+	}
+}
+
+static void a6_7_120_t1_disassemble(const struct inst *inst)
+{
+	printf("  STR%s R%d, [R%d, R%d]\n",
+	       get_condition_name(inst->cond), inst->t, inst->n, inst->m);
+}
+
+static void a6_7_120_t1(struct registers *registers, struct inst *inst,
+                        uint16_t halfword)
+{
+	uint8_t m = (halfword & 0x01C0) >> 6;
+	uint8_t n = (halfword & 0x0038) >> 3;
+	uint8_t t = (halfword & 0x0007) >> 0;
+
+	inst->t = t;
+	inst->n = n;
+	inst->m = m;
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->shift_t = SRType_LSL;
+	inst->shift_n = 0;
+	inst->execute = STR_register;
+	inst->disassemble = a6_7_120_t1_disassemble;
+}
+
+static void a6_7_120_t2_disassemble(const struct inst *inst)
+{
+	printf("  STR%s R%d, [R%d, R%d",
+	       get_condition_name(inst->cond), inst->t, inst->n, inst->m);
+	if (inst->shift_n != 0) {
+		printf(", LSL #%d", inst->shift_n);
+	}
+	printf("]\n");
+}
+
+static void a6_7_120_t2(struct registers *registers, struct inst *inst,
+                        uint16_t first_halfword,
+                        uint16_t second_halfword)
+{
+	uint8_t n    =  (first_halfword & 0x000F) >>  0;
+	uint8_t t    = (second_halfword & 0xF000) >> 12;
+	uint8_t imm2 = (second_halfword & 0x0030) >>  4;
+	uint8_t m    = (second_halfword & 0x000F) >>  0;
+
+	inst->t = t;
+	inst->n = n;
+	inst->m = m;
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->shift_t = SRType_LSL;
+	inst->shift_n = imm2;
+	inst->execute = STR_register;
+	inst->disassemble = a6_7_120_t2_disassemble;
+}
+
+static void STRB(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint32_t offset_addr;
+		if (inst->add) { offset_addr = registers->r[inst->n] + inst->imm32; }
+		else           { offset_addr = registers->r[inst->n] - inst->imm32; }
+		uint32_t address;
+		if (inst->index) { address = offset_addr; }
+		else             { address = registers->r[inst->n]; }
+
+		uint8_t value = registers->r[inst->t] & 0x000000FF;
+		memory_byte_write(address, value);
+
+		if (inst->wback) {
+			registers->r[inst->n] = offset_addr;
+			trace_register(inst->n, offset_addr);
+		}
+	}
+}
+
+static void a6_7_121_disassemble(const struct inst *inst)
+{
+	if (inst->index) {
+		if (!inst->wback) {
+			printf("  STRB R%d [R%d, #%d]\n",
+			       inst->t, inst->n, inst->imm32);
+		}
+		else {
+			printf("  STRB R%d [R%d, #%d]!\n",
+			       inst->t, inst->n, inst->imm32);
+		}
+	}
+	else {
+		printf("  STRB R%d [R%d] #%d\n", inst->t, inst->n, inst->imm32);
+	}
+}
+
+static void a6_7_121_t1(struct registers *registers, struct inst *inst,
+                        uint16_t halfword)
+{
+	uint8_t imm5 = (halfword & 0x07C0) >> 6;
+	uint8_t n = (halfword & 0x0038) >> 3;
+	uint8_t t = (halfword & 0x0007) >> 0;
+
+	inst->t = t;
+	inst->n = n;
+	inst->imm32 = imm5;
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->execute = STRB;
+	inst->disassemble = a6_7_121_disassemble;
+}
+
+static void a6_7_121_t2(struct registers *registers, struct inst *inst,
+                        uint16_t first_halfword,
+                        uint16_t second_halfword)
+{
+	uint8_t  n     =  (first_halfword & 0x000F) >>  0;
+	uint8_t  t     = (second_halfword & 0xF000) >> 12;
+	uint16_t imm12 = (second_halfword & 0x0FFF) >>  0;
+
+	assert(!(n == 15)); // UNDEFINED
+	assert(!(t == 13 || t == 15)); // UNPREDICTABLE
+
+	inst->t = t;
+	inst->n = n;
+	inst->imm32 = imm12;
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->execute = STRB;
+	inst->disassemble = a6_7_121_disassemble;
+}
+
+static void a6_7_121_t3(struct registers *registers, struct inst *inst,
+                        uint16_t first_halfword,
+                        uint16_t second_halfword)
+{
+	uint8_t n    =  (first_halfword & 0x000F) >>  0;
+	uint8_t t    = (second_halfword & 0xF000) >> 12;
+	uint8_t P    = (second_halfword & 0x0400) >> 10;
+	uint8_t U    = (second_halfword & 0x0200) >>  9;
+	uint8_t W    = (second_halfword & 0x0100) >>  8;
+	uint8_t imm8 = (second_halfword & 0x00FF) >>  0;
+
+	inst->t = t;
+	inst->n = n;
+	inst->imm32 = imm8;
+	inst->index = P == 1;
+	inst->add = U == 1;
+	inst->wback = W == 1;
+	inst->execute = STRB;
+	inst->disassemble = a6_7_121_disassemble;
+}
+
+static void STRB_register(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint32_t offset = registers->r[inst->m];
+		uint32_t address = registers->r[inst->n] + offset;
+		memory_byte_write(address, registers->r[inst->t]);
+	}
+}
+
+static void a6_7_122_t1_disassemble(const struct inst *inst)
+{
+	printf("  STRB%s R%d, [R%d, R%d]\n",
+	       get_condition_name(inst->cond), inst->t, inst->n, inst->m);
+}
+
+static void a6_7_122_t1(struct registers *registers, struct inst *inst,
+                        uint16_t halfword)
+{
+	uint8_t m = (halfword & 0x01C0) >> 6;
+	uint8_t n = (halfword & 0x0038) >> 3;
+	uint8_t t = (halfword & 0x0007) >> 0;
+
+	inst->t = t;
+	inst->n = n;
+	inst->m = m;
+	inst->index = true;
+	inst->add = true;
+	inst->wback = false;
+	inst->shift_t = SRType_LSL;
+	inst->shift_n = 0;
+	inst->execute = STRB_register;
+	inst->disassemble = a6_7_122_t1_disassemble;
+}
+
+static void STRH_immediate(struct registers *registers,
+                           const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint32_t offset_addr = registers->r[inst->n] + inst->imm32;
+		uint32_t address = offset_addr;
+
+		uint16_t value = registers->r[inst->t] & 0x0000FFFF;
+
+		memory_halfword_write(address, value);
+	}
+}
+
+static void a6_7_128_t1_disassemble(const struct inst *inst)
+{
+	printf("  STRH R%d [R%d, #%d]\n", inst->t, inst->n, inst->imm32);
+}
+
+static void a6_7_128_t1(struct registers *registers, struct inst *inst,
+                        uint16_t halfword)
+{
+	uint8_t rt = (halfword & 0x0007);
+	uint8_t rn = (halfword & 0x0038) >> 3;
+	uint8_t imm5 = (halfword & 0x07C0) >> 6;
+
+	inst->t = rt;
+	inst->n = rn;
+	inst->imm32 = imm5 << 1;
+	inst->execute = STRH_immediate;
+	inst->disassemble = a6_7_128_t1_disassemble;
+}
+
+static void SUB_immediate(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint32_t x = registers->r[inst->n];
+		uint32_t y = ~inst->imm32;
+		struct ResultCarryOverflowTuple T = AddWithCarry(x, y, true);
+		registers->r[inst->d] = T.result;
+		trace_register(inst->d, registers->r[inst->d]);
+		if (inst->setflags) {
+			setflags_AddWithCarry(registers, x, y, true);
+			trace_apsr(APSR(registers));
+		}
+	}
+}
+
+static void a6_7_132_t2_disassemble(const struct inst *inst)
+{
+	if (inst->setflags) {
+		printf("  SUBS R%d, R%d, #%d\n", inst->d, inst->n, inst->imm32);
+	}
+	else {
+		printf("  SUB R%d, R%d, #%d\n", inst->d, inst->n, inst->imm32);
+	}
+}
+
+static void a6_7_132_t2(struct registers *registers, struct inst *inst,
+                        uint16_t halfword)
+{
+	uint8_t d = (halfword & 0x0700) >> 8;
+	uint8_t imm8 = (halfword & 0x00FF) >> 0;
+
+	inst->d = d;
+	inst->n = d;
+	inst->setflags = !InITBlock(registers);
+	inst->imm32 = imm8;
+	inst->execute = SUB_immediate;
+	inst->disassemble = a6_7_132_t2_disassemble;
+}
+
+static void SUB_register(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint32_t shifted = Shift(registers->r[inst->m], inst->shift_t,
+		                         inst->shift_n, APSR_C(registers));
+		uint32_t x = registers->r[inst->n];
+		uint32_t y = ~shifted;
+		struct ResultCarryOverflowTuple T = AddWithCarry(x, y, true);
+		registers->r[inst->d] = T.result;
+		trace_register(inst->d, registers->r[inst->d]);
+		if (inst->setflags) {
+			setflags_AddWithCarry(registers, x, y, true);
+			trace_apsr(APSR(registers));
+		}
+	}
+}
+
+static void a6_7_133_t1_disassemble(const struct inst *inst)
+{
+	printf("  SUB");
+	if (inst->setflags) {
+		printf("S");
+	}
+	printf(" R%d, R%d, R%d\n", inst->d, inst->n, inst->m);
+}
+
+static void a6_7_133_t1(struct registers *registers, struct inst *inst,
+                        uint16_t halfword)
+{
+	uint8_t m = (halfword & 0x01C0) >> 6;
+	uint8_t n = (halfword & 0x0038) >> 3;
+	uint8_t d = (halfword & 0x0007) >> 0;
+
+	inst->d = d;
+	inst->n = n;
+	inst->m = m;
+	inst->setflags = !InITBlock(registers);
+	inst->shift_t = SRType_LSL;
+	inst->shift_n = 0;
+	inst->execute = SUB_register;
+	inst->disassemble = a6_7_133_t1_disassemble;
+}
+
+static void SUB_SP_minus_immediate(struct registers *registers,
+                                   const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint32_t x = SP(registers);
+		uint32_t y = ~inst->imm32;
+		struct ResultCarryOverflowTuple T = AddWithCarry(x, y, true);
+		registers->r[inst->d] = T.result;
+		trace_register(inst->d, registers->r[inst->d]);
+		if (inst->setflags) {
+			setflags_AddWithCarry(registers, x, y, true);
+			trace_apsr(APSR(registers));
+		}
+	}
+}
+
+static void a6_7_134_t1_disassemble(const struct inst *inst)
+{
+	printf("  SUB%s SP, SP, #%d\n",
+	       get_condition_name(inst->cond), inst->imm32 >> 2);
+}
+
+static void a6_7_134_t1(struct registers *registers, struct inst *inst,
+                        uint16_t halfword)
+{
+	uint8_t imm7 = (halfword & 0x007F) >> 0;
+
+	inst->d = 13;
+	inst->setflags = false;
+	inst->imm32 = (imm7 << 2);
+	inst->execute = SUB_SP_minus_immediate;
+	inst->disassemble = a6_7_134_t1_disassemble;
+}
+
+static void UBFX(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		uint8_t lsbit = inst->shift_n;
+		uint8_t msbit = lsbit + inst->imm32;
+		if (msbit <= 31) {
+			registers->r[inst->d] = 0;
+			for (uint8_t i = 0; i < 32; ++i) {
+				if (i >= lsbit && i <= msbit) {
+					registers->r[inst->d] |=
+						(registers->r[inst->n] & (1 << i)) >> lsbit;
+				}
+			}
+			trace_register(inst->d, registers->r[inst->d]);
+		}
+		else {
+			assert(false);
+		}
+	}
+}
+
+static void a6_7_144_t1_disassemble(const struct inst *inst)
+{
+	printf("  UBFX%s R%d, R%d, #%d, #%d\n",
+	       get_condition_name(inst->cond), inst->d, inst->n,
+	       inst->shift_n, inst->imm32 + 1);
+}
+
+/* lsbit is kept in shift_n and widthminus1 in imm32 */
+static void a6_7_144_t1(struct registers *registers, struct inst *inst,
+                        uint16_t first_halfword,
+                        uint16_t second_halfword)
+{
+	uint8_t n = (first_halfword & 0x000F) >> 0;
+	uint8_t imm3 = (second_halfword & 0x7000) >> 12;
+	uint8_t d = (second_halfword & 0x0F00) >> 8;
+	uint8_t imm2 = (second_halfword & 0x00C0) >> 6;
+	uint8_t widthminus1 = (second_halfword & 0x001F) >> 0;
+
+	assert(!(d == 13 || d == 15 || n == 13 || n == 15));
+
+	inst->d = d;
+	inst->n = n;
+	inst->shift_n = (imm3 << 2) | imm2;
+	inst->imm32 = widthminus1;
+	inst->execute = UBFX;
+	inst->disassemble = a6_7_144_t1_disassemble;
+}
+
+static void UDIV(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		assert(registers->r[inst->m] != 0);
+
+		registers->r[inst->d] = registers->r[inst->n]
+		                        / registers->r[inst->m];
+		trace_register(inst->d, registers->r[inst->d]);
+	}
+}
+
+static void a6_7_145_t1_disassemble(const struct inst *inst)
+{
+	printf("  UDIV R%d, R%d, R%d\n", inst->d, inst->n, inst->m);
+}
+
+static void a6_7_145_t1(struct registers *registers, struct inst *inst,
+                        uint16_t first_halfword,
+                        uint16_t second_halfword)
+{
+	inst->n = (first_halfword & 0x000F) >> 0;
+	inst->d = (second_halfword & 0x0F00) >> 8;
+	inst->m = (second_halfword & 0x000F) >> 0;
+	inst->execute = UDIV;
+	inst->disassemble = a6_7_145_t1_disassemble;
+}
+
+static void UXTB(struct registers *registers, const struct inst *inst)
+{
+	if (ConditionPassed(registers, inst)) {
+		registers->r[inst->d] = (registers->r[inst->m] & 0x000000FF);
+		trace_register(inst->d, registers->r[inst->d]);
+	}
+}
+
+static void a6_7_149_t1_disassemble(const struct inst *inst)
+{
+	printf("  UXTB R%d, R%d\n", inst->d, inst->m);
+}
+
+static void a6_7_149_t1(struct registers *registers, struct inst *inst,
+                        uint16_t halfword)
+{
+	inst->m = (halfword & 0x0038) >> 3;
+	inst->d = (halfword & 0x0007) >> 0;
+	inst->execute = UXTB;
+	inst->disassemble = a6_7_149_t1_disassemble;
+}
+
+static void a5_2_1(struct registers *registers, struct inst *inst,
+                   uint16_t halfword)
+{
+	uint8_t opcode = (halfword & 0x3E00) >> 9;
+
+	if ((opcode & 0b11100) == 0b00000) {
+		a6_7_67_t1(registers, inst, halfword); // LSL
 	}
 	else if ((opcode & 0b11100) == 0b00100) {
-		a6_7_69_t1(registers, halfword); // LSR
+		a6_7_69_t1(registers, inst, halfword); // LSR
+	}
+	else if ((opcode & 0b11100) == 0b01000) {
+		a6_7_10_t1(registers, inst, halfword); // ASR
+	}
+	else if (opcode == 0b01100) {
+		a6_7_4_t1(registers, inst, halfword);
+	}
+	else if (opcode == 0b01101) {
+		a6_7_133_t1(registers, inst, halfword); // SUB
+	}
+	else if (opcode == 0b01110) {
+		a6_7_3_t1(registers, inst, halfword); // ADD
+	}
+	else if (opcode == 0b01111) {
+		printf("  SUB?\n");
+		assert(false);
+	}
+	else if ((opcode & 0b11100) == 0b10000) {
+		a6_7_75_t1(registers, inst, halfword);
+	}
+	else if ((opcode & 0b11100) == 0b10100) {
+		a6_7_27_t1(registers, inst, halfword);
+	}
+	else if ((opcode & 0b11100) == 0b11000) {
+		a6_7_3_t2(registers, inst, halfword); // ADD
+	}
+	else if ((opcode & 0b11100) == 0b11100) {
+		a6_7_132_t2(registers, inst, halfword); // SUB
+	}
+	else {
+		assert(false);
+	}
+}
+
+static void a5_2_2(struct registers *registers, struct inst *inst,
+                   uint16_t halfword)
+{
+	uint8_t opcode = (halfword & 0x03C0) >> 6;
+	switch (opcode) {
+	case 0b0000:
+		printf("  AND? a5_2_2\n");
+		assert(false);
+		break;
+	case 0b0001:
+		printf("  EOR? a5_2_2\n");
+		assert(false);
+		break;
+	case 0b0010:
+		printf("  LSL? a5_2_2\n");
+		assert(false);
+		break;
+	case 0b0011:
+		printf("  LSR? a5_2_2\n");
+		assert(false);
+		break;
+	case 0b0100:
+		printf("  ASR? a5_2_2\n");
+		assert(false);
+		break;
+	case 0b0101:
+		printf("  ADC? a5_2_2\n");
+		assert(false);
+		break;
+	case 0b0110:
+		printf("  SBC? a5_2_2\n");
+		assert(false);
+		break;
+	case 0b0111:
+		printf("  ROR? a5_2_2\n");
+		assert(false);
+		break;
+	case 0b1000:
+		printf("  TST? a5_2_2\n");
+		assert(false);
+		break;
+	case 0b1001:
+		printf("  RSB? a5_2_2\n");
+		assert(false);
+		break;
+	case 0b1010:
+		a6_7_28_t1(registers, inst, halfword); // CMP
+		break;
+	case 0b1011:
+		printf("  CMN? a5_2_2\n");
+		assert(false);
+		break;
+	case 0b1100:
+		a6_7_91_t1(registers, inst, halfword); // ORR (register)
+		break;
+	case 0b1101:
+		printf("  MUL? a5_2_2\n");
+		assert(false);
+		break;
+	case 0b1110:
+		printf("  BIC? a5_2_2\n");
+		assert(false);
+		break;
+	case 0b1111:
+		printf("  MVN? a5_2_2\n");
+		assert(false);
+		break;
+	}
+}
+
+static void a5_2_3(struct registers *registers, struct inst *inst,
+                   uint16_t halfword)
+{
+	uint8_t opcode = (halfword & 0x03C0) >> 6;
+	if ((opcode & 0b1100) == 0b0000) {
+		a6_7_4_t2(registers, inst, halfword); // ADD
+	}
+	else if (opcode == 0b0100) {
+		assert(false);
+	}
+	else if (opcode == 0b0101) {
+		a6_7_28_t2(registers, inst, halfword); // CMP
+	}
+	else if ((opcode & 0b1110) == 0b0110) {
+		a6_7_28_t2(registers, inst, halfword); // CMP
+	}
+	else if ((opcode & 0b1100) == 0b1000) {
+		a6_7_76_t1(registers, inst, halfword); // MOV
+	}
+	else if ((opcode & 0b1110) == 0b1100) {
+		a6_7_20_t1(registers, inst, halfword); // BX
+	}
+	else if ((opcode & 0b1110) == 0b1110) {
+		a6_7_19_t1(registers, inst, halfword); // BLX
+	}
+	else {
+		assert(false);
+	}
+}
+
+static void a5_2_4(struct registers *registers, struct inst *inst,
+                   uint16_t halfword)
+{
+	uint8_t opA = (halfword & 0xF000) >> 12;
+	uint8_t opB = (halfword & 0x0E00) >> 9;
+
+	if (opA == 0b0101) {
+		switch (opB) {
+		case 0b000:
+			a6_7_120_t1(registers, inst, halfword); // STR
+			break;
+		case 0b001:
+			printf("  STRH? a5_2_4\n");
+			assert(false);
+			break;
+		case 0b010:
+			a6_7_122_t1(registers, inst, halfword); // STRB
+			break;
+		case 0b011:
+			printf("  LDRSB? a5_2_4\n");
+			assert(false);
+			break;
+		case 0b100:
+			a6_7_44_t1(registers, inst, halfword); // LDR
+			break;
+		case 0b101:
+			printf("  LDRH? a5_2_4\n");
+			assert(false);
+			break;
+		case 0b110:
+			a6_7_47_t1(registers, inst, halfword); // LDRB
+			break;
+		case 0b111:
+			printf("  LDRSH? a5_2_4\n");
+			assert(false);
+			break;
+		default:
+			assert(false);
+		}
+	}
+	else if (opA == 0b0110) {
+		if ((opB & 0x4) == 0x0) {
+			a6_7_119_t1(registers, inst, halfword);
+		}
+		else {
+			a6_7_42_t1(registers, inst, halfword);
+		}
+	}
+	else if (opA == 0b0111) {
+		if ((opB & 0b100) == 0b000) {
+			a6_7_121_t1(registers, inst, halfword);
+		}
+		else {
+			a6_7_45_t1(registers, inst, halfword);
+		}
+	}
+	else if (opA == 0b1000) {
+		if ((opB & 0b100) == 0b000) {
+			a6_7_128_t1(registers, inst, halfword);
+		}
+		else {
+			assert(false);
+		}
+	}
+	else if (opA == 0b1001) {
+		if ((opB & 0b100) == 0b000) {
+			a6_7_119_t2(registers, inst, halfword); // STR
+		}
+		else if ((opB & 0b100) == 0b100) {
+			a6_7_42_t2(registers, inst, halfword); // LDR
+		}
+	}
+	else {
+		assert(false);
+	}
+}
+
+static void a5_2_5(struct registers *registers, struct inst *inst,
+                   uint16_t halfword)
+{
+	uint8_t opcode = (halfword & 0x0FE0) >> 5;
+	if (opcode == 0b0110011) {
+		b4_1_1_t1(registers, inst, halfword); // CPS
+	}
+	else if ((opcode & 0b1111100) == 0b0000000) {
+		a6_7_5_t2(registers, inst, halfword); // ADD
+	}
+	else if ((opcode & 0b1111100) == 0b0000100) {
+		a6_7_134_t1(registers, inst, halfword); // SUB
+	}
+	else if ((opcode & 0b1111000) == 0b0001000) {
+		a6_7_21_t1(registers, inst, halfword); // CBNZ, CBZ
+	}
+	else if ((opcode & 0b1111110) == 0b0010000) {
+		printf("  SXTH? a5_2_5\n");
+		assert(false);
+	}
+	else if ((opcode & 0b1111110) == 0b0010010) {
+		printf("  SXTB? a5_2_5\n");
+		assert(false);
+	}
+	else if ((opcode & 0b1111110) == 0b0010100) {
+		printf("  UXTH? a5_2_5\n");
+		assert(false);
+	}
+	else if ((opcode & 0b1111110) == 0b0010110) {
+		a6_7_149_t1(registers, inst, halfword); // UXTB
+	}
+	else if ((opcode & 0b1111000) == 0b0011000) {
+		a6_7_21_t1(registers, inst, halfword); // CBNZ, CBZ
+	}
+	else if ((opcode & 0b1110000) == 0b0100000) {
+		a6_7_98_t1(registers, inst, halfword); // PUSH
+	}
+	else if ((opcode & 0b1111000) == 0b1001000) {
+		a6_7_21_t1(registers, inst, halfword); // CBNZ, CBZ
+	}
+	else if ((opcode & 0b1111110) == 0b1010000) {
+		printf("  REV? a5_2_5\n");
+		assert(false);
+	}
+	else if ((opcode & 0b1111110) == 0b1010010) {
+		printf("  REV16? a5_2_5\n");
+		assert(false);
+	}
+	else if ((opcode & 0b1111110) == 0b1010110) {
+		printf("  REVSH? a5_2_5\n");
+		assert(false);
+	}
+	else if ((opcode & 0b1111000) == 0b1011000) {
+		a6_7_21_t1(registers, inst, halfword); // CBNZ, CBZ
+	}
+	else if ((opcode & 0b1110000) == 0b1100000) {
+		a6_7_97_t1(registers, inst, halfword); // POP
+	}
+	else if ((opcode & 0b1111000) == 0b1110000) {
+		printf("  BKPT? a5_2_5\n");
+		assert(false);
+	}
+	else if ((opcode & 0b1111000) == 0b1111000) {
+		uint8_t opA = (halfword & 0x00F0) >> 4;
+		uint8_t opB = (halfword & 0x000F);
+
+		if (opB != 0b0000) {
+			a6_7_37_t1(registers, inst, halfword); // IT
+		}
+		else if (opA == 0b0000) {
+			a6_7_87_t1(registers, inst, halfword); // NOP
+		}
+		else if (opA == 0b0001) {
+			printf("  YIELD a5_2_5\n");
+			assert(false);
+		}
+		else if (opA == 0b0010) {
+			printf("  WFE a5_2_5\n");
+			assert(false);
+		}
+		else if (opA == 0b0011) {
+			printf("  WFI a5_2_5\n");
+			assert(false);
+		}
+		else if (opA == 0b0100) {
+			printf("  SEV a5_2_5\n");
+			assert(false);
+		}
+	}
+}
+
+static void a5_2_6(struct registers *registers, struct inst *inst,
+                   uint16_t halfword)
+{
+	uint8_t opcode = (halfword & 0x0F00) >> 8;
+	if (!((opcode & 0xE) == 0xE)) {
+		a6_7_12_t1(registers, inst, halfword);
+	}
+	else if (opcode == 0xE) {
+		assert(false); // UNDEFINED
+	}
+	else if (opcode == 0xF) {
+		assert(false);
+	}
+	else {
+		assert(false);
+	}
+}
+
+/* 16-bit instruction encoding */
+static void a5_2(struct registers *registers, struct inst *inst,
+                 uint16_t halfword)
+{
+	uint8_t opcode = (halfword & 0xFC00) >> 10;
+
+	// Shift (immediate), add, subtract, move and compare
+	if ((opcode & 0b110000) == 0b000000) {
+		a5_2_1(registers, inst, halfword);
+	}
+	// Data processing
+	else if (opcode == 0b010000) {
+		a5_2_2(registers, inst, halfword);
+	}
+	// Special data instructions and branch and exchange
+	else if (opcode == 0b010001) {
+		a5_2_3(registers, inst, halfword);
+	}
+	// Load from Literal Pool
+	else if ((opcode & 0b111110) == 0b010010) {
+		a6_7_43_t1(registers, inst, halfword);
+	}
+	// Load/store single data item
+	else if ((opcode & 0b111100) == 0b010100) {
+		a5_2_4(registers, inst, halfword);
+	}
+	else if ((opcode & 0b111000) == 0b011000) {
+		a5_2_4(registers, inst, halfword);
+	}
+	else if ((opcode & 0b111000) == 0b100000) {
+		a5_2_4(registers, inst, halfword);
+	}
+	else if ((opcode & 0b111110) == 0b101000) {
+		printf("  ADR? a5_2\n");
+		assert(false);
+	}
+	else if ((opcode & 0b111110) == 0b101010) {
+		a6_7_5_t1(registers, inst, halfword); // ADD
 	}
-	else if ((opcode & 0b11100) == 0b01000) {
-		a6_7_10_t1(registers, halfword); // ASR
+	else if ((opcode & 0b111100) == 0b101100) {
+		a5_2_5(registers, inst, halfword);
+	}
+	else if ((opcode & 0b111100) == 0b110100) {
+		a5_2_6(registers, inst, halfword);
+	}
+	else if ((opcode & 0b111110) == 0b111000) {
+		a6_7_12_t2(registers, inst, halfword);
+	}
+}
+
+static void a5_3_1(struct registers *registers, struct inst *inst,
+                   uint16_t first_halfword,
+                   uint16_t second_halfword)
+{
+	uint8_t op = (first_halfword & 0x01F0) >> 4;
+	uint8_t rn = (first_halfword & 0x000F) >> 0;
+	uint8_t rd = (second_halfword & 0x0F00) >> 8;
+
+	if ((op & 0b11110) == 0b00000) {
+		if (!(rd == 0b1111)) {
+			a6_7_8_t1(registers, inst,
+			          first_halfword, second_halfword); // AND
+		}
+		else if (rd == 0b1111) {
+			printf("  TST? a5_3_1\n");
+			assert(false);
+		}
+	}
+	else if ((op & 0b11110) == 0b00010) {
+		a6_7_15_t1(registers, inst, first_halfword, second_halfword); // BIC
+	}
+	else if ((op & 0b11110) == 0b00100) {
+		if (!(rn == 0b1111)) {
+			a6_7_90_t1(registers, inst,
+			           first_halfword, second_halfword); // ORR
+		}
+		else if (rn == 0b1111) {
+			a6_7_75_t2(registers, inst,
+			           first_halfword, second_halfword); // MOV
+		}
+	}
+	else if ((op & 0b11110) == 0b00110) {
+		if (!(rn == 0b1111)) {
+			printf("  ORN? a5_3_1\n");
+			assert(false);
+		}
+		else if (rn == 0b1111) {
+			a6_7_84_t1(registers, inst,
+			           first_halfword, second_halfword); // MVN
+		}
+	}
+	else if ((op & 0b11110) == 0b01000) {
+		if (!(rd == 0b1111)) {
+			printf("  EOR? a5_3_1\n");
+			assert(false);
+		}
+		else if (rd == 0b1111) {
+			printf("  TEQ? a5_3_1\n");
+			assert(false);
+		}
+	}
+	else if ((op & 0b11110) == 0b10000) {
+		if (!(rd == 0b1111)) {
+			a6_7_3_t3(registers, inst,
+			          first_halfword, second_halfword); // ADD
+		}
+		else if (rd == 0b1111) {
+			printf("  CMN? a5_3_1\n");
+			assert(false);
+		}
+	}
+	else if ((op & 0b11110) == 0b10100) {
+		printf("  ADC? a5_3_1\n");
+		assert(false);
+	}
+	else if ((op & 0b11110) == 0b10110) {
+		printf("  SBC? a5_3_1\n");
+		assert(false);
+	}
+	else if ((op & 0b11110) == 0b11010) {
+		if (!(rd == 0b1111)) {
+			printf("  SUB? a5_3_1\n");
+			assert(false);
+		}
+		else if (rd == 0b1111) {
+			a6_7_27_t2(registers, inst,
+			           first_halfword, second_halfword); // CMP
+		}
+	}
+	else if ((op & 0b11110) == 0b11100) {
+		a6_7_106_t2(registers, inst, first_halfword, second_halfword); // RSB
+	}
+}
+
+static void a5_3_3(struct registers *registers, struct inst *inst,
+                   uint16_t first_halfword,
+                   uint16_t second_halfword)
+{
+	uint8_t op = (first_halfword & 0x01F0) >> 4;
+	uint8_t rn = (first_halfword & 0x000F) >> 0;
+
+	if (op == 0b00000) {
+		if (!(rn == 0b1111)) {
+			printf("  ADD a5_3_3\n");
+			assert(false);
+		}
+		else {
+			printf("  ADR a5_3_3\n");
+			assert(false);
+		}
+	}
+	else if (op == 0b00100) {
+		a6_7_75_t3(registers, inst, first_halfword, second_halfword); // MOV
+	}
+	else if (op == 0b01010) {
+		if (!(rn == 0b1111)) {
+			printf("  SUB a5_3_3\n");
+			assert(false);
+		}
+		else {
+			printf("  ADR a5_3_3\n");
+			assert(false);
+		}
+	}
+	else if (op == 0b01100) {
+		a6_7_78_t1(registers, inst, first_halfword, second_halfword); // MOVT
+	}
+	else if ((op & 0b11101) == 0b10000) {
+		printf("  SSAT a5_3_3\n");
+		assert(false);
+	}
+	else if (op == 0b10100) {
+		assert(false);
+	}
+	else if (op == 0b10110) {
+		assert(false);
+	}
+	else if ((op & 0b11101) == 0b11000) {
+		printf("  USAT a5_3_3\n");
+		assert(false);
+	}
+	else if (op == 0b11100) {
+		a6_7_144_t1(registers, inst,
+		            first_halfword, second_halfword); // UBFX
+	}
+	else {
+		assert(false);
+	}
+}
+
+static void a5_3_4(struct registers *registers, struct inst *inst,
+                   uint16_t first_halfword,
+                   uint16_t second_halfword)
+{
+	uint8_t op1 = (first_halfword & 0x07F0) >> 4;
+	uint8_t op2 = (second_halfword & 0x7000) >> 12;
+
+	if (((op2 & 0b101) == 0b000) && !((op1 & 0b0111000) == 0b0111000)) {
+		a6_7_12_t3(registers, inst, first_halfword, second_halfword); // B
+	}
+	else if (((op2 & 0b101) == 0b000)
+	         && ((op1 & 0b1111110) == 0b0111000)) {
+		printf("MSR a5_3_4\n");
+		assert(false);
+	}
+	else if (((op2 & 0b101) == 0b000) && (op1 == 0b0111010)) {
+		printf("Hint a5_3_4\n");
+		assert(false);
+	}
+	else if (((op2 & 0b101) == 0b000) && (op1 == 0b0111011)) {
+		printf("Misc a5_3_4\n");
+		assert(false);
+	}
+	else if (((op2 & 0b101) == 0b000)
+	         && ((op1 & 0b1111110) == 0b0111110)) {
+		printf("MSR a5_3_4\n");
+		assert(false);
+	}
+	else if ((op2  == 0b010) && (op1 == 0b1111111)) {
+		assert(false);
+	}
+	else if ((op2 & 0b101) == 0b001) {
+		a6_7_12_t4(registers, inst, first_halfword, second_halfword); // B
+	}
+	else if ((op2 & 0b101) == 0b101) {
+		a6_7_18_t1(registers, inst, first_halfword, second_halfword); // BL
+	}
+	else {
+		assert(false);
+	}
+}
+
+static void a5_3_5(struct registers *registers, struct inst *inst,
+                   uint16_t first_halfword,
+                   uint16_t second_halfword)
+{
+	uint8_t op = (first_halfword & 0x0180) >> 7;
+	uint8_t W = (first_halfword & 0x0020) >> 5;
+	uint8_t L = (first_halfword & 0x0010) >> 4;
+	uint8_t Rn = (first_halfword & 0x000F) >> 0;
+
+	if (op == 0b01) {
+		if (L == 0) {
+			printf("TODO 1: a5_3_5\n");
+			assert(false);
+		}
+		else if (L == 1) {
+			if (!((W == 1) && (Rn == 0b1101))) {
+				printf("TODO 2: a5_3_5\n");
+				assert(false);
+			}
+			else {
+				a6_7_97_t2(registers, inst, first_halfword,
+				           second_halfword); // POP
+			}
+		}
+	}
+	else if (op == 0b10) {
+		if (L == 0) {
+			if (!(W == 1 && Rn == 0b1101)) {
+				printf("TODO 3: a5_3_5\n");
+				assert(false);
+			}
+			else {
+				a6_7_98_t2(registers, inst, first_halfword,
+				           second_halfword); // PUSH
+			}
+		}
+		else if (L == 1) {
+			printf("TODO 3: a5_3_5\n");
+			assert(false);
+		}
+	}
+	else {
+		assert(false);
+	}
+}
+
+static void a5_3_7(struct registers *registers, struct inst *inst,
+                   uint16_t first_halfword,
+                   uint16_t second_halfword)
+{
+	uint8_t op1 = (first_halfword & 0x0180) >> 7;
+	uint8_t n = (first_halfword & 0x000F) >> 0;
+	uint8_t op2 = (second_halfword & 0x0FC0) >> 6;
+
+	if (n != 0b1111) {
+		if (op1 == 0b01) {
+			a6_7_42_t3(registers, inst,
+			           first_halfword,
+			           second_halfword); // LDR
+		}
+		else {
+			assert(op1 == 0b00);
+			if ((op2 & 0x24) == 0x24) {
+				a6_7_42_t4(registers, inst,
+				           first_halfword,
+				           second_halfword); // LDR
+			}
+			else if ((op2 & 0x3C) == 0x30) {
+				printf("LDR a5_3_7 2\n");
+				assert(false);
+			}
+			else if ((op2 & 0x3C) == 0x38) {
+				printf("LDRT a5_3_7\n");
+				assert(false);
+			}
+			else if (op2 == 0b000000) {
+				// LDR (register)
+				a6_7_44_t2(registers, inst,
+				           first_halfword, second_halfword);
+			}
+			else {
+				assert(false);
+			}
+		}
+	}
+	else {
+		assert((op1 & 0b10) == 0b00);
+		printf("  Load register a5_3_7\n");
+		assert(false);
 	}
-	else if (opcode == 0b01100) {
-		a6_7_4_t1(registers, halfword);
+}
+
+static void a5_3_9(struct registers *registers, struct inst *inst,
+                   uint16_t first_halfword,
+                   uint16_t second_halfword)
+{
+	uint8_t op1 =  (first_halfword & 0x0180) >>  7;
+	uint8_t n   =  (first_halfword & 0x000F) >>  7;
+	uint8_t t   = (second_halfword & 0xF000) >> 12;
+	uint8_t op2 = (second_halfword & 0x0FC0) >>  6;
+
+	bool nNot1111 = n != 0b1111;
+	bool tNot1111 = t != 0b1111;
+
+	if ((op1 == 0b01) && nNot1111 && tNot1111) {
+		// LDRB (immediate)
+		a6_7_45_t2(registers, inst, first_halfword, second_halfword);
 	}
-	else if (opcode == 0b01101) {
-		a6_7_133_t1(registers, halfword); // SUB
+	else if ((op1 == 0b00) && ((op2 & 0b100100) == 0b100100)
+	         && nNot1111) {
+		assert(false);
 	}
-	else if (opcode == 0b01110) {
-		a6_7_3_t1(registers, halfword); // ADD
+	else if ((op1 == 0b00) && ((op2 & 0b111100) == 0b110000)
+	         && nNot1111 && tNot1111) {
+		assert(false);
 	}
-	else if (opcode == 0b01111) {
-		printf("  SUB?\n");
+	else {
+		printf("a5_3_9\n");
 		assert(false);
 	}
-	else if ((opcode & 0b11100) == 0b10000) {
-		a6_7_75_t1(registers, halfword);
+}
+
+static void a5_3_10(struct registers *registers, struct inst *inst,
+                    uint16_t first_halfword,
+                    uint16_t second_halfword)
+{
+	uint8_t op1 =  (first_halfword & 0x00E0) >> 5;
+	uint8_t op2 = (second_halfword & 0x0FC0) >> 6;
+
+	if (op1 == 0b100) {
+		// STRB (immediate)
+		a6_7_121_t2(registers, inst, first_halfword, second_halfword);
 	}
-	else if ((opcode & 0b11100) == 0b10100) {
-		a6_7_27_t1(registers, halfword);
+	else if ((op1 == 0b000) && ((op2 & 0b100000) == 0b100000)) {
+		// STRB (immediate)
+		a6_7_121_t3(registers, inst, first_halfword, second_halfword);
 	}
-	else if ((opcode & 0b11100) == 0b11000) {
-		a6_7_3_t2(registers, halfword); // ADD
+	else if ((op1 == 0b000) && ((op2 & 0b100000) == 0b000000)) {
+		assert(false); // STRB (register)
 	}
-	else if ((opcode & 0b11100) == 0b11100) {
-		a6_7_132_t2(registers, halfword); // SUB
+	else if (op1 == 0b101) {
+		assert(false); // STRH (immediate)
+	}
+	else if ((op1 == 0b001) && ((op2 & 0b100000) == 0b100000)) {
+		assert(false); // STRH (immediate)
+	}
+	else if ((op1 == 0b001) && ((op2 & 0b100000) == 0b000000)) {
+		assert(false); // STRH (register)
+	}
+	else if (op1 == 0b110) {
+		// STR (immediate)
+		a6_7_119_t3(registers, inst, first_halfword, second_halfword);
+	}
+	else if ((op1 == 0b010) && ((op2 & 0b100000) == 0b100000)) {
+		a6_7_119_t4(registers, inst, first_halfword, second_halfword);
+	}
+	else if ((op1 == 0b010) && ((op2 & 0b100000) == 0b000000)) {
+		// STR (register)
+		a6_7_120_t2(registers, inst, first_halfword, second_halfword);
 	}
 	else {
 		assert(false);
 	}
 }
 
-static void a5_2_2(struct registers *registers,
-                   uint16_t halfword)
+static void a5_3_11(struct registers *registers, struct inst *inst,
+                    uint16_t first_halfword,
+                    uint16_t second_halfword)
 {
-	uint8_t opcode = (halfword & 0x03C0) >> 6;
-	switch (opcode) {
-	case 0b0000:
-		printf("  AND? a5_2_2\n");
-		assert(false);
-		break;
-	case 0b0001:
-		printf("  EOR? a5_2_2\n");
+	uint8_t op =  (first_halfword & 0x01E0) >> 5;
+	uint8_t S  =  (first_halfword & 0x0010) >> 4;
+	uint8_t n  =  (first_halfword & 0x000F) >> 0;
+	uint8_t d  = (second_halfword & 0x0F00) >> 8;
+
+	if (op == 0b0000) {
 		assert(false);
-		break;
-	case 0b0010:
-		printf("  LSL? a5_2_2\n");
+	}
+	else if (op == 0b0001) {
 		assert(false);
-		break;
-	case 0b0011:
-		printf("  LSR? a5_2_2\n");
+	}
+	else if (op == 0b0010) {
+		if (n != 0b1111) {
+			// ORR (register)
+			a6_7_91_t2(registers, inst, first_halfword, second_halfword);
+		}
+		else {
+			uint8_t imm3 = (second_halfword & 0x7000) >> 12;
+			uint8_t imm2 = (second_halfword & 0x00C0) >>  6;
+			uint8_t type = (second_halfword & 0x0030) >>  4;
+
+			uint8_t imm5 = (imm3 << 2) | imm2;
+
+			switch (type) {
+			case 0b00:
+				assert(false);
+				break;
+			case 0b01:
+				a6_7_69_t2(registers, inst,
+				           first_halfword,
+				           second_halfword); // LSR
+				break;
+			case 0b10:
+				a6_7_10_t2(registers, inst,
+				           first_halfword,
+				           second_halfword); // ASR
+				break;
+			case 0b11:
+				assert(false);
+				break;
+			}
+		}
+	}
+	else if (op == 0b0011) {
 		assert(false);
-		break;
-	case 0b0100:
-		printf("  ASR? a5_2_2\n");
+	}
+	else if (op == 0b0100) {
 		assert(false);
-		break;
-	case 0b0101:
-		printf("  ADC? a5_2_2\n");
+	}
+	else if (op == 0b1000) {
+		if (d != 0b1111) {
+			a6_7_4_t3(registers, inst, first_halfword,
+			          second_halfword); // ADD
+		}
+		else if (d == 0b1111) {
+			if (S == 0) {
+				assert(false);
+			}
+			else if (S == 1) {
+				assert(false);
+			}
+		}
+	}
+	else if (op == 0b1010) {
 		assert(false);
-		break;
-	case 0b0110:
-		printf("  SBC? a5_2_2\n");
+	}
+	else if (op == 0b1011) {
 		assert(false);
-		break;
-	case 0b0111:
-		printf("  ROR? a5_2_2\n");
+	}
+	else if (op == 0b1101) {
 		assert(false);
-		break;
-	case 0b1000:
-		printf("  TST? a5_2_2\n");
+	}
+	else if (op == 0b1110) {
+		a6_7_107_t1(registers, inst, first_halfword, second_halfword); // RSB
+	}
+}
+
+static void a5_3_12(struct registers *registers, struct inst *inst,
+                    uint16_t first_halfword,
+                    uint16_t second_halfword)
+{
+	uint8_t op1 =  (first_halfword & 0x00F0) >> 4;
+	uint8_t op2 = (second_halfword & 0x00F0) >> 4;
+
+	if (op2 == 0b0000) {
+		if ((op1 == 0b1110) == 0b0000) {
+			a6_7_68_t2(registers, inst, first_halfword,
+			           second_halfword); // LSL
+		}
+		else if ((op1 == 0b1110) == 0b0010) {
+			assert(false);
+		}
+		else if ((op1 == 0b1110) == 0b0100) {
+			assert(false);
+		}
+		else if ((op1 == 0b1110) == 0b0110) {
+			assert(false);
+		}
+		else {
+			assert(false);
+		}
+	}
+	else {
 		assert(false);
-		break;
-	case 0b1001:
-		printf("  RSB? a5_2_2\n");
+	}
+}
+
+static void a5_3_14(struct registers *registers, struct inst *inst,
+                    uint16_t first_halfword,
+                    uint16_t second_halfword)
+{
+	uint8_t op1 = (first_halfword & 0x0070) >> 4;
+	uint8_t a = (second_halfword & 0xF000) >> 12;
+	uint8_t op2 = (second_halfword & 0x0030) >> 4;
+
+	assert(op1 == 0b000);
+
+	if (op2 == 0b00) {
+		if (a != 0b1111) {
+			a6_7_73_t1(registers, inst, first_halfword, second_halfword);
+		}
+		else if (a == 0b1111) {
+			printf("  MUL a5_3_14\n");
+			assert(false);
+		}
+	}
+	else if (op2 == 0b01) {
+		a6_7_74_t1(registers, inst, first_halfword, second_halfword); //MLS
+	}
+	else {
 		assert(false);
-		break;
-	case 0b1010:
-		a6_7_28_t1(registers, halfword); // CMP
-		break;
-	case 0b1011:
-		printf("  CMN? a5_2_2\n");
+	}
+}
+
+static void a5_3_15(struct registers *registers, struct inst *inst,
+                    uint16_t first_halfword,
+                    uint16_t second_halfword)
+{
+	uint8_t op1 = (first_halfword & 0x0070) >> 4;
+	uint8_t op2 = (second_halfword & 0x00F0) >> 4;
+
+	switch (op1) {
+	case 0b000:
+		assert(op2 == 0b0000);
+		printf("  SMULL a5_3_15\n");
 		assert(false);
 		break;
-	case 0b1100:
-		a6_7_91_t1(registers, halfword); // ORR (register)
-		break;
-	case 0b1101:
-		printf("  MUL? a5_2_2\n");
+	case 0b001:
+		assert(op2 == 0b1111);
+		printf("  SDIV a5_3_15\n");
 		assert(false);
 		break;
-	case 0b1110:
-		printf("  BIC? a5_2_2\n");
+	case 0b010:
+		assert(op2 == 0b0000);
+		printf("  UMULL a5_3_15\n");
 		assert(false);
 		break;
-	case 0b1111:
-		printf("  MVN? a5_2_2\n");
-		assert(false);
+	case 0b011:
+		assert(op2 == 0b1111);
+		a6_7_145_t1(registers, inst, first_halfword, second_halfword);
 		break;
-	}
-}
-
-static void a5_2_3(struct registers *registers,
-                   uint16_t halfword)
-{
-	uint8_t opcode = (halfword & 0x03C0) >> 6;
-	if ((opcode & 0b1100) == 0b0000) {
-		a6_7_4_t2(registers, halfword); // ADD
-	}
-	else if (opcode == 0b0100) {
+	case 0b100:
+		assert(op2 == 0b0000);
+		printf("  SMLAL a5_3_15\n");
 		assert(false);
-	}
-	else if (opcode == 0b0101) {
-		a6_7_28_t2(registers, halfword); // CMP
-	}
-	else if ((opcode & 0b1110) == 0b0110) {
-		a6_7_28_t2(registers, halfword); // CMP
-	}
-	else if ((opcode & 0b1100) == 0b1000) {
-		a6_7_76_t1(registers, halfword); // MOV
-	}
-	else if ((opcode & 0b1110) == 0b1100) {
-		a6_7_20_t1(registers, halfword); // BX
-	}
-	else if ((opcode & 0b1110) == 0b1110) {
-		a6_7_19_t1(registers, halfword); // BLX
-	}
-	else {
+		break;
+	case 0b110:
+		assert(op2 == 0b0000);
+		printf("  UMLAL a5_3_15\n");
+		assert(false);
+		break;
+	default:
 		assert(false);
 	}
 }
 
-static void a5_2_4(struct registers *registers,
-                   uint16_t halfword)
+/* 32-bit instruction encoding */
+static void a5_3(struct registers *registers, struct inst *inst,
+                 uint16_t first_halfword,
+                 uint16_t second_halfword)
 {
-	uint8_t opA = (halfword & 0xF000) >> 12;
-	uint8_t opB = (halfword & 0x0E00) >> 9;
+	uint8_t op1 = (first_halfword & 0x1800) >> 11;
+	uint8_t op2 = (first_halfword & 0x07F0) >> 4;
+	uint8_t op = (second_halfword & 0x8000) >> 15;
 
-	if (opA == 0b0101) {
-		switch (opB) {
-		case 0b000:
-			a6_7_120_t1(registers, halfword); // STR
-			break;
-		case 0b001:
-			printf("  STRH? a5_2_4\n");
-			assert(false);
-			break;
-		case 0b010:
-			a6_7_122_t1(registers, halfword); // STRB
-			break;
-		case 0b011:
-			printf("  LDRSB? a5_2_4\n");
-			assert(false);
-			break;
-		case 0b100:
-			a6_7_44_t1(registers, halfword); // LDR
-			break;
-		case 0b101:
-			printf("  LDRH? a5_2_4\n");
-			assert(false);
-			break;
-		case 0b110:
-			a6_7_47_t1(registers, halfword); // LDRB
-			break;
-		case 0b111:
-			printf("  LDRSH? a5_2_4\n");
-			assert(false);
-			break;
-		default:
+	if (op1 == 0b01) {
+		if ((op2 & 0b1100100) == 0b0000000) {
+			a5_3_5(registers, inst, first_halfword, second_halfword);
+		}
+		else if ((op2 & 0b1100100) == 0b0000100) {
+			printf("Load/store dual or exclusive, table branch\n");
 			assert(false);
 		}
-	}
-	else if (opA == 0b0110) {
-		if ((opB & 0x4) == 0x0) {
-			a6_7_119_t1(registers, halfword);
+		else if ((op2 & 0b1100000) == 0b0100000) {
+			// Data processing (shifted register)
+			a5_3_11(registers, inst, first_halfword, second_halfword);
 		}
-		else {
-			a6_7_42_t1(registers, halfword);
+		else if ((op2 & 0b1000000) == 0b1000000) {
+			printf("Coprocessor instructions\n");
+			assert(false);
 		}
 	}
-	else if (opA == 0b0111) {
-		if ((opB & 0b100) == 0b000) {
-			a6_7_121_t1(registers, halfword);
+	else if (op1 == 0b10) {
+		if (((op2 & 0b0100000) == 0b0000000)
+		     && (op == 0)) {
+			// Data processing (modified immediate)
+			a5_3_1(registers, inst, first_halfword, second_halfword);
 		}
-		else {
-			a6_7_45_t1(registers, halfword);
+		else if (((op2 & 0b0100000) == 0b0100000)
+		     && (op == 0)) {
+			// Data processing (plain binary immediate)
+			a5_3_3(registers, inst, first_halfword, second_halfword);
+		}
+		else if ((op == 1)) {
+			// Branches and miscellaneous control
+			a5_3_4(registers, inst, first_halfword, second_halfword);
 		}
 	}
-	else if (opA == 0b1000) {
-		if ((opB & 0b100) == 0b000) {
-			a6_7_128_t1(registers, halfword);
+	else if (op1 == 0b11) {
+		if ((op2 & 0b1110001) == 0b0000000) {
+			// Store single data item
+			a5_3_10(registers, inst, first_halfword, second_halfword);
 		}
-		else {
+		else if ((op2 & 0b1100111) == 0b0000001) {
+			// Load bytes, memory hints
+			a5_3_9(registers, inst, first_halfword, second_halfword);
+		}
+		else if ((op2 & 0b1100111) == 0b0000011) {
+			printf("Load halfword, unallocated memory hints\n");
 			assert(false);
 		}
-	}
-	else if (opA == 0b1001) {
-		if ((opB & 0b100) == 0b000) {
-			a6_7_119_t2(registers, halfword); // STR
+		else if ((op2 & 0b1100111) == 0b0000101) {
+			a5_3_7(registers, inst,
+			       first_halfword, second_halfword); // Load word
 		}
-		else if ((opB & 0b100) == 0b100) {
-			a6_7_42_t2(registers, halfword); // LDR
+		else if ((op2 & 0b1110000) == 0b0100000) {
+			a5_3_12(registers, inst, first_halfword, second_halfword);
+		}
+		else if ((op2 & 0b1111000) == 0b0110000) {
+			a5_3_14(registers, inst, first_halfword, second_halfword);
+		}
+		else if ((op2 & 0b1111000) == 0b0111000) {
+			a5_3_15(registers, inst, first_halfword, second_halfword);
+		}
+		else if ((op2 & 0b1000000) == 0b1000000) {
+			printf("Coprocessor\n");
+			assert(false);
 		}
 	}
-	else {
-		assert(false);
+}
+
+typedef void (*decoder_16)(struct registers *registers, struct inst *inst,
+                           uint16_t halfword);
+typedef void (*decoder_32)(struct registers *registers, struct inst *inst,
+                           uint16_t first_halfword,
+                           uint16_t second_halfword);
+
+/* The encoding spec, the first entry matching an instruction decides it.
+   A NULL decoder marks an encoding that is known but not implemented, it is
+   only listed when a later entry would otherwise match it */
+struct encoding_16 {
+	uint16_t mask;
+	uint16_t value;
+	decoder_16 decoder;
+};
+
+struct encoding_32 {
+	uint16_t first_mask;
+	uint16_t first_value;
+	uint16_t second_mask;
+	uint16_t second_value;
+	decoder_32 decoder;
+};
+
+static const struct encoding_16 encodings_16[] = {
+	// A5.2.1 Shift (immediate), add, subtract, move, and compare
+	{ 0xF800, 0x0000, a6_7_67_t1 },  // LSL (immediate)
+	{ 0xF800, 0x0800, a6_7_69_t1 },  // LSR (immediate)
+	{ 0xF800, 0x1000, a6_7_10_t1 },  // ASR (immediate)
+	{ 0xFE00, 0x1800, a6_7_4_t1 },   // ADD (register)
+	{ 0xFE00, 0x1A00, a6_7_133_t1 }, // SUB (register)
+	{ 0xFE00, 0x1C00, a6_7_3_t1 },   // ADD (immediate)
+	{ 0xF800, 0x2000, a6_7_75_t1 },  // MOV (immediate)
+	{ 0xF800, 0x2800, a6_7_27_t1 },  // CMP (immediate)
+	{ 0xF800, 0x3000, a6_7_3_t2 },   // ADD (immediate)
+	{ 0xF800, 0x3800, a6_7_132_t2 }, // SUB (immediate)
+	// A5.2.2 Data processing
+	{ 0xFFC0, 0x4280, a6_7_28_t1 },  // CMP (register)
+	{ 0xFFC0, 0x4300, a6_7_91_t1 },  // ORR (register)
+	// A5.2.3 Special data instructions and branch and exchange
+	{ 0xFF00, 0x4400, a6_7_4_t2 },   // ADD (register)
+	{ 0xFFC0, 0x4540, a6_7_28_t2 },  // CMP (register)
+	{ 0xFF80, 0x4580, a6_7_28_t2 },  // CMP (register)
+	{ 0xFF00, 0x4600, a6_7_76_t1 },  // MOV (register)
+	{ 0xFF80, 0x4700, a6_7_20_t1 },  // BX
+	{ 0xFF80, 0x4780, a6_7_19_t1 },  // BLX (register)
+	// Load from Literal Pool
+	{ 0xF800, 0x4800, a6_7_43_t1 },  // LDR (literal)
+	// A5.2.4 Load/store single data item
+	{ 0xFE00, 0x5000, a6_7_120_t1 }, // STR (register)
+	{ 0xFE00, 0x5400, a6_7_122_t1 }, // STRB (register)
+	{ 0xFE00, 0x5800, a6_7_44_t1 },  // LDR (register)
+	{ 0xFE00, 0x5C00, a6_7_47_t1 },  // LDRB (register)
+	{ 0xF800, 0x6000, a6_7_119_t1 }, // STR (immediate)
+	{ 0xF800, 0x6800, a6_7_42_t1 },  // LDR (immediate)
+	{ 0xF800, 0x7000, a6_7_121_t1 }, // STRB (immediate)
+	{ 0xF800, 0x7800, a6_7_45_t1 },  // LDRB (immediate)
+	{ 0xF800, 0x8000, a6_7_128_t1 }, // STRH (immediate)
+	{ 0xF800, 0x9000, a6_7_119_t2 }, // STR (immediate)
+	{ 0xF800, 0x9800, a6_7_42_t2 },  // LDR (immediate)
+	{ 0xF800, 0xA800, a6_7_5_t1 },   // ADD (SP plus immediate)
+	// A5.2.5 Miscellaneous 16-bit instructions
+	{ 0xFFE0, 0xB660, b4_1_1_t1 },   // CPS
+	{ 0xFF80, 0xB000, a6_7_5_t2 },   // ADD (SP plus immediate)
+	{ 0xFF80, 0xB080, a6_7_134_t1 }, // SUB (SP minus immediate)
+	{ 0xF500, 0xB100, a6_7_21_t1 },  // CBNZ, CBZ
+	{ 0xFFC0, 0xB2C0, a6_7_149_t1 }, // UXTB
+	{ 0xFE00, 0xB400, a6_7_98_t1 },  // PUSH
+	{ 0xFE00, 0xBC00, a6_7_97_t1 },  // POP
+	{ 0xFFFF, 0xBF00, a6_7_87_t1 },  // NOP
+	{ 0xFF0F, 0xBF00, NULL },        // Other hints
+	{ 0xFF00, 0xBF00, a6_7_37_t1 },  // IT
+	// A5.2.6 Conditional branch, and Supervisor Call
+	{ 0xFE00, 0xDE00, NULL },        // UDF, SVC
+	{ 0xF000, 0xD000, a6_7_12_t1 },  // B
+	// Unconditional branch
+	{ 0xF800, 0xE000, a6_7_12_t2 },  // B
+};
+
+static const struct encoding_32 encodings_32[] = {
+	// A5.3.5 Load Multiple and Store Multiple
+	{ 0xFFFF, 0xE8BD, 0x0000, 0x0000, a6_7_97_t2 },  // POP
+	{ 0xFFFF, 0xE92D, 0x0000, 0x0000, a6_7_98_t2 },  // PUSH
+	// A5.3.11 Data processing (shifted register)
+	{ 0xFFEF, 0xEA4F, 0x0030, 0x0010, a6_7_69_t2 },  // LSR (immediate)
+	{ 0xFFEF, 0xEA4F, 0x0030, 0x0020, a6_7_10_t2 },  // ASR (immediate)
+	{ 0xFFEF, 0xEA4F, 0x0000, 0x0000, NULL },        // Other shifts
+	{ 0xFFE0, 0xEA40, 0x0000, 0x0000, a6_7_91_t2 },  // ORR (register)
+	{ 0xFFE0, 0xEB00, 0x0F00, 0x0F00, NULL },        // CMN (register)
+	{ 0xFFE0, 0xEB00, 0x0000, 0x0000, a6_7_4_t3 },   // ADD (register)
+	{ 0xFFE0, 0xEBC0, 0x0000, 0x0000, a6_7_107_t1 }, // RSB (register)
+	// A5.3.1 Data processing (modified immediate)
+	{ 0xFBE0, 0xF000, 0x8F00, 0x0F00, NULL },        // TST (immediate)
+	{ 0xFBE0, 0xF000, 0x8000, 0x0000, a6_7_8_t1 },   // AND (immediate)
+	{ 0xFBE0, 0xF020, 0x8000, 0x0000, a6_7_15_t1 },  // BIC (immediate)
+	{ 0xFBEF, 0xF04F, 0x8000, 0x0000, a6_7_75_t2 },  // MOV (immediate)
+	{ 0xFBE0, 0xF040, 0x8000, 0x0000, a6_7_90_t1 },  // ORR (immediate)
+	{ 0xFBEF, 0xF06F, 0x8000, 0x0000, a6_7_84_t1 },  // MVN (immediate)
+	{ 0xFBE0, 0xF100, 0x8F00, 0x0F00, NULL },        // CMN (immediate)
+	{ 0xFBE0, 0xF100, 0x8000, 0x0000, a6_7_3_t3 },   // ADD (immediate)
+	{ 0xFBE0, 0xF1A0, 0x8F00, 0x0F00, a6_7_27_t2 },  // CMP (immediate)
+	{ 0xFBE0, 0xF1C0, 0x8000, 0x0000, a6_7_106_t2 }, // RSB (immediate)
+	// A5.3.3 Data processing (plain binary immediate)
+	{ 0xFBF0, 0xF240, 0x8000, 0x0000, a6_7_75_t3 },  // MOV (immediate)
+	{ 0xFBF0, 0xF2C0, 0x8000, 0x0000, a6_7_78_t1 },  // MOVT
+	{ 0xFBF0, 0xF3C0, 0x8000, 0x0000, a6_7_144_t1 }, // UBFX
+	// A5.3.4 Branches and miscellaneous control
+	{ 0xFB80, 0xF380, 0xD000, 0x8000, NULL },        // MSR, hints, MRS
+	{ 0xF800, 0xF000, 0xD000, 0x8000, a6_7_12_t3 },  // B
+	{ 0xF800, 0xF000, 0xD000, 0x9000, a6_7_12_t4 },  // B
+	{ 0xF800, 0xF000, 0xD000, 0xD000, a6_7_18_t1 },  // BL
+	// A5.3.10 Store single data item
+	{ 0xFFF0, 0xF880, 0x0000, 0x0000, a6_7_121_t2 }, // STRB (immediate)
+	{ 0xFFF0, 0xF800, 0x0800, 0x0800, a6_7_121_t3 }, // STRB (immediate)
+	{ 0xFFF0, 0xF8C0, 0x0000, 0x0000, a6_7_119_t3 }, // STR (immediate)
+	{ 0xFFF0, 0xF840, 0x0800, 0x0800, a6_7_119_t4 }, // STR (immediate)
+	{ 0xFFF0, 0xF840, 0x0800, 0x0000, a6_7_120_t2 }, // STR (register)
+	// A5.3.9 Load byte, memory hints
+	{ 0xFFF0, 0xF890, 0xF000, 0xF000, NULL },        // PLD (immediate)
+	{ 0xFFF0, 0xF890, 0x0000, 0x0000, a6_7_45_t2 },  // LDRB (immediate)
+	// A5.3.7 Load word
+	{ 0xFE7F, 0xF85F, 0x0000, 0x0000, NULL },        // LDR (literal)
+	{ 0xFFF0, 0xF8D0, 0x0000, 0x0000, a6_7_42_t3 },  // LDR (immediate)
+	{ 0xFFF0, 0xF850, 0x0900, 0x0900, a6_7_42_t4 },  // LDR (immediate)
+	{ 0xFFF0, 0xF850, 0x0FC0, 0x0000, a6_7_44_t2 },  // LDR (register)
+	// A5.3.12 Data processing (register)
+	{ 0xFFF0, 0xFAE0, 0x00F0, 0x0000, NULL },
+	{ 0xFF00, 0xFA00, 0x00F0, 0x0000, a6_7_68_t2 },  // LSL (register)
+	// A5.3.14 Multiply, multiply accumulate, and absolute difference
+	{ 0xFFF0, 0xFB00, 0xF030, 0xF000, NULL },        // MUL
+	{ 0xFFF0, 0xFB00, 0x0030, 0x0000, a6_7_73_t1 },  // MLA
+	{ 0xFFF0, 0xFB00, 0x0030, 0x0010, a6_7_74_t1 },  // MLS
+	// A5.3.15 Long multiply, long multiply accumulate, and divide
+	{ 0xFFF0, 0xFBB0, 0x00F0, 0x00F0, a6_7_145_t1 }, // UDIV
+};
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(arr[0]))
+
+static void a5_2_unimplemented(struct registers *registers, struct inst *inst,
+                               uint16_t halfword)
+{
+	printf("  ? %04X\n", halfword);
+	assert(false);
+}
+
+static void a5_3_unimplemented(struct registers *registers, struct inst *inst,
+                               uint16_t first_halfword,
+                               uint16_t second_halfword)
+{
+	printf("  ? %04X %04X\n", first_halfword, second_halfword);
+	assert(false);
+}
+
+/* The 16-bit table is indexed by the whole halfword.  The 32-bit table is
+   indexed by the first halfword (from 0xE800) to get a second level table
+   indexed by the top 12 bits of the second halfword, first halfwords that
+   match the same spec entries share their second level table */
+#define DECODE_32_FIRST 0xE800
+#define DECODE_32_SECOND_SHIFT 4
+
+static decoder_16 decode_table_16[0x10000];
+static decoder_32 *decode_table_32[0x10000 - DECODE_32_FIRST];
+
+static void decode_table_16_init(void)
+{
+	for (uint32_t halfword = 0; halfword < 0x10000; ++halfword) {
+		decoder_16 decoder = a5_2_unimplemented;
+		for (size_t i = 0; i < ARRAY_SIZE(encodings_16); ++i) {
+			const struct encoding_16 *e = &encodings_16[i];
+			if ((halfword & e->mask) == e->value) {
+				if (e->decoder != NULL) {
+					decoder = e->decoder;
+				}
+				break;
+			}
+		}
+		decode_table_16[halfword] = decoder;
 	}
 }
 
-static void a5_2_5(struct registers *registers, uint16_t halfword)
+static void decode_table_32_init(void)
 {
-	uint8_t opcode = (halfword & 0x0FE0) >> 5;
-	if (opcode == 0b0110011) {
-		b4_1_1_t1(registers, halfword); // CPS
+	static_assert(ARRAY_SIZE(encodings_32) <= 64, "matches fit in 64 bits");
+
+	struct {
+		uint64_t matches;
+		decoder_32 *table;
+	} groups[ARRAY_SIZE(decode_table_32)];
+	size_t groups_size = 0;
+
+	for (uint32_t first = DECODE_32_FIRST; first < 0x10000; ++first) {
+		uint64_t matches = 0;
+		for (size_t i = 0; i < ARRAY_SIZE(encodings_32); ++i) {
+			const struct encoding_32 *e = &encodings_32[i];
+			assert((e->second_mask & 0x000F) == 0x0000);
+			if ((first & e->first_mask) == e->first_value) {
+				matches |= ((uint64_t) 1) << i;
+			}
+		}
+
+		size_t group = 0;
+		while (group < groups_size && groups[group].matches != matches) {
+			++group;
+		}
+		if (group == groups_size) {
+			uint32_t size = 0x10000 >> DECODE_32_SECOND_SHIFT;
+			decoder_32 *table = malloc(size * sizeof(decoder_32));
+			assert(table != NULL);
+			for (uint32_t index = 0; index < size; ++index) {
+				uint16_t second = index << DECODE_32_SECOND_SHIFT;
+				decoder_32 decoder = a5_3_unimplemented;
+				for (size_t i = 0; i < ARRAY_SIZE(encodings_32); ++i) {
+					const struct encoding_32 *e = &encodings_32[i];
+					if ((matches & (((uint64_t) 1) << i)) != 0
+					    && (second & e->second_mask)
+					       == e->second_value) {
+						if (e->decoder != NULL) {
+							decoder = e->decoder;
+						}
+						break;
+					}
+				}
+				table[index] = decoder;
+			}
+			groups[group].matches = matches;
+			groups[group].table = table;
+			++groups_size;
+		}
+		decode_table_32[first - DECODE_32_FIRST] = groups[group].table;
 	}
-	else if ((opcode & 0b1111100) == 0b0000000) {
-		a6_7_5_t2(registers, halfword); // ADD
+}
+
+static void decode_tables_build(void)
+{
+	decode_table_16_init();
+	decode_table_32_init();
+}
+
+/* The tables are shared by every board */
+static void decode_tables_init(void)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, decode_tables_build);
+}
+
+static void undefined_disassemble(const struct inst *inst)
+{
+}
+
+static bool is_32_bit(uint16_t first_halfword)
+{
+	return ((first_halfword & 0xE000) == 0xE000)
+	       && ((first_halfword & 0x1800) != 0x0000);
+}
+
+static void decode_begin(struct registers *registers, struct inst *inst)
+{
+	uint32_t address = registers->r[15];
+	uint16_t halfword = memory_halfword_read(address);
+
+	*inst = (struct inst) {0};
+	inst->address = address;
+	inst->itstate = registers->itstate;
+	inst->cond = CurrentCond(registers);
+	inst->first_halfword = halfword;
+	if (is_32_bit(halfword)) {
+		inst->second_halfword = memory_halfword_read(address + 2);
+		inst->length = 4;
 	}
-	else if ((opcode & 0b1111100) == 0b0000100) {
-		a6_7_134_t1(registers, halfword); // SUB
+	else {
+		inst->length = 2;
 	}
-	else if ((opcode & 0b1111000) == 0b0001000) {
-		a6_7_21_t1(registers, halfword); // CBNZ, CBZ
+}
+
+static void decode_dispatch(struct registers *registers, struct inst *inst)
+{
+	uint16_t first_halfword = inst->first_halfword;
+	uint16_t second_halfword = inst->second_halfword;
+	if (inst->length == 4) {
+		decoder_32 *table = decode_table_32[first_halfword
+		                                    - DECODE_32_FIRST];
+		table[second_halfword >> DECODE_32_SECOND_SHIFT](
+			registers, inst, first_halfword, second_halfword);
 	}
-	else if ((opcode & 0b1111110) == 0b0010000) {
-		printf("  SXTH? a5_2_5\n");
-		assert(false);
+	else {
+		decode_table_16[first_halfword](registers, inst, first_halfword);
 	}
-	else if ((opcode & 0b1111110) == 0b0010010) {
-		printf("  SXTB? a5_2_5\n");
-		assert(false);
+}
+
+/* Decode the instruction at the PC into a record, the decoders only look at
+   the encoding and ITSTATE so the record is valid as long as both match */
+static void decode(struct registers *registers, struct inst *inst)
+{
+	decode_begin(registers, inst);
+	decode_dispatch(registers, inst);
+}
+
+/* Decode an instruction from a trace event instead of memory */
+static void decode_halfwords(struct inst *inst, uint32_t address,
+                             uint8_t itstate, uint16_t first_halfword,
+                             uint16_t second_halfword)
+{
+	struct registers registers = {0};
+	registers.r[15] = address;
+	registers.itstate = itstate;
+
+	*inst = (struct inst) {0};
+	inst->address = address;
+	inst->itstate = itstate;
+	inst->cond = CurrentCond(&registers);
+	inst->first_halfword = first_halfword;
+	if (is_32_bit(first_halfword)) {
+		inst->second_halfword = second_halfword;
+		inst->length = 4;
 	}
-	else if ((opcode & 0b1111110) == 0b0010100) {
-		printf("  UXTH? a5_2_5\n");
-		assert(false);
+	else {
+		inst->length = 2;
 	}
-	else if ((opcode & 0b1111110) == 0b0010110) {
-		a6_7_149_t1(registers, halfword); // UXTB
+	decode_dispatch(&registers, inst);
+}
+
+/* The original decoder, following the ARM ARM tables one level at a time */
+static void decode_cascade(struct registers *registers, struct inst *inst)
+{
+	decode_begin(registers, inst);
+	if (inst->length == 4) {
+		a5_3(registers, inst, inst->first_halfword, inst->second_halfword);
 	}
-	else if ((opcode & 0b1111000) == 0b0011000) {
-		a6_7_21_t1(registers, halfword); // CBNZ, CBZ
+	else {
+		a5_2(registers, inst, inst->first_halfword);
 	}
-	else if ((opcode & 0b1110000) == 0b0100000) {
-		a6_7_98_t1(registers, halfword); // PUSH
+
+	// Encodings not matched by the cascade are skipped
+	if (inst->execute == NULL) {
+		inst->execute = NOP;
+		inst->disassemble = undefined_disassemble;
 	}
-	else if ((opcode & 0b1111000) == 0b1001000) {
-		a6_7_21_t1(registers, halfword); // CBNZ, CBZ
+}
+
+static const struct inst *fetch(struct registers *registers)
+{
+	uint32_t address = registers->r[15];
+	if (address < PROGRAM_FLASH_SIZE) {
+		struct teensy_3_2_flash *flash = board->flash;
+		struct inst *inst = &flash->insts[address / 2];
+		_Atomic uint8_t *state = &flash->states[address / 2];
+		uint8_t expected = atomic_load_explicit(state,
+		                                        memory_order_acquire);
+		if (expected == INST_DECODED
+		    && inst->itstate == registers->itstate) {
+			return inst;
+		}
+		/* The cached instruction is never changed once it's there,
+		   so one in a different IT block is decoded on its own */
+		if (expected == INST_EMPTY
+		    && atomic_compare_exchange_strong_explicit(
+			    state, &expected, INST_DECODING,
+			    memory_order_acquire, memory_order_acquire)) {
+			decode(registers, inst);
+			atomic_store_explicit(state, INST_DECODED,
+			                      memory_order_release);
+			return inst;
+		}
 	}
-	else if ((opcode & 0b1111110) == 0b1010000) {
-		printf("  REV? a5_2_5\n");
-		assert(false);
+	decode(registers, &board->inst_uncached);
+	return &board->inst_uncached;
+}
+
+static void trace_inst_print(const struct inst *inst)
+{
+	if (inst->length == 4) {
+		printf("%08X: %04X %04X\n", inst->address,
+		       inst->first_halfword, inst->second_halfword);
 	}
-	else if ((opcode & 0b1111110) == 0b1010010) {
-		printf("  REV16? a5_2_5\n");
-		assert(false);
+	else {
+		printf("%08X: %04X\n", inst->address, inst->first_halfword);
 	}
-	else if ((opcode & 0b1111110) == 0b1010110) {
-		printf("  REVSH? a5_2_5\n");
-		assert(false);
+	inst->disassemble(inst);
+}
+
+static void trace_inst(const struct inst *inst)
+{
+	if (!tracing(TEENSY_3_2_TRACE_INSTRUCTIONS)) {
+		return;
 	}
-	else if ((opcode & 0b1111000) == 0b1011000) {
-		a6_7_21_t1(registers, halfword); // CBNZ, CBZ
+
+	if (trace_to_file) {
+		struct teensy_3_2_trace_event event = {
+			.type = TEENSY_3_2_TRACE_EVENT_INST,
+			.n = inst->length,
+			.itstate = inst->itstate,
+			.address = inst->address,
+			.value = inst->first_halfword
+			         | (inst->second_halfword << 16),
+		};
+		trace_ring_push(&event);
 	}
-	else if ((opcode & 0b1110000) == 0b1100000) {
-		a6_7_97_t1(registers, halfword); // POP
+	else {
+		trace_inst_print(inst);
 	}
-	else if ((opcode & 0b1111000) == 0b1110000) {
-		printf("  BKPT? a5_2_5\n");
-		assert(false);
+}
+
+static void trace_branch(uint32_t from, uint32_t to)
+{
+	if (tracing(TEENSY_3_2_TRACE_BRANCHES)
+	    && !tracing(TEENSY_3_2_TRACE_INSTRUCTIONS)) {
+		trace_event(TEENSY_3_2_TRACE_EVENT_BRANCH, 0, from, to);
 	}
-	else if ((opcode & 0b1111000) == 0b1111000) {
-		uint8_t opA = (halfword & 0x00F0) >> 4;
-		uint8_t opB = (halfword & 0x000F);
+}
 
-		if (opB != 0b0000) {
-			a6_7_37_t1(registers, halfword); // IT
-		}
-		else if (opA == 0b0000) {
-			a6_7_87_t1(registers, halfword); // NOP
-		}
-		else if (opA == 0b0001) {
-			printf("  YIELD a5_2_5\n");
-			assert(false);
-		}
-		else if (opA == 0b0010) {
-			printf("  WFE a5_2_5\n");
-			assert(false);
-		}
-		else if (opA == 0b0011) {
-			printf("  WFI a5_2_5\n");
-			assert(false);
+static const char *exception_names[EXCEPTION_IRQ0] = {
+	"Thread", "Reset", "NMI", "HardFault", "MemManage", "BusFault",
+	"UsageFault", "Reserved", "Reserved", "Reserved", "Reserved",
+	"SVCall", "DebugMonitor", "Reserved", "PendSV", "SysTick",
+};
+
+void teensy_3_2_trace_event_print(const struct teensy_3_2_trace_event *event)
+{
+	switch (event->type) {
+	case TEENSY_3_2_TRACE_EVENT_INST: {
+		struct inst inst;
+		decode_tables_init();
+		decode_halfwords(&inst, event->address, event->itstate,
+		                 event->value, event->value >> 16);
+		trace_inst_print(&inst);
+		break;
+	}
+	case TEENSY_3_2_TRACE_EVENT_BRANCH:
+		printf("%08X -> %08X\n", event->address, event->value);
+		break;
+	case TEENSY_3_2_TRACE_EVENT_REGISTER:
+		printf("  > R%d = %08X\n", event->n, event->value);
+		break;
+	case TEENSY_3_2_TRACE_EVENT_REGISTER_LOAD:
+		printf("  > R%d = %08X (MemA[%08X, 4])\n",
+		       event->n, event->value, event->address);
+		break;
+	case TEENSY_3_2_TRACE_EVENT_PC:
+		printf("  > PC = %08X\n", event->value);
+		break;
+	case TEENSY_3_2_TRACE_EVENT_APSR:
+		printf("  > APSR = %08X\n", event->value);
+		break;
+	case TEENSY_3_2_TRACE_EVENT_ITSTATE:
+		printf("  > ITSTATE = %02X\n", event->value);
+		break;
+	case TEENSY_3_2_TRACE_EVENT_READ:
+		printf("  > READ (%s) MemU[%08X,%d] = %0*X\n",
+		       get_address_name(event->address), event->address,
+		       event->n, 2 * event->n, event->value);
+		break;
+	case TEENSY_3_2_TRACE_EVENT_WRITE:
+		printf("  > (%s) MemU[%08X,%d] = %0*X\n",
+		       get_address_name(event->address), event->address,
+		       event->n, 2 * event->n, event->value);
+		break;
+	case TEENSY_3_2_TRACE_EVENT_NOTE_HIGHER_REGISTERS:
+		printf("  > Note: higher registers at higher addresses\n");
+		break;
+	case TEENSY_3_2_TRACE_EVENT_EXCEPTION:
+		if (event->n >= EXCEPTION_IRQ0) {
+			printf("Exception %u (IRQ %u): ", event->n,
+			       event->n - EXCEPTION_IRQ0);
 		}
-		else if (opA == 0b0100) {
-			printf("  SEV a5_2_5\n");
-			assert(false);
+		else {
+			printf("Exception %u (%s): ", event->n,
+			       exception_names[event->n]);
 		}
+		printf("%08X -> %08X\n", event->address, event->value);
+		break;
+	default:
+		printf("  ? trace event %d\n", event->type);
+		break;
 	}
 }
 
-static void a5_2_6(struct registers *registers, uint16_t halfword)
+/* Compressed branch trace, modelled on ETM.  Only what can't be known from
+   the program itself is recorded: an atom for each conditional branch
+   (taken or not), the target of each taken indirect branch, each exception
+   taken and, every BRANCH_TRACE_SYNC_PERIOD instructions, a sync packet
+   with the registers.
+   The decoder re-decodes flash to rebuild every instruction in between */
+enum branch_kind {
+	BRANCH_NONE,
+	BRANCH_DIRECT,
+	BRANCH_INDIRECT,
+};
+
+static enum branch_kind branch_kind(const struct inst *inst)
 {
-	uint8_t opcode = (halfword & 0x0F00) >> 8;
-	if (!((opcode & 0xE) == 0xE)) {
-		a6_7_12_t1(registers, halfword);
-	}
-	else if (opcode == 0xE) {
-		assert(false); // UNDEFINED
-	}
-	else if (opcode == 0xF) {
-		assert(false);
+	if (inst->execute == B
+	    || inst->execute == BL
+	    || inst->execute == CBNZ_CBZ) {
+		return BRANCH_DIRECT;
 	}
-	else {
-		assert(false);
+	else if (inst->execute == BLX_register
+	         || inst->execute == BX
+	         || (inst->execute == POP
+	             && (inst->register_list & 0x8000) == 0x8000)) {
+		return BRANCH_INDIRECT;
 	}
+	return BRANCH_NONE;
 }
 
-/* 16-bit instruction encoding */
-static void a5_2(struct registers *registers, uint16_t halfword)
+static bool branch_conditional(const struct inst *inst)
 {
-	printf("%08X: %04X\n", registers->r[15], halfword);
+	return inst->cond < 0b1110 || inst->execute == CBNZ_CBZ;
+}
 
-	uint8_t opcode = (halfword & 0xFC00) >> 10;
+static uint32_t branch_direct_target(const struct inst *inst)
+{
+	return (inst->address + 4 + inst->imm32) & 0xFFFFFFFE;
+}
 
-	// Shift (immediate), add, subtract, move and compare
-	if ((opcode & 0b110000) == 0b000000) {
-		a5_2_1(registers, halfword);
-	}
-	// Data processing
-	else if (opcode == 0b010000) {
-		a5_2_2(registers, halfword);
-	}
-	// Special data instructions and branch and exchange
-	else if (opcode == 0b010001) {
-		a5_2_3(registers, halfword);
-	}
-	// Load from Literal Pool
-	else if ((opcode & 0b111110) == 0b010010) {
-		a6_7_43_t1(registers, halfword);
-	}
-	// Load/store single data item
-	else if ((opcode & 0b111100) == 0b010100) {
-		a5_2_4(registers, halfword);
-	}
-	else if ((opcode & 0b111000) == 0b011000) {
-		a5_2_4(registers, halfword);
-	}
-	else if ((opcode & 0b111000) == 0b100000) {
-		a5_2_4(registers, halfword);
+#define BRANCH_TRACE_SYNC 0x01    // count (8), R0-R15 (64), APSR (4), ITSTATE
+#define BRANCH_TRACE_END 0x02     // count (8)
+#define BRANCH_TRACE_EXCEPTION 0x03 // count (8), number, handler (4)
+#define BRANCH_TRACE_ADDRESS 0x10 // | changed low bytes, then those bytes
+#define BRANCH_TRACE_ATOMS 0x80   // | (1 << count) | bits, first atom in bit 0
+#define BRANCH_TRACE_ATOMS_MAX 6
+#define BRANCH_TRACE_END_SIZE 9
+#define BRANCH_TRACE_SYNC_PERIOD 0x10000
+
+bool teensy_3_2_branch_trace_open(struct teensy_3_2 *teensy,
+                                   const char *path)
+{
+	board = teensy;
+	assert(board->branch_trace == NULL);
+	board->branch_trace = fopen(path, "wb");
+	return board->branch_trace != NULL;
+}
+
+void teensy_3_2_branch_trace_close(struct teensy_3_2 *teensy)
+{
+	board = teensy;
+	if (board->branch_trace != NULL) {
+		fclose(board->branch_trace);
+		board->branch_trace = NULL;
 	}
-	else if ((opcode & 0b111110) == 0b101000) {
-		printf("  ADR? a5_2\n");
-		assert(false);
+}
+
+static void branch_trace_put(uint64_t value, uint8_t size)
+{
+	for (uint8_t i = 0; i < size; ++i) {
+		fputc(value >> (8 * i), board->branch_trace);
 	}
-	else if ((opcode & 0b111110) == 0b101010) {
-		a6_7_5_t1(registers, halfword); // ADD
+}
+
+static void branch_trace_flush_atoms(void)
+{
+	if (board->branch_trace_atom_count > 0) {
+		fputc(BRANCH_TRACE_ATOMS | (1 << board->branch_trace_atom_count)
+		      | board->branch_trace_atoms, board->branch_trace);
+		board->branch_trace_atoms = 0;
+		board->branch_trace_atom_count = 0;
 	}
-	else if ((opcode & 0b111100) == 0b101100) {
-		a5_2_5(registers, halfword);
+}
+
+static void branch_trace_atom(bool taken)
+{
+	board->branch_trace_atoms |= taken << board->branch_trace_atom_count;
+	if (++board->branch_trace_atom_count == BRANCH_TRACE_ATOMS_MAX) {
+		branch_trace_flush_atoms();
 	}
-	else if ((opcode & 0b111100) == 0b110100) {
-		a5_2_6(registers, halfword);
+}
+
+static void branch_trace_target(uint32_t address)
+{
+	branch_trace_flush_atoms();
+	uint32_t changed = address ^ board->branch_trace_address;
+	uint8_t size = 0;
+	while (changed != 0) {
+		changed >>= 8;
+		++size;
 	}
-	else if ((opcode & 0b111110) == 0b111000) {
-		a6_7_12_t2(registers, halfword);
+	fputc(BRANCH_TRACE_ADDRESS | size, board->branch_trace);
+	branch_trace_put(address, size);
+	board->branch_trace_address = address;
+}
+
+static void branch_trace_sync(struct registers *registers)
+{
+	branch_trace_flush_atoms();
+	fputc(BRANCH_TRACE_SYNC, board->branch_trace);
+	branch_trace_put(board->branch_trace_count, 8);
+	for (uint8_t i = 0; i < 16; ++i) {
+		branch_trace_put(registers->r[i], 4);
 	}
+	branch_trace_put(APSR(registers), 4);
+	branch_trace_put(registers->itstate, 1);
+	board->branch_trace_next_sync = board->branch_trace_count
+	                                + BRANCH_TRACE_SYNC_PERIOD;
 }
 
-static void a5_3_1(struct registers *registers,
-                   uint16_t first_halfword,
-                   uint16_t second_halfword)
+static void branch_trace_start(struct registers *registers)
 {
-	uint8_t op = (first_halfword & 0x01F0) >> 4;
-	uint8_t rn = (first_halfword & 0x000F) >> 0;
-	uint8_t rd = (second_halfword & 0x0F00) >> 8;
+	board->branch_trace_atoms = 0;
+	board->branch_trace_atom_count = 0;
+	board->branch_trace_address = 0;
+	board->branch_trace_count = 0;
+	branch_trace_sync(registers);
+}
 
-	if ((op & 0b11110) == 0b00000) {
-		if (!(rd == 0b1111)) {
-			a6_7_8_t1(registers,
-			          first_halfword, second_halfword); // AND
+/* Exceptions are taken between instructions, count is how many ran */
+static void branch_trace_exception(uint8_t number, uint32_t handler)
+{
+	branch_trace_flush_atoms();
+	fputc(BRANCH_TRACE_EXCEPTION, board->branch_trace);
+	branch_trace_put(board->branch_trace_count, 8);
+	branch_trace_put(number, 1);
+	branch_trace_put(handler, 4);
+}
+
+static void branch_trace_end(void)
+{
+	branch_trace_flush_atoms();
+	fputc(BRANCH_TRACE_END, board->branch_trace);
+	branch_trace_put(board->branch_trace_count, 8);
+}
+
+/* Called after an instruction finished, with the PC already at the next */
+static void branch_trace_inst(struct registers *registers,
+                              const struct inst *inst)
+{
+	enum branch_kind kind = branch_kind(inst);
+	if (kind != BRANCH_NONE) {
+		if (branch_conditional(inst)) {
+			branch_trace_atom(board->is_branch);
 		}
-		else if (rd == 0b1111) {
-			printf("  TST? a5_3_1\n");
-			assert(false);
+		if (kind == BRANCH_INDIRECT && board->is_branch) {
+			branch_trace_target(registers->r[15]);
 		}
 	}
-	else if ((op & 0b11110) == 0b00010) {
-		a6_7_15_t1(registers, first_halfword, second_halfword); // BIC
-	}
-	else if ((op & 0b11110) == 0b00100) {
-		if (!(rn == 0b1111)) {
-			a6_7_90_t1(registers,
-			           first_halfword, second_halfword); // ORR
-		}
-		else if (rn == 0b1111) {
-			a6_7_75_t2(registers,
-			           first_halfword, second_halfword); // MOV
-		}
+
+	++board->branch_trace_count;
+	if (board->branch_trace_count >= board->branch_trace_next_sync) {
+		branch_trace_sync(registers);
 	}
-	else if ((op & 0b11110) == 0b00110) {
-		if (!(rn == 0b1111)) {
-			printf("  ORN? a5_3_1\n");
-			assert(false);
-		}
-		else if (rn == 0b1111) {
-			a6_7_84_t1(registers,
-			           first_halfword, second_halfword); // MVN
-		}
+}
+
+struct branch_trace_reader {
+	FILE *file;
+	uint8_t atoms;
+	uint8_t atom_count;
+	uint32_t address;
+	bool exception;
+	uint64_t exception_count;
+	uint8_t exception_number;
+	uint32_t exception_handler;
+};
+
+static uint64_t branch_trace_get(FILE *file, uint8_t size)
+{
+	uint64_t value = 0;
+	for (uint8_t i = 0; i < size; ++i) {
+		int c = fgetc(file);
+		assert(c != EOF);
+		value |= ((uint64_t) c) << (8 * i);
 	}
-	else if ((op & 0b11110) == 0b01000) {
-		if (!(rd == 0b1111)) {
-			printf("  EOR? a5_3_1\n");
-			assert(false);
+	return value;
+}
+
+static void branch_trace_read_sync(FILE *file, struct registers *registers,
+                                   uint64_t *count)
+{
+	*count = branch_trace_get(file, 8);
+	for (uint8_t i = 0; i < 16; ++i) {
+		registers->r[i] = branch_trace_get(file, 4);
+	}
+	registers->apsr = branch_trace_get(file, 4);
+	registers->flags_kind = FLAGS_APSR;
+	registers->itstate = branch_trace_get(file, 1);
+}
+
+/* Reads packets until the one asked for (atoms or an address), later sync
+   packets are only checked against the instruction count */
+static void branch_trace_read(struct branch_trace_reader *reader,
+                              bool address, uint64_t count)
+{
+	while (true) {
+		int header = fgetc(reader->file);
+		assert(header != EOF && header != BRANCH_TRACE_END);
+		if (header == BRANCH_TRACE_SYNC) {
+			struct registers registers;
+			uint64_t sync_count;
+			branch_trace_read_sync(reader->file, &registers,
+			                       &sync_count);
+			assert(sync_count <= count);
+		}
+		else if ((header & BRANCH_TRACE_ATOMS) == BRANCH_TRACE_ATOMS) {
+			assert(!address);
+			uint8_t value = header & ~BRANCH_TRACE_ATOMS;
+			reader->atom_count = 0;
+			while ((value >> (reader->atom_count + 1)) != 0) {
+				++reader->atom_count;
+			}
+			reader->atoms = value & ((1 << reader->atom_count) - 1);
+			return;
 		}
-		else if (rd == 0b1111) {
-			printf("  TEQ? a5_3_1\n");
-			assert(false);
+		else {
+			assert((header & 0xF0) == BRANCH_TRACE_ADDRESS);
+			assert(address);
+			uint8_t size = header & 0x0F;
+			uint32_t mask = size == 4 ? 0xFFFFFFFF
+			                          : (UINT32_C(1) << (8 * size)) - 1;
+			uint32_t low = branch_trace_get(reader->file, size);
+			reader->address = (reader->address & ~mask) | low;
+			return;
 		}
 	}
-	else if ((op & 0b11110) == 0b10000) {
-		if (!(rd == 0b1111)) {
-			a6_7_3_t3(registers,
-			          first_halfword, second_halfword); // ADD
-		}
-		else if (rd == 0b1111) {
-			printf("  CMN? a5_3_1\n");
-			assert(false);
+}
+
+/* An exception packet has to be seen before the instruction it comes
+   before is decoded, so the reader looks past sync packets for one after
+   every packet it reads */
+static void branch_trace_peek(struct branch_trace_reader *reader)
+{
+	while (true) {
+		int header = fgetc(reader->file);
+		if (header == BRANCH_TRACE_SYNC) {
+			struct registers registers;
+			uint64_t sync_count;
+			branch_trace_read_sync(reader->file, &registers,
+			                       &sync_count);
+			continue;
 		}
-	}
-	else if ((op & 0b11110) == 0b10100) {
-		printf("  ADC? a5_3_1\n");
-		assert(false);
-	}
-	else if ((op & 0b11110) == 0b10110) {
-		printf("  SBC? a5_3_1\n");
-		assert(false);
-	}
-	else if ((op & 0b11110) == 0b11010) {
-		if (!(rd == 0b1111)) {
-			printf("  SUB? a5_3_1\n");
-			assert(false);
+		if (header == BRANCH_TRACE_EXCEPTION) {
+			reader->exception = true;
+			reader->exception_count = branch_trace_get(reader->file,
+			                                           8);
+			reader->exception_number = branch_trace_get(reader->file,
+			                                            1);
+			reader->exception_handler =
+				branch_trace_get(reader->file, 4);
 		}
-		else if (rd == 0b1111) {
-			a6_7_27_t2(registers,
-			           first_halfword, second_halfword); // CMP
+		else if (header != EOF) {
+			ungetc(header, reader->file);
 		}
+		return;
 	}
-	else if ((op & 0b11110) == 0b11100) {
-		a6_7_106_t2(registers, first_halfword, second_halfword); // RSB
+}
+
+static bool branch_trace_read_atom(struct branch_trace_reader *reader,
+                                   uint64_t count)
+{
+	if (reader->atom_count == 0) {
+		branch_trace_read(reader, false, count);
+		branch_trace_peek(reader);
 	}
+	bool taken = reader->atoms & 1;
+	reader->atoms >>= 1;
+	--reader->atom_count;
+	return taken;
 }
 
-static void a5_3_3(struct registers *registers,
-                   uint16_t first_halfword,
-                   uint16_t second_halfword)
+static uint32_t branch_trace_read_address(struct branch_trace_reader *reader,
+                                          uint64_t count)
 {
-	uint8_t op = (first_halfword & 0x01F0) >> 4;
-	uint8_t rn = (first_halfword & 0x000F) >> 0;
+	assert(reader->atom_count == 0);
+	branch_trace_read(reader, true, count);
+	branch_trace_peek(reader);
+	return reader->address;
+}
 
-	if (op == 0b00000) {
-		if (!(rn == 0b1111)) {
-			printf("  ADD a5_3_3\n");
-			assert(false);
-		}
-		else {
-			printf("  ADR a5_3_3\n");
-			assert(false);
-		}
-	}
-	else if (op == 0b00100) {
-		a6_7_75_t3(registers, first_halfword, second_halfword); // MOV
-	}
-	else if (op == 0b01010) {
-		if (!(rn == 0b1111)) {
-			printf("  SUB a5_3_3\n");
-			assert(false);
-		}
-		else {
-			printf("  ADR a5_3_3\n");
-			assert(false);
-		}
-	}
-	else if (op == 0b01100) {
-		a6_7_78_t1(registers, first_halfword, second_halfword); // MOVT
-	}
-	else if ((op & 0b11101) == 0b10000) {
-		printf("  SSAT a5_3_3\n");
-		assert(false);
-	}
-	else if (op == 0b10100) {
-		assert(false);
-	}
-	else if (op == 0b10110) {
-		assert(false);
+
+/* Cortex-M4 cycle costs (TRM 3.3), anything not listed takes a cycle.  A
+   load or store right after another pipelines with it and takes a cycle
+   instead of two, UDIV is charged its worst case so deadline estimates
+   stay safe.  Taken branches refill the pipeline, fetching the target from
+   flash, and literal loads read flash, both pay the wait states.  Whether
+   the last instruction run was a load or store is carried on the board, so
+   a cost only depends on the instructions run and not on whether they ran
+   in blocks or single steps */
+static bool loads_or_stores(const struct inst *inst)
+{
+	return inst->execute == LDR_immediate
+	       || inst->execute == LDR_literal
+	       || inst->execute == LDR_register
+	       || inst->execute == LDRB_immediate
+	       || inst->execute == LDRB_register
+	       || inst->execute == STR_immediate
+	       || inst->execute == STR_register
+	       || inst->execute == STRB
+	       || inst->execute == STRB_register
+	       || inst->execute == STRH_immediate;
+}
+
+static uint32_t inst_cycles(const struct inst *inst, bool pipelined)
+{
+	if (loads_or_stores(inst)) {
+		return pipelined ? 1 : 2;
 	}
-	else if ((op & 0b11101) == 0b11000) {
-		printf("  USAT a5_3_3\n");
-		assert(false);
+	else if (inst->execute == PUSH || inst->execute == POP) {
+		return 1 + __builtin_popcount(inst->register_list);
 	}
-	else if (op == 0b11100) {
-		a6_7_144_t1(registers,
-		            first_halfword, second_halfword); // UBFX
+	else if (inst->execute == MLA || inst->execute == MLS) {
+		return 2;
 	}
-	else {
-		assert(false);
+	else if (inst->execute == UDIV) {
+		return 12;
 	}
+	return 1;
 }
 
-static void a5_3_4(struct registers *registers,
-                   uint16_t first_halfword,
-                   uint16_t second_halfword)
+static uint32_t inst_flash_reads(const struct inst *inst)
 {
-	uint8_t op1 = (first_halfword & 0x07F0) >> 4;
-	uint8_t op2 = (second_halfword & 0x7000) >> 12;
+	return inst->execute == LDR_literal ? 1 : 0;
+}
 
-	if (((op2 & 0b101) == 0b000) && !((op1 & 0b0111000) == 0b0111000)) {
-		a6_7_12_t3(registers, first_halfword, second_halfword); // B
-	}
-	else if (((op2 & 0b101) == 0b000)
-	         && ((op1 & 0b1111110) == 0b0111000)) {
-		printf("MSR a5_3_4\n");
-		assert(false);
-	}
-	else if (((op2 & 0b101) == 0b000) && (op1 == 0b0111010)) {
-		printf("Hint a5_3_4\n");
-		assert(false);
-	}
-	else if (((op2 & 0b101) == 0b000) && (op1 == 0b0111011)) {
-		printf("Misc a5_3_4\n");
-		assert(false);
-	}
-	else if (((op2 & 0b101) == 0b000)
-	         && ((op1 & 0b1111110) == 0b0111110)) {
-		printf("MSR a5_3_4\n");
-		assert(false);
+static uint32_t branch_refill_cycles(void)
+{
+	return 1 + board->flash_wait_states;
+}
+
+static void step(struct registers *registers)
+{
+	board->is_branch = false;
+	board->is_it_inst = false;
+
+	const struct inst *inst = fetch(registers);
+	uint32_t cycles = inst_cycles(inst, board->after_load_store);
+	board->after_load_store = loads_or_stores(inst);
+	trace_inst(inst);
+	inst->execute(registers, inst);
+	if (board->exc_return != 0) {
+		exception_return(registers);
 	}
-	else if ((op2  == 0b010) && (op1 == 0b1111111)) {
-		assert(false);
+
+	if (!board->is_branch) {
+		registers->r[15] += inst->length;
 	}
-	else if ((op2 & 0b101) == 0b001) {
-		a6_7_12_t4(registers, first_halfword, second_halfword); // B
+	else {
+		trace_branch(inst->address, registers->r[15]);
 	}
-	else if ((op2 & 0b101) == 0b101) {
-		a6_7_18_t1(registers, first_halfword, second_halfword); // BL
+
+	if (InITBlock(registers) && !board->is_it_inst) {
+		ITAdvance(registers);
 	}
-	else {
-		assert(false);
+
+	if (board->branch_trace != NULL) {
+		branch_trace_inst(registers, inst);
 	}
+
+	board->cycles += cycles
+	          + inst_flash_reads(inst) * board->flash_wait_states
+	          + (board->is_branch ? branch_refill_cycles() : 0);
+}
+
+/* A basic block is a straight-line run of instructions outside of an IT
+   block, ending at anything that may branch or at an IT instruction.  Each
+   exit remembers the block it went to last, so the lookup only runs when an
+   exit goes somewhere new (indirect branches) */
+#define BLOCK_INSTS_MAX 64
+
+struct block {
+	uint32_t address;
+	uint32_t count;
+	uint32_t runs;
+	uint32_t size; // bytes
+	bool loop;     // see block_loops
+	bool starts_load_store;
+	bool ends_load_store;
+	uint32_t cycles;      // without wait states or a refill, not pipelined
+	uint32_t flash_reads;
+	void (*code)(struct registers *registers);
+	struct block *taken;
+	struct block *fallthrough;
+#if defined(THREADED_DISPATCH)
+	const void **handlers;
+#endif
+	struct inst insts[];
+};
+
+static bool ends_block(const struct inst *inst)
+{
+	return inst->execute == IT || branch_kind(inst) != BRANCH_NONE;
 }
 
-static void a5_3_5(struct registers *registers,
-                   uint16_t first_halfword,
-                   uint16_t second_halfword)
+/* Instructions changing nothing but registers and flags, reads included */
+static bool changes_only_registers(const struct inst *inst)
 {
-	uint8_t op = (first_halfword & 0x0180) >> 7;
-	uint8_t W = (first_halfword & 0x0020) >> 5;
-	uint8_t L = (first_halfword & 0x0010) >> 4;
-	uint8_t Rn = (first_halfword & 0x000F) >> 0;
+	static void (*const executes[])(struct registers *,
+	                                const struct inst *) = {
+		ADD_immediate, ADD_register, ADD_SP_plus_immediate,
+		AND_immediate, ASR_immediate, B, BIC_immediate, CMP_immediate,
+		CMP_register, LDR_immediate, LDR_literal, LDR_register,
+		LDRB_immediate, LDRB_register, LSL_immediate, LSL_register,
+		LSR_immediate, MLA, MLS, MOV_immediate, MOVW, MOV_register,
+		MOVT, MVN_immediate, NOP, ORR_immediate, ORR_register,
+		RSB_immediate, RSB_register, SUB_immediate, SUB_register,
+		SUB_SP_minus_immediate, UBFX, UDIV, UXTB,
+	};
 
-	if (op == 0b01) {
-		if (L == 0) {
-			printf("TODO 1: a5_3_5\n");
-			assert(false);
-		}
-		else if (L == 1) {
-			if (!((W == 1) && (Rn == 0b1101))) {
-				printf("TODO 2: a5_3_5\n");
-				assert(false);
-			}
-			else {
-				a6_7_97_t2(registers, first_halfword,
-				           second_halfword); // POP
-			}
+	for (size_t i = 0; i < sizeof(executes) / sizeof(executes[0]); ++i) {
+		if (inst->execute == executes[i]) {
+			return true;
 		}
 	}
-	else if (op == 0b10) {
-		if (L == 0) {
-			if (!(W == 1 && Rn == 0b1101)) {
-				printf("TODO 3: a5_3_5\n");
-				assert(false);
-			}
-			else {
-				a6_7_98_t2(registers, first_halfword,
-				           second_halfword); // PUSH
-			}
-		}
-		else if (L == 1) {
-			printf("TODO 3: a5_3_5\n");
-			assert(false);
-		}
+	return false;
+}
+
+/* A loop block branches back to its own start without writing memory, so
+   once an iteration leaves the registers and flags as they were (and only
+   read memory nothing else writes) the core is idle.  Self branches from
+   teensy-compile and polling loops are the usual ones */
+static bool block_loops(const struct block *block)
+{
+	const struct inst *last = &block->insts[block->count - 1];
+	if (last->execute != B
+	    || branch_direct_target(last) != block->address) {
+		return false;
 	}
-	else {
-		assert(false);
+	for (uint32_t i = 0; i < block->count; ++i) {
+		if (!changes_only_registers(&block->insts[i])) {
+			return false;
+		}
 	}
+	return true;
 }
 
-static void a5_3_7(struct registers *registers,
-                   uint16_t first_halfword,
-                   uint16_t second_halfword)
+static struct block *block_build(uint32_t address)
 {
-	uint8_t op1 = (first_halfword & 0x0180) >> 7;
-	uint8_t n = (first_halfword & 0x000F) >> 0;
-	uint8_t op2 = (second_halfword & 0x0FC0) >> 6;
+	struct inst insts[BLOCK_INSTS_MAX];
 
-	if (n != 0b1111) {
-		if (op1 == 0b01) {
-			a6_7_42_t3(registers,
-			           first_halfword,
-			           second_halfword); // LDR
-		}
-		else {
-			assert(op1 == 0b00);
-			if ((op2 & 0x24) == 0x24) {
-				a6_7_42_t4(registers,
-				           first_halfword,
-				           second_halfword); // LDR
-			}
-			else if ((op2 & 0x3C) == 0x30) {
-				printf("LDR a5_3_7 2\n");
-				assert(false);
-			}
-			else if ((op2 & 0x3C) == 0x38) {
-				printf("LDRT a5_3_7\n");
-				assert(false);
-			}
-			else if (op2 == 0b000000) {
-				// LDR (register)
-				a6_7_44_t2(registers,
-				           first_halfword, second_halfword);
-			}
-			else {
-				assert(false);
-			}
+	struct registers registers = {0};
+	uint32_t count = 0;
+	while (count < BLOCK_INSTS_MAX
+	       && address + 4 <= PROGRAM_FLASH_SIZE) {
+		registers.r[15] = address;
+		insts[count] = *fetch(&registers);
+		address += insts[count].length;
+		++count;
+		if (ends_block(&insts[count - 1])) {
+			break;
 		}
 	}
-	else {
-		assert((op1 & 0b10) == 0b00);
-		printf("  Load register a5_3_7\n");
-		assert(false);
+	assert(count > 0);
+
+	struct block *block = malloc(sizeof(struct block)
+	                             + count * sizeof(struct inst));
+	assert(block != NULL);
+	block->address = insts[0].address;
+	block->count = count;
+	block->runs = 0;
+	block->size = address - block->address;
+	block->code = NULL;
+	block->taken = NULL;
+	block->fallthrough = NULL;
+#if defined(THREADED_DISPATCH)
+	block->handlers = NULL;
+#endif
+	memcpy(block->insts, insts, count * sizeof(struct inst));
+	block->loop = block_loops(block);
+	block->starts_load_store = loads_or_stores(&insts[0]);
+	block->ends_load_store = loads_or_stores(&insts[count - 1]);
+	block->cycles = 0;
+	block->flash_reads = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		bool pipelined = i > 0 && loads_or_stores(&insts[i - 1]);
+		block->cycles += inst_cycles(&insts[i], pipelined);
+		block->flash_reads += inst_flash_reads(&insts[i]);
 	}
+	return block;
 }
 
-static void a5_3_9(struct registers *registers,
-                   uint16_t first_halfword,
-                   uint16_t second_halfword)
+static struct block *block_lookup(uint32_t address)
 {
-	uint8_t op1 =  (first_halfword & 0x0180) >>  7;
-	uint8_t n   =  (first_halfword & 0x000F) >>  7;
-	uint8_t t   = (second_halfword & 0xF000) >> 12;
-	uint8_t op2 = (second_halfword & 0x0FC0) >>  6;
+	struct block **entry = &board->block_map[address / 2];
+	if (*entry == NULL) {
+		*entry = block_build(address);
+	}
+	return *entry;
+}
 
-	bool nNot1111 = n != 0b1111;
-	bool tNot1111 = t != 0b1111;
+static bool block_runnable(struct registers *registers)
+{
+	return registers->itstate == 0
+	       && registers->r[15] + 4 <= PROGRAM_FLASH_SIZE;
+}
 
-	if ((op1 == 0b01) && nNot1111 && tNot1111) {
-		// LDRB (immediate)
-		a6_7_45_t2(registers, first_halfword, second_halfword);
-	}
-	else if ((op1 == 0b00) && ((op2 & 0b100100) == 0b100100)
-	         && nNot1111) {
-		assert(false);
-	}
-	else if ((op1 == 0b00) && ((op2 & 0b111100) == 0b110000)
-	         && nNot1111 && tNot1111) {
-		assert(false);
+static struct block *block_exit(struct registers *registers,
+                                struct block **link)
+{
+	if (!block_runnable(registers)) {
+		return NULL;
 	}
-	else {
-		printf("a5_3_9\n");
-		assert(false);
+	if (*link == NULL || (*link)->address != registers->r[15]) {
+		*link = block_lookup(registers->r[15]);
 	}
+	return *link;
 }
 
-static void a5_3_10(struct registers *registers,
-                    uint16_t first_halfword,
-                    uint16_t second_halfword)
+#if defined(__x86_64__)
+/* Blocks that run often are compiled to x86-64.  RBX holds the registers
+   pointer for the whole block, simple register moves and arithmetic are
+   emitted inline and everything else (memory accesses included) calls the
+   execute function of the predecoded instruction, so MMIO still goes
+   through memory_read and memory_write */
+#define JIT_HOT_RUNS 16
+#define JIT_CODE_SIZE 0x1000000
+
+#define JIT_R(n) ((int32_t) (offsetof(struct registers, r) + 4 * (n)))
+
+static void print_register(struct registers *registers, uint8_t n)
 {
-	uint8_t op1 =  (first_halfword & 0x00E0) >> 5;
-	uint8_t op2 = (second_halfword & 0x0FC0) >> 6;
+	trace_register(n, registers->r[n]);
+}
 
-	if (op1 == 0b100) {
-		// STRB (immediate)
-		a6_7_121_t2(registers, first_halfword, second_halfword);
-	}
-	else if ((op1 == 0b000) && ((op2 & 0b100000) == 0b100000)) {
-		// STRB (immediate)
-		a6_7_121_t3(registers, first_halfword, second_halfword);
-	}
-	else if ((op1 == 0b000) && ((op2 & 0b100000) == 0b000000)) {
-		assert(false); // STRB (register)
-	}
-	else if (op1 == 0b101) {
-		assert(false); // STRH (immediate)
-	}
-	else if ((op1 == 0b001) && ((op2 & 0b100000) == 0b100000)) {
-		assert(false); // STRH (immediate)
+static void jit_call(struct x86_64_code *code, const void *function)
+{
+	x86_64_mov_r64_imm64(code, X86_64_RAX, (uintptr_t) function);
+	x86_64_call_r64(code, X86_64_RAX);
+}
+
+static void jit_print_register(struct x86_64_code *code, uint8_t n)
+{
+	x86_64_mov_r64_r64(code, X86_64_RDI, X86_64_RBX);
+	x86_64_mov_r64_imm32(code, X86_64_RSI, n);
+	jit_call(code, (const void *) print_register);
+}
+
+/* Returns false if the instruction has to go through its execute function */
+static bool jit_native(struct x86_64_code *code, const struct inst *inst)
+{
+	if (inst->cond != 0b1110 && inst->cond != 0b1111) {
+		return false;
 	}
-	else if ((op1 == 0b001) && ((op2 & 0b100000) == 0b000000)) {
-		assert(false); // STRH (register)
+
+	if (inst->execute == MOVW
+	    || (inst->execute == MOV_immediate && !inst->setflags)) {
+		x86_64_mov_m32_imm32(code, X86_64_RBX, JIT_R(inst->d),
+		                     inst->imm32);
 	}
-	else if (op1 == 0b110) {
-		// STR (immediate)
-		a6_7_119_t3(registers, first_halfword, second_halfword);
+	else if (inst->execute == MOVT) {
+		x86_64_mov_r32_m32(code, X86_64_RAX, X86_64_RBX, JIT_R(inst->d));
+		x86_64_and_r32_imm32(code, X86_64_RAX, 0x0000FFFF);
+		x86_64_or_r32_imm32(code, X86_64_RAX, inst->imm32 << 16);
+		x86_64_mov_m32_r32(code, X86_64_RBX, JIT_R(inst->d), X86_64_RAX);
 	}
-	else if ((op1 == 0b010) && ((op2 & 0b100000) == 0b100000)) {
-		a6_7_119_t4(registers, first_halfword, second_halfword);
+	else if (inst->execute == MOV_register) {
+		x86_64_mov_r32_m32(code, X86_64_RAX, X86_64_RBX, JIT_R(inst->m));
+		x86_64_mov_m32_r32(code, X86_64_RBX, JIT_R(inst->d), X86_64_RAX);
 	}
-	else if ((op1 == 0b010) && ((op2 & 0b100000) == 0b000000)) {
-		// STR (register)
-		a6_7_120_t2(registers, first_halfword, second_halfword);
+	else if ((inst->execute == ADD_immediate && !inst->setflags)
+	         || (inst->execute == ADD_SP_plus_immediate && !inst->setflags)
+	         || (inst->execute == SUB_SP_minus_immediate && !inst->setflags)) {
+		uint8_t n = inst->execute == ADD_immediate ? inst->n : 13;
+		uint32_t imm32 = inst->execute == SUB_SP_minus_immediate
+		                 ? -inst->imm32 : inst->imm32;
+		x86_64_mov_r32_m32(code, X86_64_RAX, X86_64_RBX, JIT_R(n));
+		x86_64_add_r32_imm32(code, X86_64_RAX, imm32);
+		x86_64_mov_m32_r32(code, X86_64_RBX, JIT_R(inst->d), X86_64_RAX);
 	}
 	else {
-		assert(false);
+		return false;
+	}
+
+	if (tracing(TEENSY_3_2_TRACE_FULL)) {
+		jit_print_register(code, inst->d);
+	}
+	return true;
+}
+
+static void jit_compile(struct block *block)
+{
+	if (board->jit_code == NULL) {
+		void *memory = mmap(NULL, JIT_CODE_SIZE,
+		                    PROT_READ | PROT_WRITE | PROT_EXEC,
+		                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED) {
+			board->jit_disabled = true;
+			return;
+		}
+		board->jit_code = memory;
+	}
+
+	struct x86_64_code code = {
+		.data = board->jit_code + board->jit_code_size,
+		.size = 0,
+		.capacity = JIT_CODE_SIZE - board->jit_code_size,
+	};
+
+	x86_64_push_r64(&code, X86_64_RBX);
+	x86_64_mov_r64_r64(&code, X86_64_RBX, X86_64_RDI);
+	for (uint32_t i = 0; i < block->count; ++i) {
+		const struct inst *inst = &block->insts[i];
+		x86_64_mov_m32_imm32(&code, X86_64_RBX, JIT_R(15), inst->address);
+		x86_64_mov_r64_imm64(&code, X86_64_RDI, (uintptr_t) inst);
+		if (tracing(TEENSY_3_2_TRACE_INSTRUCTIONS)) {
+			jit_call(&code, (const void *) trace_inst);
+		}
+		if (!jit_native(&code, inst)) {
+			x86_64_mov_r64_r64(&code, X86_64_RDI, X86_64_RBX);
+			x86_64_mov_r64_imm64(&code, X86_64_RSI, (uintptr_t) inst);
+			jit_call(&code, (const void *) inst->execute);
+		}
+	}
+	x86_64_pop_r64(&code, X86_64_RBX);
+	x86_64_ret(&code);
+
+	if (code.size > code.capacity) {
+		board->jit_disabled = true;
+		return;
+	}
+	block->code = (void (*)(struct registers *)) code.data;
+	board->jit_code_size += code.size;
+}
+#endif
+
+#if defined(THREADED_DISPATCH)
+#if !defined(__GNUC__)
+#error "THREADED_DISPATCH needs computed goto (GCC or Clang)"
+#endif
+
+#define EXECUTE_FUNCTIONS(X) \
+	X(CPS) \
+	X(ADD_immediate) \
+	X(ADD_register) \
+	X(ADD_SP_plus_immediate) \
+	X(AND_immediate) \
+	X(ASR_immediate) \
+	X(B) \
+	X(BIC_immediate) \
+	X(BL) \
+	X(BLX_register) \
+	X(BX) \
+	X(CBNZ_CBZ) \
+	X(CMP_immediate) \
+	X(CMP_register) \
+	X(IT) \
+	X(LDR_immediate) \
+	X(LDR_literal) \
+	X(LDR_register) \
+	X(LDRB_immediate) \
+	X(LDRB_register) \
+	X(LSL_immediate) \
+	X(LSL_register) \
+	X(LSR_immediate) \
+	X(MLA) \
+	X(MLS) \
+	X(MOV_immediate) \
+	X(MOVW) \
+	X(MOV_register) \
+	X(MOVT) \
+	X(MVN_immediate) \
+	X(NOP) \
+	X(ORR_immediate) \
+	X(ORR_register) \
+	X(POP) \
+	X(PUSH) \
+	X(RSB_immediate) \
+	X(RSB_register) \
+	X(STR_immediate) \
+	X(STR_register) \
+	X(STRB) \
+	X(STRB_register) \
+	X(STRH_immediate) \
+	X(SUB_immediate) \
+	X(SUB_register) \
+	X(SUB_SP_minus_immediate) \
+	X(UBFX) \
+	X(UDIV) \
+	X(UXTB)
+
+/* Direct-threaded interpreter for a block: every instruction gets the label
+   of its handler and each handler ends in its own indirect jump to the next
+   one, instead of all of them sharing the call in a loop.  The labels are
+   resolved the first time the block runs, with a final one for the exit */
+static void block_run_threaded(struct registers *registers,
+                               struct block *block)
+{
+	static const struct {
+		void (*execute)(struct registers *, const struct inst *);
+		const void *handler;
+	} handlers[] = {
+#define X(name) { name, &&handler_##name },
+		EXECUTE_FUNCTIONS(X)
+#undef X
+	};
+
+	if (block->handlers == NULL) {
+		block->handlers = malloc((block->count + 1) * sizeof(void *));
+		assert(block->handlers != NULL);
+		for (uint32_t i = 0; i < block->count; ++i) {
+			size_t j = 0;
+			while (handlers[j].execute != block->insts[i].execute) {
+				++j;
+				assert(j < sizeof(handlers) / sizeof(handlers[0]));
+			}
+			block->handlers[i] = handlers[j].handler;
+		}
+		block->handlers[block->count] = &&done;
 	}
+
+	const void **handler = block->handlers;
+	const struct inst *inst = block->insts;
+	goto **handler;
+
+#define X(name) \
+handler_##name: \
+	registers->r[15] = inst->address; \
+	trace_inst(inst); \
+	name(registers, inst); \
+	++inst; \
+	goto **++handler;
+	EXECUTE_FUNCTIONS(X)
+#undef X
+
+done:
+	return;
 }
+#endif
 
-static void a5_3_11(struct registers *registers,
-                    uint16_t first_halfword,
-                    uint16_t second_halfword)
+/* Only the last instruction of a block can branch */
+static void branch_trace_block(struct registers *registers,
+                               const struct block *block)
 {
-	uint8_t op =  (first_halfword & 0x01E0) >> 5;
-	uint8_t S  =  (first_halfword & 0x0010) >> 4;
-	uint8_t n  =  (first_halfword & 0x000F) >> 0;
-	uint8_t d  = (second_halfword & 0x0F00) >> 8;
+	board->branch_trace_count += block->count - 1;
+	branch_trace_inst(registers, &block->insts[block->count - 1]);
+}
 
-	if (op == 0b0000) {
-		assert(false);
-	}
-	else if (op == 0b0001) {
-		assert(false);
+/* pipelined if the instruction before the block was a load or store */
+static uint64_t block_cycles(const struct block *block, bool taken,
+                             bool pipelined)
+{
+	return block->cycles + block->flash_reads * board->flash_wait_states
+	       + (taken ? branch_refill_cycles() : 0)
+	       - (pipelined && block->starts_load_store ? 1 : 0);
+}
+
+/* The cycle an instruction starts at, for the timers.  A block is only
+   charged once it's done, inside one the instructions before the one at
+   the PC are added */
+static uint64_t now(void)
+{
+	const struct block *block = board->running;
+	if (block == NULL) {
+		return board->cycles;
 	}
-	else if (op == 0b0010) {
-		if (n != 0b1111) {
-			// ORR (register)
-			a6_7_91_t2(registers, first_halfword, second_halfword);
+	uint64_t cycles = board->cycles;
+	bool pipelined = board->after_load_store;
+	for (uint32_t i = 0; i < block->count; ++i) {
+		const struct inst *inst = &block->insts[i];
+		if (inst->address == board->running_registers->r[15]) {
+			break;
 		}
-		else {
-			uint8_t imm3 = (second_halfword & 0x7000) >> 12;
-			uint8_t imm2 = (second_halfword & 0x00C0) >>  6;
-			uint8_t type = (second_halfword & 0x0030) >>  4;
-
-			uint8_t imm5 = (imm3 << 2) | imm2;
+		cycles += inst_cycles(inst, pipelined)
+		          + inst_flash_reads(inst) * board->flash_wait_states;
+		pipelined = loads_or_stores(inst);
+	}
+	return cycles;
+}
 
-			switch (type) {
-			case 0b00:
-				assert(false);
-				break;
-			case 0b01:
-				a6_7_69_t2(registers,
-				           first_halfword,
-				           second_halfword); // LSR
-				break;
-			case 0b10:
-				a6_7_10_t2(registers,
-				           first_halfword,
-				           second_halfword); // ASR
-				break;
-			case 0b11:
-				assert(false);
-				break;
-			}
+/* Only the last instruction of a block can branch, so the PC is set before
+   each instruction for the ones reading it and the block exit is taken from
+   the final is_branch.  With single_step the instructions are stepped and
+   charged one at a time instead, everything else (the exits, exceptions
+   only between blocks, idle loops) stays the same so the cycles have to
+   come out the same */
+static struct block *block_run(struct registers *registers,
+                               struct block *block)
+{
+	if (board->single_step) {
+		for (uint32_t i = 0; i < block->count; ++i) {
+			step(registers);
 		}
+		return block_exit(registers, board->is_branch
+		                             ? &block->taken
+		                             : &block->fallthrough);
 	}
-	else if (op == 0b0011) {
-		assert(false);
+
+#if defined(__x86_64__)
+	if (block->code == NULL && !board->jit_disabled
+	    && ++block->runs == JIT_HOT_RUNS) {
+		jit_compile(block);
 	}
-	else if (op == 0b0100) {
-		assert(false);
+#endif
+
+	board->running = block;
+	board->running_registers = registers;
+	board->is_branch = false;
+	if (block->code != NULL) {
+		block->code(registers);
 	}
-	else if (op == 0b1000) {
-		if (d != 0b1111) {
-			a6_7_4_t3(registers, first_halfword,
-			          second_halfword); // ADD
-		}
-		else if (d == 0b1111) {
-			if (S == 0) {
-				assert(false);
-			}
-			else if (S == 1) {
-				assert(false);
-			}
+	else {
+#if defined(THREADED_DISPATCH)
+		block_run_threaded(registers, block);
+#else
+		for (uint32_t i = 0; i < block->count; ++i) {
+			const struct inst *inst = &block->insts[i];
+			registers->r[15] = inst->address;
+			trace_inst(inst);
+			inst->execute(registers, inst);
 		}
+#endif
 	}
-	else if (op == 0b1010) {
-		assert(false);
+	board->running = NULL;
+
+	bool pipelined = board->after_load_store;
+	board->after_load_store = block->ends_load_store;
+	if (board->exc_return != 0) {
+		exception_return(registers);
 	}
-	else if (op == 0b1011) {
-		assert(false);
+
+	const struct inst *last = &block->insts[block->count - 1];
+	if (!board->is_branch) {
+		registers->r[15] = last->address + last->length;
 	}
-	else if (op == 0b1101) {
-		assert(false);
+	if (board->branch_trace != NULL) {
+		branch_trace_block(registers, block);
 	}
-	else if (op == 0b1110) {
-		a6_7_107_t1(registers, first_halfword, second_halfword); // RSB
+	board->cycles += block_cycles(block, board->is_branch, pipelined);
+
+	if (board->is_branch) {
+		trace_branch(last->address, registers->r[15]);
+		return block_exit(registers, &block->taken);
 	}
+	return block_exit(registers, &block->fallthrough);
 }
 
-static void a5_3_12(struct registers *registers,
-                    uint16_t first_halfword,
-                    uint16_t second_halfword)
+/* The watched location is read straight from memory so the check has no
+   side effects and isn't traced */
+static uint32_t watch_read(const struct teensy_3_2_run_control *control)
 {
-	uint8_t op1 =  (first_halfword & 0x00F0) >> 4;
-	uint8_t op2 = (second_halfword & 0x00F0) >> 4;
+	uint32_t value = 0;
+	for (uint8_t i = 0; i < control->watch_size; ++i) {
+		value |= (uint32_t) memory_read(control->watch_address + i)
+		         << (8 * i);
+	}
+	return value;
+}
 
-	if (op2 == 0b0000) {
-		if ((op1 == 0b1110) == 0b0000) {
-			a6_7_68_t2(registers, first_halfword,
-			           second_halfword); // LSL
-		}
-		else if ((op1 == 0b1110) == 0b0010) {
-			assert(false);
-		}
-		else if ((op1 == 0b1110) == 0b0100) {
-			assert(false);
-		}
-		else if ((op1 == 0b1110) == 0b0110) {
-			assert(false);
+static bool watch_valid(const struct teensy_3_2_run_control *control)
+{
+	if (control->watch_size == 0) {
+		return true;
+	}
+	if (control->watch_size != 1 && control->watch_size != 2
+	    && control->watch_size != 4) {
+		return false;
+	}
+	uint32_t first = control->watch_address;
+	uint32_t last = first + control->watch_size - 1;
+	return last >= first
+	       && ((last < PROGRAM_FLASH_SIZE)
+	           || (first >= SRAM_LOWER && last <= SRAM_UPPER));
+}
+
+/* Writes are aligned stores to SRAM, the peripherals or the system control
+   space */
+static bool writes_valid(const struct teensy_3_2_run_control *control)
+{
+	if (control->writes_size > TEENSY_3_2_WRITES) {
+		return false;
+	}
+	for (uint8_t i = 0; i < control->writes_size; ++i) {
+		const struct teensy_3_2_write *write = &control->writes[i];
+		if (write->size != 1 && write->size != 2 && write->size != 4) {
+			return false;
 		}
-		else {
-			assert(false);
+		uint32_t first = write->address;
+		uint32_t last = first + write->size - 1;
+		if (first % write->size != 0
+		    || !((first >= SRAM_LOWER && last <= SRAM_UPPER)
+		         || (first >= 0x40000000 && last <= 0x400FFFFF)
+		         || (first >= 0xE0000000 && last <= 0xE00FFFFF))) {
+			return false;
 		}
 	}
-	else {
-		assert(false);
+	return true;
+}
+
+static void writes_apply(const struct teensy_3_2_run_control *control)
+{
+	for (uint8_t i = 0; i < control->writes_size; ++i) {
+		const struct teensy_3_2_write *write = &control->writes[i];
+		switch (write->size) {
+		case 1:
+			memory_byte_write(write->address, write->value);
+			break;
+		case 2:
+			memory_halfword_write(write->address, write->value);
+			break;
+		case 4:
+			memory_word_write(write->address, write->value);
+			break;
+		}
 	}
 }
 
-static void a5_3_14(struct registers *registers,
-                    uint16_t first_halfword,
-                    uint16_t second_halfword)
+static double seconds_since(const struct timespec *start)
 {
-	uint8_t op1 = (first_halfword & 0x0070) >> 4;
-	uint8_t a = (second_halfword & 0xF000) >> 12;
-	uint8_t op2 = (second_halfword & 0x0030) >> 4;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec)
+	       + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
 
-	assert(op1 == 0b000);
+/* The clock is only read every RUN_CLOCK_BLOCKS block exits */
+#define RUN_CLOCK_BLOCKS 0x1000
 
-	if (op2 == 0b00) {
-		if (a != 0b1111) {
-			a6_7_73_t1(registers, first_halfword, second_halfword);
-		}
-		else if (a == 0b1111) {
-			printf("  MUL a5_3_14\n");
-			assert(false);
-		}
-	}
-	else if (op2 == 0b01) {
-		a6_7_74_t1(registers, first_halfword, second_halfword); //MLS
+static bool registers_repeat(struct registers *a, struct registers *b)
+{
+	return memcmp(a->r, b->r, sizeof(a->r)) == 0
+	       && APSR(a) == APSR(b)
+	       && a->itstate == b->itstate;
+}
+
+/* An idle loop only ends once a scheduled event pends an exception that
+   can preempt it */
+static bool exception_can_wake(const struct registers *registers)
+{
+	if (registers->primask != 0) {
+		return false;
 	}
-	else {
-		assert(false);
+	for (uint8_t i = 0; i < board->events_scheduled; ++i) {
+		uint32_t number = event_exception(board->event_heap[i]);
+		if (number != 0
+		    && exception_bit(board->exception_enabled, number)
+		    && board->exception_priority[number]
+		       < board->execution_priority) {
+			return true;
+		}
 	}
+	return false;
 }
 
-static void a5_3_15(struct registers *registers,
-                    uint16_t first_halfword,
-                    uint16_t second_halfword)
+/* Skips whole iterations of an idle loop block, all of them up to the
+   instruction limit or just enough to reach the next event, and returns
+   how many */
+static uint64_t idle_skip(const struct block *block, uint64_t count,
+                          bool wakes)
 {
-	uint8_t op1 = (first_halfword & 0x0070) >> 4;
-	uint8_t op2 = (second_halfword & 0x00F0) >> 4;
-
-	switch (op1) {
-	case 0b000:
-		assert(op2 == 0b0000);
-		printf("  SMULL a5_3_15\n");
-		assert(false);
-		break;
-	case 0b001:
-		assert(op2 == 0b1111);
-		printf("  SDIV a5_3_15\n");
-		assert(false);
-		break;
-	case 0b010:
-		assert(op2 == 0b0000);
-		printf("  UMULL a5_3_15\n");
-		assert(false);
-		break;
-	case 0b011:
-		assert(op2 == 0b1111);
-		a6_7_145_t1(registers, first_halfword, second_halfword);
-		break;
-	case 0b100:
-		assert(op2 == 0b0000);
-		printf("  SMLAL a5_3_15\n");
-		assert(false);
-		break;
-	case 0b110:
-		assert(op2 == 0b0000);
-		printf("  UMLAL a5_3_15\n");
-		assert(false);
-		break;
-	default:
-		assert(false);
+	uint64_t iterations = count / block->count;
+	uint64_t iteration_cycles = block_cycles(block, true,
+	                                         block->ends_load_store);
+	if (wakes) {
+		uint64_t wake = board->next_event > board->cycles
+		                ? (board->next_event - board->cycles
+		                   + iteration_cycles - 1) / iteration_cycles
+		                : 0;
+		if (wake < iterations) {
+			iterations = wake;
+		}
 	}
+	board->cycles += iterations * iteration_cycles;
+	return iterations;
 }
 
-/* 32-bit instruction encoding */
-static void a5_3(struct registers *registers,
-                 uint16_t first_halfword,
-                 uint16_t second_halfword)
+/* Runs one iteration of a loop block as if it started at a given cycle,
+   from a copy of the registers, and returns if it stays in the loop */
+static bool time_probe(struct block *block, const struct registers *from,
+                       uint64_t at, struct registers *to)
 {
-	printf("%08X: %04X %04X\n", registers->r[15], first_halfword, second_halfword);
+	uint64_t now = board->cycles;
+	bool after_load_store = board->after_load_store;
+	*to = *from;
+	board->cycles = at;
+	bool stays = block_run(to, block) == block;
+	board->cycles = now;
+	board->after_load_store = after_load_store;
+	return stays;
+}
 
-	uint8_t op1 = (first_halfword & 0x1800) >> 11;
-	uint8_t op2 = (first_halfword & 0x07F0) >> 4;
-	uint8_t op = (second_halfword & 0x8000) >> 15;
+/* A loop block whose only peripheral reads are of timer counters waits for
+   a deadline.  If an iteration doesn't depend on the registers the last
+   one left behind, the first iteration to exit is searched for among those
+   starting before the next event (while the counters run without wrapping
+   the loop is taken to exit for good once its deadline passes).  The
+   iterations before it are skipped, ending with the registers the last of
+   them leaves, and their number is returned */
+static uint64_t time_skip(struct block *block, struct registers *registers,
+                          const struct registers *before, uint64_t count)
+{
+	if (board->next_event == UINT64_MAX
+	    || board->next_event <= board->cycles) {
+		return 0;
+	}
+	uint64_t iteration_cycles = block_cycles(block, true,
+	                                         block->ends_load_store);
+	uint64_t iterations = count / block->count;
+	uint64_t window = (board->next_event - board->cycles
+	                   + iteration_cycles - 1) / iteration_cycles;
+	if (window < iterations) {
+		iterations = window;
+	}
+	if (iterations == 0) {
+		return 0;
+	}
 
-	if (op1 == 0b01) {
-		if ((op2 & 0b1100100) == 0b0000000) {
-			a5_3_5(registers, first_halfword, second_halfword);
-		}
-		else if ((op2 & 0b1100100) == 0b0000100) {
-			printf("Load/store dual or exclusive, table branch\n");
-			assert(false);
-		}
-		else if ((op2 & 0b1100000) == 0b0100000) {
-			// Data processing (shifted register)
-			a5_3_11(registers, first_halfword, second_halfword);
-		}
-		else if ((op2 & 0b1000000) == 0b1000000) {
-			printf("Coprocessor instructions\n");
-			assert(false);
-		}
+	struct registers a;
+	struct registers b;
+	time_probe(block, before, board->cycles, &a);
+	time_probe(block, registers, board->cycles, &b);
+	if (!registers_repeat(&a, &b)) {
+		return 0;
 	}
-	else if (op1 == 0b10) {
-		if (((op2 & 0b0100000) == 0b0000000)
-		     && (op == 0)) {
-			// Data processing (modified immediate)
-			a5_3_1(registers, first_halfword, second_halfword);
-		}
-		else if (((op2 & 0b0100000) == 0b0100000)
-		     && (op == 0)) {
-			// Data processing (plain binary immediate)
-			a5_3_3(registers, first_halfword, second_halfword);
+
+	uint64_t low = 0;
+	uint64_t high = iterations;
+	while (low < high) {
+		uint64_t middle = low + (high - low) / 2;
+		if (time_probe(block, registers,
+		               board->cycles + middle * iteration_cycles, &a)) {
+			low = middle + 1;
 		}
-		else if ((op == 1)) {
-			// Branches and miscellaneous control
-			a5_3_4(registers, first_halfword, second_halfword);
+		else {
+			high = middle;
 		}
 	}
-	else if (op1 == 0b11) {
-		if ((op2 & 0b1110001) == 0b0000000) {
-			// Store single data item
-			a5_3_10(registers, first_halfword, second_halfword);
-		}
-		else if ((op2 & 0b1100111) == 0b0000001) {
-			// Load bytes, memory hints
-			a5_3_9(registers, first_halfword, second_halfword);
-		}
-		else if ((op2 & 0b1100111) == 0b0000011) {
-			printf("Load halfword, unallocated memory hints\n");
-			assert(false);
-		}
-		else if ((op2 & 0b1100111) == 0b0000101) {
-			a5_3_7(registers,
-			       first_halfword, second_halfword); // Load word
+	if (low == 0) {
+		return 0;
+	}
+	time_probe(block, &b, board->cycles + (low - 1) * iteration_cycles,
+	           registers);
+	board->cycles += low * iteration_cycles;
+	return low;
+}
+
+/* Run until a limit of the run control is reached, single stepping inside
+   IT blocks, for a final partial block and up to a stop PC inside a block.
+   Everything but the PC check happens once per block.
+
+   An iteration of a loop block that ends where it started is idle, it will
+   repeat until an exception.  Without an instruction limit (or with
+   until_idle) the run stops there if nothing can interrupt it, otherwise
+   the iterations up to the end of the limit or the next event are
+   skipped unless every iteration has to be traced.  Loops polling a
+   timer counter for a deadline skip to it (see time_skip), loops polling
+   other peripherals keep running, the models change on reads.
+
+   Pending exceptions are taken between blocks, due events only run there
+   too */
+/* Like AFL, an edge is the hash of where the core goes, xor the hash of
+   where it came from shifted once so A to B and B to A differ.  The counts
+   saturate */
+static void coverage_add(uint32_t address)
+{
+	uint32_t location = ((address >> 1) * UINT32_C(0x9E3779B1)) >> 16;
+	uint8_t *count = &board->coverage[(location ^ board->coverage_previous)
+	                                  % TEENSY_3_2_COVERAGE_SIZE];
+	if (*count != UINT8_MAX) {
+		++*count;
+	}
+	board->coverage_previous = location >> 1;
+}
+
+static enum teensy_3_2_stop run(struct registers *registers,
+                                const struct teensy_3_2_run_control *control,
+                                uint64_t *executed)
+{
+	uint64_t count = control->instructions != 0 ? control->instructions
+	                                            : UINT64_MAX;
+	uint32_t watch_value = watch_read(control);
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	uint32_t exits = 0;
+	bool fast_forward = !tracing(TEENSY_3_2_TRACE_BRANCHES)
+	                    && board->branch_trace == NULL;
+
+	struct block *block = NULL;
+	enum teensy_3_2_stop stop;
+	while (true) {
+		if (control->until_pc && registers->r[15] == control->pc) {
+			stop = TEENSY_3_2_STOP_PC;
+			break;
 		}
-		else if ((op2 & 0b1110000) == 0b0100000) {
-			a5_3_12(registers, first_halfword, second_halfword);
+		if (count == 0) {
+			stop = TEENSY_3_2_STOP_INSTRUCTIONS;
+			break;
 		}
-		else if ((op2 & 0b1111000) == 0b0110000) {
-			a5_3_14(registers, first_halfword, second_halfword);
+		if (board->cycles >= board->next_event) {
+			events_run();
 		}
-		else if ((op2 & 0b1111000) == 0b0111000) {
-			a5_3_15(registers, first_halfword, second_halfword);
+		if (board->pending_priorities != 0
+		    && exception_take(registers)) {
+			if (board->branch_trace != NULL) {
+				branch_trace_exception(registers->ipsr,
+				                       registers->r[15]);
+			}
+			block = NULL;
+			continue;
+		}
+		if (block == NULL && block_runnable(registers)) {
+			block = block_lookup(registers->r[15]);
+		}
+		if (board->coverage != NULL) {
+			coverage_add(registers->r[15]);
+		}
+		if (block == NULL || block->count > count
+		    || (control->until_pc
+		        && control->pc - block->address < block->size)) {
+			step(registers);
+			--count;
+			block = NULL;
+		}
+		else if (block->loop) {
+			struct registers before = *registers;
+			uint32_t reads = board->slow_reads;
+			uint32_t times = board->time_reads;
+			uint32_t stables = board->stable_reads;
+			count -= block->count;
+			struct block *next = block_run(registers, block);
+			uint32_t unstable = (board->slow_reads - reads)
+			                    - (board->stable_reads - stables);
+			if (next == block && unstable == 0
+			    && registers_repeat(&before, registers)) {
+				bool wakes = exception_can_wake(registers);
+				if (!wakes && (control->until_idle
+				               || control->instructions == 0)) {
+					stop = TEENSY_3_2_STOP_IDLE;
+					break;
+				}
+				if (fast_forward) {
+					count -= idle_skip(block, count, wakes)
+					         * block->count;
+				}
+			}
+			else if (next == block && fast_forward
+			         && times != board->time_reads
+			         && unstable == board->time_reads - times) {
+				count -= time_skip(block, registers, &before,
+				                   count)
+				         * block->count;
+			}
+			block = next;
 		}
-		else if ((op2 & 0b1000000) == 0b1000000) {
-			printf("Coprocessor\n");
-			assert(false);
+		else {
+			count -= block->count;
+			block = block_run(registers, block);
 		}
-	}
-}
-
-static void step(struct registers *registers)
-{
-	is_branch = false;
-	is_it_inst = false;
 
-	uint16_t halfword = memory_halfword_read(registers->r[15]);
-	if (((halfword & 0xE000) == 0xE000)
-	    && ((halfword & 0x1800) != 0x0000)) {
-		uint16_t first_halfword = halfword;
-		uint16_t second_halfword
-			= memory_halfword_read(registers->r[15] + 2);
-		a5_3(registers, first_halfword, second_halfword);
-		if (!is_branch) {
-			registers->r[15] += 4;
+		if (control->watch_size != 0
+		    && watch_read(control) != watch_value) {
+			stop = TEENSY_3_2_STOP_WATCH;
+			break;
 		}
-	}
-	else {
-		a5_2(registers, halfword);
-		if (!is_branch) {
-			registers->r[15] += 2;
+		if (control->seconds > 0 && ++exits == RUN_CLOCK_BLOCKS) {
+			exits = 0;
+			if (seconds_since(&start) >= control->seconds) {
+				stop = TEENSY_3_2_STOP_TIME;
+				break;
+			}
 		}
 	}
 
-	if (InITBlock(registers) && !is_it_inst) {
-		ITAdvance(registers);
-	}
+	*executed = (control->instructions != 0 ? control->instructions
+	                                        : UINT64_MAX) - count;
+	return stop;
 }
 
-void teensy_3_2_emulate(uint8_t *data, uint32_t length) {
-	flash = data;
-
-	struct registers registers;
-
-	uint32_t initial_sp  = word_at_address(0x00000000);
-	uint32_t initial_pc  = word_at_address(0x00000004);
+static void print_vector_table(uint32_t initial_sp, uint32_t initial_pc)
+{
 	uint32_t nmi_address = word_at_address(0x00000008);
 	uint32_t hard_fault_address = word_at_address(0x0000000c);
 	uint32_t mem_manage_fault_address = word_at_address(0x00000010);
@@ -4126,31 +7371,503 @@ void teensy_3_2_emulate(uint8_t *data, uint32_t length) {
 		printf("Vector %3d:              %08X\n",
 		       i, word_at_address(0x00000000 + (4*i)));
 	}
+}
+
+const char *teensy_3_2_stop_name(enum teensy_3_2_stop stop)
+{
+	switch (stop) {
+	case TEENSY_3_2_STOP_INSTRUCTIONS:
+		return "instructions";
+	case TEENSY_3_2_STOP_PC:
+		return "pc";
+	case TEENSY_3_2_STOP_WATCH:
+		return "watch";
+	case TEENSY_3_2_STOP_TIME:
+		return "time";
+	case TEENSY_3_2_STOP_IDLE:
+		return "idle";
+	case TEENSY_3_2_STOP_INVALID:
+		return "invalid";
+	}
+	return "unknown";
+}
+
+void teensy_3_2_emulate(struct teensy_3_2 *teensy, uint8_t *data,
+                        uint32_t length)
+{
+	struct teensy_3_2_run_control control = {
+		.instructions = TEENSY_3_2_DEFAULT_INSTRUCTIONS,
+	};
+	struct teensy_3_2_run_result result =
+		teensy_3_2_emulate_until(teensy, data, length, &control);
+	teensy_3_2_watchdog_print(&result);
+}
+
+/* A snapshot is this struct as is, so only the build that saved it can read
+   it back.  Whatever follows from the saved fields (the flash wait states,
+   the exception priorities, next_event) is worked out again */
+#define SNAPSHOT_MAGIC "EYLSNP02"
+
+struct snapshot {
+	char magic[8];
+	struct registers registers;
+	uint64_t cycles;
+	bool after_load_store;
+	uint64_t event_cycle[EVENT_SOURCES];
+	uint8_t event_heap[EVENT_SOURCES];
+	uint8_t event_index[EVENT_SOURCES];
+	uint8_t events_scheduled;
+	uint32_t exception_pending[EXCEPTION_WORDS];
+	uint32_t exception_enabled[EXCEPTION_WORDS];
+	uint32_t exception_active[EXCEPTION_WORDS];
+	uint8_t exception_priority[EXCEPTIONS];
+	uint32_t exception_current;
+	uint32_t VTOR;
+	uint32_t SYST_CSR;
+	uint32_t SYST_RVR;
+	uint32_t systick_value;
+	uint32_t SIM_CLKDIV1;
+	uint32_t PIT_MCR;
+	struct pit_channel pit_channels[PIT_CHANNELS];
+	uint8_t UART0_C2;
+	uint8_t WDOG_state;
+	uint32_t MCG_S_reads;
+	uint8_t flash[PROGRAM_FLASH_SIZE];
+	uint8_t eeprom[EEPROM_SIZE];
+	uint8_t sram[SRAM_SIZE];
+};
+
+struct teensy_3_2 *teensy_3_2_create(void)
+{
+	struct teensy_3_2 *teensy = calloc(1, sizeof(struct teensy_3_2));
+	assert(teensy != NULL);
+	return teensy;
+}
+
+/* Blocks and decoded instructions only stay valid for one program */
+static void caches_reset(void)
+{
+	for (size_t i = 0; i < sizeof(board->block_map) / sizeof(void *); ++i) {
+		struct block *block = board->block_map[i];
+		if (block == NULL) {
+			continue;
+		}
+#if defined(THREADED_DISPATCH)
+		free(block->handlers);
+#endif
+		free(block);
+		board->block_map[i] = NULL;
+	}
+	board->jit_code_size = 0;
+}
+
+struct teensy_3_2_flash *teensy_3_2_flash_create(const uint8_t *data,
+                                                 uint32_t length)
+{
+	if (length > PROGRAM_FLASH_SIZE) {
+		fprintf(stderr, "a program can't be more than %u bytes\n",
+		        PROGRAM_FLASH_SIZE);
+		return NULL;
+	}
+	struct teensy_3_2_flash *flash =
+		malloc(sizeof(struct teensy_3_2_flash));
+	assert(flash != NULL);
+	flash->data = mmap(NULL, PROGRAM_FLASH_SIZE, PROT_READ | PROT_WRITE,
+	                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	void *cache = mmap(NULL, FLASH_CACHE_SIZE, PROT_READ | PROT_WRITE,
+	                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (flash->data == MAP_FAILED || cache == MAP_FAILED) {
+		perror("flash image");
+		if (flash->data != MAP_FAILED) {
+			munmap(flash->data, PROGRAM_FLASH_SIZE);
+		}
+		if (cache != MAP_FAILED) {
+			munmap(cache, FLASH_CACHE_SIZE);
+		}
+		free(flash);
+		return NULL;
+	}
+	// The rest of flash reads as erased to 0, like a new mapping
+	memcpy(flash->data, data, length);
+	int error = mprotect(flash->data, PROGRAM_FLASH_SIZE, PROT_READ);
+	assert(error == 0);
+	flash->insts = cache;
+	flash->states = (_Atomic uint8_t *) (flash->insts
+	                                     + PROGRAM_FLASH_SIZE / 2);
+	atomic_init(&flash->references, 1);
+	// So processes forked after this don't each build the tables
+	decode_tables_init();
+	return flash;
+}
+
+static struct teensy_3_2_flash *flash_hold(struct teensy_3_2_flash *flash)
+{
+	atomic_fetch_add_explicit(&flash->references, 1,
+	                          memory_order_relaxed);
+	return flash;
+}
 
-	registers.apsr = 0; // Acutally unknown value
+void teensy_3_2_flash_free(struct teensy_3_2_flash *flash)
+{
+	if (flash == NULL || atomic_fetch_sub_explicit(
+		    &flash->references, 1, memory_order_acq_rel) != 1) {
+		return;
+	}
+	munmap(flash->data, PROGRAM_FLASH_SIZE);
+	munmap(flash->insts, FLASH_CACHE_SIZE);
+	free(flash);
+}
 
-	/* R15 (Program Counter):
-	   EPSR (Execution Program Status Register): bit 24 is the Thumb bit */
-	const uint8_t EPSR_T_BIT = 24;
+/* Blocks are built for the board's image, so they go with it */
+static void flash_set(struct teensy_3_2_flash *flash)
+{
+	if (board->flash != NULL) {
+		caches_reset();
+		teensy_3_2_flash_free(board->flash);
+	}
+	board->flash = flash;
+}
 
-	registers.itstate = 0;
-	registers.r[13] = initial_sp;
-	registers.r[14] = 0xFFFFFFFF;
-	registers.r[15] = initial_pc & 0xFFFFFFFE;
-	registers.epsr = 0x01000000;
-	if ((initial_pc & 0x00000001) == 0x00000001) {
-		set_bit(&registers.epsr, EPSR_T_BIT);
+void teensy_3_2_flash_use(struct teensy_3_2 *teensy,
+                          struct teensy_3_2_flash *flash)
+{
+	board = teensy;
+	assert(flash != NULL);
+	if (flash != board->flash) {
+		flash_set(flash_hold(flash));
 	}
+}
 
-	printf("\nExecution:\n");
-	for (int i = 0; i < 4384; ++i) {
-		step(&registers);
+void teensy_3_2_destroy(struct teensy_3_2 *teensy)
+{
+	board = teensy;
+	caches_reset();
+	teensy_3_2_flash_free(board->flash);
+	pages_reset();
+#if defined(__x86_64__)
+	if (board->jit_code != NULL) {
+		munmap(board->jit_code, JIT_CODE_SIZE);
+	}
+#endif
+	if (board->snapshot != NULL) {
+		munmap((void *) board->snapshot, sizeof(struct snapshot));
+	}
+	if (board->branch_trace != NULL) {
+		fclose(board->branch_trace);
+	}
+	free(board);
+	board = NULL;
+}
+
+/* Puts a program in an image of the board's own, unless the board's image
+   (which may be shared) already holds it.  NULL data keeps the image */
+static void program_load(const uint8_t *data, uint32_t length)
+{
+	assert(length <= PROGRAM_FLASH_SIZE);
+	if (board->flash != NULL && data == NULL) {
+		return;
+	}
+	assert(data != NULL);
+	if (board->flash != NULL
+	    && memcmp(board->flash->data, data, length) == 0) {
+		bool rest_erased = true;
+		for (uint32_t i = length; i < PROGRAM_FLASH_SIZE; ++i) {
+			rest_erased = rest_erased
+			              && board->flash->data[i] == 0;
+		}
+		if (rest_erased) {
+			return;
+		}
 	}
+	struct teensy_3_2_flash *flash = teensy_3_2_flash_create(data, length);
+	assert(flash != NULL);
+	flash_set(flash);
+}
 
-	printf("\n");
+static void snapshot_take(struct snapshot *saved)
+{
+	memcpy(saved->magic, SNAPSHOT_MAGIC, sizeof(saved->magic));
+	saved->registers = board->final_registers;
+	saved->cycles = board->cycles;
+	saved->after_load_store = board->after_load_store;
+	memcpy(saved->event_cycle, board->event_cycle,
+	       sizeof(board->event_cycle));
+	memcpy(saved->event_heap, board->event_heap, sizeof(board->event_heap));
+	memcpy(saved->event_index, board->event_index,
+	       sizeof(board->event_index));
+	saved->events_scheduled = board->events_scheduled;
+	memcpy(saved->exception_pending, board->exception_pending,
+	       sizeof(board->exception_pending));
+	memcpy(saved->exception_enabled, board->exception_enabled,
+	       sizeof(board->exception_enabled));
+	memcpy(saved->exception_active, board->exception_active,
+	       sizeof(board->exception_active));
+	memcpy(saved->exception_priority, board->exception_priority,
+	       sizeof(board->exception_priority));
+	saved->exception_current = board->exception_current;
+	saved->VTOR = board->VTOR;
+	saved->SYST_CSR = board->SYST_CSR;
+	saved->SYST_RVR = board->SYST_RVR;
+	saved->systick_value = board->systick_value;
+	saved->SIM_CLKDIV1 = board->SIM_CLKDIV1;
+	saved->PIT_MCR = board->PIT_MCR;
+	memcpy(saved->pit_channels, board->pit_channels,
+	       sizeof(board->pit_channels));
+	saved->UART0_C2 = board->UART0_C2;
+	saved->WDOG_state = board->WDOG_state;
+	saved->MCG_S_reads = board->MCG_S_reads;
+	memcpy(saved->flash, board->flash->data, sizeof(saved->flash));
+	memcpy(saved->eeprom, board->eeprom, sizeof(board->eeprom));
+	memcpy(saved->sram, board->sram, sizeof(board->sram));
+}
+
+bool teensy_3_2_snapshot_save(struct teensy_3_2 *teensy, const char *path)
+{
+	board = teensy;
+	struct snapshot *saved = calloc(1, sizeof(struct snapshot));
+	assert(saved != NULL);
+	snapshot_take(saved);
+
+	FILE *file = fopen(path, "wb");
+	bool written = file != NULL
+	               && fwrite(saved, sizeof(struct snapshot), 1, file) == 1;
+	if (file != NULL && fclose(file) != 0) {
+		written = false;
+	}
+	free(saved);
+	return written;
+}
+
+bool teensy_3_2_snapshot_load(struct teensy_3_2 *teensy, const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		perror(path);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		perror(path);
+		close(fd);
+		return false;
+	}
+	if (st.st_size != sizeof(struct snapshot)) {
+		fprintf(stderr, "%s: not a snapshot of this build\n", path);
+		close(fd);
+		return false;
+	}
+	void *mapped = mmap(NULL, sizeof(struct snapshot), PROT_READ,
+	                    MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		perror(path);
+		return false;
+	}
+	if (memcmp(mapped, SNAPSHOT_MAGIC, strlen(SNAPSHOT_MAGIC)) != 0) {
+		fprintf(stderr, "%s: not a snapshot of this build\n", path);
+		munmap(mapped, sizeof(struct snapshot));
+		return false;
+	}
+
+	if (teensy->snapshot != NULL) {
+		munmap((void *) teensy->snapshot, sizeof(struct snapshot));
+	}
+	teensy->snapshot = mapped;
+	return true;
+}
+
+/* Called after memory_init, which reset everything the snapshot doesn't
+   hold */
+static void snapshot_restore(const struct snapshot *snapshot,
+                             struct registers *registers)
+{
+	*registers = snapshot->registers;
+	board->cycles = snapshot->cycles;
+	board->after_load_store = snapshot->after_load_store;
+	memcpy(board->event_cycle, snapshot->event_cycle,
+	       sizeof(board->event_cycle));
+	memcpy(board->event_heap, snapshot->event_heap,
+	       sizeof(board->event_heap));
+	memcpy(board->event_index, snapshot->event_index,
+	       sizeof(board->event_index));
+	board->events_scheduled = snapshot->events_scheduled;
+	board->next_event = board->events_scheduled != 0
+	                    ? board->event_cycle[board->event_heap[0]]
+	                    : UINT64_MAX;
+	memcpy(board->exception_pending, snapshot->exception_pending,
+	       sizeof(board->exception_pending));
+	memcpy(board->exception_enabled, snapshot->exception_enabled,
+	       sizeof(board->exception_enabled));
+	memcpy(board->exception_active, snapshot->exception_active,
+	       sizeof(board->exception_active));
+	memcpy(board->exception_priority, snapshot->exception_priority,
+	       sizeof(board->exception_priority));
+	board->exception_current = snapshot->exception_current;
+	exceptions_update();
+	board->VTOR = snapshot->VTOR;
+	board->SYST_CSR = snapshot->SYST_CSR;
+	board->SYST_RVR = snapshot->SYST_RVR;
+	board->systick_value = snapshot->systick_value;
+	SIM_CLKDIV1_write(SIM_CLKDIV1_ADDRESS, snapshot->SIM_CLKDIV1, 4);
+	board->PIT_MCR = snapshot->PIT_MCR;
+	memcpy(board->pit_channels, snapshot->pit_channels,
+	       sizeof(board->pit_channels));
+	board->UART0_C2 = snapshot->UART0_C2;
+	uart0_update();
+	board->WDOG_state = snapshot->WDOG_state;
+	board->MCG_S_reads = snapshot->MCG_S_reads;
+	memcpy(board->eeprom, snapshot->eeprom, sizeof(board->eeprom));
+	memcpy(board->sram, snapshot->sram, sizeof(board->sram));
+}
+
+/* A checkpoint is a snapshot that doesn't go through a file */
+struct teensy_3_2_checkpoint {
+	struct snapshot snapshot;
+};
+
+struct teensy_3_2_checkpoint *
+teensy_3_2_checkpoint_take(struct teensy_3_2 *teensy)
+{
+	board = teensy;
+	struct teensy_3_2_checkpoint *checkpoint =
+		malloc(sizeof(struct teensy_3_2_checkpoint));
+	assert(checkpoint != NULL);
+	snapshot_take(&checkpoint->snapshot);
+	return checkpoint;
+}
+
+/* The board keeps its memory map and caches, so only the state a snapshot
+   holds is copied back */
+void teensy_3_2_checkpoint_restore(
+	struct teensy_3_2 *teensy,
+	const struct teensy_3_2_checkpoint *checkpoint)
+{
+	board = teensy;
+	assert(board->flash != NULL);
+	snapshot_restore(&checkpoint->snapshot, &board->final_registers);
+	board->continuing = true;
+}
+
+void teensy_3_2_checkpoint_free(struct teensy_3_2_checkpoint *checkpoint)
+{
+	free(checkpoint);
+}
+
+struct teensy_3_2_run_result
+teensy_3_2_emulate_until(struct teensy_3_2 *teensy, uint8_t *data,
+                         uint32_t length,
+                         const struct teensy_3_2_run_control *control)
+{
+	board = teensy;
+	struct teensy_3_2_run_result result = {
+		.stop = TEENSY_3_2_STOP_INVALID,
+	};
+	if (!watch_valid(control) || !writes_valid(control)) {
+		return result;
+	}
+
+	bool continuing = board->continuing && board->flash != NULL;
+	board->continuing = false;
+	if (continuing) {
+		// Everything is where the last emulation left it
+	}
+	else if (board->snapshot != NULL) {
+		program_load(board->snapshot->flash,
+		             sizeof(board->snapshot->flash));
+	}
+	else {
+		program_load(data, length);
+	}
+	if (!continuing) {
+		memory_init();
+	}
+
+	struct registers registers = {0};
+
+	decode_tables_init();
+
+	if (continuing) {
+		registers = board->final_registers;
+	}
+	else if (board->snapshot != NULL) {
+		snapshot_restore(board->snapshot, &registers);
+		munmap((void *) board->snapshot, sizeof(struct snapshot));
+		board->snapshot = NULL;
+	}
+	else {
+		uint32_t initial_sp  = word_at_address(0x00000000);
+		uint32_t initial_pc  = word_at_address(0x00000004);
+
+		if (tracing(TEENSY_3_2_TRACE_INSTRUCTIONS)) {
+			print_vector_table(initial_sp, initial_pc);
+		}
+
+		registers.apsr = 0; // Acutally unknown value
+		registers.flags_kind = FLAGS_APSR;
+
+		/* R15 (Program Counter):
+		   EPSR (Execution Program Status Register): bit 24 is the
+		   Thumb bit */
+		const uint8_t EPSR_T_BIT = 24;
+
+		registers.itstate = 0;
+		registers.r[13] = initial_sp;
+		registers.r[14] = 0xFFFFFFFF;
+		registers.r[15] = initial_pc & 0xFFFFFFFE;
+		registers.epsr = 0x01000000;
+		if ((initial_pc & 0x00000001) == 0x00000001) {
+			set_bit(&registers.epsr, EPSR_T_BIT);
+		}
+	}
+
+	if (tracing(TEENSY_3_2_TRACE_BRANCHES)) {
+		printf("\nExecution:\n");
+	}
+	writes_apply(control);
+	board->coverage_previous = 0;
+	board->single_step = control->single_step;
+	if (board->branch_trace != NULL) {
+		branch_trace_start(&registers);
+	}
+	result.stop = run(&registers, control, &result.instructions);
+	result.pc = registers.r[15];
+	result.cycles = board->cycles;
+	board->final_registers = registers;
+	if (board->branch_trace != NULL) {
+		branch_trace_end();
+	}
+
+	if (tracing(TEENSY_3_2_TRACE_BRANCHES)) {
+		printf("\n");
+	}
+	result.watchdog_disabled = board->WDOG_state == 3;
+	return result;
+}
+
+void teensy_3_2_continue(struct teensy_3_2 *teensy)
+{
+	teensy->continuing = true;
+}
+
+void teensy_3_2_input(struct teensy_3_2 *teensy, const uint8_t *data,
+                      uint32_t size)
+{
+	board = teensy;
+	board->input = data;
+	board->input_size = size;
+	board->input_next = 0;
+	uart0_update();
+}
+
+void teensy_3_2_coverage(struct teensy_3_2 *teensy, uint8_t *bitmap)
+{
+	teensy->coverage = bitmap;
+}
 
+void teensy_3_2_watchdog_print(const struct teensy_3_2_run_result *result)
+{
 	printf("[");
-	if (WDOG_state == 3) {
+	if (result->watchdog_disabled) {
 		printf("\e[32mOkay\e[0m");
 	}
 	else {
@@ -4158,3 +7875,215 @@ void teensy_3_2_emulate(uint8_t *data, uint32_t length) {
 	}
 	printf("] watchdog disable\n");
 }
+
+/* Print every instruction of a branch trace like the instructions trace
+   level, the program has to be the one that was traced */
+bool teensy_3_2_branch_trace_decode(uint8_t *data, uint32_t length,
+                                    const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		perror(path);
+		return false;
+	}
+
+	// The trace ends with its instruction count and starts with a sync
+	int end = fseek(file, -BRANCH_TRACE_END_SIZE, SEEK_END) == 0
+	          ? fgetc(file) : EOF;
+	uint64_t total = end == BRANCH_TRACE_END ? branch_trace_get(file, 8)
+	                                         : 0;
+	rewind(file);
+	if (end != BRANCH_TRACE_END || fgetc(file) != BRANCH_TRACE_SYNC) {
+		fprintf(stderr, "%s: not a branch trace\n", path);
+		fclose(file);
+		return false;
+	}
+
+	struct teensy_3_2 *teensy = teensy_3_2_create();
+	board = teensy;
+	program_load(data, length);
+	memory_init();
+	decode_tables_init();
+
+	// ITSTATE is tracked with ITAdvance, which shouldn't print anything
+	enum teensy_3_2_trace_level saved_trace_level = trace_level;
+	trace_level = TEENSY_3_2_TRACE_INSTRUCTIONS;
+
+	struct branch_trace_reader reader = { .file = file };
+	struct registers registers = {0};
+	uint64_t count;
+	branch_trace_read_sync(file, &registers, &count);
+	branch_trace_peek(&reader);
+
+	while (count < total) {
+		while (reader.exception && reader.exception_count == count) {
+			struct teensy_3_2_trace_event event = {
+				.type = TEENSY_3_2_TRACE_EVENT_EXCEPTION,
+				.n = reader.exception_number,
+				.address = registers.r[15],
+				.value = reader.exception_handler,
+			};
+			teensy_3_2_trace_event_print(&event);
+			registers.r[15] = reader.exception_handler;
+			registers.itstate = 0;
+			reader.exception = false;
+			branch_trace_peek(&reader);
+		}
+
+		struct inst inst;
+		decode(&registers, &inst);
+		trace_inst_print(&inst);
+
+		enum branch_kind kind = branch_kind(&inst);
+		bool taken = false;
+		if (kind != BRANCH_NONE) {
+			taken = branch_conditional(&inst)
+			        ? branch_trace_read_atom(&reader, count)
+			        : true;
+		}
+
+		if (taken && kind == BRANCH_DIRECT) {
+			registers.r[15] = branch_direct_target(&inst);
+		}
+		else if (taken && kind == BRANCH_INDIRECT) {
+			registers.r[15] = branch_trace_read_address(&reader,
+			                                            count);
+		}
+		else {
+			registers.r[15] += inst.length;
+		}
+
+		if (inst.execute == IT) {
+			registers.itstate = inst.imm32;
+		}
+		else if (InITBlock(&registers)) {
+			ITAdvance(&registers);
+		}
+		++count;
+	}
+
+	trace_level = saved_trace_level;
+	fclose(file);
+	teensy_3_2_destroy(teensy);
+	return true;
+}
+
+static bool inst_equal(const struct inst *a, const struct inst *b)
+{
+	return a->execute == b->execute
+	       && a->disassemble == b->disassemble
+	       && a->address == b->address
+	       && a->imm32 == b->imm32
+	       && a->first_halfword == b->first_halfword
+	       && a->second_halfword == b->second_halfword
+	       && a->register_list == b->register_list
+	       && a->length == b->length
+	       && a->itstate == b->itstate
+	       && a->cond == b->cond
+	       && a->d == b->d
+	       && a->n == b->n
+	       && a->m == b->m
+	       && a->t == b->t
+	       && a->a == b->a
+	       && a->shift_t == b->shift_t
+	       && a->shift_n == b->shift_n
+	       && a->setflags == b->setflags
+	       && a->index == b->index
+	       && a->add == b->add
+	       && a->wback == b->wback
+	       && a->carry == b->carry
+	       && a->carry_in == b->carry_in
+	       && a->nonzero == b->nonzero;
+}
+
+static double decoder_time(void (*decoder)(struct registers *, struct inst *),
+                           const struct inst *samples, size_t samples_size,
+                           uint32_t rounds)
+{
+	struct registers registers = {0};
+	struct inst inst;
+	struct timespec start;
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (uint32_t round = 0; round < rounds; ++round) {
+		for (size_t i = 0; i < samples_size; ++i) {
+			registers.r[15] = samples[i].address;
+			registers.itstate = samples[i].itstate;
+			decoder(&registers, &inst);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double ns = (end.tv_sec - start.tv_sec) * 1e9
+	            + (end.tv_nsec - start.tv_nsec);
+	return ns / ((double) rounds * samples_size);
+}
+
+/* Compare the table decoder against the cascade on every instruction the
+   emulator executed, the emulator runs without tracing */
+void teensy_3_2_decoder_benchmark(uint8_t *data, uint32_t length)
+{
+	enum teensy_3_2_trace_level saved_trace_level = trace_level;
+	trace_level = TEENSY_3_2_TRACE_NONE;
+	struct teensy_3_2 *teensy = teensy_3_2_create();
+	teensy_3_2_emulate(teensy, data, length);
+	trace_level = saved_trace_level;
+
+	size_t samples_size = 0;
+	const struct teensy_3_2_flash *flash = board->flash;
+	for (size_t i = 0; i < PROGRAM_FLASH_SIZE / 2; ++i) {
+		if (flash->states[i] == INST_DECODED) {
+			++samples_size;
+		}
+		if (board->block_map[i] != NULL) {
+			samples_size += board->block_map[i]->count;
+		}
+	}
+	struct inst *samples = malloc(samples_size * sizeof(struct inst));
+	assert(samples != NULL);
+	samples_size = 0;
+	for (size_t i = 0; i < PROGRAM_FLASH_SIZE / 2; ++i) {
+		if (flash->states[i] == INST_DECODED) {
+			samples[samples_size++] = flash->insts[i];
+		}
+		struct block *block = board->block_map[i];
+		if (block != NULL) {
+			for (uint32_t j = 0; j < block->count; ++j) {
+				samples[samples_size++] = block->insts[j];
+			}
+		}
+	}
+	printf("Samples: %zu\n", samples_size);
+	if (samples_size == 0) {
+		free(samples);
+		teensy_3_2_destroy(teensy);
+		return;
+	}
+
+	struct registers registers = {0};
+	size_t mismatches = 0;
+	for (size_t i = 0; i < samples_size; ++i) {
+		struct inst cascade;
+		struct inst table;
+		registers.r[15] = samples[i].address;
+		registers.itstate = samples[i].itstate;
+		decode_cascade(&registers, &cascade);
+		decode(&registers, &table);
+		if (!inst_equal(&cascade, &table)) {
+			printf("Mismatch: %08X\n", samples[i].address);
+			++mismatches;
+		}
+	}
+	printf("Mismatches: %zu\n", mismatches);
+
+	const uint32_t rounds = 10000000 / samples_size + 1;
+	double cascade_ns = decoder_time(decode_cascade, samples, samples_size,
+	                                 rounds);
+	double table_ns = decoder_time(decode, samples, samples_size, rounds);
+	printf("Cascade: %6.2f ns/decode\n", cascade_ns);
+	printf("Table:   %6.2f ns/decode\n", table_ns);
+
+	free(samples);
+	teensy_3_2_destroy(teensy);
+}
@@ -1,8 +1,186 @@
 #ifndef TEENSY_3_2_H
 #define TEENSY_3_2_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
-void teensy_3_2_emulate(uint8_t *data, uint32_t length);
+enum teensy_3_2_trace_level {
+	TEENSY_3_2_TRACE_NONE,
+	TEENSY_3_2_TRACE_BRANCHES,
+	TEENSY_3_2_TRACE_INSTRUCTIONS,
+	TEENSY_3_2_TRACE_FULL,
+};
+
+/* Binary trace events, a file written by teensy_3_2_trace_open starts with
+   TEENSY_3_2_TRACE_MAGIC followed by the events */
+#define TEENSY_3_2_TRACE_MAGIC "EYLTRC01"
+
+enum teensy_3_2_trace_event_type {
+	TEENSY_3_2_TRACE_EVENT_INST,          // n = length, value = halfwords
+	TEENSY_3_2_TRACE_EVENT_BRANCH,        // address -> value
+	TEENSY_3_2_TRACE_EVENT_REGISTER,      // Rn = value
+	TEENSY_3_2_TRACE_EVENT_REGISTER_LOAD, // Rn = value from address
+	TEENSY_3_2_TRACE_EVENT_PC,
+	TEENSY_3_2_TRACE_EVENT_APSR,
+	TEENSY_3_2_TRACE_EVENT_ITSTATE,
+	TEENSY_3_2_TRACE_EVENT_READ,          // n = size
+	TEENSY_3_2_TRACE_EVENT_WRITE,         // n = size
+	TEENSY_3_2_TRACE_EVENT_NOTE_HIGHER_REGISTERS,
+	TEENSY_3_2_TRACE_EVENT_EXCEPTION,     // n = number, address -> value
+};
+
+struct teensy_3_2_trace_event {
+	uint8_t type;
+	uint8_t n;
+	uint8_t itstate;
+	uint8_t reserved;
+	uint32_t address;
+	uint32_t value;
+};
+
+/* An emulated board, all of the emulator's state is in one so boards can
+   run on different threads at the same time.  The trace level and the
+   trace file are shared by every board, only one board should trace */
+struct teensy_3_2;
+
+struct teensy_3_2 *teensy_3_2_create(void);
+void teensy_3_2_destroy(struct teensy_3_2 *teensy);
+
+void teensy_3_2_set_trace_level(enum teensy_3_2_trace_level level);
+
+/* Send trace events to a file through a writer thread instead of printing
+   them, either raw or as indexed compressed blocks (see trace_ring.h),
+   returns false if the file can't be opened */
+bool teensy_3_2_trace_open(const char *path, bool indexed);
+void teensy_3_2_trace_close(void);
+
+/* Record a compressed branch trace of the next emulation, and print the
+   instructions of one given the program it was recorded from (false if
+   the trace can't be read) */
+bool teensy_3_2_branch_trace_open(struct teensy_3_2 *teensy,
+                                   const char *path);
+void teensy_3_2_branch_trace_close(struct teensy_3_2 *teensy);
+bool teensy_3_2_branch_trace_decode(uint8_t *data, uint32_t length,
+                                    const char *path);
+
+/* Print an event the same way the emulator does */
+void teensy_3_2_trace_event_print(const struct teensy_3_2_trace_event *event);
+void teensy_3_2_emulate(struct teensy_3_2 *teensy, uint8_t *data,
+                        uint32_t length);
+
+/* Run control, an emulation stops at the first limit it reaches.  A zero
+   (or false) field leaves its limit out.  The instruction and PC limits
+   are exact, the others are checked when a block exits.  The watched
+   location has to be in flash or SRAM.  A run without an instruction limit
+   always stops once the core is idle, the core isn't idle while a timer
+   (SysTick or the PIT) can still interrupt it.
+
+   The writes are stores made before the first instruction, such as the
+   inputs a scenario starts with.  They have to be aligned and to SRAM, a
+   peripheral or the system control space.
+
+   The result has the Cortex-M4 cycles the instructions would have taken,
+   including flash wait states from the clock dividers the firmware set in
+   SIM_CLKDIV1.  The timers count these cycles */
+enum teensy_3_2_stop {
+	TEENSY_3_2_STOP_INSTRUCTIONS,
+	TEENSY_3_2_STOP_PC,
+	TEENSY_3_2_STOP_WATCH,
+	TEENSY_3_2_STOP_TIME,
+	TEENSY_3_2_STOP_IDLE,    // in a loop that can't exit
+	TEENSY_3_2_STOP_INVALID, // the run control can't be used
+};
+
+#define TEENSY_3_2_WRITES 16
+
+struct teensy_3_2_write {
+	uint32_t address;
+	uint32_t value;
+	uint8_t size;            // 1, 2 or 4 bytes
+};
+
+struct teensy_3_2_run_control {
+	uint64_t instructions;
+	bool until_pc;
+	uint32_t pc;
+	uint8_t watch_size;      // 1, 2 or 4 bytes at watch_address
+	uint32_t watch_address;
+	double seconds;          // wall-clock
+	bool until_idle;
+	bool single_step;        // blocks stepped, to check their cycles
+	uint8_t writes_size;
+	struct teensy_3_2_write writes[TEENSY_3_2_WRITES];
+};
+
+struct teensy_3_2_run_result {
+	enum teensy_3_2_stop stop;
+	uint64_t instructions;
+	uint32_t pc;
+	uint64_t cycles;
+	bool watchdog_disabled;
+};
+
+/* teensy_3_2_emulate runs TEENSY_3_2_DEFAULT_INSTRUCTIONS instructions */
+#define TEENSY_3_2_DEFAULT_INSTRUCTIONS 4384
+
+struct teensy_3_2_run_result
+teensy_3_2_emulate_until(struct teensy_3_2 *teensy, uint8_t *data,
+                         uint32_t length,
+                         const struct teensy_3_2_run_control *control);
+const char *teensy_3_2_stop_name(enum teensy_3_2_stop stop);
+
+/* A flash image is a program loaded once into read-only memory, along with
+   the instructions decoded from it.  Every board using an image shares
+   both, across threads and across processes forked after it's created.
+   An emulation copies data into an image of the board's own unless the
+   board's image already holds it, data can be NULL to run the board's
+   image as is.  Create returns NULL if the image can't be made, free drops
+   the caller's reference and boards keep their own */
+struct teensy_3_2_flash;
+
+struct teensy_3_2_flash *teensy_3_2_flash_create(const uint8_t *data,
+                                                 uint32_t length);
+void teensy_3_2_flash_free(struct teensy_3_2_flash *flash);
+void teensy_3_2_flash_use(struct teensy_3_2 *teensy,
+                          struct teensy_3_2_flash *flash);
+
+/* The next emulation of the board carries on from where the last one
+   stopped instead of from reset, data is ignored */
+void teensy_3_2_continue(struct teensy_3_2 *teensy);
+void teensy_3_2_watchdog_print(const struct teensy_3_2_run_result *result);
+
+/* Bytes the firmware receives through UART0, they're all there from the
+   start.  The board reads them from data as it goes, so data has to stay
+   valid for the emulations after this */
+void teensy_3_2_input(struct teensy_3_2 *teensy, const uint8_t *data,
+                      uint32_t size);
+
+/* The emulations after this count each edge between two locations the
+   core runs from in a byte of bitmap, picked by a hash like AFL does.
+   NULL stops counting */
+#define TEENSY_3_2_COVERAGE_SIZE 0x10000
+void teensy_3_2_coverage(struct teensy_3_2 *teensy, uint8_t *bitmap);
+
+/* A snapshot holds the whole machine an emulation stopped with: the
+   registers (ITSTATE included), flash, SRAM, EEPROM, the peripheral models
+   and the scheduled timer events.  After loading one the next emulation of
+   the board carries on from the snapshot instead of from reset, with the
+   snapshot's flash instead of data.  Both return false if the file can't
+   be used */
+bool teensy_3_2_snapshot_save(struct teensy_3_2 *teensy, const char *path);
+bool teensy_3_2_snapshot_load(struct teensy_3_2 *teensy, const char *path);
+
+/* A checkpoint is a snapshot kept in memory.  Restoring one into the board
+   it was taken from puts the board back right away, without a reset, and
+   the next emulation carries on from it */
+struct teensy_3_2_checkpoint;
+
+struct teensy_3_2_checkpoint *
+teensy_3_2_checkpoint_take(struct teensy_3_2 *teensy);
+void teensy_3_2_checkpoint_restore(
+	struct teensy_3_2 *teensy,
+	const struct teensy_3_2_checkpoint *checkpoint);
+void teensy_3_2_checkpoint_free(struct teensy_3_2_checkpoint *checkpoint);
+void teensy_3_2_decoder_benchmark(uint8_t *data, uint32_t length);
 
 #endif
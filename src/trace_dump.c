@@ -0,0 +1,56 @@
+/*
+ * Copyright 2017 Jonathan Eyolfson
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "teensy_3_2.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* Print a binary trace in the emulator's text format */
+int main(int argc, char **argv)
+{
+	if (argc != 2) {
+		fprintf(stderr, "usage: trace-dump FILE\n");
+		return 1;
+	}
+
+	FILE *file = fopen(argv[1], "rb");
+	if (file == NULL) {
+		perror(argv[1]);
+		return 2;
+	}
+
+	char magic[sizeof(TEENSY_3_2_TRACE_MAGIC) - 1];
+	if (fread(magic, 1, sizeof(magic), file) != sizeof(magic)
+	    || memcmp(magic, TEENSY_3_2_TRACE_MAGIC, sizeof(magic)) != 0) {
+		fprintf(stderr, "%s: not a trace\n", argv[1]);
+		fclose(file);
+		return 3;
+	}
+
+	struct teensy_3_2_trace_event events[4096];
+	size_t count;
+	while ((count = fread(events, sizeof(events[0]),
+	                      sizeof(events) / sizeof(events[0]), file)) > 0) {
+		for (size_t i = 0; i < count; ++i) {
+			teensy_3_2_trace_event_print(&events[i]);
+		}
+	}
+
+	fclose(file);
+	return 0;
+}
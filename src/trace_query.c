@@ -0,0 +1,282 @@
+/*
+ * Copyright 2017 Jonathan Eyolfson
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "teensy_3_2.h"
+#include "trace_ring.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+/* Both the index and the blocks are mapped, only the blocks a query needs
+   are decompressed */
+static const struct trace_index_entry *entries;
+static size_t entries_size;
+static const uint8_t *blocks;
+
+static struct teensy_3_2_trace_event events[TRACE_BLOCK_EVENTS];
+static size_t events_block = SIZE_MAX;
+
+static const void *map(const char *path, size_t *size)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		perror(path);
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		perror(path);
+		close(fd);
+		return NULL;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		perror(path);
+		return NULL;
+	}
+	*size = st.st_size;
+	return data;
+}
+
+static bool trace_map(const char *path)
+{
+	size_t blocks_size;
+	blocks = map(path, &blocks_size);
+	if (blocks == NULL) {
+		return false;
+	}
+	if (blocks_size < strlen(TRACE_BLOCKS_MAGIC)
+	    || memcmp(blocks, TRACE_BLOCKS_MAGIC,
+	              strlen(TRACE_BLOCKS_MAGIC)) != 0) {
+		fprintf(stderr, "%s: not an indexed trace\n", path);
+		return false;
+	}
+
+	char *index_path = malloc(strlen(path) + strlen(TRACE_INDEX_SUFFIX)
+	                          + 1);
+	assert(index_path != NULL);
+	strcpy(index_path, path);
+	strcat(index_path, TRACE_INDEX_SUFFIX);
+	size_t index_size;
+	const uint8_t *index = map(index_path, &index_size);
+	if (index == NULL) {
+		free(index_path);
+		return false;
+	}
+	if (index_size < strlen(TRACE_INDEX_MAGIC)
+	    || memcmp(index, TRACE_INDEX_MAGIC,
+	              strlen(TRACE_INDEX_MAGIC)) != 0) {
+		fprintf(stderr, "%s: not a trace index\n", index_path);
+		free(index_path);
+		return false;
+	}
+	free(index_path);
+
+	entries = (const struct trace_index_entry *)
+	          (index + strlen(TRACE_INDEX_MAGIC));
+	entries_size = (index_size - strlen(TRACE_INDEX_MAGIC))
+	               / sizeof(struct trace_index_entry);
+	return true;
+}
+
+static void block_load(size_t i)
+{
+	if (events_block == i) {
+		return;
+	}
+	uLongf size = sizeof(events);
+	int result = uncompress((Bytef *) events, &size,
+	                        blocks + entries[i].offset, entries[i].size);
+	assert(result == Z_OK);
+	assert(size == entries[i].events * sizeof(events[0]));
+	events_block = i;
+}
+
+/* The block holding instruction n is the last one starting at or before
+   it, blocks without instructions share first_inst with the next block */
+static size_t block_find(uint64_t n)
+{
+	size_t low = 0;
+	size_t high = entries_size;
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		if (entries[middle].first_inst <= n) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+	return low == 0 ? 0 : low - 1;
+}
+
+/* Finds the event of instruction n, returns false past the end */
+static bool inst_find(uint64_t n, size_t *block, uint32_t *event)
+{
+	for (size_t i = block_find(n); i < entries_size; ++i) {
+		block_load(i);
+		uint64_t inst = entries[i].first_inst;
+		for (uint32_t j = 0; j < entries[i].events; ++j) {
+			if (events[j].type != TEENSY_3_2_TRACE_EVENT_INST) {
+				continue;
+			}
+			if (inst == n) {
+				*block = i;
+				*event = j;
+				return true;
+			}
+			++inst;
+		}
+	}
+	return false;
+}
+
+static void inst_print(uint64_t n)
+{
+	size_t block;
+	uint32_t event;
+	if (inst_find(n, &block, &event)) {
+		block_load(block);
+		printf("#%" PRIu64 " ", n);
+		teensy_3_2_trace_event_print(&events[event]);
+	}
+}
+
+/* Print count instructions from n on, with all their events */
+static void query_inst(uint64_t n, uint64_t count)
+{
+	size_t block;
+	uint32_t event;
+	if (!inst_find(n, &block, &event)) {
+		fprintf(stderr, "no instruction %" PRIu64 "\n", n);
+		return;
+	}
+
+	uint64_t printed = 0;
+	for (size_t i = block; i < entries_size; ++i) {
+		block_load(i);
+		for (uint32_t j = i == block ? event : 0;
+		     j < entries[i].events; ++j) {
+			if (events[j].type == TEENSY_3_2_TRACE_EVENT_INST) {
+				if (printed == count) {
+					return;
+				}
+				printf("#%" PRIu64 " ", n + printed);
+				++printed;
+			}
+			teensy_3_2_trace_event_print(&events[j]);
+		}
+	}
+}
+
+/* Print the first write to a byte address from instruction n on */
+static void query_write(uint32_t address, uint64_t n)
+{
+	for (size_t i = block_find(n); i < entries_size; ++i) {
+		if (!trace_bloom_has(entries[i].write_bloom, address)) {
+			continue;
+		}
+		block_load(i);
+		// Events before the first instruction of a block belong to the
+		// last one of an earlier block
+		uint64_t inst = entries[i].first_inst - 1;
+		for (uint32_t j = 0; j < entries[i].events; ++j) {
+			const struct teensy_3_2_trace_event *e = &events[j];
+			if (e->type == TEENSY_3_2_TRACE_EVENT_INST) {
+				++inst;
+			}
+			else if (e->type == TEENSY_3_2_TRACE_EVENT_WRITE
+			         && inst + 1 > n
+			         && address >= e->address
+			         && address - e->address < e->n) {
+				struct teensy_3_2_trace_event write = *e;
+				inst_print(inst);
+				teensy_3_2_trace_event_print(&write);
+				return;
+			}
+		}
+	}
+	fprintf(stderr, "no write to %08X\n", address);
+}
+
+/* Print every execution of the instruction at an address */
+static void query_pc(uint32_t address)
+{
+	for (size_t i = 0; i < entries_size; ++i) {
+		if (!trace_bloom_has(entries[i].pc_bloom, address)) {
+			continue;
+		}
+		block_load(i);
+		uint64_t inst = entries[i].first_inst;
+		for (uint32_t j = 0; j < entries[i].events; ++j) {
+			const struct teensy_3_2_trace_event *e = &events[j];
+			if (e->type != TEENSY_3_2_TRACE_EVENT_INST) {
+				continue;
+			}
+			if (e->address == address) {
+				printf("#%" PRIu64 " ", inst);
+				teensy_3_2_trace_event_print(e);
+			}
+			++inst;
+		}
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: trace-query TRACE inst N [COUNT]\n"
+	                "       trace-query TRACE write ADDRESS [N]\n"
+	                "       trace-query TRACE pc ADDRESS\n");
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 4) {
+		usage();
+		return 1;
+	}
+	if (!trace_map(argv[1])) {
+		return 2;
+	}
+
+	if (strcmp(argv[2], "inst") == 0 && argc <= 5) {
+		uint64_t count = argc == 5 ? strtoull(argv[4], NULL, 0) : 1;
+		query_inst(strtoull(argv[3], NULL, 0), count);
+	}
+	else if (strcmp(argv[2], "write") == 0 && argc <= 5) {
+		uint64_t n = argc == 5 ? strtoull(argv[4], NULL, 0) : 0;
+		query_write(strtoul(argv[3], NULL, 16), n);
+	}
+	else if (strcmp(argv[2], "pc") == 0 && argc == 4) {
+		query_pc(strtoul(argv[3], NULL, 16));
+	}
+	else {
+		usage();
+		return 1;
+	}
+	return 0;
+}
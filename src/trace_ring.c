@@ -0,0 +1,223 @@
+#include "trace_ring.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <zlib.h>
+
+/* The emulator only writes head and the writer thread only writes tail, so
+   neither side takes a lock.  The writer sleeps while the ring is empty and
+   writes every filled event up to the end of the ring at once, the emulator
+   only waits if the ring is full */
+#define TRACE_RING_SIZE (1 << 20) // events, 12 MiB
+
+static struct teensy_3_2_trace_event ring[TRACE_RING_SIZE];
+static _Atomic size_t head;
+static _Atomic size_t tail;
+static atomic_bool closing;
+
+static FILE *file;
+static pthread_t writer;
+
+/* An indexed trace is written in compressed blocks of events, with an
+   entry for each block in a separate index file */
+static bool indexed;
+static FILE *index_file;
+static struct teensy_3_2_trace_event block[TRACE_BLOCK_EVENTS];
+static uint32_t block_events;
+static struct trace_index_entry block_entry;
+static uint8_t *block_compressed;
+static uLongf block_compressed_capacity;
+static uint64_t offset;
+static uint64_t insts;
+
+static void pause_briefly(void)
+{
+	struct timespec duration = { .tv_sec = 0, .tv_nsec = 100000 };
+	nanosleep(&duration, NULL);
+}
+
+static void block_flush(void)
+{
+	if (block_events == 0) {
+		return;
+	}
+
+	uLongf size = block_compressed_capacity;
+	int result = compress2(block_compressed, &size, (const Bytef *) block,
+	                       block_events * sizeof(block[0]),
+	                       Z_DEFAULT_COMPRESSION);
+	assert(result == Z_OK);
+	size_t written = fwrite(block_compressed, 1, size, file);
+	assert(written == size);
+
+	block_entry.offset = offset;
+	block_entry.size = size;
+	block_entry.events = block_events;
+	written = fwrite(&block_entry, sizeof(block_entry), 1, index_file);
+	assert(written == 1);
+
+	offset += size;
+	block_events = 0;
+}
+
+static void block_append(const struct teensy_3_2_trace_event *event)
+{
+	if (block_events == 0) {
+		memset(&block_entry, 0, sizeof(block_entry));
+		block_entry.first_inst = insts;
+	}
+
+	if (event->type == TEENSY_3_2_TRACE_EVENT_INST) {
+		trace_bloom_add(block_entry.pc_bloom, event->address);
+		++insts;
+	}
+	else if (event->type == TEENSY_3_2_TRACE_EVENT_WRITE) {
+		for (uint8_t i = 0; i < event->n; ++i) {
+			trace_bloom_add(block_entry.write_bloom,
+			                event->address + i);
+		}
+	}
+
+	block[block_events] = *event;
+	if (++block_events == TRACE_BLOCK_EVENTS) {
+		block_flush();
+	}
+}
+
+static void write_events(const struct teensy_3_2_trace_event *events,
+                         size_t count)
+{
+	if (indexed) {
+		for (size_t i = 0; i < count; ++i) {
+			block_append(&events[i]);
+		}
+	}
+	else {
+		size_t written = fwrite(events, sizeof(events[0]), count,
+		                        file);
+		assert(written == count);
+	}
+}
+
+static void *writer_main(void *arg)
+{
+	(void) arg;
+	size_t position = atomic_load_explicit(&tail, memory_order_relaxed);
+	while (true) {
+		bool last = atomic_load_explicit(&closing,
+		                                 memory_order_acquire);
+		size_t end = atomic_load_explicit(&head, memory_order_acquire);
+		if (position == end) {
+			if (last) {
+				break;
+			}
+			pause_briefly();
+			continue;
+		}
+
+		while (position != end) {
+			size_t index = position % TRACE_RING_SIZE;
+			size_t count = end - position;
+			if (count > TRACE_RING_SIZE - index) {
+				count = TRACE_RING_SIZE - index;
+			}
+			write_events(&ring[index], count);
+			position += count;
+			atomic_store_explicit(&tail, position,
+			                      memory_order_release);
+		}
+	}
+	if (indexed) {
+		block_flush();
+	}
+	return NULL;
+}
+
+static bool indexed_open(const char *path)
+{
+	size_t length = strlen(path);
+	char *index_path = malloc(length + strlen(TRACE_INDEX_SUFFIX) + 1);
+	assert(index_path != NULL);
+	memcpy(index_path, path, length);
+	strcpy(index_path + length, TRACE_INDEX_SUFFIX);
+	index_file = fopen(index_path, "wb");
+	free(index_path);
+	if (index_file == NULL) {
+		return false;
+	}
+	fwrite(TRACE_INDEX_MAGIC, 1, strlen(TRACE_INDEX_MAGIC), index_file);
+
+	block_compressed_capacity = compressBound(sizeof(block));
+	block_compressed = malloc(block_compressed_capacity);
+	assert(block_compressed != NULL);
+	block_events = 0;
+	offset = strlen(TRACE_BLOCKS_MAGIC);
+	insts = 0;
+	return true;
+}
+
+bool trace_ring_open(const char *path, bool index)
+{
+	assert(file == NULL);
+	file = fopen(path, "wb");
+	if (file == NULL) {
+		return false;
+	}
+	setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+	indexed = index;
+	if (indexed) {
+		fwrite(TRACE_BLOCKS_MAGIC, 1, strlen(TRACE_BLOCKS_MAGIC),
+		       file);
+		if (!indexed_open(path)) {
+			fclose(file);
+			file = NULL;
+			return false;
+		}
+	}
+	else {
+		fwrite(TEENSY_3_2_TRACE_MAGIC, 1,
+		       strlen(TEENSY_3_2_TRACE_MAGIC), file);
+	}
+
+	atomic_store(&head, 0);
+	atomic_store(&tail, 0);
+	atomic_store(&closing, false);
+	if (pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+		fclose(file);
+		file = NULL;
+		return false;
+	}
+	return true;
+}
+
+void trace_ring_push(const struct teensy_3_2_trace_event *event)
+{
+	size_t position = atomic_load_explicit(&head, memory_order_relaxed);
+	while (position - atomic_load_explicit(&tail, memory_order_acquire)
+	       == TRACE_RING_SIZE) {
+		pause_briefly();
+	}
+	ring[position % TRACE_RING_SIZE] = *event;
+	atomic_store_explicit(&head, position + 1, memory_order_release);
+}
+
+void trace_ring_close(void)
+{
+	atomic_store_explicit(&closing, true, memory_order_release);
+	pthread_join(writer, NULL);
+	fclose(file);
+	file = NULL;
+	if (indexed) {
+		fclose(index_file);
+		index_file = NULL;
+		free(block_compressed);
+		block_compressed = NULL;
+	}
+}
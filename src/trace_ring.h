@@ -0,0 +1,66 @@
+#ifndef TRACE_RING_H
+#define TRACE_RING_H
+
+#include "teensy_3_2.h"
+
+#include <stdbool.h>
+
+/* An indexed trace is a file of zlib compressed blocks of events, starting
+   with TRACE_BLOCKS_MAGIC, and an index file (the same path with
+   TRACE_INDEX_SUFFIX) starting with TRACE_INDEX_MAGIC followed by an entry
+   for each block.  The blooms say which instruction addresses and written
+   byte addresses may be in a block.  A block can hold thousands of each,
+   so a bloom is 8 KiB: with 3 hashes and 4096 addresses in a block about
+   1 in 200 other addresses look like they're in it */
+#define TRACE_BLOCKS_MAGIC "EYLTRCZ1"
+#define TRACE_INDEX_MAGIC "EYLTRCI2"
+#define TRACE_INDEX_SUFFIX ".idx"
+#define TRACE_BLOCK_EVENTS 65536
+#define TRACE_BLOOM_BITS 65536
+#define TRACE_BLOOM_WORDS (TRACE_BLOOM_BITS / 64)
+#define TRACE_BLOOM_HASHES 3
+
+struct trace_index_entry {
+	uint64_t offset;
+	uint64_t first_inst; // instruction number of the first INST event
+	uint32_t size;       // compressed
+	uint32_t events;
+	uint64_t pc_bloom[TRACE_BLOOM_WORDS];
+	uint64_t write_bloom[TRACE_BLOOM_WORDS];
+};
+
+/* The bits of an address are spread from two hashes of it */
+static inline uint32_t trace_bloom_bit(uint32_t address, uint32_t i)
+{
+	uint64_t h = (uint64_t) address * UINT64_C(0x9E3779B97F4A7C15);
+	uint32_t a = h >> 32;
+	uint32_t b = ((uint32_t) h * 0x5BD1E995) | 1;
+	return (a + i * b) % TRACE_BLOOM_BITS;
+}
+
+static inline void trace_bloom_add(uint64_t *bloom, uint32_t address)
+{
+	for (uint32_t i = 0; i < TRACE_BLOOM_HASHES; ++i) {
+		uint32_t bit = trace_bloom_bit(address, i);
+		bloom[bit / 64] |= UINT64_C(1) << (bit % 64);
+	}
+}
+
+static inline bool trace_bloom_has(const uint64_t *bloom, uint32_t address)
+{
+	for (uint32_t i = 0; i < TRACE_BLOOM_HASHES; ++i) {
+		uint32_t bit = trace_bloom_bit(address, i);
+		if ((bloom[bit / 64] & (UINT64_C(1) << (bit % 64))) == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* A single producer ring of trace events drained to a file by a writer
+   thread, only one can be open at a time */
+bool trace_ring_open(const char *path, bool index);
+void trace_ring_push(const struct teensy_3_2_trace_event *event);
+void trace_ring_close(void);
+
+#endif
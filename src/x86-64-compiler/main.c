@@ -25,6 +25,7 @@
 #include <unistd.h>
 
 #include "linux_syscall.h"
+#include "x86_64.h"
 
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(arr[0]))
 
@@ -106,22 +107,33 @@ int main(int argc, char **argv)
 	if (fd == -1)
 		return 1;
 
-	/* linux.exit_group(0) */
-	unsigned char instructions[] = {
-		0x48, 0xc7, 0xc0, 0x01, 0x00, 0x00, 0x00, /* mov $0x01, %rax */
-		0x48, 0xc7, 0xc7, 0x01, 0x00, 0x00, 0x00, /* mov $0x01, %rdi */
-		0x48, 0xc7, 0xc6, 0xa6, 0x00, 0x01, 0x00, /* mov $0x100a6, %rsi */
-		0x48, 0xc7, 0xc2, 0x0c, 0x00, 0x00, 0x00, /* mov $0x0c, %rdx */
-		0x0f, 0x05,                               /* syscall */
-
-		0x48, 0xc7, 0xc0, 0xe7, 0x00, 0x00, 0x00, /* mov $0xe7,%rax */
-		0x48, 0xc7, 0xc7, 0x00, 0x00, 0x00, 0x00, /* mov $0x00,%rdi */
-		0x0f, 0x05,                               /* syscall */
+	uint8_t instructions[64];
+	struct x86_64_code code = {
+		.data = instructions,
+		.size = 0,
+		.capacity = ARRAY_SIZE(instructions),
 	};
 
+	/* linux.write(1, "Hello world\n", 12) */
+	x86_64_mov_r64_imm32(&code, X86_64_RAX, SYSCALL_WRITE);
+	x86_64_mov_r64_imm32(&code, X86_64_RDI, 0x01);
+	x86_64_mov_r64_imm32(&code, X86_64_RSI, 0x100a6);
+	x86_64_mov_r64_imm32(&code, X86_64_RDX, 0x0c);
+	x86_64_syscall(&code);
+
+	/* linux.exit_group(0) */
+	x86_64_mov_r64_imm32(&code, X86_64_RAX, SYSCALL_EXIT_GROUP);
+	x86_64_mov_r64_imm32(&code, X86_64_RDI, 0x00);
+	x86_64_syscall(&code);
+
+	if (code.size > code.capacity) {
+		close(fd);
+		return 1;
+	}
+
 	uint8_t *data;
 	size_t data_size;
-	if (elf_simple_executable(instructions, ARRAY_SIZE(instructions),
+	if (elf_simple_executable(instructions, code.size,
 	                          &data, &data_size) != 0) {
 		close(fd);
 		return 1;
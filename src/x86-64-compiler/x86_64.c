@@ -17,3 +17,154 @@ int x86_64_decode(uint8_t *data, size_t size)
             [Displacment] [Immediate] */
 	return 0;
 }
+
+static void emit(struct x86_64_code *code, uint8_t byte)
+{
+	if (code->size < code->capacity) {
+		code->data[code->size] = byte;
+	}
+	++code->size;
+}
+
+static void emit_imm32(struct x86_64_code *code, uint32_t imm)
+{
+	emit(code, imm);
+	emit(code, imm >> 8);
+	emit(code, imm >> 16);
+	emit(code, imm >> 24);
+}
+
+/* REX prefix: 0100WRXB, only emitted when one of the bits is needed */
+static void emit_rex(struct x86_64_code *code, uint8_t w,
+                     enum x86_64_register reg, enum x86_64_register rm)
+{
+	uint8_t rex = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+	if (rex != 0x40) {
+		emit(code, rex);
+	}
+}
+
+static void emit_modrm_reg(struct x86_64_code *code,
+                           uint8_t reg, enum x86_64_register rm)
+{
+	emit(code, 0xC0 | ((reg & 0x7) << 3) | (rm & 0x7));
+}
+
+/* [base + disp32], RSP and R12 as a base would need a SIB byte */
+static void emit_modrm_disp32(struct x86_64_code *code, uint8_t reg,
+                              enum x86_64_register base, int32_t disp)
+{
+	emit(code, 0x80 | ((reg & 0x7) << 3) | (base & 0x7));
+	if ((base & 0x7) == X86_64_RSP) {
+		emit(code, 0x24);
+	}
+	emit_imm32(code, disp);
+}
+
+void x86_64_push_r64(struct x86_64_code *code, enum x86_64_register reg)
+{
+	emit_rex(code, 0, 0, reg);
+	emit(code, 0x50 + (reg & 0x7));
+}
+
+void x86_64_pop_r64(struct x86_64_code *code, enum x86_64_register reg)
+{
+	emit_rex(code, 0, 0, reg);
+	emit(code, 0x58 + (reg & 0x7));
+}
+
+void x86_64_mov_r64_r64(struct x86_64_code *code,
+                        enum x86_64_register dst, enum x86_64_register src)
+{
+	emit_rex(code, 1, src, dst);
+	emit(code, 0x89);
+	emit_modrm_reg(code, src, dst);
+}
+
+void x86_64_mov_r64_imm32(struct x86_64_code *code,
+                          enum x86_64_register reg, int32_t imm)
+{
+	emit_rex(code, 1, 0, reg);
+	emit(code, 0xC7);
+	emit_modrm_reg(code, 0, reg);
+	emit_imm32(code, imm);
+}
+
+void x86_64_mov_r64_imm64(struct x86_64_code *code,
+                          enum x86_64_register reg, uint64_t imm)
+{
+	emit_rex(code, 1, 0, reg);
+	emit(code, 0xB8 + (reg & 0x7));
+	emit_imm32(code, imm);
+	emit_imm32(code, imm >> 32);
+}
+
+void x86_64_mov_r32_m32(struct x86_64_code *code, enum x86_64_register dst,
+                        enum x86_64_register base, int32_t disp)
+{
+	emit_rex(code, 0, dst, base);
+	emit(code, 0x8B);
+	emit_modrm_disp32(code, dst, base, disp);
+}
+
+void x86_64_mov_m32_r32(struct x86_64_code *code, enum x86_64_register base,
+                        int32_t disp, enum x86_64_register src)
+{
+	emit_rex(code, 0, src, base);
+	emit(code, 0x89);
+	emit_modrm_disp32(code, src, base, disp);
+}
+
+void x86_64_mov_m32_imm32(struct x86_64_code *code, enum x86_64_register base,
+                          int32_t disp, uint32_t imm)
+{
+	emit_rex(code, 0, 0, base);
+	emit(code, 0xC7);
+	emit_modrm_disp32(code, 0, base, disp);
+	emit_imm32(code, imm);
+}
+
+void x86_64_add_r32_imm32(struct x86_64_code *code,
+                          enum x86_64_register reg, uint32_t imm)
+{
+	emit_rex(code, 0, 0, reg);
+	emit(code, 0x81);
+	emit_modrm_reg(code, 0, reg);
+	emit_imm32(code, imm);
+}
+
+void x86_64_and_r32_imm32(struct x86_64_code *code,
+                          enum x86_64_register reg, uint32_t imm)
+{
+	emit_rex(code, 0, 0, reg);
+	emit(code, 0x81);
+	emit_modrm_reg(code, 4, reg);
+	emit_imm32(code, imm);
+}
+
+void x86_64_or_r32_imm32(struct x86_64_code *code,
+                         enum x86_64_register reg, uint32_t imm)
+{
+	emit_rex(code, 0, 0, reg);
+	emit(code, 0x81);
+	emit_modrm_reg(code, 1, reg);
+	emit_imm32(code, imm);
+}
+
+void x86_64_call_r64(struct x86_64_code *code, enum x86_64_register reg)
+{
+	emit_rex(code, 0, 0, reg);
+	emit(code, 0xFF);
+	emit_modrm_reg(code, 2, reg);
+}
+
+void x86_64_ret(struct x86_64_code *code)
+{
+	emit(code, 0xC3);
+}
+
+void x86_64_syscall(struct x86_64_code *code)
+{
+	emit(code, 0x0F);
+	emit(code, 0x05);
+}
@@ -1,2 +1,57 @@
+#pragma once
+
 #include <stddef.h>
 #include <stdint.h>
+
+enum x86_64_register {
+	X86_64_RAX,
+	X86_64_RCX,
+	X86_64_RDX,
+	X86_64_RBX,
+	X86_64_RSP,
+	X86_64_RBP,
+	X86_64_RSI,
+	X86_64_RDI,
+	X86_64_R8,
+	X86_64_R9,
+	X86_64_R10,
+	X86_64_R11,
+	X86_64_R12,
+	X86_64_R13,
+	X86_64_R14,
+	X86_64_R15,
+};
+
+/* Instructions are appended to data, size keeps counting past capacity so
+   the caller can check for overflow once at the end */
+struct x86_64_code {
+	uint8_t *data;
+	size_t size;
+	size_t capacity;
+};
+
+int x86_64_decode(uint8_t *data, size_t size);
+
+void x86_64_push_r64(struct x86_64_code *code, enum x86_64_register reg);
+void x86_64_pop_r64(struct x86_64_code *code, enum x86_64_register reg);
+void x86_64_mov_r64_r64(struct x86_64_code *code,
+                        enum x86_64_register dst, enum x86_64_register src);
+void x86_64_mov_r64_imm32(struct x86_64_code *code,
+                          enum x86_64_register reg, int32_t imm);
+void x86_64_mov_r64_imm64(struct x86_64_code *code,
+                          enum x86_64_register reg, uint64_t imm);
+void x86_64_mov_r32_m32(struct x86_64_code *code, enum x86_64_register dst,
+                        enum x86_64_register base, int32_t disp);
+void x86_64_mov_m32_r32(struct x86_64_code *code, enum x86_64_register base,
+                        int32_t disp, enum x86_64_register src);
+void x86_64_mov_m32_imm32(struct x86_64_code *code, enum x86_64_register base,
+                          int32_t disp, uint32_t imm);
+void x86_64_add_r32_imm32(struct x86_64_code *code,
+                          enum x86_64_register reg, uint32_t imm);
+void x86_64_and_r32_imm32(struct x86_64_code *code,
+                          enum x86_64_register reg, uint32_t imm);
+void x86_64_or_r32_imm32(struct x86_64_code *code,
+                         enum x86_64_register reg, uint32_t imm);
+void x86_64_call_r64(struct x86_64_code *code, enum x86_64_register reg);
+void x86_64_ret(struct x86_64_code *code);
+void x86_64_syscall(struct x86_64_code *code);